@@ -0,0 +1,13 @@
+// closures.w: creating and calling closures inside a function.
+let run => (n) {
+	let offset = 3;
+	let scale = 2;
+	let unused = [1, 2, 3];
+	let total = 0;
+	for k in 0->n {
+		let f = #:(x) x * scale + offset;
+		total += f(k);
+	}
+	ret total;
+};
+run(20000);
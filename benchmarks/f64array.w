@@ -0,0 +1,14 @@
+// f64array.w: returns, volatility and a moving total of a price series,
+//   repeated over f64arrays instead of per-element loops.
+import array;
+let n = 20000;
+let prices = array.of(0->n) * 0.01 + 100;
+let total = 0;
+for k in 0->50 {
+	let returns = (prices[1->n] - prices[0->n - 1]) / prices[0->n - 1];
+	let mean = array.sum(returns) / (n - 1);
+	let deviation = returns - mean;
+	total += array.dot(deviation, deviation) + array.max(returns);
+	total += array.cumsum(returns)[n - 2];
+}
+total;
@@ -0,0 +1,6 @@
+// fib.w: deep recursion with many small calls.
+let fib => (n) {
+	if n < 2 ret n;
+	ret fib(n - 1) + fib(n - 2);
+};
+fib(20);
@@ -0,0 +1,7 @@
+// hashset.w: insertions and lookups with hashset.w.
+import hashset;
+let table = hashset(31);
+for k in 0->600 table.add(k * 7);
+let found = 0;
+for k in 0->1200 if table.exist(k) found += 1;
+found;
@@ -0,0 +1,7 @@
+// list_build.w: growing a list one element at a time and reading it back.
+let l = [];
+for k in 0->4000 l += k * 2;
+let total = 0;
+for k in 0->l.size total += l[k];
+total;
+l.size;
@@ -0,0 +1,8 @@
+// numeric_loop.w: arithmetic and comparisons in a tight loop.
+let sum = 0;
+let i = 0;
+for i < 100000 {
+	sum = sum + i * i % 7 - i / 3;
+	i += 1;
+}
+sum;
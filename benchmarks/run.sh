@@ -0,0 +1,146 @@
+#!/bin/bash
+
+# Runs every benchmarks/*.w workload and reports, for each, the median wall
+#   time of BENCH_RUNS runs along with the instructions executed, peak heap
+#   cells and garbage collection time counted by --stats-json. Each workload
+#   runs once untimed first, so every timed run loads its bytecode from a
+#   compile cache of its own instead of the user's.
+# A workload with a "// limit_ms: N" line fails the run when its median takes
+#   longer than N milliseconds, to catch changes in complexity.
+# Results are written as JSON to benchmarks/results.json, one benchmark per
+#   line, and compared against benchmarks/baseline.json when it exists.
+#
+# usage: benchmarks/run.sh [--save] [--baseline=path] [--output=path]
+#   --save          : also stores the results as the new baseline.
+#   BENCH_RUNS=N    : number of timed runs per workload, defaults to 3.
+#   BENCH_FLAGS=... : extra flags for the interpreter, e.g. "--optimize".
+
+cd "$(dirname "$0")/.."
+
+runs=${BENCH_RUNS:-3}
+flags=${BENCH_FLAGS:-}
+output=benchmarks/results.json
+baseline=benchmarks/baseline.json
+save=false
+over_limit=false
+for arg in "$@"; do
+	case $arg in
+		--save) save=true ;;
+		--baseline=*) baseline=${arg#--baseline=} ;;
+		--output=*) output=${arg#--output=} ;;
+		*) echo "Unknown option $arg"; exit 1 ;;
+	esac
+done
+
+stats=$(mktemp)
+export WENDY_CACHE=$(mktemp -d)
+trap 'rm -f "$stats"; rm -rf "$WENDY_CACHE"' EXIT
+
+# stat(key) prints the number following "key": in the stats file.
+stat() {
+	grep -o "\"$1\": [0-9]*" "$stats" | head -n 1 | grep -o '[0-9]*$'
+}
+
+echo Running Benchmarks...
+{
+	echo "{ \"flags\": \"$flags\", \"runs\": $runs, \"benchmarks\": ["
+	first=true
+	for f in benchmarks/*.w ; do
+		name=$(basename "$f" .w)
+		times=()
+		# Warm up, this run compiles the workload into the cache.
+		if ! bin/wendy "$f" $flags > /dev/null < /dev/null; then
+			echo "Benchmark $name failed." >&2
+			continue
+		fi
+		for ((r = 0; r < runs; r++)); do
+			start=$(date +%s%N)
+			if ! bin/wendy "$f" $flags > /dev/null < /dev/null; then
+				echo "Benchmark $name failed." >&2
+				continue 2
+			fi
+			end=$(date +%s%N)
+			times+=($(( (end - start) / 1000 )))
+		done
+		median=$(printf "%s\n" "${times[@]}" | sort -n |
+			awk '{ t[NR] = $1 } END { print t[int((NR + 1) / 2)] }')
+		limit=$(grep -o '^// limit_ms: [0-9]*' "$f" | grep -o '[0-9]*$')
+		if [ -n "$limit" ] && [ $((median / 1000)) -gt "$limit" ]; then
+			echo "Benchmark $name took $((median / 1000)) ms," \
+				"over its limit of $limit ms." >&2
+			over_limit=true
+		fi
+		# Counting opcodes slows the interpreter down, so it gets its own run.
+		bin/wendy "$f" $flags --stats-json="$stats" > /dev/null < /dev/null
+		$first || echo ","
+		first=false
+		printf '  { "name": "%s", "wall_ms": %d.%03d, "instructions": %s, ' \
+			"$name" $((median / 1000)) $((median % 1000)) "$(stat instructions)"
+		printf '"peak_heap_cells": %s, "collections": %s, "gc_ms": %s }' \
+			"$(stat peak_heap_cells)" "$(stat collections)" \
+			"$(awk -v ns="$(stat pause_ns)" 'BEGIN { printf "%.3f", ns / 1e6 }')"
+		echo "Benchmark $name done." >&2
+	done
+	echo
+	echo "] }"
+} > "$output"
+
+# Prints one row per benchmark with the change from the baseline.
+if [ -f "$baseline" ] && [ "$baseline" != "$output" ]; then
+	awk '
+		function field(line, key,    m) {
+			if (match(line, "\"" key "\": [^,}]*")) {
+				m = substr(line, RSTART, RLENGTH)
+				sub(/^"[^"]*": "?/, "", m)
+				sub(/"$/, "", m)
+				return m
+			}
+			return ""
+		}
+		function change(old, new) {
+			if (old == 0) return "     n/a"
+			return sprintf("%+7.1f%%", (new - old) * 100 / old)
+		}
+		FNR == 1 { file++ }
+		/"name"/ {
+			name = field($0, "name")
+			if (file == 1) {
+				base_wall[name] = field($0, "wall_ms")
+				base_insns[name] = field($0, "instructions")
+				base_heap[name] = field($0, "peak_heap_cells")
+			}
+			else {
+				names[++count] = name
+				wall[name] = field($0, "wall_ms")
+				insns[name] = field($0, "instructions")
+				heap[name] = field($0, "peak_heap_cells")
+			}
+		}
+		END {
+			printf "%-20s %12s %12s %8s %12s %8s %8s\n", "benchmark",
+				"base ms", "ms", "time", "instructions", "insns", "heap"
+			for (i = 1; i <= count; i++) {
+				n = names[i]
+				if (!(n in base_wall)) {
+					printf "%-20s %12s %12.3f\n", n, "-", wall[n]
+					continue
+				}
+				printf "%-20s %12.3f %12.3f %8s %12d %8s %8s\n", n,
+					base_wall[n], wall[n], change(base_wall[n], wall[n]),
+					insns[n], change(base_insns[n], insns[n]),
+					change(base_heap[n], heap[n])
+			}
+		}
+	' "$baseline" "$output"
+else
+	cat "$output"
+fi
+
+if $save; then
+	cp "$output" benchmarks/baseline.json
+	echo Saved baseline to benchmarks/baseline.json
+fi
+echo Benchmarks Done
+if $over_limit; then
+	exit 1
+fi
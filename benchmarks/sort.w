@@ -0,0 +1,11 @@
+// sort.w: sorting pseudo-random numbers with list.w.
+import list;
+let seed = 42;
+let numbers = [];
+for k in 0->300 {
+	seed = (seed * 1103515245 + 12345) % 2147483648;
+	numbers += seed % 1000;
+}
+let sorted = sort(numbers);
+sorted[0];
+sorted[sorted.size - 1];
@@ -0,0 +1,7 @@
+// string_append.w: building a string with += in a loop.
+// limit_ms: 15000
+// Appends take amortized constant time, this takes seconds. Rescanning the
+//   string on every append makes it quadratic, which takes minutes.
+let s = "";
+for i in 0->1000000 s += "ab";
+s.size;
@@ -0,0 +1,8 @@
+// string_split_join.w: splitting and joining with string.w.
+import string;
+let words = [];
+for k in 0->150 words += "word" + k;
+let sentence = words % " ";
+let parts = sentence / " ";
+parts.size;
+(parts % ",").size;
@@ -1,10 +1,27 @@
 #!/bin/bash
 echo Running Tests...
+# Later runs of a test load the bytecode cached by the first.
+export WENDY_CACHE=$(mktemp -d)
+# run_test(file, flags...) runs the test with flags into file.tmp. A test with a
+#   .stderr file stops with an error on purpose, its errors aren't shown but
+#   have to contain the line in the .stderr file.
+run_test() {
+	local f=$1
+	shift
+	if [ -f "${f%.in}.stderr" ]; then
+		bin/wendy "$f" "$@" 2> err.tmp > file.tmp
+		if ! grep -qF -f "${f%.in}.stderr" err.tmp; then
+			echo "Expected error: $(cat "${f%.in}.stderr")" >> file.tmp
+		fi
+	else
+		bin/wendy "$f" "$@" > file.tmp
+	fi
+}
 for f in tests/*.err ; do
 	rm -f $f
 done
 for f in tests/*.in ; do
-	bin/wendy "$f" > file.tmp
+	run_test "$f"
 	if diff "${f%.in}.expect" file.tmp > /dev/null ; then
 		echo Test $(basename $f) passed.
 	else
@@ -16,7 +33,7 @@ for f in tests/*.in ; do
 done
 echo Running Tests with Optimize Flag...
 for f in tests/*.in ; do
-	bin/wendy "$f" --optimize > file.tmp
+	run_test "$f" --optimize
 	if diff "${f%.in}.expect" file.tmp > /dev/null ; then
 		echo Test $(basename $f):optimize passed.
 	else
@@ -26,5 +43,28 @@ for f in tests/*.in ; do
 		echo ============================
 	fi
 done
-rm file.tmp
+echo Running Tests with JIT Flag...
+for f in tests/*.in ; do
+	run_test "$f" --jit --jit-threshold=0
+	if diff "${f%.in}.expect" file.tmp > /dev/null ; then
+		echo Test $(basename $f):jit passed.
+	else
+		cp file.tmp "${f%.in}.err"
+		echo Test $(basename $f):jit failed.
+		diff -c "${f%.in}.expect" file.tmp
+		echo ============================
+	fi
+done
+echo Running Embedding Test...
+bin/embed-test 2> /dev/null > file.tmp
+if diff tests/embed.expect file.tmp > /dev/null ; then
+	echo Test embed.c passed.
+else
+	cp file.tmp tests/embed.err
+	echo Test embed.c failed.
+	diff -c tests/embed.expect file.tmp
+	echo ============================
+fi
+rm -f file.tmp err.tmp file_io.tmp
+rm -rf "$WENDY_CACHE"
 echo Tests Done
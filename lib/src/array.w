@@ -0,0 +1,41 @@
+/*
+ * array.w: WendyScript 2.0
+ * Numeric Arrays for WendyScript
+ * By: Felix Guo
+ * Provides: of, zeros, toList, sum, min, max, dot, cumsum and element-wise
+ *   +, -, * and / on f64arrays
+ */
+
+// An f64array packs its numbers together instead of storing each one in a
+//   memory cell like a list does, and is worked on by native loops that use
+//   the CPU's vector instructions. array.of(list) makes one from a list or
+//   range of numbers, and a[i] and a[start->end] read it. Arrays can't be
+//   changed, every operation returns a new one.
+// a + b, a - b, a * b and a / b work element-wise on two arrays of the same
+//   length, or an array and a number.
+struct array => [of, zeros, toList, sum, min, max, dot, cumsum, simd];
+array.of => (values) native array_of;
+array.zeros => (length) native array_zeros;
+array.toList => (a) native array_toList;
+array.sum => (a) native array_sum;
+// min(a) and max(a) return none for an empty array.
+array.min => (a) native array_min;
+array.max => (a) native array_max;
+array.dot => (a, b) native array_dot;
+// cumsum(a) returns the running totals of a.
+array.cumsum => (a) native array_cumsum;
+// simd() returns the vector instructions in use: "avx2", "sse2" or "scalar".
+array.simd => () native array_simd;
+
+let <f64array> + <f64array> => (lhs, rhs) native array_add;
+let <f64array> + <number> => (lhs, rhs) native array_add;
+let <number> + <f64array> => (lhs, rhs) native array_add;
+let <f64array> - <f64array> => (lhs, rhs) native array_sub;
+let <f64array> - <number> => (lhs, rhs) native array_sub;
+let <number> - <f64array> => (lhs, rhs) native array_sub;
+let <f64array> * <f64array> => (lhs, rhs) native array_mul;
+let <f64array> * <number> => (lhs, rhs) native array_mul;
+let <number> * <f64array> => (lhs, rhs) native array_mul;
+let <f64array> / <f64array> => (lhs, rhs) native array_div;
+let <f64array> / <number> => (lhs, rhs) native array_div;
+let <number> / <f64array> => (lhs, rhs) native array_div;
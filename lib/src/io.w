@@ -1,11 +1,38 @@
 /*
  * io.w: WendyScript 2.0
  * Created by Felix Guo
- * Provides read(), readRaw(), and readFile()
+ * Provides read(), readRaw(), readFile(), writeFile(), flush() and open()
  */
 
-struct io => [read, readRaw, readFile, writeFile];
+struct io => [read, readRaw, readFile, writeFile, flush, open];
+// read() and readRaw() return none at the end of the input.
 io.read => () native io_read;
 io.readRaw => () native io_readRaw;
 io.readFile => (fileName) native io_readFile;
 io.writeFile => (fileName, content) native io_writeFile;
+// Output is buffered, flush() writes it out immediately.
+io.flush => () native io_flush;
+
+// A File is returned by io.open(fileName, mode), where mode is "r" to read,
+//   "w" to write or "a" to append. Writes are buffered until the file is
+//   closed. readLine() returns none at the end of the file, and lines() can
+//   be looped over to read a file of any size one line at a time:
+//   for line in file.lines() ...
+struct File => (handle) [readLine, lines, write, close];
+{
+	// Prevent Global Scope Pollution
+	let openFile => (fileName, mode) native io_open;
+	let readLine => (handle) native io_readLine;
+	let lines => (handle) native io_lines;
+	let write => (handle, content) native io_write;
+	let close => (handle) native io_close;
+	io.open => (fileName, mode = "r") {
+		let handle = openFile(fileName, mode);
+		if handle == none ret none;
+		ret File(handle);
+	};
+	File.readLine => () readLine(this.handle);
+	File.lines => () lines(this.handle);
+	File.write => (content) write(this.handle, content);
+	File.close => () close(this.handle);
+}
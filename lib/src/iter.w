@@ -0,0 +1,40 @@
+/*
+ * iter.w: WendyScript 2.0
+ * Lazy sequence functions for WendyScript
+ * By: Felix Guo
+ * Provides: map, filter, take, list
+ */
+
+// Each function returns a generator that computes one element at a time, when
+//   the for loop iterating it asks for the next one, so chained calls don't
+//   build a list for every step and work on generators that never end:
+//
+//   let naturals => () { let n = 0; for (true) { yield n; n += 1; }; };
+//   for x in iter.take(iter.filter(#:(n) n % 3 == 0, naturals()), 5) x;
+//
+// iter.map(fn, xs) yields fn(x) for each x of xs.
+// iter.filter(fn, xs) yields the elements x of xs for which fn(x) is true.
+// iter.take(xs, n) yields the first n elements of xs, or all of them if xs has
+//   fewer, and stops without asking xs for more.
+// iter.list(xs) returns the elements of xs as a list.
+// xs can be a generator, or anything else a for loop iterates.
+struct iter => [map, filter, take, list];
+iter.map => (fn, xs) {
+	for x in xs yield fn(x);
+};
+iter.filter => (fn, xs) {
+	for x in xs if fn(x) yield x;
+};
+iter.take => (xs, n) {
+	if n <= 0 ret;
+	for x in xs {
+		yield x;
+		n -= 1;
+		if n <= 0 ret;
+	};
+};
+iter.list => (xs) {
+	let result = [];
+	for x in xs result += [x];
+	ret result;
+};
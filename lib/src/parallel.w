@@ -0,0 +1,46 @@
+/*
+ * parallel.w: WendyScript 2.0
+ * Parallel functions for WendyScript
+ * By: Felix Guo
+ * Provides: map, spawn and channel
+ */
+
+// parallel.map(fn, list, workers) returns [fn(x) for x in list], computed by
+//   splitting the list into one chunk per worker and running each chunk on a
+//   thread of its own. workers defaults to one per processor, the threads are
+//   kept for later calls.
+// Every thread runs a separate interpreter: the elements, fn and the global
+//   variables are copied to it, and the results are copied back, so changes
+//   fn makes to globals or to its argument aren't seen by the program. Open
+//   files can't be passed to another thread.
+//
+// parallel.spawn(fn, args) starts fn(args[0], args[1], ...) on a thread of its
+//   own and returns a Task, whose join() waits for fn to return and returns a
+//   copy of its result. Tasks that were never joined are waited for when the
+//   program ends.
+//
+// parallel.channel(capacity) returns a Channel holding up to capacity values
+//   in flight between threads. send(value) waits while the channel is full
+//   and receive() waits while it's empty, so the stages of a pipeline run at
+//   the pace of the slowest one. After close(), receive() returns the values
+//   still queued and then none. Channels can be passed to spawned functions.
+struct parallel => [map, spawn, channel];
+struct Task => (handle) [join];
+struct Channel => (handle) [send, receive, close];
+{
+	// Prevent Global Scope Pollution
+	let map => (fn, list, workers) native parallel_map;
+	let spawn => (fn, args) native parallel_spawn;
+	let join => (handle) native parallel_join;
+	let openChannel => (capacity) native parallel_channel;
+	let send => (handle, value) native parallel_send;
+	let receive => (handle) native parallel_receive;
+	let close => (handle) native parallel_close;
+	parallel.map => (fn, list, workers = 0) map(fn, list, workers);
+	parallel.spawn => (fn, args = []) Task(spawn(fn, args));
+	parallel.channel => (capacity = 1) Channel(openChannel(capacity));
+	Task.join => () join(this.handle);
+	Channel.send => (value) send(this.handle, value);
+	Channel.receive => () receive(this.handle);
+	Channel.close => () close(this.handle);
+}
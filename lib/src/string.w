@@ -2,48 +2,43 @@
  * string.w: WendyScript 2.0
  * String Functions for WendyScript
  * By: Felix Guo
- * Provides: split, join, % substitution
+ * Provides: split, join, find, replace, startsWith, endsWith, % substitution
+ *   and StringBuilder
  */
 
 import list;
 import data;
 
-let <string> / <string> => (lhs, rhs) {
-	// Split LHS with RHS
-	let res = [];
-	let last = 0;
-	for i in 0->(lhs.size - rhs.size + 1) {
-		if (rhs == lhs[i->(i + rhs.size)]) {
-			res += lhs[last->i];
-			i += rhs.size;
-			last = i;
-		}
-	}
-	if (last != lhs.size - rhs.size + 1) {
-		res += lhs[last->lhs.size];
-	}
-	ret res;
-	ret filter(#:(x) x != "", res);
+// StringBuilder builds a string from many pieces in linear time, append()
+//   takes a string or number and appendAll() a list of them.
+struct StringBuilder => (buffer) [append, appendAll, toString];
+StringBuilder.init => () {
+	ret this;
 };
+{
+	// Prevent Global Scope Pollution
+	let builderAppend => (builder, value) native stringBuilderAppend;
+	let builderAppendAll => (builder, values) native stringBuilderAppendAll;
+	let builderToString => (builder) native stringBuilderToString;
+	StringBuilder.append => (value) builderAppend(this, value);
+	StringBuilder.appendAll => (values) builderAppendAll(this, values);
+	StringBuilder.toString => () builderToString(this);
+}
 
-let <list> % <string> => (lhs, rhs) {
-	let res = "";
-	for i in 0->lhs.size {
-		if i != 0 res += rhs;
-		res += str(lhs[i]);
-	}
-	ret res;
-};
+// string provides the string functions, which are implemented natively.
+//   split(s, separator) and join(list, separator) are also available as
+//   s / separator and list % separator, and format(s, list), which replaces
+//   $1, $2, ... with the items of list, as s % list.
+struct string => [split, join, find, replace, startsWith, endsWith, format];
+string.split => (s, separator) native string_split;
+string.join => (list, separator) native string_join;
+// find(s, search) returns the index of the first occurrence or -1.
+string.find => (s, search) native string_find;
+string.replace => (s, from, to) native string_replace;
+string.startsWith => (s, prefix) native string_startsWith;
+string.endsWith => (s, suffix) native string_endsWith;
+string.format => (s, list) native string_format;
 
-let <string> % <list> => (lhs, rhs) {
-	let parts = lhs / "$";
-	for i in 0->rhs.size {
-		let search = (i + 1) + "";
-		parts = map(#:(x) {
-			if (x[0->search.size] == search)
-				ret rhs[i] + x[search.size -> x.size];
-			else ret x;
-		}, parts);
-	}
-	ret parts % "";
-};
+let <string> / <string> => (lhs, rhs) native string_split;
+let <list> % <string> => (lhs, rhs) native string_join;
+let <string> % <list> => (lhs, rhs) native string_format;
@@ -3,9 +3,11 @@
  * Provides system functions
  */
 
-struct System => [printCallStack, printFreeMemory, examineMemory, exec, getc, printBytecode, gc, program, getImportedLibraries];
+struct System => [printCallStack, printFreeMemory, examineMemory, exec, getc, printBytecode, gc, program, getImportedLibraries, stats];
 struct Program => [args];
 struct GarbageCollector => [collect];
+// Opcodes are only counted when running with --stats or --stats-json.
+struct Stats => (wallNs, instructions, allocations, allocatedCells, collections, gcPauseNs, gcMaxPauseNs, reclaimedCells, peakStack, peakOperandStack, closures, freeBlocks, freeCells, peakHeapCells);
 
 GarbageCollector.collect => () native garbageCollect;
 System.printCallStack => (numLines) native printCallStack;
@@ -16,6 +18,11 @@ System.getc => () native getc;
 System.printBytecode => () native printBytecode;
 System.getImportedLibraries => () native getImportedLibraries;
 System.gc => () GarbageCollector;
+System.stats => () {
+	let read => () native stats;
+	let s = read();
+	ret Stats(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], s[8], s[9], s[10], s[11], s[12], s[13]);
+};
 System.program = Program();
 {
 	// Prevent Global Scope Pollution
@@ -0,0 +1,66 @@
+#include "arena.h"
+#include "global.h"
+#include <string.h>
+
+// Chunks are kept newest first, only the newest is allocated from.
+
+typedef union {
+	double number;
+	long long integer;
+	void* pointer;
+} max_align;
+
+struct arena_chunk {
+	arena_chunk* next;
+	size_t used;
+	size_t capacity;
+	max_align memory[];
+};
+
+static size_t align(size_t size) {
+	return (size + sizeof(max_align) - 1) / sizeof(max_align) * sizeof(max_align);
+}
+
+void* arena_alloc(arena* a, size_t size) {
+	size = align(size ? size : 1);
+	arena_chunk* chunk = a->chunks;
+	if (!chunk || chunk->capacity - chunk->used < size) {
+		size_t capacity = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+		chunk = safe_malloc(sizeof(arena_chunk) + capacity);
+		chunk->used = 0;
+		chunk->capacity = capacity;
+		if (size > ARENA_CHUNK_SIZE && a->chunks) {
+			// Keep allocating from the chunk that's partly used.
+			chunk->next = a->chunks->next;
+			a->chunks->next = chunk;
+		}
+		else {
+			chunk->next = a->chunks;
+			a->chunks = chunk;
+		}
+	}
+	void* result = (char*)chunk->memory + chunk->used;
+	chunk->used += size;
+	return result;
+}
+
+char* arena_strndup(arena* a, const char* s, size_t n) {
+	char* copy = arena_alloc(a, n + 1);
+	memcpy(copy, s, n);
+	copy[n] = 0;
+	return copy;
+}
+
+char* arena_strdup(arena* a, const char* s) {
+	return arena_strndup(a, s, strlen(s));
+}
+
+void arena_free(arena* a) {
+	arena_chunk* chunk = a->chunks;
+	while (chunk) {
+		arena_chunk* next = chunk->next;
+		safe_free(chunk);
+		chunk = next;
+	}
+	a->chunks = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// arena.h - Felix Guo
+// A bump allocator for the front end. The [scanner], [ast] and [optimizer]
+//   allocate the tokens, syntax tree nodes and strings of a compilation from
+//   its arena, and the whole compilation is released by one arena_free()
+//   once the bytecode is generated, instead of node by node.
+
+// Size of the chunks the arena takes from safe_malloc, larger allocations get
+//   a chunk of their own.
+#define ARENA_CHUNK_SIZE 65536
+
+typedef struct arena_chunk arena_chunk;
+
+// A zeroed arena is empty and ready to allocate from.
+typedef struct arena {
+	arena_chunk* chunks;
+} arena;
+
+// arena_alloc(a, size) returns size bytes from a, aligned for any type. The
+//   memory lives until arena_free(a).
+void* arena_alloc(arena* a, size_t size);
+
+// arena_strndup(a, s, n) copies the first n characters of s to a, null
+//   terminated.
+char* arena_strndup(arena* a, const char* s, size_t n);
+
+// arena_strdup(a, s) copies s to a.
+char* arena_strdup(arena* a, const char* s);
+
+// arena_free(a) frees everything allocated from a and leaves it empty.
+void arena_free(arena* a);
+
+#endif
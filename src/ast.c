@@ -8,10 +8,11 @@
 
 #define match(...) fnmatch(sizeof((token_type []) {__VA_ARGS__}) / sizeof(token_type), __VA_ARGS__)
 
-static token* tokens = 0;
-static size_t length = 0;
-static size_t curr_index = 0;
-static bool error_thrown = false;
+static THREAD_LOCAL arena* nodes = 0; // owns the tree
+static THREAD_LOCAL token* tokens = 0;
+static THREAD_LOCAL size_t length = 0;
+static THREAD_LOCAL size_t curr_index = 0;
+static THREAD_LOCAL bool error_thrown = false;
 
 // Forward Declarations
 static expr* make_lit_expr(token t);
@@ -34,53 +35,6 @@ static token advance(void);
 static token previous(void);
 
 // Public Methods
-// Wrapping safe_free macro for use as a function pointer.
-
-// In most cases we want traversal algorithm internals to be private, but these
-// are exposed so optimizer can use them to properly free.
-void ast_safe_free_e(expr* ptr, traversal_algorithm* algo) {
-    UNUSED(algo);
-    if (ptr->type == E_FUNCTION && ptr->op.func_expr.is_native) {
-        safe_free(ptr->op.func_expr.native_name);
-    } else if (ptr->type == E_LITERAL) {
-        destroy_data(&ptr->op.lit_expr);
-    }
-    safe_free(ptr);
-}
-
-void ast_safe_free_el(expr_list* ptr, traversal_algorithm* algo) {
-    UNUSED(algo);
-    safe_free(ptr);
-}
-
-void ast_safe_free_s(statement* ptr, traversal_algorithm* algo) {
-    UNUSED(algo);
-    if (ptr->type == S_IMPORT && ptr->op.import_statement) {
-        safe_free(ptr->op.import_statement);
-    } else if (ptr->type == S_LET && ptr->op.let_statement.lvalue) {
-        safe_free(ptr->op.let_statement.lvalue);
-    } else if (ptr->type == S_STRUCT && ptr->op.struct_statement.name) {
-        safe_free(ptr->op.struct_statement.name);
-    } else if (ptr->type == S_LOOP && ptr->op.loop_statement.index_var) {
-        safe_free(ptr->op.loop_statement.index_var);
-    }
-    safe_free(ptr);
-}
-
-void ast_safe_free_sl(statement_list* ptr, traversal_algorithm* algo) {
-    UNUSED(algo);
-    safe_free(ptr);
-}
-
-traversal_algorithm ast_safe_free_impl =
-{
-	ast_safe_free_e,
-	ast_safe_free_el,
-	ast_safe_free_s,
-	ast_safe_free_sl,
-	HANDLE_AFTER_CHILDREN, 0
-};
-
 static void print_e(expr*, traversal_algorithm*);
 static void print_el(expr_list*, traversal_algorithm*);
 static void print_s(statement*, traversal_algorithm*);
@@ -94,8 +48,9 @@ static traversal_algorithm print_ast_impl =
 	HANDLE_BEFORE_CHILDREN, 0
 };
 
-statement_list* generate_ast(token* _tokens, size_t _length) {
+statement_list* generate_ast(arena* a, token* _tokens, size_t _length) {
 	error_thrown = false;
+	nodes = a;
 	tokens = _tokens;
 	length = _length;
 	curr_index = 0;
@@ -106,8 +61,14 @@ void print_ast(statement_list* ast) {
 	traverse_ast(ast, &print_ast_impl);
 }
 
-void free_ast(statement_list* ast) {
-	traverse_ast(ast, &ast_safe_free_impl);
+data ast_literal(arena* a, data d) {
+	if (is_numeric(d)) {
+		return d;
+	}
+	data literal = make_data(d.type, d.value);
+	literal.value.string = arena_strdup(a, d.value.string);
+	destroy_data(&d);
+	return literal;
 }
 
 bool ast_error_flag(void) {
@@ -165,7 +126,7 @@ static void consume(token_type t) {
 }
 
 static expr_list* identifier_list(void) {
-	expr_list* list = safe_malloc(sizeof(expr_list));
+	expr_list* list = arena_alloc(nodes, sizeof(expr_list));
 	list->next = 0;
 	expr** curr = &list->elem;
 	expr_list* curr_list = list;
@@ -173,7 +134,7 @@ static expr_list* identifier_list(void) {
 		if (match(T_IDENTIFIER)) {
 			*curr = make_lit_expr(previous());
 			if (match(T_COMMA)) {
-				curr_list->next = safe_malloc(sizeof(expr_list));
+				curr_list->next = arena_alloc(nodes, sizeof(expr_list));
 				curr_list = curr_list->next;
 				curr_list->next = 0;
 				curr = &curr_list->elem;
@@ -190,51 +151,39 @@ static expr_list* identifier_list(void) {
 
 static expr_list* read_bytecode_token_list(token_type end_delimiter) {
 	if (peek().t_type == end_delimiter) return 0;
-	expr_list* list = safe_malloc(sizeof(expr_list));
+	expr_list* list = arena_alloc(nodes, sizeof(expr_list));
 	list->next = 0;
 	expr** curr = &list->elem;
 	expr_list* curr_list = list;
 	forever {
 		*curr = make_lit_expr(advance());
 		if (peek().t_type != end_delimiter) {
-			curr_list->next = safe_malloc(sizeof(expr_list));
+			curr_list->next = arena_alloc(nodes, sizeof(expr_list));
 			curr_list = curr_list->next;
 			curr_list->next = 0;
 			curr = &curr_list->elem;
 		} else break;
 	}
-	if (error_thrown) {
-		// rollback
-		traverse_expr_list(list, &ast_safe_free_impl);
-		return 0;
-	}
-	else {
-		return list;
-	}
+	// On errors the nodes are left to the arena.
+	return error_thrown ? 0 : list;
 }
 static expr_list* expression_list(token_type end_delimiter) {
 	if (peek().t_type == end_delimiter) return 0;
-	expr_list* list = safe_malloc(sizeof(expr_list));
+	expr_list* list = arena_alloc(nodes, sizeof(expr_list));
 	list->next = 0;
 	expr** curr = &list->elem;
 	expr_list* curr_list = list;
 	forever {
 		*curr = expression();
 		if (match(T_COMMA)) {
-			curr_list->next = safe_malloc(sizeof(expr_list));
+			curr_list->next = arena_alloc(nodes, sizeof(expr_list));
 			curr_list = curr_list->next;
 			curr_list->next = 0;
 			curr = &curr_list->elem;
 		} else break;
 	}
-	if (error_thrown) {
-		// rollback
-		traverse_expr_list(list, &ast_safe_free_impl);
-		return 0;
-	}
-	else {
-		return list;
-	}
+	// On errors the nodes are left to the arena.
+	return error_thrown ? 0 : list;
 }
 
 static expr* lvalue(void) {
@@ -398,26 +347,18 @@ static expr* assignment(void) {
 }
 static expr* expression(void) {
 	expr* res = assignment();
-	if (error_thrown) {
-		// Rollback
-		traverse_expr(res, &ast_safe_free_impl);
-		return 0;
-	}
-	else {
-		return res;
-	}
+	return error_thrown ? 0 : res;
 }
 
 static statement* parse_statement(void) {
 	token first = advance();
-	statement* sm = safe_malloc(sizeof(statement));
+	statement* sm = arena_alloc(nodes, sizeof(statement));
 	sm->src_line = first.t_line;
 	switch (first.t_type) {
 		case T_LEFT_BRACE: {
 			if (peek().t_type == T_RIGHT_BRACE) {
 				// Non-Empty Statement Block
 				consume(T_RIGHT_BRACE);
-				safe_free(sm);
 				return 0;
 			}
 			statement_list* sl = parse_statement_list();
@@ -441,7 +382,7 @@ static statement* parse_statement(void) {
 			char* lvalue = 0;
 			if (match(T_IDENTIFIER)) {
                 token prev = previous();
-				lvalue = safe_strdup(prev.t_data.string);
+				lvalue = token_text(prev, nodes);
 			}
 			else {
                 size_t alloc_size = strlen(OPERATOR_OVERLOAD_PREFIX);
@@ -450,22 +391,22 @@ static statement* parse_statement(void) {
 				if (match(T_OBJ_TYPE)) {
                     lhs = previous();
                     is_binary = true;
-                    alloc_size += strlen(lhs.t_data.string);
+                    alloc_size += lhs.t_length;
                 }
                 token op = advance();
                 token operand;
                 if (precedence(op) || op.t_type == T_AT) {
-                    alloc_size += strlen(op.t_data.string);
+                    alloc_size += op.t_length;
                     consume(T_OBJ_TYPE);
                     operand = previous();
-                    alloc_size += strlen(operand.t_data.string);
-					lvalue = safe_calloc(alloc_size + 1, sizeof(char));
-					strcat(lvalue, OPERATOR_OVERLOAD_PREFIX);
+                    alloc_size += operand.t_length;
+					lvalue = arena_alloc(nodes, alloc_size + 1);
+					strcpy(lvalue, OPERATOR_OVERLOAD_PREFIX);
 					if (is_binary) {
-						strcat(lvalue, lhs.t_data.string);
+						strncat(lvalue, lhs.t_lexeme, lhs.t_length);
 					}
-					strcat(lvalue, op.t_data.string);
-					strcat(lvalue, operand.t_data.string);
+					strncat(lvalue, op.t_lexeme, op.t_length);
+					strncat(lvalue, operand.t_lexeme, operand.t_length);
                 }
                 else {
 					error_lexer(op.t_line, op.t_col,
@@ -491,9 +432,7 @@ static statement* parse_statement(void) {
 				}
 			}
 			else {
-				token none_tk = none_token();
-				rvalue = make_lit_expr(none_tk);
-				destroy_token(none_tk);
+				rvalue = make_lit_expr(none_token());
 			}
 			sm->type = S_LET;
 			sm->op.let_statement.lvalue = lvalue;
@@ -524,8 +463,7 @@ static statement* parse_statement(void) {
 					token t = previous();
 					error_lexer(t.t_line, t.t_col, AST_EXPECTED_IDENTIFIER_LOOP);
 				}
-				a_index = safe_strdup(index_var->op.lit_expr.value.string);
-		        traverse_expr(index_var, &ast_safe_free_impl);
+				a_index = index_var->op.lit_expr.value.string;
 			}
 			else {
 				condition = index_var;
@@ -563,45 +501,44 @@ static statement* parse_statement(void) {
 				}
 			}
 			// Default Initiation Function
-			statement_list* init_fn = safe_malloc(sizeof(statement_list));
+			statement_list* init_fn = arena_alloc(nodes, sizeof(statement_list));
 			statement_list* curr = init_fn;
 			statement_list* prev = 0;
 
 			expr_list* tmp_ins = instance_members;
 			while (tmp_ins) {
-				curr->elem = safe_malloc(sizeof(statement));
+				curr->elem = arena_alloc(nodes, sizeof(statement));
 				curr->elem->type = S_EXPR;
-				curr->elem->op.expr_statement = safe_malloc(sizeof(expr));
+				curr->elem->op.expr_statement = arena_alloc(nodes, sizeof(expr));
 				curr->elem->op.expr_statement->type = E_ASSIGN;
 				expr* ass_expr = curr->elem->op.expr_statement;
 				ass_expr->op.assign_expr.operator = O_ASSIGN;
 				ass_expr->op.assign_expr.rvalue = copy_lit_expr(tmp_ins->elem);
 				// Binary Dot Expr
-				expr* left = lit_expr_from_data(make_data(D_IDENTIFIER,
-								data_value_str("this")));
+				expr* left = lit_expr_from_data(ast_literal(nodes,
+					make_data(D_IDENTIFIER, data_value_str("this"))));
 				expr* right = copy_lit_expr(tmp_ins->elem);
 
 				token op = make_token(T_DOT, make_data_str("."));
                 // This isn't very clean, having to make a fake token to
                 // construct the expression.
 				ass_expr->op.assign_expr.lvalue = make_bin_expr(left, op, right);
-                destroy_token(op);
 
 				if (prev) prev->next = curr;
 				prev = curr;
-				curr = safe_malloc(sizeof(statement_list));
+				curr = arena_alloc(nodes, sizeof(statement_list));
 
 				tmp_ins = tmp_ins->next;
 			}
 			// Return This Operation
-			curr->elem = safe_malloc(sizeof(statement));
+			curr->elem = arena_alloc(nodes, sizeof(statement));
 			if(prev) prev->next = curr;
 			curr->next = 0;
 			curr->elem->type = S_OPERATION;
 			curr->elem->op.operation_statement.operator = OP_RET;
 			curr->elem->op.operation_statement.operand =
-                lit_expr_from_data(make_data(D_IDENTIFIER,
-								data_value_str("this")));
+				lit_expr_from_data(ast_literal(nodes,
+					make_data(D_IDENTIFIER, data_value_str("this"))));
 
 			expr_list* parameters = 0;
 			if (instance_members) {
@@ -610,14 +547,14 @@ static statement* parse_statement(void) {
 				parameters = identifier_list();
 				curr_index = saved_before_pop;
 			}
-			statement* function_body = safe_malloc(sizeof(statement));
+			statement* function_body = arena_alloc(nodes, sizeof(statement));
 			function_body->type = S_BLOCK;
 			function_body->op.block_statement = init_fn;
 			// init_fn is now the list of statements, to make it a function
 			expr* function_const = make_func_expr(parameters, function_body);
 
 			sm->type = S_STRUCT;
-			sm->op.struct_statement.name = safe_strdup(name.t_data.string);
+			sm->op.struct_statement.name = token_text(name, nodes);
 			sm->op.struct_statement.init_fn = function_const;
 			sm->op.struct_statement.instance_members = instance_members;
 			sm->op.struct_statement.static_members = static_members;
@@ -647,7 +584,7 @@ static statement* parse_statement(void) {
 				//   delegate that task to codegen to decide.
                 token p = previous();
                 if (p.t_type == T_IDENTIFIER) {
-				    sm->op.import_statement = safe_strdup(p.t_data.string);
+				    sm->op.import_statement = token_text(p, nodes);
                 } else {
                     sm->op.import_statement = 0;
                 }
@@ -657,14 +594,17 @@ static statement* parse_statement(void) {
 			}
 			break;
 		}
-		case T_RET: {
+		case T_RET:
+		case T_YIELD: {
 			sm->type = S_OPERATION;
-			sm->op.operation_statement.operator = OP_RET;
+			sm->op.operation_statement.operator =
+				first.t_type == T_RET ? OP_RET : OP_YIELD;
 			if (peek().t_type != T_SEMICOLON && peek().t_type != T_RIGHT_BRACE) {
 				sm->op.operation_statement.operand = expression();
 			}
 			else {
-				sm->op.operation_statement.operand = lit_expr_from_data(noneret_data());
+				sm->op.operation_statement.operand = lit_expr_from_data(
+					ast_literal(nodes, noneret_data()));
 			}
 			break;
 		}
@@ -677,36 +617,24 @@ static statement* parse_statement(void) {
 		}
 	}
 	match(T_SEMICOLON);
-	if (error_thrown) {
-		// Rollback
-		traverse_statement(sm, &ast_safe_free_impl);
-		return 0;
-	}
-	return sm;
+	return error_thrown ? 0 : sm;
 }
 
 static statement_list* parse_statement_list(void) {
-	statement_list* ast = safe_malloc(sizeof(statement_list));
+	statement_list* ast = arena_alloc(nodes, sizeof(statement_list));
 	ast->next = 0;
 	statement** curr = &ast->elem;
 	statement_list* curr_ast = ast;
 	while (true) {
 		*curr = parse_statement();
 		if (!is_at_end() && peek().t_type != T_RIGHT_BRACE) {
-			curr_ast->next = safe_malloc(sizeof(statement_list));
+			curr_ast->next = arena_alloc(nodes, sizeof(statement_list));
 			curr_ast = curr_ast->next;
 			curr_ast->next = 0;
 			curr = &curr_ast->elem;
 		} else break;
 	}
-	if (error_thrown) {
-		// Rollback
-		traverse_statement_list(ast, &ast_safe_free_impl);
-		return 0;
-	}
-	else {
-		return ast;
-	}
+	return error_thrown ? 0 : ast;
 }
 
 void traverse_statement_list(statement_list* list, traversal_algorithm* algo) {
@@ -900,26 +828,29 @@ void traverse_ast(statement_list* list, traversal_algorithm* algo) {
 
 /* Consumes d */
 static expr* lit_expr_from_data(data d) {
-    expr* node = safe_malloc(sizeof(expr));
+    expr* node = arena_alloc(nodes, sizeof(expr));
     node->type = E_LITERAL;
     node->op.lit_expr = d;
     return node;
 }
 
 static expr* copy_lit_expr(expr* from) {
-    expr* node = lit_expr_from_data(copy_data(from->op.lit_expr));
+    expr* node = lit_expr_from_data(from->op.lit_expr);
 	node->line = from->line;
 	node->col = from->col;
 	return node;
 }
 static expr* make_lit_expr(token t) {
+	if (t.t_type != T_NUMBER) {
+		t.t_data.string = token_text(t, nodes);
+	}
 	expr* node = lit_expr_from_data(literal_to_data(t));
 	node->line = t.t_line;
 	node->col = t.t_col;
 	return node;
 }
 static expr* make_bin_expr(expr* left, token op, expr* right) {
-	expr* node = safe_malloc(sizeof(expr));
+	expr* node = arena_alloc(nodes, sizeof(expr));
 	node->line = op.t_line;
 	node->col = op.t_col;
 	node->type = E_BINARY;
@@ -930,7 +861,7 @@ static expr* make_bin_expr(expr* left, token op, expr* right) {
 }
 static expr* make_if_expr(expr* condition, expr* if_true, expr* if_false) {
 	token t = tokens[curr_index];
-	expr* node = safe_malloc(sizeof(expr));
+	expr* node = arena_alloc(nodes, sizeof(expr));
 	node->line = t.t_line;
 	node->col = t.t_col;
 	node->type = E_IF;
@@ -940,7 +871,7 @@ static expr* make_if_expr(expr* condition, expr* if_true, expr* if_false) {
 	return node;
 }
 static expr* make_una_expr(token op, expr* operand) {
-	expr* node = safe_malloc(sizeof(expr));
+	expr* node = arena_alloc(nodes, sizeof(expr));
 	node->type = E_UNARY;
 	node->op.una_expr.operator = token_operator_unary(op);
 	node->op.una_expr.operand = operand;
@@ -950,7 +881,7 @@ static expr* make_una_expr(token op, expr* operand) {
 }
 static expr* make_call_expr(expr* left, expr_list* arg_list) {
 	token t = tokens[curr_index];
-	expr* node = safe_malloc(sizeof(expr));
+	expr* node = arena_alloc(nodes, sizeof(expr));
 	node->type = E_CALL;
 	node->op.call_expr.function = left;
 	node->op.call_expr.arguments = arg_list;
@@ -960,7 +891,7 @@ static expr* make_call_expr(expr* left, expr_list* arg_list) {
 }
 static expr* make_list_expr(expr_list* list) {
 	token t = tokens[curr_index];
-	expr* node = safe_malloc(sizeof(expr));
+	expr* node = arena_alloc(nodes, sizeof(expr));
 	node->type = E_LIST;
 	int size = 0;
 	expr_list* start = list;
@@ -975,7 +906,7 @@ static expr* make_list_expr(expr_list* list) {
 	return node;
 }
 static expr* make_assign_expr(expr* left, expr* right, token op) {
-	expr* node = safe_malloc(sizeof(expr));
+	expr* node = arena_alloc(nodes, sizeof(expr));
 	node->type = E_ASSIGN;
 	node->op.assign_expr.lvalue = left;
 	node->op.assign_expr.rvalue = right;
@@ -1007,7 +938,7 @@ static expr* make_assign_expr(expr* left, expr* right, token op) {
 }
 static expr* make_func_expr(expr_list* parameters, statement* body) {
 	token t = tokens[curr_index];
-	expr* node = safe_malloc(sizeof(expr));
+	expr* node = arena_alloc(nodes, sizeof(expr));
 	node->type = E_FUNCTION;
 	node->op.func_expr.parameters = parameters;
 	node->op.func_expr.body = body;
@@ -1019,6 +950,6 @@ static expr* make_func_expr(expr_list* parameters, statement* body) {
 static expr* make_native_func_expr(expr_list* parameters, token name) {
 	expr* node = make_func_expr(parameters, 0);
 	node->op.func_expr.is_native = true;
-	node->op.func_expr.native_name = safe_strdup(name.t_data.string);
+	node->op.func_expr.native_name = token_text(name, nodes);
 	return node;
 }
@@ -4,6 +4,7 @@
 #include "token.h"
 #include "operators.h"
 #include "codegen.h"
+#include "arena.h"
 #include <stdbool.h>
 
 // ast.h - Felix Guo
@@ -116,13 +117,14 @@ typedef struct traversal_algorithm {
 	int level;
 } traversal_algorithm;
 
-extern traversal_algorithm ast_safe_free_impl;
+// generate_ast(a, tokens, length) generates an ast based on the tokens/length,
+//   the nodes are allocated in the arena a and share the strings of the
+//   tokens, so the tree lives until a is freed
+statement_list* generate_ast(arena* a, token* tokens, size_t length);
 
-// generate_ast(tokens, length) generates an ast based on the tokens/length
-statement_list* generate_ast(token* tokens, size_t length);
-
-// free_ast(ast) frees all the memory associated with the AST module
-void free_ast(statement_list* ast);
+// ast_literal(a, d) returns the literal d with its string moved to the arena a,
+//   for literals that are added to the tree after parsing. Consumes d.
+data ast_literal(arena* a, data d);
 
 // print_ast(ast) prints the tree in post order
 void print_ast(statement_list* ast);
@@ -137,8 +139,4 @@ void traverse_expr_list(expr_list*, traversal_algorithm*);
 void traverse_statement_list(statement_list*, traversal_algorithm*);
 void traverse_statement(statement*, traversal_algorithm*);
 
-void ast_safe_free_e(expr* ptr, traversal_algorithm* algo);
-void ast_safe_free_el(expr_list* ptr, traversal_algorithm* algo);
-void ast_safe_free_s(statement* ptr, traversal_algorithm* algo);
-void ast_safe_free_sl(statement_list* ptr, traversal_algorithm* algo);
 #endif
@@ -0,0 +1,359 @@
+#define _GNU_SOURCE
+#include "cache.h"
+#include "codegen.h"
+#include "global.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CACHE_SUPPORTED
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+// Implementation of the compile cache. An entry is a text header followed by
+//   the bytecode:
+//     WendyCache 1
+//     <F or L> <hash of the contents> <path or library name>
+//     ...
+//     <empty line>
+//     <bytecode>
+// Entries are written to a temporary file and renamed, so a program that runs
+//   at the same time never reads half an entry. Loading an entry touches it,
+//   and once the entries take more than CACHE_MAX_BYTES the least recently
+//   used ones are removed after a store.
+
+#define CACHE_HEADER "WendyCache 1\n"
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define CACHE_MAX_BYTES (64 * 1024 * 1024)
+#define CACHE_EXTENSION ".wcache"
+
+typedef struct {
+	cache_dependency_kind kind;
+	char* name;
+	uint64_t hash;
+} dependency;
+
+static THREAD_LOCAL bool recording = false;
+static THREAD_LOCAL dependency* dependencies = 0;
+static THREAD_LOCAL size_t dependencies_count = 0;
+static THREAD_LOCAL size_t dependencies_capacity = 0;
+
+static uint64_t fnv1a(uint64_t hash, const void* bytes, size_t length) {
+	const unsigned char* b = bytes;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= b[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+void cache_begin(void) {
+	recording = true;
+	dependencies_count = 0;
+}
+
+void cache_add_dependency(cache_dependency_kind kind, const char* name,
+	const void* contents, size_t length) {
+	if (!recording) {
+		return;
+	}
+	for (size_t i = 0; i < dependencies_count; i++) {
+		if (dependencies[i].kind == kind && streq(dependencies[i].name, name)) {
+			return;
+		}
+	}
+	if (dependencies_count == dependencies_capacity) {
+		dependencies_capacity = dependencies_capacity ? 2 * dependencies_capacity : 8;
+		dependencies = dependencies ?
+			safe_realloc(dependencies, dependencies_capacity * sizeof(dependency)) :
+			safe_malloc(dependencies_capacity * sizeof(dependency));
+	}
+	dependency* d = &dependencies[dependencies_count++];
+	d->kind = kind;
+	d->name = safe_strdup(name);
+	d->hash = fnv1a(FNV_OFFSET, contents, length);
+}
+
+static void stop_recording(void) {
+	for (size_t i = 0; i < dependencies_count; i++) {
+		safe_free(dependencies[i].name);
+	}
+	if (dependencies) {
+		safe_free(dependencies);
+	}
+	dependencies = 0;
+	dependencies_count = 0;
+	dependencies_capacity = 0;
+	recording = false;
+}
+
+#ifdef CACHE_SUPPORTED
+// cache_directory(create) returns the path of the cache directory, with room
+//   for an entry name after it, creating it if asked to, or 0 if there's no
+//   cache directory.
+static char* cache_directory(bool create) {
+	const char* directory = getenv("WENDY_CACHE");
+	const char* home = getenv("HOME");
+	char* path;
+	if (directory && directory[0]) {
+		path = safe_malloc(strlen(directory) + 32);
+		strcpy(path, directory);
+	}
+	else if (home && home[0]) {
+		path = safe_malloc(strlen(home) + strlen("/.cache/wendy") + 32);
+		strcpy(path, home);
+		strcat(path, "/.cache");
+		if (create) mkdir(path, 0755);
+		strcat(path, "/wendy");
+	}
+	else {
+		return 0;
+	}
+	// Failures show up when the entry is written.
+	if (create) mkdir(path, 0755);
+	return path;
+}
+
+// entry_path(source, length, create) returns the path of the entry of the
+//   source, creating the cache directory if asked to, or 0 if there's no
+//   cache directory.
+static char* entry_path(const char* source, size_t length, bool create) {
+	char flags[64];
+	int flags_length = snprintf(flags, sizeof(flags), "%d %d %d",
+		get_settings_flag(SETTINGS_OPTIMIZE),
+		get_settings_value(SETTINGS_INLINE_MAX_SIZE),
+		get_settings_value(SETTINGS_INLINE_MAX_GROWTH));
+	uint64_t key = fnv1a(FNV_OFFSET, WENDY_VERSION, sizeof(WENDY_VERSION));
+	key = fnv1a(key, BUILD_VERSION, sizeof(BUILD_VERSION));
+	key = fnv1a(key, flags, flags_length + 1);
+	key = fnv1a(key, source, length);
+
+	char* path = cache_directory(create);
+	if (path) {
+		sprintf(path + strlen(path), "/%016" PRIx64 CACHE_EXTENSION, key);
+	}
+	return path;
+}
+
+typedef struct {
+	char* path;
+	off_t size;
+	time_t used;
+} cache_entry;
+
+static int compare_entries(const void* a, const void* b) {
+	time_t x = ((const cache_entry*)a)->used;
+	time_t y = ((const cache_entry*)b)->used;
+	return x < y ? -1 : x > y;
+}
+
+// is_entry(name) returns true if the file name is the name of an entry.
+static bool is_entry(const char* name) {
+	size_t length = strlen(name);
+	size_t extension = strlen(CACHE_EXTENSION);
+	return length > extension &&
+		streq(name + length - extension, CACHE_EXTENSION);
+}
+
+// evict() removes the least recently used entries until the rest take at
+//   most CACHE_MAX_BYTES.
+static void evict(void) {
+	char* directory = cache_directory(false);
+	DIR* dir = directory ? opendir(directory) : 0;
+	if (!dir) {
+		if (directory) safe_free(directory);
+		return;
+	}
+	cache_entry* entries = 0;
+	size_t count = 0;
+	size_t capacity = 0;
+	off_t total = 0;
+	struct dirent* e;
+	while ((e = readdir(dir))) {
+		if (!is_entry(e->d_name)) {
+			continue;
+		}
+		char* path = safe_malloc(strlen(directory) + strlen(e->d_name) + 2);
+		sprintf(path, "%s/%s", directory, e->d_name);
+		struct stat info;
+		if (stat(path, &info) != 0) {
+			safe_free(path);
+			continue;
+		}
+		if (count == capacity) {
+			capacity = capacity ? 2 * capacity : 64;
+			entries = entries ?
+				safe_realloc(entries, capacity * sizeof(cache_entry)) :
+				safe_malloc(capacity * sizeof(cache_entry));
+		}
+		entries[count++] = (cache_entry){ path, info.st_size, info.st_mtime };
+		total += info.st_size;
+	}
+	closedir(dir);
+	if (total > CACHE_MAX_BYTES) {
+		qsort(entries, count, sizeof(cache_entry), compare_entries);
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (total > CACHE_MAX_BYTES && remove(entries[i].path) == 0) {
+			total -= entries[i].size;
+		}
+		safe_free(entries[i].path);
+	}
+	if (entries) {
+		safe_free(entries);
+	}
+	safe_free(directory);
+}
+
+// read_stream(f, length) returns the rest of f, null terminated, and sets
+//   length.
+static char* read_stream(FILE* f, size_t* length) {
+	size_t capacity = 4096;
+	char* contents = safe_malloc(capacity);
+	*length = 0;
+	size_t read;
+	while ((read = fread(contents + *length, 1, capacity - *length - 1, f))) {
+		*length += read;
+		if (*length == capacity - 1) {
+			capacity *= 2;
+			contents = safe_realloc(contents, capacity);
+		}
+	}
+	contents[*length] = '\0';
+	return contents;
+}
+
+// is_unchanged(kind, name, hash) returns true if the dependency still has the
+//   contents it was compiled with.
+static bool is_unchanged(cache_dependency_kind kind, const char* name,
+	uint64_t hash) {
+	FILE* f = kind == CACHE_FILE ? fopen(name, "r") : open_library(name);
+	if (!f) {
+		return false;
+	}
+	size_t length;
+	char* contents = read_stream(f, &length);
+	fclose(f);
+	bool unchanged = fnv1a(FNV_OFFSET, contents, length) == hash;
+	safe_free(contents);
+	return unchanged;
+}
+
+// bytecode_start(entry, length) returns where the bytecode of the entry starts,
+//   or 0 if the entry is invalid or a dependency has changed.
+static size_t bytecode_start(char* entry, size_t length) {
+	size_t header_length = strlen(CACHE_HEADER);
+	if (length < header_length || memcmp(entry, CACHE_HEADER, header_length)) {
+		return 0;
+	}
+	char* line = entry + header_length;
+	char* end = entry + length;
+	while (line < end && *line != '\n') {
+		char* line_end = memchr(line, '\n', end - line);
+		// <kind> <16 digits> <name>
+		if (!line_end || line_end - line < 20 || line[1] != ' ' ||
+			line[18] != ' ') {
+			return 0;
+		}
+		*line_end = '\0';
+		cache_dependency_kind kind = line[0] == 'L' ? CACHE_LIBRARY : CACHE_FILE;
+		uint64_t hash = strtoull(line + 2, 0, 16);
+		bool unchanged = is_unchanged(kind, line + 19, hash);
+		*line_end = '\n';
+		if (!unchanged) {
+			return 0;
+		}
+		line = line_end + 1;
+	}
+	if (line == end) {
+		return 0;
+	}
+	// The empty line.
+	line++;
+	size_t vm_header_length = strlen(WENDY_VM_HEADER) + 1;
+	if ((size_t)(end - line) <= vm_header_length ||
+		memcmp(line, WENDY_VM_HEADER, vm_header_length)) {
+		return 0;
+	}
+	return line - entry;
+}
+#endif
+
+uint8_t* cache_load(const char* source, size_t length, size_t* size) {
+#ifdef CACHE_SUPPORTED
+	char* path = entry_path(source, length, false);
+	if (!path) {
+		return 0;
+	}
+	FILE* f = fopen(path, "rb");
+	if (f) {
+		// The modification time is when the entry was last used.
+		utime(path, 0);
+	}
+	safe_free(path);
+	if (!f) {
+		return 0;
+	}
+	size_t entry_length;
+	char* entry = read_stream(f, &entry_length);
+	fclose(f);
+	uint8_t* bytecode = 0;
+	size_t start = bytecode_start(entry, entry_length);
+	if (start) {
+		*size = entry_length - start;
+		bytecode = safe_malloc(*size);
+		memcpy(bytecode, entry + start, *size);
+	}
+	safe_free(entry);
+	return bytecode;
+#else
+	UNUSED(source);
+	UNUSED(length);
+	UNUSED(size);
+	return 0;
+#endif
+}
+
+void cache_store(const char* source, size_t length, const uint8_t* bytecode,
+	size_t size) {
+#ifdef CACHE_SUPPORTED
+	char* path = bytecode && recording ? entry_path(source, length, true) : 0;
+	if (path) {
+		char* temporary = safe_malloc(strlen(path) + 32);
+		sprintf(temporary, "%s.%ld.tmp", path, (long)getpid());
+		FILE* f = fopen(temporary, "wb");
+		if (f) {
+			fputs(CACHE_HEADER, f);
+			for (size_t i = 0; i < dependencies_count; i++) {
+				fprintf(f, "%c %016" PRIx64 " %s\n",
+					dependencies[i].kind == CACHE_LIBRARY ? 'L' : 'F',
+					dependencies[i].hash, dependencies[i].name);
+			}
+			fputc('\n', f);
+			fwrite(bytecode, 1, size, f);
+			if (fclose(f) == 0 && rename(temporary, path) == 0) {
+				evict();
+			}
+			else {
+				remove(temporary);
+			}
+		}
+		safe_free(temporary);
+		safe_free(path);
+	}
+#else
+	UNUSED(source);
+	UNUSED(length);
+	UNUSED(bytecode);
+	UNUSED(size);
+#endif
+	stop_recording();
+}
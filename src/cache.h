@@ -0,0 +1,46 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// cache.h - Felix Guo
+// Keeps the bytecode of programs run from source files, so running a program
+//   whose source hasn't changed loads its bytecode instead of scanning,
+//   parsing and generating code again. Entries are files in $WENDY_CACHE, or
+//   ~/.cache/wendy, named by a FNV-1a hash of the source, the version of the
+//   interpreter and the flags that change the bytecode.
+// Imported files and compiled libraries are only known once the program is
+//   compiled, so each entry lists the ones it was compiled with and a hash
+//   of their contents, and is only used while all of them still match.
+// The directory is kept under a size limit by removing the entries that were
+//   used least recently.
+// Caching is only available on unix-like systems.
+
+// Where a dependency of a program came from.
+typedef enum {
+	CACHE_FILE,   // import "path", read by the [scanner]
+	CACHE_LIBRARY // import name, linked in by [codegen]
+} cache_dependency_kind;
+
+// cache_load(source, length, size) returns a copy of the cached bytecode of
+//   the source and sets size, or returns 0 if there's no usable entry.
+uint8_t* cache_load(const char* source, size_t length, size_t* size);
+
+// cache_begin() starts recording the dependencies of the program that is
+//   compiled next.
+void cache_begin(void);
+
+// cache_add_dependency(kind, name, contents, length) records that the program
+//   being compiled uses contents, read from the file or library name. Does
+//   nothing unless cache_begin() was called.
+void cache_add_dependency(cache_dependency_kind kind, const char* name,
+	const void* contents, size_t length);
+
+// cache_store(source, length, bytecode, size) stops recording and keeps the
+//   bytecode of the source with the dependencies recorded since
+//   cache_begin(). Nothing is kept if bytecode is 0.
+void cache_store(const char* source, size_t length, const uint8_t* bytecode,
+	size_t size);
+
+#endif
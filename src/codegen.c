@@ -8,11 +8,13 @@
 #include "source.h"
 #include "data.h"
 #include "imports.h"
+#include "state.h"
+#include "cache.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
-#define write_byte(op) do { bytecode[size++] = op; } while(0)
+#define write_byte(op) do { vm->codegen_bytecode[vm->codegen_size++] = op; } while(0)
 
 // Implementation of Wendy ByteCode Generator
 const char* opcode_string[] = {
@@ -20,11 +22,6 @@ const char* opcode_string[] = {
 	0 // Sentinal value used when traversing through this array; acts as a NULL
 };
 
-static uint8_t* bytecode = 0;
-static size_t capacity = 0;
-static size_t size = 0;
-static int global_loop_id = 0;
-
 int verify_header(uint8_t* bytecode) {
 	char* start = (char*)bytecode;
 	if (streq(WENDY_VM_HEADER, start)) {
@@ -37,10 +34,10 @@ int verify_header(uint8_t* bytecode) {
 }
 
 static void guarantee_size(size_t desired_additional) {
-	if (size + desired_additional + CODEGEN_PAD_SIZE > capacity) {
-		capacity += desired_additional + CODEGEN_PAD_SIZE;
-		uint8_t* re = safe_realloc(bytecode, capacity * sizeof(uint8_t));
-		bytecode = re;
+	if (vm->codegen_size + desired_additional + CODEGEN_PAD_SIZE > vm->codegen_capacity) {
+		vm->codegen_capacity += desired_additional + CODEGEN_PAD_SIZE;
+		uint8_t* re = safe_realloc(vm->codegen_bytecode, vm->codegen_capacity * sizeof(uint8_t));
+		vm->codegen_bytecode = re;
 	}
 }
 
@@ -57,12 +54,12 @@ static void write_string(char* string) {
 
 static void write_address(address a) {
 	guarantee_size(sizeof(address));
-	size_t pos = size;
+	size_t pos = vm->codegen_size;
 	if (!is_big_endian) pos += sizeof(a);
-	size += sizeof(a);
+	vm->codegen_size += sizeof(a);
 	uint8_t* first = (void*)&a;
 	for (size_t i = 0; i < sizeof(address); i++) {
-		bytecode[is_big_endian ? pos++ : --pos] = first[i];
+		vm->codegen_bytecode[is_big_endian ? pos++ : --pos] = first[i];
 	}
 }
 
@@ -70,7 +67,7 @@ static void write_address_at(address a, int pos) {
 	if (!is_big_endian) pos += sizeof(address);
 	uint8_t* first = (void*)&a;
 	for (size_t i = 0; i < sizeof(address); i++) {
-		bytecode[is_big_endian ? pos++ : --pos] = first[i];
+		vm->codegen_bytecode[is_big_endian ? pos++ : --pos] = first[i];
 	}
 }
 
@@ -78,18 +75,18 @@ static void write_double_at(double a, int pos) {
 	if (!is_big_endian) pos += sizeof(a);
 	uint8_t* p = (void*)&a;
 	for (size_t i = 0; i < sizeof(double); i++) {
-		bytecode[is_big_endian ? pos++ : --pos] = p[i];
+		vm->codegen_bytecode[is_big_endian ? pos++ : --pos] = p[i];
 	}
 }
 
 static void write_double(double a) {
 	guarantee_size(sizeof(double));
-	size_t pos = size;
+	size_t pos = vm->codegen_size;
 	if (!is_big_endian) pos += sizeof(a);
-	size += sizeof(double);
+	vm->codegen_size += sizeof(double);
 	uint8_t* p = (void*)&a;
 	for (size_t i = 0; i < sizeof(double); i++) {
-		bytecode[is_big_endian ? pos++ : --pos] = p[i];
+		vm->codegen_bytecode[is_big_endian ? pos++ : --pos] = p[i];
 	}
 }
 
@@ -207,6 +204,199 @@ static void codegen_expr_list_for_call(expr_list* list) {
 	codegen_expr_list_for_call_named(list);
 }
 
+// free_names collects the identifiers a function refers to without binding
+//   them as parameters, those are the variables its closure has to capture.
+typedef struct {
+	char** names;
+	size_t count;
+	size_t capacity;
+	bool capture_all;
+} free_names;
+
+static void collect_names_statement(statement* state, free_names* names);
+
+// add_free_name(names, name) adds name to the set if it's not there yet.
+static void add_free_name(free_names* names, char* name) {
+	for (size_t i = 0; i < names->count; i++) {
+		if (streq(names->names[i], name)) {
+			return;
+		}
+	}
+	if (names->count == names->capacity) {
+		names->capacity = names->capacity ? names->capacity * 2 : 8;
+		names->names = names->names
+			? safe_realloc(names->names, names->capacity * sizeof(char*))
+			: safe_malloc(names->capacity * sizeof(char*));
+	}
+	names->names[names->count++] = name;
+}
+
+static void collect_names_expr(expr* expression, free_names* names) {
+	if (!expression) return;
+	switch (expression->type) {
+		case E_LITERAL:
+			if (expression->op.lit_expr.type == D_IDENTIFIER) {
+				add_free_name(names, expression->op.lit_expr.value.string);
+			}
+			break;
+		case E_BINARY:
+			collect_names_expr(expression->op.bin_expr.left, names);
+			collect_names_expr(expression->op.bin_expr.right, names);
+			break;
+		case E_UNARY:
+			collect_names_expr(expression->op.una_expr.operand, names);
+			break;
+		case E_CALL:
+			collect_names_expr(expression->op.call_expr.function, names);
+			for (expr_list* a = expression->op.call_expr.arguments; a;
+					a = a->next) {
+				collect_names_expr(a->elem, names);
+			}
+			break;
+		case E_LIST:
+			for (expr_list* a = expression->op.list_expr.contents; a;
+					a = a->next) {
+				collect_names_expr(a->elem, names);
+			}
+			break;
+		case E_FUNCTION:
+			// A nested function is created in our frame, so whatever it
+			//   captures has to be captured by us first.
+			for (expr_list* a = expression->op.func_expr.parameters; a;
+					a = a->next) {
+				if (a->elem->type == E_ASSIGN) {
+					collect_names_expr(a->elem->op.assign_expr.rvalue, names);
+				}
+			}
+			collect_names_statement(expression->op.func_expr.body, names);
+			break;
+		case E_ASSIGN:
+			collect_names_expr(expression->op.assign_expr.lvalue, names);
+			collect_names_expr(expression->op.assign_expr.rvalue, names);
+			break;
+		case E_IF:
+			collect_names_expr(expression->op.if_expr.condition, names);
+			collect_names_expr(expression->op.if_expr.expr_true, names);
+			collect_names_expr(expression->op.if_expr.expr_false, names);
+			break;
+	}
+}
+
+static void collect_names_statement(statement* state, free_names* names) {
+	if (!state) return;
+	switch (state->type) {
+		case S_EXPR:
+			collect_names_expr(state->op.expr_statement, names);
+			break;
+		case S_OPERATION:
+			collect_names_expr(state->op.operation_statement.operand, names);
+			break;
+		case S_LET:
+			collect_names_expr(state->op.let_statement.rvalue, names);
+			break;
+		case S_STRUCT:
+			for (expr_list* a = state->op.struct_statement.static_members; a;
+					a = a->next) {
+				collect_names_expr(a->elem, names);
+			}
+			collect_names_expr(state->op.struct_statement.init_fn, names);
+			break;
+		case S_IF:
+			collect_names_expr(state->op.if_statement.condition, names);
+			collect_names_statement(state->op.if_statement.statement_true,
+				names);
+			collect_names_statement(state->op.if_statement.statement_false,
+				names);
+			break;
+		case S_BLOCK:
+			for (statement_list* s = state->op.block_statement; s;
+					s = s->next) {
+				collect_names_statement(s->elem, names);
+			}
+			break;
+		case S_LOOP:
+			collect_names_expr(state->op.loop_statement.condition, names);
+			collect_names_statement(state->op.loop_statement.statement_true,
+				names);
+			break;
+		case S_BYTECODE:
+			// Raw bytecode can look up any name.
+			names->capture_all = true;
+			break;
+		default:
+			break;
+	}
+}
+
+// yields(state) returns true if state has a yield statement, not counting
+//   those of the functions it defines, which makes the function whose body it
+//   is a generator.
+static bool yields(statement* state) {
+	if (!state) return false;
+	switch (state->type) {
+		case S_OPERATION:
+			return state->op.operation_statement.operator == OP_YIELD;
+		case S_IF:
+			return yields(state->op.if_statement.statement_true) ||
+				yields(state->op.if_statement.statement_false);
+		case S_BLOCK:
+			for (statement_list* s = state->op.block_statement; s;
+					s = s->next) {
+				if (yields(s->elem)) return true;
+			}
+			return false;
+		case S_LOOP:
+			return yields(state->op.loop_statement.statement_true);
+		default:
+			return false;
+	}
+}
+
+// codegen_closure(function) writes the OP_CLOSUR instruction for function,
+//   naming the variables its closure captures.
+static void codegen_closure(expr* function) {
+	free_names names = { 0, 0, 0, false };
+	collect_names_statement(function->op.func_expr.body, &names);
+	for (expr_list* p = function->op.func_expr.parameters; p; p = p->next) {
+		// Default values are evaluated inside the function.
+		if (p->elem->type == E_ASSIGN) {
+			collect_names_expr(p->elem->op.assign_expr.rvalue, &names);
+		}
+	}
+	// Parameters are bound by the call and shadow anything captured.
+	size_t count = 0;
+	for (size_t i = 0; i < names.count; i++) {
+		bool is_parameter = false;
+		for (expr_list* p = function->op.func_expr.parameters; p;
+				p = p->next) {
+			expr* param = p->elem->type == E_ASSIGN
+				? p->elem->op.assign_expr.lvalue : p->elem;
+			if (param->type == E_LITERAL &&
+				param->op.lit_expr.type == D_IDENTIFIER &&
+				streq(param->op.lit_expr.value.string, names.names[i])) {
+				is_parameter = true;
+				break;
+			}
+		}
+		if (!is_parameter) {
+			names.names[count++] = names.names[i];
+		}
+	}
+	write_opcode(OP_CLOSUR);
+	if (names.capture_all || count >= CLOSURE_CAPTURE_ALL) {
+		write_byte(CLOSURE_CAPTURE_ALL);
+	}
+	else {
+		write_byte(count);
+		for (size_t i = 0; i < count; i++) {
+			write_string(names.names[i]);
+		}
+	}
+	if (names.names) {
+		safe_free(names.names);
+	}
+}
+
 static void codegen_statement(void* expre) {
 	if (!expre) return;
 	statement* state = (statement*) expre;
@@ -225,6 +415,14 @@ static void codegen_statement(void* expre) {
 		if (state->op.operation_statement.operator == OP_RET) {
 			codegen_expr(state->op.operation_statement.operand);
 		}
+		else if (state->op.operation_statement.operator == OP_YIELD) {
+			if (!vm->codegen_yields) {
+				expr* operand = state->op.operation_statement.operand;
+				error_lexer(operand->line, operand->col,
+					CODEGEN_YIELD_OUTSIDE_FUNCTION);
+			}
+			codegen_expr(state->op.operation_statement.operand);
+		}
 		else if (state->op.operation_statement.operator == OP_OUTL) {
 			codegen_expr(state->op.operation_statement.operand);
 		}
@@ -255,39 +453,18 @@ static void codegen_statement(void* expre) {
 			add_imported_library(library_name);
 			write_opcode(OP_IMPORT);
 			write_string(library_name);
-			int jumpLoc = size;
-			size += sizeof(address);
-
-			// Could either be in local directory or in standard
-			// library location. Local directory prevails.
-			static char *extension = ".wc";
-			char *local_path = safe_malloc(strlen(library_name) +
-							   strlen(extension) + 1);
-			local_path[0] = 0;
-			strcat(local_path, library_name);
-			strcat(local_path, extension);
-			FILE *f = fopen(local_path, "r");
-			safe_free(local_path);
-			if (f) {
-				goto file_found;
-			}
-			// Not found, try standard library.
-			char* path = get_path();
-			long length = 0;
-			uint8_t* buffer;
-			strcat(path, "wendy-lib/");
-			strcat(path, library_name);
-			strcat(path, extension);
-			f = fopen(path, "r");
-			safe_free(path);
+			int jumpLoc = vm->codegen_size;
+			vm->codegen_size += sizeof(address);
+
+			FILE *f = open_library(library_name);
 			if (f) {
-			file_found:
 				fseek (f, 0, SEEK_END);
-				length = ftell(f);
+				long length = ftell(f);
 				fseek (f, 0, SEEK_SET);
-				buffer = safe_malloc(length);
-				fread (buffer, sizeof(uint8_t), length, f);
-				int offset = size - strlen(WENDY_VM_HEADER) - 1;
+				uint8_t* buffer = safe_malloc(length);
+				length = fread (buffer, sizeof(uint8_t), length, f);
+				cache_add_dependency(CACHE_LIBRARY, library_name, buffer, length);
+				int offset = vm->codegen_size - strlen(WENDY_VM_HEADER) - 1;
 				offset_addresses(buffer, length, offset);
 				guarantee_size(length);
 				for (long i = verify_header(buffer); i < length; i++) {
@@ -301,7 +478,7 @@ static void codegen_statement(void* expre) {
 				error_lexer(state->src_line, 0,
 							CODEGEN_REQ_FILE_READ_ERR);
 			}
-			write_address_at(size, jumpLoc);
+			write_address_at(vm->codegen_size, jumpLoc);
 		}
 	}
 	else if (state->type == S_STRUCT) {
@@ -310,7 +487,7 @@ static void codegen_statement(void* expre) {
 
 		// Push Header and Name
 		write_opcode(OP_PUSH);
-		int metaHeaderLoc = size;
+		int metaHeaderLoc = vm->codegen_size;
 		write_data(make_data(D_STRUCT_METADATA, data_value_num(1)));
 		write_opcode(OP_PUSH);
 		write_data(make_data(D_STRUCT_NAME, data_value_str(struct_name)));
@@ -364,23 +541,23 @@ static void codegen_statement(void* expre) {
 	else if (state->type == S_IF) {
 		codegen_expr(state->op.if_statement.condition);
 		write_opcode(OP_JIF);
-		int falseJumpLoc = size;
-		size += sizeof(address);
+		int falseJumpLoc = vm->codegen_size;
+		vm->codegen_size += sizeof(address);
 
 		write_opcode(OP_FRM);
 		codegen_statement(state->op.if_statement.statement_true);
 		write_opcode(OP_END);
 
 		write_opcode(OP_JMP);
-		int doneJumpLoc = size;
-		size += sizeof(address);
-		write_address_at(size, falseJumpLoc);
+		int doneJumpLoc = vm->codegen_size;
+		vm->codegen_size += sizeof(address);
+		write_address_at(vm->codegen_size, falseJumpLoc);
 
 		write_opcode(OP_FRM);
 		codegen_statement(state->op.if_statement.statement_false);
 		write_opcode(OP_END);
 
-		write_address_at(size, doneJumpLoc);
+		write_address_at(vm->codegen_size, doneJumpLoc);
 	}
 	else if (state->type == S_LOOP) {
 		// Setup Loop Index
@@ -390,7 +567,7 @@ static void codegen_statement(void* expre) {
 		write_data(make_data(D_NUMBER, data_value_num(0)));
 		write_opcode(OP_RBW);
 		char loopIndexName[30];
-		sprintf(loopIndexName, LOOP_COUNTER_PREFIX "%d", global_loop_id++);
+		sprintf(loopIndexName, LOOP_COUNTER_PREFIX "%d", vm->global_loop_id++);
 		write_string(loopIndexName);
 
 		if (state->op.loop_statement.index_var) {
@@ -402,13 +579,27 @@ static void codegen_statement(void* expre) {
 		}
 
 		// Start of Loop, Push Condition to Stack
-		int loop_start_addr = size;
+		int loop_start_addr = vm->codegen_size;
+		int condition_skip_loc = -1;
+		if (state->op.loop_statement.index_var) {
+			// A generator is evaluated once, later iterations resume it.
+			write_opcode(OP_LGEN);
+			condition_skip_loc = vm->codegen_size;
+			vm->codegen_size += sizeof(address);
+			char generatorName[sizeof(loopIndexName) +
+				sizeof(LOOP_GENERATOR_SUFFIX)];
+			sprintf(generatorName, "%s" LOOP_GENERATOR_SUFFIX, loopIndexName);
+			write_string(generatorName);
+		}
 		codegen_expr(state->op.loop_statement.condition);
+		if (condition_skip_loc >= 0) {
+			write_address_at(vm->codegen_size, condition_skip_loc);
+		}
 
 		// Check Condition and Jump if Needed
 		write_opcode(OP_LJMP);
-		int loop_skip_loc = size;
-		size += sizeof(address);
+		int loop_skip_loc = vm->codegen_size;
+		vm->codegen_size += sizeof(address);
 		write_string(loopIndexName);
 
 		write_opcode(OP_FRM); // Start Local Variable Frame
@@ -440,7 +631,7 @@ static void codegen_statement(void* expre) {
 		write_address(loop_start_addr);
 
 		// Write End of Loop
-		write_address_at(size, loop_skip_loc);
+		write_address_at(vm->codegen_size, loop_skip_loc);
 		write_opcode(OP_END);
 	}
 	else if (state->type == S_BYTECODE) {
@@ -577,13 +768,13 @@ static void codegen_expr(void* expre) {
 	else if (expression->type == E_IF) {
 		codegen_expr(expression->op.if_expr.condition);
 		write_opcode(OP_JIF);
-		int falseJumpLoc = size;
-		size += sizeof(address);
+		int falseJumpLoc = vm->codegen_size;
+		vm->codegen_size += sizeof(address);
 		codegen_expr(expression->op.if_expr.expr_true);
 		write_opcode(OP_JMP);
-		int doneJumpLoc = size;
-		size += sizeof(address);
-		write_address_at(size, falseJumpLoc);
+		int doneJumpLoc = vm->codegen_size;
+		vm->codegen_size += sizeof(address);
+		write_address_at(vm->codegen_size, falseJumpLoc);
 		if (expression->op.if_expr.expr_false) {
 			codegen_expr(expression->op.if_expr.expr_false);
 		}
@@ -591,13 +782,20 @@ static void codegen_expr(void* expre) {
 			write_opcode(OP_PUSH);
 			write_data(none_data());
 		}
-		write_address_at(size, doneJumpLoc);
+		write_address_at(vm->codegen_size, doneJumpLoc);
 	}
 	else if (expression->type == E_ASSIGN) {
         enum operator op = expression->op.assign_expr.operator;
 		codegen_expr(expression->op.assign_expr.rvalue);
 
 		codegen_lvalue_expr(expression->op.assign_expr.lvalue);
+		int appendJumpLoc = -1;
+		if (op == O_ADD) {
+			// Strings are appended to in place, skipping the generic path.
+			write_opcode(OP_APPEND);
+			appendJumpLoc = vm->codegen_size;
+			vm->codegen_size += sizeof(address);
+		}
         // O_ASSIGN is the default =
 		if (op != O_ASSIGN) {
 			write_opcode(OP_READ);
@@ -607,6 +805,9 @@ static void codegen_expr(void* expre) {
 		// Memory Register should still be where lvalue is
 		write_opcode(OP_WRITE);
 		write_byte(1);
+		if (appendJumpLoc >= 0) {
+			write_address_at(vm->codegen_size, appendJumpLoc);
+		}
 	}
 	else if (expression->type == E_UNARY) {
 		codegen_expr(expression->op.una_expr.operand);
@@ -637,9 +838,9 @@ static void codegen_expr(void* expre) {
 	}
 	else if (expression->type == E_FUNCTION) {
 		write_opcode(OP_JMP);
-		int writeSizeLoc = size;
-		size += sizeof(address);
-		int startAddr = size;
+		int writeSizeLoc = vm->codegen_size;
+		vm->codegen_size += sizeof(address);
+		int startAddr = vm->codegen_size;
 		if (expression->op.func_expr.is_native) {
 			write_opcode(OP_NATIVE);
 			int count = 0;
@@ -692,6 +893,12 @@ static void codegen_expr(void* expre) {
 			}
 			// Process named arguments.
 			write_opcode(OP_ARGCLN);
+			bool enclosing_yields = vm->codegen_yields;
+			vm->codegen_yields = yields(expression->op.func_expr.body);
+			if (vm->codegen_yields) {
+				// The body runs when the generator is advanced.
+				write_opcode(OP_GEN);
+			}
 			if (expression->op.func_expr.body &&
 				expression->op.func_expr.body->type == S_EXPR) {
 				codegen_expr(expression->op.func_expr.body->op.expr_statement);
@@ -699,18 +906,25 @@ static void codegen_expr(void* expre) {
 			}
 			else {
 				codegen_statement(expression->op.func_expr.body);
-				if (bytecode[size - 1] != OP_RET) {
+				if (vm->codegen_bytecode[vm->codegen_size - 1] != OP_RET) {
 					// Function has no explicit Return
 					write_opcode(OP_PUSH);
 					write_data(noneret_data());
 					write_opcode(OP_RET);
 				}
 			}
+			vm->codegen_yields = enclosing_yields;
 		}
-		write_address_at(size, writeSizeLoc);
+		write_address_at(vm->codegen_size, writeSizeLoc);
 		write_opcode(OP_PUSH);
 		write_data(make_data(D_ADDRESS, data_value_num(startAddr)));
-		write_opcode(OP_CLOSUR);
+		if (expression->op.func_expr.is_native) {
+			write_opcode(OP_CLOSUR);
+			write_byte(0);
+		}
+		else {
+			codegen_closure(expression);
+		}
 		write_opcode(OP_PUSH);
 		write_data(make_data(D_STRING, data_value_str("self")));
 		write_opcode(OP_REQ);
@@ -722,10 +936,34 @@ static void codegen_expr(void* expre) {
 	}
 }
 
+FILE* open_library(const char* name) {
+	// Could either be in local directory or in standard
+	// library location. Local directory prevails.
+	static char *extension = ".wc";
+	char *local_path = safe_malloc(strlen(name) + strlen(extension) + 1);
+	local_path[0] = 0;
+	strcat(local_path, name);
+	strcat(local_path, extension);
+	FILE *f = fopen(local_path, "r");
+	safe_free(local_path);
+	if (f) {
+		return f;
+	}
+	// Not found, try standard library.
+	char* path = get_path();
+	strcat(path, "wendy-lib/");
+	strcat(path, name);
+	strcat(path, extension);
+	f = fopen(path, "r");
+	safe_free(path);
+	return f;
+}
+
 uint8_t* generate_code(statement_list* _ast, size_t* size_ptr) {
-	capacity = CODEGEN_START_SIZE;
-	bytecode = safe_malloc(capacity * sizeof(uint8_t));
-	size = 0;
+	vm->codegen_capacity = CODEGEN_START_SIZE;
+	vm->codegen_bytecode = safe_malloc(vm->codegen_capacity * sizeof(uint8_t));
+	vm->codegen_size = 0;
+	vm->codegen_yields = false;
 	if (!get_settings_flag(SETTINGS_REPL)) {
 		write_string(WENDY_VM_HEADER);
 	}
@@ -733,8 +971,8 @@ uint8_t* generate_code(statement_list* _ast, size_t* size_ptr) {
 	codegen_statement_list(_ast);
 	free_imported_libraries_ll();
 	write_opcode(OP_HALT);
-	*size_ptr = size;
-	return bytecode;
+	*size_ptr = vm->codegen_size;
+	return vm->codegen_bytecode;
 }
 
 // CANNOT FREE OR DESTROY THIS ONE!
@@ -761,7 +999,7 @@ data get_data(uint8_t* bytecode, unsigned int* end) {
 }
 
 void write_bytecode(uint8_t* bytecode, FILE* buffer) {
-	fwrite(bytecode, sizeof(uint8_t), size, buffer);
+	fwrite(bytecode, sizeof(uint8_t), vm->codegen_size, buffer);
 }
 
 char* get_string(uint8_t* bytecode, unsigned int* end) {
@@ -817,6 +1055,11 @@ void print_bytecode(uint8_t* bytecode, FILE* buffer) {
 			operator o = bytecode[i++];
 			p += fprintf(buffer, "%s", operator_string[o]);
 		}
+		else if (is_quickened_opcode(op)) {
+			uint8_t o = bytecode[i++];
+			p += fprintf(buffer, "%s%s", operator_string[o & ~QUICKENED_REVERSED],
+				(o & QUICKENED_REVERSED) ? " (r)" : "");
+		}
 		else if (op == OP_BIND || op == OP_WHERE || op == OP_RBW ||
 				 op == OP_IMPORT || op == OP_MEMPTR) {
 			char* c = get_string(bytecode + i, &i);
@@ -841,10 +1084,10 @@ void print_bytecode(uint8_t* bytecode, FILE* buffer) {
 			p += fprintf(buffer, "%d", a);
 			printSourceLine = a;
 		}
-		else if (op == OP_JMP || op == OP_JIF) {
+		else if (op == OP_JMP || op == OP_JIF || op == OP_APPEND) {
 			p += fprintf(buffer, "0x%X", get_address(bytecode + i, &i));
 		}
-		else if (op == OP_LJMP) {
+		else if (op == OP_LJMP || op == OP_LGEN) {
 			p += fprintf(buffer, "0x%X ",
 				get_address(bytecode + i + baseaddr, &i));
 			char* c = get_string(bytecode + i, &i);
@@ -864,6 +1107,18 @@ void print_bytecode(uint8_t* bytecode, FILE* buffer) {
 			char* c = get_string(bytecode + i, &i);
 			p += fprintf(buffer, "%.*s", max_len, c);
 		}
+		else if (op == OP_CLOSUR) {
+			size_t count = bytecode[i++];
+			if (count == CLOSURE_CAPTURE_ALL) {
+				p += fprintf(buffer, "*");
+			}
+			else {
+				for (size_t n = 0; n < count; n++) {
+					char* c = get_string(bytecode + i, &i);
+					p += fprintf(buffer, "%.*s ", max_len, c);
+				}
+			}
+		}
 		while (p++ < 30) {
 			fprintf(buffer, " ");
 		}
@@ -940,13 +1195,13 @@ void offset_addresses(uint8_t* buffer, size_t length, int offset) {
 		else if (op == OP_SRC) {
 			get_address(buffer + i, &i);
 		}
-		else if (op == OP_JMP || op == OP_JIF) {
+		else if (op == OP_JMP || op == OP_JIF || op == OP_APPEND) {
 			unsigned int bi = i;
 			address loc = get_address(buffer + i, &i);
 			loc += offset;
 			write_address_at_buffer(loc, buffer, bi);
 		}
-		else if (op == OP_LJMP) {
+		else if (op == OP_LJMP || op == OP_LGEN) {
 			unsigned int bi = i;
 			address loc = get_address(buffer + i, &i);
 			loc += offset;
@@ -965,9 +1220,12 @@ void offset_addresses(uint8_t* buffer, size_t length, int offset) {
 			get_address(buffer + i, &i);
 			get_string(buffer + i, &i);
 		}
+		else if (op == OP_CLOSUR) {
+			i = next_instruction(buffer, i - 1);
+		}
 		else if (op == OP_REQ || op == OP_MKPTR ||
 				 op == OP_BIN || op == OP_UNA || op == OP_RBIN ||
-				 op == OP_WRITE) {
+				 op == OP_WRITE || is_quickened_opcode(op)) {
 			i++;
 		}
 		if (op == OP_HALT) {
@@ -975,3 +1233,57 @@ void offset_addresses(uint8_t* buffer, size_t length, int offset) {
 		}
 	}
 }
+
+unsigned int next_instruction(uint8_t* bytecode, unsigned int i) {
+	opcode op = bytecode[i++];
+	switch (op) {
+		case OP_PUSH:
+			get_data(bytecode + i, &i);
+			break;
+		case OP_BIND: case OP_WHERE: case OP_RBW: case OP_MEMPTR:
+			get_string(bytecode + i, &i);
+			break;
+		case OP_IMPORT:
+			get_string(bytecode + i, &i);
+			get_address(bytecode + i, &i);
+			break;
+		case OP_SRC: case OP_JMP: case OP_JIF: case OP_APPEND:
+			get_address(bytecode + i, &i);
+			break;
+		case OP_LJMP: case OP_LGEN:
+			get_address(bytecode + i, &i);
+			get_string(bytecode + i, &i);
+			break;
+		case OP_LBIND:
+			get_string(bytecode + i, &i);
+			get_string(bytecode + i, &i);
+			break;
+		case OP_ASSERT:
+			i++;
+			get_string(bytecode + i, &i);
+			break;
+		case OP_NATIVE:
+			get_address(bytecode + i, &i);
+			get_string(bytecode + i, &i);
+			break;
+		case OP_CLOSUR: {
+			size_t count = bytecode[i++];
+			if (count != CLOSURE_CAPTURE_ALL) {
+				for (size_t n = 0; n < count; n++) {
+					get_string(bytecode + i, &i);
+				}
+			}
+			break;
+		}
+		case OP_REQ: case OP_MKPTR: case OP_BIN: case OP_UNA: case OP_RBIN:
+		case OP_WRITE:
+			i++;
+			break;
+		default:
+			if (is_quickened_opcode(op)) {
+				i++;
+			}
+			break;
+	}
+	return i;
+}
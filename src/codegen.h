@@ -90,8 +90,10 @@
 //                               data register
 // 0x1D |-DOUT   |           | moves data from data register to top of the
 //                               stack
-// 0x1E | CLOSUR |           | binds a closure, pushes a closure to the top of
-//                               the stack.
+// 0x1E | CLOSUR | [byte]    | binds a closure, pushes a closure to the top of
+//                 [string]* |   the stack. Only variables named by the [byte]
+//                               strings are captured, or all of them if [byte]
+//                               is CLOSURE_CAPTURE_ALL.
 // 0x1F | RBIN   | [op]      | reverse binary operator, b OP a
 // 0x20 | RBW    | [string]  | REQ-BIND-WRITE, requests 1, binds string
 //   `- if top of stack is END_OF_ARGUMENTs or NAMED_ARGUMENT, we don't write
@@ -104,6 +106,31 @@
 //               | [address] |   jumps if already imported
 // 0x26 | ARGCLN |           | cleans up all arguments up to END_OF_ARGUMENTS,
 //                           |   assigning all NAMED_ARGUMENTS
+// 0x27 | ADDNN  | [op]      | quickened forms of BIN and RBIN, never emitted
+// 0x28 | SUBNN  | [op]      |   by the code generator. The VM rewrites a BIN
+// 0x29 | MULNN  | [op]      |   or RBIN in place once it has seen the same
+// 0x2A | DIVNN  | [op]      |   operand types a few times. Each form checks
+// 0x2B | LTNN   | [op]      |   that both operands are numbers (CATSS:
+// 0x2C | GTNN   | [op]      |   strings) and that no operator overload was
+// 0x2D | LTENN  | [op]      |   bound since it was quickened; otherwise the
+// 0x2E | GTENN  | [op]      |   site is rewritten back to BIN/RBIN. [op] is
+// 0x2F | EQNN   | [op]      |   the original operator, with the high bit
+// 0x30 | NEQNN  | [op]      |   (QUICKENED_REVERSED) set if it was an RBIN.
+// 0x31 | CATSS  | [op]      |
+// 0x32 | APPEND | [address] | (...) (a) -> (...)
+//   `- if $MR is a string and a is a string or number, appends a to it in
+//      place and jumps to address. Otherwise does nothing, codegen follows it
+//      with READ RBIN(+) WRITE(1) to perform the generic +=.
+// 0x33 | GEN    |           | (...) -> (...) [generator]
+//   `- first instruction of a function that yields, after ARGCLN. Suspends
+//      the frame as a new generator and returns it to the caller.
+// 0x34 | YIELD  |           | (...) (a) -> (...)
+//   `- suspends the running generator, handing a to the code advancing it.
+// 0x35 | LGEN   | [address] | (...) -> (...) [generator]
+//                 [string]  |   starts a loop iteration: if the last variable
+//                               is [string], the generator the loop iterates
+//                               is pushed and the condition skipped by jumping
+//                               to [address], LJMP binds it on the first pass.
 
 // Forward Declaration
 typedef struct statement_list statement_list;
@@ -113,7 +140,11 @@ typedef enum opcode {
 	OP_OUT, OP_OUTL, OP_IN, OP_MKPTR, OP_RANGE, OP_READ, OP_WRITE, OP_JMP,
 	OP_JIF, OP_FRM, OP_END, OP_LJMP, OP_LBIND, OP_INC, OP_DEC, OP_NTHPTR,
 	OP_MEMPTR, OP_ASSERT, OP_MPTR, OP_CLOSUR, OP_RBIN,
-	OP_RBW, OP_HALT, OP_SRC, OP_NATIVE, OP_IMPORT, OP_ARGCLN }
+	OP_RBW, OP_HALT, OP_SRC, OP_NATIVE, OP_IMPORT, OP_ARGCLN,
+	OP_ADDNN, OP_SUBNN, OP_MULNN, OP_DIVNN, OP_LTNN, OP_GTNN, OP_LTENN,
+	OP_GTENN, OP_EQNN, OP_NEQNN, OP_CATSS, OP_APPEND, OP_GEN, OP_YIELD,
+	OP_LGEN,
+	OPCODE_COUNT }
 	opcode;
 
 #define OPCODE_STRING \
@@ -121,7 +152,21 @@ typedef enum opcode {
 	"where", "out", "outl", "in", "mkptr", "range", "read", "write", "jmp",\
 	"jif", "frm", "end", "ljmp", "lbind", "inc", "dec", "nthptr",\
 	"memptr", "assert", "mptr", "closur", "rbin", "rbw",\
-	"halt", "src", "native", "import", "argcln"
+	"halt", "src", "native", "import", "argcln",\
+	"addnn", "subnn", "mulnn", "divnn", "ltnn", "gtnn", "ltenn",\
+	"gtenn", "eqnn", "neqnn", "catss", "append", "gen",\
+	"yield", "lgen"
+
+// Quickened binary opcodes occupy a contiguous block so they can be
+//   recognized with a range check.
+#define is_quickened_opcode(op) ((op) >= OP_ADDNN && (op) <= OP_CATSS)
+
+// Set on the operator byte of a quickened instruction that replaced an RBIN.
+#define QUICKENED_REVERSED 0x80
+
+// Operand of OP_CLOSUR for functions whose free variables can't be determined
+//   at compile time, every variable in the frame is captured instead.
+#define CLOSURE_CAPTURE_ALL 0xFF
 
 extern const char* opcode_string[];
 
@@ -138,6 +183,10 @@ void print_bytecode(uint8_t* bytecode, FILE* buffer);
 //   that require an address by the given offset
 void offset_addresses(uint8_t* buffer, size_t length, int offset);
 
+// open_library(name) opens the compiled library name, from the working
+//   directory or else the standard library, returns 0 if there's neither
+FILE* open_library(const char* name);
+
 // write_bytecode(bytecode, buffer) writes the bytecode into binary file
 void write_bytecode(uint8_t* bytecode, FILE* buffer);
 
@@ -152,6 +201,10 @@ address get_address(uint8_t* bytecode, unsigned int* end);
 //   advances end to the byte after the string
 char *get_string(uint8_t *bytecode, unsigned int *end);
 
+// next_instruction(bytecode, i) returns the address of the instruction
+//   that follows the one at address i
+unsigned int next_instruction(uint8_t* bytecode, unsigned int i);
+
 // verify_header(bytecode) checks the header for information,
 //   then returns the index of the first opcode instruction
 int verify_header(uint8_t* bytecode);
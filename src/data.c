@@ -2,8 +2,11 @@
 #include "global.h"
 #include "memory.h"
 #include "time.h"
+#include "dtoa.h"
+#include "state.h"
 #include <string.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <time.h>
 
 // Implementation for Data Model
@@ -19,6 +22,22 @@ data make_data(data_type type, data_value value) {
 }
 
 data copy_data(data d) {
+	if (d.type == D_STRING_BUFFER) {
+		string_buffer* b = string_buffer_of(&d);
+		size_t size = sizeof(string_buffer) + b->capacity;
+		data copy = make_data(D_STRING_BUFFER, d.value);
+		copy.value.string = safe_malloc(size);
+		memcpy(copy.value.string, b, size);
+		return copy;
+	}
+	if (d.type == D_F64ARRAY) {
+		f64_array_of(&d)->references++;
+		return d;
+	}
+	if (d.type == D_LIST_VIEW) {
+		list_view_of(&d)->references++;
+		return d;
+	}
 	if (is_numeric(d)) {
 		return make_data(d.type, data_value_num(d.value.number));
 	}
@@ -35,6 +54,26 @@ bool data_equal(data* a, data* b) {
 		if (is_numeric(*a)) {
 			return a->value.number == b->value.number;
 		}
+		else if (a->type == D_STRING_BUFFER) {
+			return streq(string_buffer_of(a)->chars, string_buffer_of(b)->chars);
+		}
+		else if (a->type == D_F64ARRAY) {
+			f64_array* x = f64_array_of(a);
+			f64_array* y = f64_array_of(b);
+			if (x->length != y->length) {
+				return false;
+			}
+			for (size_t i = 0; i < x->length; i++) {
+				if (x->values[i] != y->values[i]) {
+					return false;
+				}
+			}
+			return true;
+		}
+		else if (a->type == D_LIST_VIEW) {
+			// Like lists, views are only equal to the same view.
+			return a->value.string == b->value.string;
+		}
 		else {
 			return streq(a->value.string, b->value.string);
 		}
@@ -42,7 +81,26 @@ bool data_equal(data* a, data* b) {
 }
 
 void destroy_data(data* d) {
-	if (!is_numeric(*d)) {
+	if (d->type == D_F64ARRAY) {
+		if (--f64_array_of(d)->references == 0) {
+			safe_free(d->value.string);
+		}
+	}
+	else if (d->type == D_LIST_VIEW) {
+		list_view* v = list_view_of(d);
+		if (--v->references == 0) {
+			if (!v->owner) {
+				if (v->previous) v->previous->next = v->next;
+				else vm->list_views = v->next;
+				if (v->next) v->next->previous = v->previous;
+			}
+			safe_free(v);
+		}
+	}
+	else if (!is_numeric(*d)) {
+		if (d->value.string == vm->append_string) {
+			vm->append_string = 0;
+		}
 		safe_free(d->value.string);
 	}
 	d->type = D_EMPTY;
@@ -68,10 +126,11 @@ data_value data_value_num(double num) {
 
 bool is_numeric(data t) {
 	return t.type == D_NUMBER || t.type == D_ADDRESS || t.type == D_LIST ||
-		t.type == D_LIST_HEADER || t.type == D_STRUCT || t.type == D_FUNCTION ||
+		t.type == D_LIST_HEADER || t.type == D_SHARED_LIST_HEADER ||
+		t.type == D_STRUCT || t.type == D_FUNCTION ||
 		t.type == D_STRUCT_METADATA || t.type == D_STRUCT_INSTANCE ||
 		t.type == D_STRUCT_INSTANCE_HEAD || t.type == D_STRUCT_FUNCTION ||
-		t.type == D_CLOSURE ||
+		t.type == D_CLOSURE || t.type == D_ITERATOR || t.type == D_GENERATOR ||
 		t.type == D_EMPTY || t.type == D_INTERNAL_POINTER || t.type == D_END_OF_ARGUMENTS;
 }
 
@@ -128,6 +187,97 @@ int range_end(data r) {
 	return end;
 }
 
+// Capacity of a new string buffer, not counting the null terminator.
+#define STRING_BUFFER_INITIAL_CAPACITY 16
+
+data string_buffer_data(void) {
+	data d = make_data(D_STRING_BUFFER, data_value_num(0));
+	string_buffer* b = safe_malloc(sizeof(string_buffer) +
+		STRING_BUFFER_INITIAL_CAPACITY + 1);
+	b->length = 0;
+	b->capacity = STRING_BUFFER_INITIAL_CAPACITY;
+	b->chars[0] = 0;
+	d.value.string = (char*)b;
+	return d;
+}
+
+string_buffer* string_buffer_of(const data* d) {
+	return (string_buffer*)d->value.string;
+}
+
+void string_buffer_append(data* d, const char* s, size_t length) {
+	string_buffer* b = string_buffer_of(d);
+	if (b->length + length > b->capacity) {
+		size_t capacity = b->capacity * 2;
+		while (capacity < b->length + length) {
+			capacity *= 2;
+		}
+		b = safe_realloc(b, sizeof(string_buffer) + capacity + 1);
+		b->capacity = capacity;
+		d->value.string = (char*)b;
+	}
+	memcpy(b->chars + b->length, s, length);
+	b->length += length;
+	b->chars[b->length] = 0;
+}
+
+data f64_array_data(size_t length) {
+	data d = make_data(D_F64ARRAY, data_value_num(0));
+	f64_array* a = safe_malloc(sizeof(f64_array) + length * sizeof(double));
+	a->references = 1;
+	a->length = length;
+	d.value.string = (char*)a;
+	return d;
+}
+
+f64_array* f64_array_of(const data* d) {
+	return (f64_array*)d->value.string;
+}
+
+data list_view_data(unsigned int list, int start, int end) {
+	data d = make_data(D_LIST_VIEW, data_value_num(0));
+	list_view* v = safe_malloc(sizeof(list_view));
+	v->references = 1;
+	v->list = list;
+	v->start = start;
+	v->end = end;
+	v->owner = false;
+	v->previous = 0;
+	v->next = vm->list_views;
+	if (vm->list_views) {
+		vm->list_views->previous = v;
+	}
+	vm->list_views = v;
+	vm->memory[list].type = D_SHARED_LIST_HEADER;
+	d.value.string = (char*)v;
+	return d;
+}
+
+list_view* list_view_of(const data* d) {
+	return (list_view*)d->value.string;
+}
+
+bool is_list(const data* d) {
+	return d->type == D_LIST || d->type == D_LIST_VIEW;
+}
+
+int list_size(const data* d) {
+	if (d->type == D_LIST_VIEW) {
+		list_view* v = list_view_of(d);
+		return abs(v->end - v->start);
+	}
+	return vm->memory[(address)d->value.number].value.number;
+}
+
+data* list_element(const data* d, int i) {
+	if (d->type == D_LIST_VIEW) {
+		list_view* v = list_view_of(d);
+		int index = v->start < v->end ? v->start + i : v->start - i;
+		return &vm->memory[v->list + index + 1];
+	}
+	return &vm->memory[(address)d->value.number + i + 1];
+}
+
 data list_header_data(int size) {
 	data res = make_data(D_LIST_HEADER, data_value_num(size));
 	return res;
@@ -136,8 +286,7 @@ data list_header_data(int size) {
 void print_data(const data* t) {
 	print_data_inline(t, stdout);
 	printf("\n");
-	last_printed_newline = true;
-	fflush(stdout);
+	vm->last_printed_newline = true;
 }
 
 unsigned int print_data_inline(const data* t, FILE* buf) {
@@ -157,27 +306,32 @@ unsigned int print_data_inline(const data* t, FILE* buf) {
 	else if (t->type == D_END_OF_ARGUMENTS) {
 		p += fprintf(buf, "<eoargs>");
 	}
+	else if (t->type == D_ITERATOR) {
+		p += fprintf(buf, "<iterator>");
+	}
+	else if (t->type == D_GENERATOR) {
+		p += fprintf(buf, "<generator>");
+	}
 	else if (t->type == D_STRUCT_INSTANCE) {
-		data instance_loc = memory[(int)(t->value.number)];
+		data instance_loc = vm->memory[(int)(t->value.number)];
 		p += fprintf(buf, "<struct:%s>",
-				memory[(int)instance_loc.value.number + 1].value.string);
+				vm->memory[(int)instance_loc.value.number + 1].value.string);
 	}
 	else if (t->type == D_RANGE) {
 		p += fprintf(buf, "<range from %d to %d>", range_start(*t), range_end(*t));
 	}
-	else if (t->type == D_LIST_HEADER) {
+	else if (t->type == D_LIST_HEADER || t->type == D_SHARED_LIST_HEADER) {
 		p += fprintf(buf, "<lhd size %d>", (int)(t->value.number));
 	}
 	else if (t->type == D_STRUCT_METADATA) {
 		p += fprintf(buf, "<meta size %d>", (int)(t->value.number));
 	}
-	else if (t->type == D_LIST) {
-		address start = t->value.number;
-		data l_header = memory[start];
+	else if (is_list(t)) {
+		int size = list_size(t);
 		p += fprintf(buf, "[");
-		for (int i = 0; i < l_header.value.number; i++) {
+		for (int i = 0; i < size; i++) {
 			if (i != 0) p += fprintf(buf, ", ");
-			p += print_data_inline(&memory[start + i + 1], buf);
+			p += print_data_inline(list_element(t, i), buf);
 		}
 		p += fprintf(buf, "]");
 	}
@@ -185,19 +339,27 @@ unsigned int print_data_inline(const data* t, FILE* buf) {
 		p += fprintf(buf, "named: %s", t->value.string);
 	}
 	else if (t->type == D_NUMBER) {
-		size_t len = snprintf(0, 0, "%f", t->value.number);
-		char* buffer = safe_malloc(len + 1);
-		snprintf(buffer, len + 1, "%f", t->value.number);
-		len--;
-		while (buffer[len] == '0') {
-			buffer[len--] = 0;
-		}
-		if (buffer[len] == '.') {
-			buffer[len--] = 0;
+		char buffer[NUMBER_BUFFER_SIZE];
+		size_t len = format_number(t->value.number, buffer);
+		fwrite(buffer, 1, len, buf);
+		p += len;
+	}
+	else if (t->type == D_STRING_BUFFER) {
+		string_buffer* b = string_buffer_of(t);
+		fwrite(b->chars, 1, b->length, buf);
+		p += b->length;
+	}
+	else if (t->type == D_F64ARRAY) {
+		f64_array* a = f64_array_of(t);
+		char buffer[NUMBER_BUFFER_SIZE];
+		p += fprintf(buf, "f64[");
+		for (size_t i = 0; i < a->length; i++) {
+			if (i != 0) p += fprintf(buf, ", ");
+			size_t len = format_number(a->values[i], buffer);
+			fwrite(buffer, 1, len, buf);
+			p += len;
 		}
-
-		p += fprintf(buf, "%s", buffer);
-		safe_free(buffer);
+		p += fprintf(buf, "]");
 	}
 	else if (is_numeric(*t)) {
 		p += fprintf(buf, "[%s] 0x%X", data_string[t->type],
@@ -206,8 +368,7 @@ unsigned int print_data_inline(const data* t, FILE* buf) {
 	else {
 		p += fprintf(buf, "%s", t->value.string);
 	}
-	last_printed_newline = false;
-	fflush(buf);
+	vm->last_printed_newline = false;
 	return p;
 }
 
@@ -238,6 +399,7 @@ data literal_to_data(token literal) {
 	if (literal.t_type == T_NUMBER) {
 		return make_data(D_NUMBER, data_value_num(literal.t_data.number));
 	}
-	return make_data(literal_type_to_data_type(literal.t_type),
-		data_value_str(literal.t_data.string));
+	data_value value;
+	value.string = literal.t_data.string;
+	return make_data(literal_type_to_data_type(literal.t_type), value);
 }
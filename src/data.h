@@ -37,7 +37,13 @@
 	OP(D_MEMBER_IDENTIFIER) \
 	OP(D_NAMED_ARGUMENT_NAME) /* For named arguments */ \
 	OP(D_END_OF_ARGUMENTS) \
-	OP(D_ANY) // No way for client to construct this, can only have a type <any>
+	OP(D_ANY) /* No way for client to construct this, can only have a type <any> */ \
+	OP(D_STRING_BUFFER) /* Growable string owned by a StringBuilder */ \
+	OP(D_ITERATOR) /* Lines of the open file whose handle is the value */ \
+	OP(D_F64ARRAY) /* Contiguous doubles, shared until the last copy is gone */ \
+	OP(D_GENERATOR) /* Suspended function whose handle is the value */ \
+	OP(D_LIST_VIEW) /* Slice of a list that shares the list's elements */ \
+	OP(D_SHARED_LIST_HEADER) /* Header of a list that views share */
 
 typedef enum {
 	FOREACH_DATA(ENUM)
@@ -55,6 +61,40 @@ typedef struct {
 	data_value value;
 } data;
 
+// The string of a D_STRING_BUFFER points to this block, which keeps the
+//   length and capacity so appending doesn't need to scan or copy the chars.
+typedef struct {
+	size_t length;
+	size_t capacity;
+	char chars[];
+} string_buffer;
+
+// The string of a D_F64ARRAY points to this block. Arrays are never changed
+//   once made, so copies of the data share the block and count references
+//   instead of copying every element.
+typedef struct {
+	size_t references;
+	size_t length;
+	double values[];
+} f64_array;
+
+// The string of a D_LIST_VIEW points to this block. A view is the elements
+//   of the list at address list in the order of the range start->end, which
+//   is how it was sliced. Copies of the view share the block and count
+//   references like f64 arrays do. Until either side is changed the list
+//   keeps a D_SHARED_LIST_HEADER and the view is linked into the views of
+//   the interpreter, see unshare_list().
+typedef struct list_view {
+	size_t references;
+	unsigned int list;
+	int start;
+	int end;
+	// Whether list is a copy only the view uses, made when it was changed.
+	bool owner;
+	struct list_view* previous;
+	struct list_view* next;
+} list_view;
+
 data make_data(data_type type, data_value value);
 data copy_data(data d);
 void destroy_data(data* d);
@@ -77,7 +117,43 @@ data list_header_data(int size);
 void print_data(const data *t);
 bool data_equal(data *a, data *b);
 
+// string_buffer_data() returns an empty D_STRING_BUFFER.
+data string_buffer_data(void);
+
+// string_buffer_of(d) returns the buffer block of the D_STRING_BUFFER d.
+string_buffer* string_buffer_of(const data* d);
+
+// string_buffer_append(d, s, length) appends length chars of s to the
+//   D_STRING_BUFFER d, doubling its capacity when it runs out.
+void string_buffer_append(data* d, const char* s, size_t length);
+
+// f64_array_data(length) returns a D_F64ARRAY of length uninitialized values
+//   with one reference.
+data f64_array_data(size_t length);
+
+// f64_array_of(d) returns the block of the D_F64ARRAY d.
+f64_array* f64_array_of(const data* d);
+
+// list_view_data(list, start, end) returns a view of the elements of the list
+//   at address list in the order of the range start->end.
+data list_view_data(unsigned int list, int start, int end);
+
+// list_view_of(d) returns the block of the D_LIST_VIEW d.
+list_view* list_view_of(const data* d);
+
+// is_list(d) returns true if d is a D_LIST or a D_LIST_VIEW.
+bool is_list(const data* d);
+
+// list_size(d) returns the number of elements of the list or view d.
+int list_size(const data* d);
+
+// list_element(d, i) returns the cell of element i of the list or view d.
+data* list_element(const data* d, int i);
+
+// literal_to_data(literal) returns the value of a literal token, which refers
+//   to the string in its t_data instead of copying it.
 data literal_to_data(token literal);
+
 unsigned int print_data_inline(const data *t, FILE *buf);
 
 #endif
@@ -0,0 +1,366 @@
+#include "dtoa.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Implementation of Grisu3, following "Printing Floating-Point Numbers Quickly
+//   and Accurately with Integers" by Florian Loitsch. It finds the shortest
+//   digits of about 99.5% of doubles and rejects the rest, which are printed
+//   with printf instead.
+
+#define DOUBLE_SIGNIFICAND_SIZE 52
+#define DOUBLE_EXPONENT_BIAS (0x3FF + DOUBLE_SIGNIFICAND_SIZE)
+#define DOUBLE_HIDDEN_BIT 0x0010000000000000ULL
+#define DOUBLE_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DOUBLE_EXPONENT_MASK 0x7FF0000000000000ULL
+
+// Integers below this are exact and are written without Grisu.
+#define INTEGER_FAST_PATH_LIMIT 1e15
+
+// A floating point number f * 2^e with a 64 bit significand.
+typedef struct diy_fp {
+	uint64_t f;
+	int e;
+} diy_fp;
+
+// Normalized 10^k for k = -348, -340, ..., 340.
+static const uint64_t cached_powers_f[] = {
+	0xFA8FD5A0081C0288ULL, 0xBAAEE17FA23EBF76ULL, 0x8B16FB203055AC76ULL,
+	0xCF42894A5DCE35EAULL, 0x9A6BB0AA55653B2DULL, 0xE61ACF033D1A45DFULL,
+	0xAB70FE17C79AC6CAULL, 0xFF77B1FCBEBCDC4FULL, 0xBE5691EF416BD60CULL,
+	0x8DD01FAD907FFC3CULL, 0xD3515C2831559A83ULL, 0x9D71AC8FADA6C9B5ULL,
+	0xEA9C227723EE8BCBULL, 0xAECC49914078536DULL, 0x823C12795DB6CE57ULL,
+	0xC21094364DFB5637ULL, 0x9096EA6F3848984FULL, 0xD77485CB25823AC7ULL,
+	0xA086CFCD97BF97F4ULL, 0xEF340A98172AACE5ULL, 0xB23867FB2A35B28EULL,
+	0x84C8D4DFD2C63F3BULL, 0xC5DD44271AD3CDBAULL, 0x936B9FCEBB25C996ULL,
+	0xDBAC6C247D62A584ULL, 0xA3AB66580D5FDAF6ULL, 0xF3E2F893DEC3F126ULL,
+	0xB5B5ADA8AAFF80B8ULL, 0x87625F056C7C4A8BULL, 0xC9BCFF6034C13053ULL,
+	0x964E858C91BA2655ULL, 0xDFF9772470297EBDULL, 0xA6DFBD9FB8E5B88FULL,
+	0xF8A95FCF88747D94ULL, 0xB94470938FA89BCFULL, 0x8A08F0F8BF0F156BULL,
+	0xCDB02555653131B6ULL, 0x993FE2C6D07B7FACULL, 0xE45C10C42A2B3B06ULL,
+	0xAA242499697392D3ULL, 0xFD87B5F28300CA0EULL, 0xBCE5086492111AEBULL,
+	0x8CBCCC096F5088CCULL, 0xD1B71758E219652CULL, 0x9C40000000000000ULL,
+	0xE8D4A51000000000ULL, 0xAD78EBC5AC620000ULL, 0x813F3978F8940984ULL,
+	0xC097CE7BC90715B3ULL, 0x8F7E32CE7BEA5C70ULL, 0xD5D238A4ABE98068ULL,
+	0x9F4F2726179A2245ULL, 0xED63A231D4C4FB27ULL, 0xB0DE65388CC8ADA8ULL,
+	0x83C7088E1AAB65DBULL, 0xC45D1DF942711D9AULL, 0x924D692CA61BE758ULL,
+	0xDA01EE641A708DEAULL, 0xA26DA3999AEF774AULL, 0xF209787BB47D6B85ULL,
+	0xB454E4A179DD1877ULL, 0x865B86925B9BC5C2ULL, 0xC83553C5C8965D3DULL,
+	0x952AB45CFA97A0B3ULL, 0xDE469FBD99A05FE3ULL, 0xA59BC234DB398C25ULL,
+	0xF6C69A72A3989F5CULL, 0xB7DCBF5354E9BECEULL, 0x88FCF317F22241E2ULL,
+	0xCC20CE9BD35C78A5ULL, 0x98165AF37B2153DFULL, 0xE2A0B5DC971F303AULL,
+	0xA8D9D1535CE3B396ULL, 0xFB9B7CD9A4A7443CULL, 0xBB764C4CA7A44410ULL,
+	0x8BAB8EEFB6409C1AULL, 0xD01FEF10A657842CULL, 0x9B10A4E5E9913129ULL,
+	0xE7109BFBA19C0C9DULL, 0xAC2820D9623BF429ULL, 0x80444B5E7AA7CF85ULL,
+	0xBF21E44003ACDD2DULL, 0x8E679C2F5E44FF8FULL, 0xD433179D9C8CB841ULL,
+	0x9E19DB92B4E31BA9ULL, 0xEB96BF6EBADF77D9ULL, 0xAF87023B9BF0EE6BULL,
+};
+
+static const int16_t cached_powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+	-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+	-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+	-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+	109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+	641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t pow10_64[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+	10000000000000000000ULL
+};
+
+static diy_fp diy_fp_from_double(double d) {
+	uint64_t u;
+	memcpy(&u, &d, sizeof(u));
+	int biased_e = (int)((u & DOUBLE_EXPONENT_MASK) >> DOUBLE_SIGNIFICAND_SIZE);
+	uint64_t significand = u & DOUBLE_SIGNIFICAND_MASK;
+	diy_fp result;
+	if (biased_e != 0) {
+		result.f = significand + DOUBLE_HIDDEN_BIT;
+		result.e = biased_e - DOUBLE_EXPONENT_BIAS;
+	}
+	else {
+		result.f = significand;
+		result.e = 1 - DOUBLE_EXPONENT_BIAS;
+	}
+	return result;
+}
+
+static diy_fp diy_fp_multiply(diy_fp x, diy_fp y) {
+	const uint64_t mask_32 = 0xFFFFFFFFULL;
+	uint64_t a = x.f >> 32;
+	uint64_t b = x.f & mask_32;
+	uint64_t c = y.f >> 32;
+	uint64_t d = y.f & mask_32;
+	uint64_t ac = a * c;
+	uint64_t bc = b * c;
+	uint64_t ad = a * d;
+	uint64_t bd = b * d;
+	uint64_t tmp = (bd >> 32) + (ad & mask_32) + (bc & mask_32);
+	// Round to nearest.
+	tmp += 1ULL << 31;
+	diy_fp result = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32),
+		x.e + y.e + 64 };
+	return result;
+}
+
+static diy_fp diy_fp_normalize(diy_fp x) {
+	while (!(x.f & (1ULL << 63))) {
+		x.f <<= 1;
+		x.e--;
+	}
+	return x;
+}
+
+// normalized_boundaries(v, minus, plus) computes the halfway points between v
+//   and its neighbouring doubles, every number between them reads as v.
+static void normalized_boundaries(diy_fp v, diy_fp* minus, diy_fp* plus) {
+	diy_fp pl = { (v.f << 1) + 1, v.e - 1 };
+	while (!(pl.f & (DOUBLE_HIDDEN_BIT << 1))) {
+		pl.f <<= 1;
+		pl.e--;
+	}
+	pl.f <<= 64 - DOUBLE_SIGNIFICAND_SIZE - 2;
+	pl.e -= 64 - DOUBLE_SIGNIFICAND_SIZE - 2;
+	diy_fp mi;
+	if (v.f == DOUBLE_HIDDEN_BIT) {
+		// The lower neighbour is closer at a power of two.
+		mi.f = (v.f << 2) - 1;
+		mi.e = v.e - 2;
+	}
+	else {
+		mi.f = (v.f << 1) - 1;
+		mi.e = v.e - 1;
+	}
+	mi.f <<= mi.e - pl.e;
+	mi.e = pl.e;
+	*plus = pl;
+	*minus = mi;
+}
+
+// cached_power(e, k) returns a power of ten c = 10^-k such that multiplying a
+//   normalized number with binary exponent e by c gives an exponent within
+//   [-60, -32], which keeps the integral part of the product in 32 bits.
+static diy_fp cached_power(int e, int* k) {
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int ik = (int)dk;
+	if (dk - ik > 0.0) {
+		ik++;
+	}
+	unsigned int index = (unsigned int)((ik >> 3) + 1);
+	*k = -(-348 + (int)(index << 3));
+	diy_fp result = { cached_powers_f[index], cached_powers_e[index] };
+	return result;
+}
+
+static int count_digits(uint32_t n) {
+	int digits = 1;
+	while (digits < 10 && n >= pow10_64[digits]) {
+		digits++;
+	}
+	return digits;
+}
+
+// round_weed(buffer, length, wp_w, delta, rest, ten_kappa, unit) moves the
+//   last digit towards w while it stays in the safe interval, and returns
+//   false if the digits can't be proven to be the closest shortest ones. w,
+//   the interval of width delta and rest are only known within unit.
+static bool round_weed(char* buffer, int length, uint64_t wp_w, uint64_t delta,
+		uint64_t rest, uint64_t ten_kappa, uint64_t unit) {
+	uint64_t wp_w_up = wp_w - unit;
+	uint64_t wp_w_down = wp_w + unit;
+	while (rest < wp_w_up && delta - rest >= ten_kappa &&
+			(rest + ten_kappa < wp_w_up ||
+			 wp_w_up - rest >= rest + ten_kappa - wp_w_up)) {
+		buffer[length - 1]--;
+		rest += ten_kappa;
+	}
+	if (rest < wp_w_down && delta - rest >= ten_kappa &&
+			(rest + ten_kappa < wp_w_down ||
+			 wp_w_down - rest > rest + ten_kappa - wp_w_down)) {
+		return false;
+	}
+	return 2 * unit <= rest && rest <= delta - 4 * unit;
+}
+
+// digit_gen(low, w, high, buffer, length, k) generates as few digits of w as
+//   are needed to stay strictly between low and high, and returns false if
+//   that can't be proven.
+static bool digit_gen(diy_fp low, diy_fp w, diy_fp high, char* buffer,
+		int* length, int* k) {
+	uint64_t unit = 1;
+	diy_fp too_low = { low.f - unit, low.e };
+	diy_fp too_high = { high.f + unit, high.e };
+	uint64_t unsafe_interval = too_high.f - too_low.f;
+	diy_fp one = { 1ULL << -w.e, w.e };
+	uint32_t p1 = (uint32_t)(too_high.f >> -one.e);
+	uint64_t p2 = too_high.f & (one.f - 1);
+	int kappa = count_digits(p1);
+	*length = 0;
+	while (kappa > 0) {
+		uint32_t d = (uint32_t)(p1 / pow10_64[kappa - 1]);
+		p1 %= pow10_64[kappa - 1];
+		if (d || *length) {
+			buffer[(*length)++] = (char)('0' + d);
+		}
+		kappa--;
+		uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+		if (rest < unsafe_interval) {
+			*k += kappa;
+			return *length > 0 && round_weed(buffer, *length,
+				too_high.f - w.f, unsafe_interval, rest,
+				pow10_64[kappa] << -one.e, unit);
+		}
+	}
+	for (;;) {
+		p2 *= 10;
+		unit *= 10;
+		unsafe_interval *= 10;
+		char d = (char)(p2 >> -one.e);
+		if (d || *length) {
+			buffer[(*length)++] = (char)('0' + d);
+		}
+		p2 &= one.f - 1;
+		kappa--;
+		if (p2 < unsafe_interval) {
+			*k += kappa;
+			int index = -kappa;
+			return *length > 0 && index < 20 && round_weed(buffer, *length,
+				(too_high.f - w.f) * pow10_64[index], unsafe_interval, p2,
+				one.f, unit);
+		}
+	}
+}
+
+// grisu3(value, digits, length, k) writes the shortest digits of the positive
+//   value so that value = digits * 10^k, or returns false for the few values
+//   where Grisu can't prove its digits are the shortest.
+static bool grisu3(double value, char* digits, int* length, int* k) {
+	diy_fp v = diy_fp_from_double(value);
+	diy_fp w_m, w_p;
+	normalized_boundaries(v, &w_m, &w_p);
+	diy_fp c_mk = cached_power(w_p.e, k);
+	diy_fp w = diy_fp_multiply(diy_fp_normalize(v), c_mk);
+	diy_fp wp = diy_fp_multiply(w_p, c_mk);
+	diy_fp wm = diy_fp_multiply(w_m, c_mk);
+	return digit_gen(wm, w, wp, digits, length, k);
+}
+
+// fallback(value, digits, length, k) is grisu3() for the values it rejects.
+//   The shortest %e precision that reads back as value is the shortest
+//   representation, and printf rounds it correctly.
+static void fallback(double value, char* digits, int* length, int* k) {
+	char printed[NUMBER_BUFFER_SIZE];
+	for (int precision = 0; precision < 17; precision++) {
+		snprintf(printed, sizeof(printed), "%.*e", precision, value);
+		if (strtod(printed, 0) == value) {
+			break;
+		}
+	}
+	// d.ddde+x
+	*length = 0;
+	char* c = printed;
+	for (; *c != 'e'; c++) {
+		if (*c != '.') {
+			digits[(*length)++] = *c;
+		}
+	}
+	while (*length > 1 && digits[*length - 1] == '0') {
+		(*length)--;
+	}
+	*k = atoi(c + 1) - (*length - 1);
+}
+
+static size_t write_integer(uint64_t n, char* buffer) {
+	char reversed[20];
+	size_t count = 0;
+	do {
+		reversed[count++] = (char)('0' + n % 10);
+		n /= 10;
+	} while (n);
+	for (size_t c = 0; c < count; c++) {
+		buffer[c] = reversed[count - c - 1];
+	}
+	return count;
+}
+
+size_t format_number(double value, char* buffer) {
+	char* start = buffer;
+	if (isnan(value)) {
+		strcpy(buffer, "nan");
+		return 3;
+	}
+	// -0 keeps its sign, like printf writes it.
+	if (signbit(value)) {
+		*buffer++ = '-';
+		value = -value;
+	}
+	if (isinf(value)) {
+		strcpy(buffer, "inf");
+		return buffer - start + 3;
+	}
+	if (value < INTEGER_FAST_PATH_LIMIT && value == (double)(uint64_t)value) {
+		buffer += write_integer((uint64_t)value, buffer);
+		*buffer = 0;
+		return buffer - start;
+	}
+	char digits[18];
+	int length, k;
+	if (!grisu3(value, digits, &length, &k)) {
+		fallback(value, digits, &length, &k);
+	}
+	// The value is 0.digits * 10^point.
+	int point = length + k;
+	if (point > 21 || point <= -6) {
+		// d.ddde+x
+		*buffer++ = digits[0];
+		if (length > 1) {
+			*buffer++ = '.';
+			memcpy(buffer, digits + 1, length - 1);
+			buffer += length - 1;
+		}
+		*buffer++ = 'e';
+		int exponent = point - 1;
+		*buffer++ = exponent < 0 ? '-' : '+';
+		buffer += write_integer(exponent < 0 ? -exponent : exponent, buffer);
+	}
+	else if (k >= 0) {
+		// dddd000
+		memcpy(buffer, digits, length);
+		buffer += length;
+		for (int z = 0; z < k; z++) {
+			*buffer++ = '0';
+		}
+	}
+	else if (point > 0) {
+		// ddd.ddd
+		memcpy(buffer, digits, point);
+		buffer += point;
+		*buffer++ = '.';
+		memcpy(buffer, digits + point, length - point);
+		buffer += length - point;
+	}
+	else {
+		// 0.000ddd
+		*buffer++ = '0';
+		*buffer++ = '.';
+		for (int z = 0; z < -point; z++) {
+			*buffer++ = '0';
+		}
+		memcpy(buffer, digits, length);
+		buffer += length;
+	}
+	*buffer = 0;
+	return buffer - start;
+}
@@ -0,0 +1,21 @@
+#ifndef DTOA_H
+#define DTOA_H
+
+#include <stddef.h>
+
+// dtoa.h - Felix Guo
+// Converts numbers to their shortest decimal representation that reads back
+//   as the same double, e.g. 0.1 is "0.1" and 1/3 is "0.3333333333333333".
+//   Integers take a fast path, everything else uses the Grisu3 algorithm by
+//   Florian Loitsch. Very large and very small magnitudes are written with an
+//   exponent, like 1e+21 and 1.5e-7.
+
+// Large enough for any number written by format_number, including the null
+//   terminator.
+#define NUMBER_BUFFER_SIZE 32
+
+// format_number(value, buffer) writes value into buffer, which must hold
+//   NUMBER_BUFFER_SIZE characters, and returns the length written.
+size_t format_number(double value, char* buffer);
+
+#endif
@@ -3,20 +3,24 @@
 #include "memory.h"
 #include "source.h"
 #include "vm.h"
+#include "state.h"
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
-static bool error_flag = false;
 
 void reset_error_flag() {
-	error_flag = false;
+	vm->error_flag = false;
 }
 
 bool get_error_flag() {
-	return error_flag;
+	return vm->error_flag;
+}
+
+const char* get_error_message() {
+	return vm->error_message;
 }
 
 // Error Functions:
@@ -30,24 +34,40 @@ void print_verbose_info(void) {
 		fprintf(stderr, "RESERVED_MEMORY %d\n", RESERVED_MEMORY);
 		fprintf(stderr, "MEMREGSTACK_SIZE %d\n", MEMREGSTACK_SIZE);
 		fprintf(stderr, GRN "Memory\n" RESET);
-		fprintf(stderr, "FP: %d 0x%X\n", frame_pointer, frame_pointer);
-		fprintf(stderr, "SP: %d 0x%X\n", stack_pointer, stack_pointer);
-		fprintf(stderr, "AP: %d 0x%X\n", arg_pointer, arg_pointer);
-		fprintf(stderr, "CP: %d 0x%X\n", closure_list_pointer, closure_list_pointer);
-		fprintf(stderr, "CP: %d 0x%X\n", closure_list_pointer, closure_list_pointer);
-        fprintf(stderr, "MRSP: %d 0x%X\n", mem_reg_pointer, mem_reg_pointer);
+		fprintf(stderr, "FP: %d 0x%X\n", vm->frame_pointer, vm->frame_pointer);
+		fprintf(stderr, "SP: %d 0x%X\n", vm->stack_pointer, vm->stack_pointer);
+		fprintf(stderr, "AP: %d 0x%X\n", vm->arg_pointer, vm->arg_pointer);
+		fprintf(stderr, "CP: %d 0x%X\n", vm->closure_list_pointer, vm->closure_list_pointer);
+		fprintf(stderr, "CP: %d 0x%X\n", vm->closure_list_pointer, vm->closure_list_pointer);
+        fprintf(stderr, "MRSP: %d 0x%X\n", vm->mem_reg_pointer, vm->mem_reg_pointer);
 		print_free_memory();
 	}
 }
 
+// keep_message(msg) makes msg the message of the interpreter's last error.
+//   Cannot be safe, because vasprintf uses malloc!
+static void keep_message(char* msg) {
+	free(vm->error_message);
+	vm->error_message = msg;
+}
+
 char* error_message(char* message, va_list args) {
 	char* result;
 	vasprintf(&result, message, args);
 	return result;
 }
 
+void set_error_message(char* message, ...) {
+	va_list args;
+	va_start(args, message);
+	keep_message(error_message(message, args));
+	va_end(args);
+}
+
 void error_general(char* message, ...) {
-	error_flag = true;
+	// Output printed before the error should appear before it.
+	fflush(stdout);
+	vm->error_flag = true;
 	va_list args;
 	va_start(args, message);
 
@@ -55,15 +75,15 @@ void error_general(char* message, ...) {
 	fprintf(stderr, RED "Fatal Error: " RESET "%s\n", msg);
 	print_verbose_info();
 
-	// Cannot be safe, because vasprintf uses malloc!
-	free(msg);
+	keep_message(msg);
 	if (get_settings_flag(SETTINGS_STRICT_ERROR)) {
 		safe_exit(1);
 	}
 }
 
 void error_lexer(int line, int col, char* message, ...) {
-	error_flag = true;
+	fflush(stdout);
+	vm->error_flag = true;
 	va_list args;
 	va_start(args, message);
 
@@ -78,7 +98,7 @@ void error_lexer(int line, int col, char* message, ...) {
 		fprintf(stderr, "      %*c^\n", col, ' ');
 	}
 	print_verbose_info();
-	free(msg);
+	keep_message(msg);
 	if (get_settings_flag(SETTINGS_STRICT_ERROR)) {
 		safe_exit(1);
 	}
@@ -86,7 +106,8 @@ void error_lexer(int line, int col, char* message, ...) {
 
 
 void error_compile(int line, int col, char* message, ...) {
-	error_flag = true;
+	fflush(stdout);
+	vm->error_flag = true;
 	va_list args;
 	va_start(args, message);
 
@@ -101,14 +122,15 @@ void error_compile(int line, int col, char* message, ...) {
 		fprintf(stderr, "      %*c^\n", col, ' ');
 	}
 	print_verbose_info();
-	free(msg);
+	keep_message(msg);
 	if (get_settings_flag(SETTINGS_STRICT_ERROR)) {
 		safe_exit(1);
 	}
 }
 
 void error_runtime(int line, char* message, ...) {
-	error_flag = true;
+	fflush(stdout);
+	vm->error_flag = true;
 	va_list args;
 	va_start(args, message);
 
@@ -137,7 +159,7 @@ void error_runtime(int line, char* message, ...) {
 		}
 		fprintf(stderr, DIVIDER "\n");
 	}
-	free(msg);
+	keep_message(msg);
 	// REPL Don't print call stack unless verbose is on!
 	if (!get_settings_flag(SETTINGS_REPL) || get_settings_flag(SETTINGS_VERBOSE)) {
 		print_call_stack(stderr, -1);
@@ -35,6 +35,7 @@ void error_compile(int line, int col, char* message, ...);
 #define SCAN_UNTERMINATED_STRING "Unterminated string! End string literal with `\"`."
 #define SCAN_UNEXPECTED_CHARACTER "Unexpected character `%c`!"
 #define SCAN_REQ_FILE_READ_ERR "File read error when trying to import."
+#define SCAN_REQ_CIRCULAR "Circular import of %s!"
 
 // AST Messages:
 #define AST_EXPECTED_TOKEN SCAN_EXPECTED_TOKEN
@@ -65,6 +66,7 @@ void error_compile(int line, int col, char* message, ...);
 	"Named argument must come after positional arguments."
 #define CODEGEN_EXPECTED_IDENTIFIER AST_EXPECTED_IDENTIFIER
 #define CODEGEN_REQ_FILE_READ_ERR SCAN_REQ_FILE_READ_ERR
+#define CODEGEN_YIELD_OUTSIDE_FUNCTION "Only functions can yield."
 
 #define CODEGEN_BYTECODE_INVALID_OPCODE "Inline Bytecode: Invalid Opcode '%s'"
 #define CODEGEN_BYTECODE_UNEXPECTED_OPERATOR "Inline Bytecode: Unexpected Operator '%s'. Operators must follow BIN or UNA opcode."
@@ -112,6 +114,23 @@ void error_compile(int line, int col, char* message, ...);
 #define VM_INVALID_NATIVE_NUMBER_OF_ARGS "Natively linked function call '%s' does not match expected number of arguments!"
 #define VM_INVALID_NATIVE_NUMERICAL_TYPE_ERROR "Type error in native function call. Expected numerical value."
 #define VM_INVALID_NATIVE_STRING_TYPE_ERROR "Type error in native function call. Expected string value."
+#define VM_INVALID_NATIVE_STRING_OR_NUMBER_TYPE_ERROR "Type error in native function call. Expected string or numerical value."
+#define VM_INVALID_NATIVE_LIST_TYPE_ERROR "Type error in native function call. Expected list value."
+#define VM_FILE_NOT_WRITABLE "File is not open for writing."
+#define VM_NOT_A_STRING_BUILDER "Type error in native function call. Expected a StringBuilder."
+#define VM_INVALID_NATIVE_ARRAY_TYPE_ERROR "Type error in native function call. Expected f64array value."
+#define VM_HOST_NATIVE_FAILED "Natively linked function '%s' failed."
+#define VM_HOST_NATIVE_INVALID_RESULT "Natively linked function '%s' returned a value the program can't use."
+#define VM_ARRAY_LENGTH_MISMATCH "Arrays of length %zu and %zu must have the same length."
+#define VM_PARALLEL_WORKER_FAILED "A parallel worker failed: %s"
+#define VM_PARALLEL_CANT_TRANSFER "Open files and generators can't be passed to another thread."
+#define VM_PARALLEL_NO_THREADS "No worker thread could be started."
+#define VM_TASK_FAILED "A spawned task failed: %s"
+#define VM_NOT_A_TASK "Not a task started by this program, or it was already joined."
+#define VM_NOT_A_CHANNEL "Not an open channel."
+#define VM_CHANNEL_CLOSED "Can't send to a closed channel."
+#define VM_GENERATOR_RUNNING "A generator can't be advanced while it is running."
+#define VM_YIELD_OUTSIDE_GENERATOR "Yield outside of a generator."
 
 // Colors
 #ifdef _WIN32
@@ -156,4 +175,12 @@ void d_error(char* message);
 
 void reset_error_flag(void);
 bool get_error_flag(void);
+
+// get_error_message() returns the message of the last error, or NULL if
+//   there was none.
+const char* get_error_message(void);
+
+// set_error_message(message) makes message the message of the last error
+//   without reporting it.
+void set_error_message(char* message, ...);
 #endif
@@ -12,7 +12,13 @@ char* get_path() {
     HMODULE module = GetModuleHandleA(NULL);
     char* path = safe_malloc(W_MAX_PATH);
     int end = GetModuleFileNameA(module, path, W_MAX_PATH);
-    while (path[end] != '/' && path[end] != '\\') {
+    if (end <= 0 || end >= W_MAX_PATH) {
+        fprintf(stderr, "Could not find the path of the executable.\n");
+        safe_exit(1);
+    }
+    // end is the length, the last character is before it.
+    end--;
+    while (end > 0 && path[end] != '/' && path[end] != '\\') {
         end--;
     }
     path[end + 1] = 0;
@@ -27,7 +33,11 @@ char* get_path() {
     uint32_t size = W_MAX_PATH;
     if(_NSGetExecutablePath(path, &size) == 0) {
         size_t end = strlen(path);
-        while (path[end] != '/' && path[end] != '\\') {
+        // end is the length, the last character is before it.
+        if (end > 0) {
+            end--;
+        }
+        while (end > 0 && path[end] != '/' && path[end] != '\\') {
             end--;
         }
         path[end + 1] = 0;
@@ -49,8 +59,15 @@ ssize_t readlink(const char *path, char *buf, size_t bufsiz);
 
 char* get_path() {
     char* path = safe_malloc(W_MAX_PATH);
-    int end = readlink("/proc/self/exe", path, W_MAX_PATH);
-    while (path[end] != '/' && path[end] != '\\') {
+    // readlink doesn't terminate the path, and fails when it's too long.
+    ssize_t end = readlink("/proc/self/exe", path, W_MAX_PATH - 1);
+    if (end <= 0 || end >= W_MAX_PATH - 1) {
+        fprintf(stderr, "Could not find the path of the executable.\n");
+        safe_exit(1);
+    }
+    path[end] = 0;
+    end--;
+    while (end > 0 && path[end] != '/' && path[end] != '\\') {
         end--;
     }
     path[end + 1] = 0;
@@ -0,0 +1,228 @@
+#define _GNU_SOURCE
+#include "files.h"
+#include "global.h"
+#include "state.h"
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FILES_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Implementation of the open file table.
+
+static open_file* get_file(int handle) {
+	if (handle < 0 || (size_t)handle >= vm->files_count ||
+		!vm->files[handle].is_open) {
+		return 0;
+	}
+	return &vm->files[handle];
+}
+
+#ifdef FILES_MMAP
+// map_file(stream, size) maps the regular file stream for reading, returns
+//   NULL if it isn't one or can't be mapped.
+static char* map_file(FILE* stream, size_t* size) {
+	struct stat info;
+	int fd = fileno(stream);
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0) {
+		return 0;
+	}
+	void* map = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		return 0;
+	}
+	madvise(map, info.st_size, MADV_SEQUENTIAL);
+	*size = info.st_size;
+	return map;
+}
+#endif
+
+int file_open(const char* path, const char* mode) {
+	if (!streq(mode, "r") && !streq(mode, "w") && !streq(mode, "a")) {
+		return -1;
+	}
+	FILE* stream = fopen(path, mode[0] == 'r' ? "rb" : mode[0] == 'w' ? "wb" :
+		"ab");
+	if (!stream) {
+		return -1;
+	}
+	size_t handle = 0;
+	while (handle < vm->files_count && vm->files[handle].is_open) {
+		handle++;
+	}
+	if (handle == vm->files_count) {
+		if (vm->files_count == vm->files_capacity) {
+			vm->files_capacity = vm->files_capacity ? vm->files_capacity * 2 : 8;
+			vm->files = vm->files
+				? safe_realloc(vm->files, vm->files_capacity * sizeof(open_file))
+				: safe_malloc(vm->files_capacity * sizeof(open_file));
+		}
+		vm->files_count++;
+	}
+	open_file* f = &vm->files[handle];
+	memset(f, 0, sizeof(open_file));
+	f->stream = stream;
+	f->is_open = true;
+	f->writable = mode[0] != 'r';
+	if (f->writable) {
+		setvbuf(stream, 0, _IOFBF, FILE_BUFFER_SIZE);
+	}
+#ifdef FILES_MMAP
+	else {
+		f->map = map_file(stream, &f->map_size);
+	}
+#endif
+	return handle;
+}
+
+bool file_close(int handle) {
+	open_file* f = get_file(handle);
+	if (!f) {
+		return false;
+	}
+#ifdef FILES_MMAP
+	if (f->map) {
+		munmap(f->map, f->map_size);
+	}
+#endif
+	fclose(f->stream);
+	if (f->line) {
+		safe_free(f->line);
+	}
+	f->is_open = false;
+	return true;
+}
+
+long read_line(FILE* stream, char** buffer, size_t* capacity) {
+	if (!*buffer) {
+		*capacity = 128;
+		*buffer = safe_malloc(*capacity);
+	}
+	size_t length = 0;
+	while (fgets(*buffer + length, *capacity - length, stream)) {
+		length += strlen(*buffer + length);
+		if (length > 0 && (*buffer)[length - 1] == '\n') {
+			(*buffer)[--length] = 0;
+			return length;
+		}
+		if (length + 1 < *capacity) {
+			// The stream ended without a newline.
+			return length;
+		}
+		*capacity *= 2;
+		*buffer = safe_realloc(*buffer, *capacity);
+	}
+	return length > 0 ? (long)length : -1;
+}
+
+const char* file_read_line(int handle, size_t* length) {
+	open_file* f = get_file(handle);
+	if (!f || f->writable) {
+		return 0;
+	}
+	if (!f->map) {
+		long read = read_line(f->stream, &f->line, &f->line_capacity);
+		if (read < 0) {
+			return 0;
+		}
+		*length = read;
+		return f->line;
+	}
+	if (f->position >= f->map_size) {
+		return 0;
+	}
+#ifdef FILES_MMAP
+	if (f->position - f->released >= FILE_RELEASE_INTERVAL) {
+		// Clean pages of a private mapping are simply read again if touched.
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t release_to = f->position / page * page;
+		madvise(f->map + f->released, release_to - f->released,
+			MADV_DONTNEED);
+		f->released = release_to;
+	}
+#endif
+	const char* start = f->map + f->position;
+	size_t remaining = f->map_size - f->position;
+	const char* newline = memchr(start, '\n', remaining);
+	*length = newline ? (size_t)(newline - start) : remaining;
+	f->position += *length + (newline ? 1 : 0);
+	return start;
+}
+
+bool file_write(int handle, const char* s, size_t length) {
+	open_file* f = get_file(handle);
+	if (!f || !f->writable) {
+		return false;
+	}
+	return fwrite(s, 1, length, f->stream) == length;
+}
+
+bool file_advance(int handle) {
+	open_file* f = get_file(handle);
+	if (!f) {
+		return false;
+	}
+	f->current = file_read_line(handle, &f->current_length);
+	return f->current != 0;
+}
+
+const char* file_current_line(int handle, size_t* length) {
+	open_file* f = get_file(handle);
+	if (!f || !f->current) {
+		*length = 0;
+		return "";
+	}
+	*length = f->current_length;
+	return f->current;
+}
+
+char* file_read_all(const char* path, size_t* length) {
+	FILE* stream = fopen(path, "rb");
+	if (!stream) {
+		return 0;
+	}
+	char* contents = 0;
+#ifdef FILES_MMAP
+	size_t size;
+	char* map = map_file(stream, &size);
+	if (map) {
+		contents = safe_malloc(size + 1);
+		memcpy(contents, map, size);
+		munmap(map, size);
+		*length = size;
+	}
+#endif
+	if (!contents) {
+		// Not a regular file, read it in chunks until it ends.
+		size_t capacity = FILE_BUFFER_SIZE;
+		size_t size = 0;
+		size_t read;
+		contents = safe_malloc(capacity + 1);
+		while ((read = fread(contents + size, 1, capacity - size, stream))) {
+			size += read;
+			if (size == capacity) {
+				capacity *= 2;
+				contents = safe_realloc(contents, capacity + 1);
+			}
+		}
+		*length = size;
+	}
+	contents[*length] = 0;
+	fclose(stream);
+	return contents;
+}
+
+void files_close_all(void) {
+	for (size_t f = 0; f < vm->files_count; f++) {
+		file_close(f);
+	}
+	if (vm->files) {
+		safe_free(vm->files);
+	}
+	vm->files = 0;
+	vm->files_count = 0;
+	vm->files_capacity = 0;
+}
@@ -0,0 +1,78 @@
+#ifndef FILES_H
+#define FILES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// files.h - Felix Guo
+// Open files for the io library. Wendy code refers to a file by the handle
+//   returned from file_open, an index into the table of open files.
+// Files opened for reading are memory mapped when possible, so reading a
+//   large file line by line only touches the part that is being read and
+//   pages that were read are released again. Anything that can't be mapped,
+//   like pipes, is read through stdio instead.
+// Lines never have a length limit, and don't include the newline.
+
+// Pages of a mapped file behind the read position are released every time
+//   this many bytes have been read.
+#define FILE_RELEASE_INTERVAL (64 << 20)
+
+// Size of the stdio buffer of each open file.
+#define FILE_BUFFER_SIZE 65536
+
+// An entry in the interpreter's table of open files.
+typedef struct open_file {
+	FILE* stream;
+	bool is_open;
+	bool writable;
+	// The whole file if it was memory mapped, read from position onwards.
+	//   Pages before released have been given back.
+	char* map;
+	size_t map_size;
+	size_t position;
+	size_t released;
+	// Buffer for lines read through stdio.
+	char* line;
+	size_t line_capacity;
+	// The line the lines() iterator is at.
+	const char* current;
+	size_t current_length;
+} open_file;
+
+// file_open(path, mode) opens path with the fopen mode "r", "w" or "a" and
+//   returns its handle, or -1 if it can't be opened.
+int file_open(const char* path, const char* mode);
+
+// file_close(handle) closes the file, returns false if it wasn't open.
+bool file_close(int handle);
+
+// file_read_line(handle, length) reads the next line of the file and stores
+//   its length. Returns NULL at the end of the file. The line is owned by the
+//   file and is valid until the next read or close.
+const char* file_read_line(int handle, size_t* length);
+
+// file_write(handle, s, length) writes length chars of s to the file, returns
+//   false if the file isn't open for writing.
+bool file_write(int handle, const char* s, size_t length);
+
+// file_advance(handle) moves on to the next line for the lines() iterator of
+//   the file, returns false at the end of the file.
+bool file_advance(int handle);
+
+// file_current_line(handle, length) returns the line file_advance moved to.
+const char* file_current_line(int handle, size_t* length);
+
+// file_read_all(path, length) reads the whole file at path into a new string
+//   and stores its length, or returns NULL if it can't be read.
+char* file_read_all(const char* path, size_t* length);
+
+// read_line(stream, buffer, capacity) reads one line from stream into buffer,
+//   which is grown as needed, and returns its length without the newline or
+//   -1 at the end of the stream. buffer may start out as NULL.
+long read_line(FILE* stream, char** buffer, size_t* capacity);
+
+// files_close_all() closes every open file and frees the table.
+void files_close_all(void);
+
+#endif
@@ -0,0 +1,357 @@
+#include "generator.h"
+#include "vm.h"
+#include "error.h"
+#include "global.h"
+#include "state.h"
+#include <string.h>
+
+// Implementation of generators. A generator runs on the stacks of the code
+//   that advances it: its frame is copied on top of the call stack with the
+//   return address pointing at the OP_HALT that ends the program, like
+//   vm_call() does, so a yield or return stops the nested execution and
+//   control goes back to generator_advance().
+
+typedef enum {
+	GENERATOR_SUSPENDED, GENERATOR_RUNNING, GENERATOR_DONE
+} generator_status;
+
+struct generator {
+	generator_status status;
+	// Where the body continues when the generator is advanced.
+	address resume;
+	// The call stack entries of the frame, starting with the function's. Each
+	//   block of the body refers to the block around it, which is kept
+	//   relative to the start of the frame, like frame_pointer.
+	stack_entry* frame;
+	size_t frame_size;
+	size_t frame_capacity;
+	address frame_pointer;
+	// Memory registers saved by the blocks of the body.
+	address* registers;
+	size_t registers_count;
+	size_t registers_capacity;
+	// What the body had on the operand stack, the bottom value first.
+	data* operands;
+	size_t operands_count;
+	size_t operands_capacity;
+	// The value yielded last, until it's taken.
+	data value;
+	// Where the frame starts on each stack while the generator runs.
+	address stack_base;
+	address register_base;
+	address operand_base;
+	// Set by the garbage collector if something refers to the generator,
+	//   pending generators still have to have their frame marked.
+	bool reached;
+	generator* next_pending;
+};
+
+static generator* generator_of(data handle) {
+	size_t index = handle.value.number;
+	return index < vm->generators_count ? vm->generators[index] : 0;
+}
+
+// add_generator(g) returns the handle of g, reusing the handle of a freed
+//   generator if there is one.
+static size_t add_generator(generator* g) {
+	while (vm->generators_hint < vm->generators_count &&
+		vm->generators[vm->generators_hint]) {
+		vm->generators_hint++;
+	}
+	if (vm->generators_hint == vm->generators_count) {
+		if (vm->generators_count == vm->generators_capacity) {
+			if (vm->generators) {
+				vm->generators_capacity *= 2;
+				vm->generators = safe_realloc(vm->generators,
+					vm->generators_capacity * sizeof(generator*));
+			}
+			else {
+				vm->generators_capacity = 16;
+				vm->generators = safe_malloc(
+					vm->generators_capacity * sizeof(generator*));
+			}
+		}
+		vm->generators_count++;
+	}
+	vm->generators[vm->generators_hint] = g;
+	return vm->generators_hint++;
+}
+
+static bool is_variable(const stack_entry* entry) {
+	return entry->id[0] != *FUNCTION_START &&
+		entry->id[0] != *AUTOFRAME_START && entry->id[0] != *RA_START;
+}
+
+// save_frame(g, base) copies the call stack from base, where the generator's
+//   function frame starts, to g.
+static void save_frame(generator* g, address base) {
+	g->frame_size = vm->stack_pointer - base;
+	if (g->frame_size > g->frame_capacity) {
+		if (g->frame) {
+			g->frame = safe_realloc(g->frame, g->frame_size * sizeof(stack_entry));
+		}
+		else {
+			g->frame = safe_malloc(g->frame_size * sizeof(stack_entry));
+		}
+		g->frame_capacity = g->frame_size;
+	}
+	memcpy(g->frame, vm->call_stack + base, g->frame_size * sizeof(stack_entry));
+	// The function's own entry and return address are replaced when the
+	//   frame is restored.
+	for (size_t i = 2; i < g->frame_size; i++) {
+		if (g->frame[i].id[0] == *AUTOFRAME_START) {
+			g->frame[i].val -= base;
+		}
+	}
+	g->frame_pointer = vm->frame_pointer - base;
+}
+
+// restore_frame(g, line) copies the frame of g to the top of the call stack,
+//   returning to the OP_HALT that ends the program.
+static bool restore_frame(generator* g, int line) {
+	address base = vm->stack_pointer;
+	if (base + g->frame_size >= STACK_SIZE) {
+		error_runtime(line, MEMORY_STACK_OVERFLOW);
+		return false;
+	}
+	memcpy(vm->call_stack + base, g->frame, g->frame_size * sizeof(stack_entry));
+	vm->call_stack[base].val = vm->frame_pointer;
+	vm->call_stack[base + 1].val = vm->bytecode_size - 1;
+	for (size_t i = 2; i < g->frame_size; i++) {
+		if (g->frame[i].id[0] == *AUTOFRAME_START) {
+			vm->call_stack[base + i].val += base;
+		}
+	}
+	vm->frame_pointer = base + g->frame_pointer;
+	vm->stack_pointer = base + g->frame_size;
+	g->stack_base = base;
+	return true;
+}
+
+// end(g) marks g as done and releases its frame, the handle stays valid.
+static void end(generator* g) {
+	g->status = GENERATOR_DONE;
+	for (size_t i = 0; i < g->operands_count; i++) {
+		destroy_data(&g->operands[i]);
+	}
+	g->operands_count = 0;
+	g->frame_size = 0;
+	g->registers_count = 0;
+	destroy_data(&g->value);
+	g->value = none_data();
+}
+
+static void free_generator(generator* g) {
+	end(g);
+	destroy_data(&g->value);
+	if (g->frame) safe_free(g->frame);
+	if (g->registers) safe_free(g->registers);
+	if (g->operands) safe_free(g->operands);
+	safe_free(g);
+}
+
+void generator_create(int line) {
+	generator* g = safe_calloc(1, sizeof(generator));
+	g->status = GENERATOR_SUSPENDED;
+	g->value = none_data();
+	// The body hasn't started, so the function's frame is the innermost one.
+	save_frame(g, vm->frame_pointer);
+	g->resume = vm->ip;
+	size_t handle = add_generator(g);
+	// Return to the caller like RET does.
+	pop_frame(true, &vm->ip);
+	vm->memory_register = pop_mem_reg();
+	push_arg(make_data(D_GENERATOR, data_value_num(handle)), line);
+}
+
+void generator_yield(int line) {
+	generator* g = vm->running_generator;
+	if (!g) {
+		error_runtime(line, VM_YIELD_OUTSIDE_GENERATOR);
+		return;
+	}
+	data value = pop_arg(line);
+	address base = g->stack_base;
+	save_frame(g, base);
+	g->registers_count = vm->mem_reg_pointer - g->register_base - 1;
+	if (g->registers_count > g->registers_capacity) {
+		if (g->registers) {
+			g->registers = safe_realloc(g->registers,
+				g->registers_count * sizeof(address));
+		}
+		else {
+			g->registers = safe_malloc(g->registers_count * sizeof(address));
+		}
+		g->registers_capacity = g->registers_count;
+	}
+	memcpy(g->registers, vm->mem_reg_stack + g->register_base + 1,
+		g->registers_count * sizeof(address));
+	g->operands_count = g->operand_base - vm->arg_pointer;
+	if (g->operands_count > g->operands_capacity) {
+		if (g->operands) {
+			g->operands = safe_realloc(g->operands,
+				g->operands_count * sizeof(data));
+		}
+		else {
+			g->operands = safe_malloc(g->operands_count * sizeof(data));
+		}
+		g->operands_capacity = g->operands_count;
+	}
+	for (size_t i = g->operands_count; i > 0; i--) {
+		g->operands[i - 1] = pop_arg(line);
+	}
+	g->resume = vm->ip;
+	g->status = GENERATOR_SUSPENDED;
+	// Leave the frame like RET does.
+	vm->ip = vm->call_stack[base + 1].val;
+	vm->frame_pointer = vm->call_stack[base].val;
+	vm->stack_pointer = base;
+	vm->memory_register = vm->mem_reg_stack[g->register_base];
+	vm->mem_reg_pointer = g->register_base;
+	push_arg(value, line);
+}
+
+bool generator_advance(data handle, int line) {
+	generator* g = generator_of(handle);
+	if (!g || g->status == GENERATOR_DONE) {
+		return false;
+	}
+	if (g->status == GENERATOR_RUNNING) {
+		error_runtime(line, VM_GENERATOR_RUNNING);
+		return false;
+	}
+	address saved_ip = vm->ip;
+	int saved_line = vm->line;
+	address saved_frame_pointer = vm->frame_pointer;
+	address saved_memory_register = vm->memory_register;
+	if (!restore_frame(g, line)) {
+		return false;
+	}
+	g->register_base = vm->mem_reg_pointer;
+	push_mem_reg(vm->memory_register, line);
+	for (size_t i = 0; i < g->registers_count; i++) {
+		push_mem_reg(g->registers[i], line);
+	}
+	g->operand_base = vm->arg_pointer;
+	for (size_t i = 0; i < g->operands_count; i++) {
+		push_arg(g->operands[i], line);
+	}
+	g->operands_count = 0;
+	g->status = GENERATOR_RUNNING;
+	generator* enclosing = vm->running_generator;
+	vm->running_generator = g;
+	if (!get_error_flag()) {
+		vm_execute(g->resume);
+	}
+	vm->running_generator = enclosing;
+	bool yielded = false;
+	if (get_error_flag()) {
+		vm->frame_pointer = saved_frame_pointer;
+		vm->stack_pointer = g->stack_base;
+		vm->mem_reg_pointer = g->register_base;
+		end(g);
+	}
+	else if (g->status == GENERATOR_SUSPENDED) {
+		destroy_data(&g->value);
+		g->value = pop_arg(line);
+		yielded = true;
+	}
+	else {
+		// The body returned, drop the value and what else it left.
+		while (vm->arg_pointer < g->operand_base) {
+			data d = pop_arg(line);
+			destroy_data(&d);
+		}
+		end(g);
+	}
+	vm->ip = saved_ip;
+	vm->line = saved_line;
+	vm->memory_register = saved_memory_register;
+	return yielded;
+}
+
+data generator_take(data handle) {
+	generator* g = generator_of(handle);
+	if (!g) {
+		return none_data();
+	}
+	data value = g->value;
+	g->value = none_data();
+	return value;
+}
+
+static void reach(generator* g) {
+	if (!g->reached) {
+		g->reached = true;
+		g->next_pending = vm->pending_generators;
+		vm->pending_generators = g;
+	}
+}
+
+void generator_reached(data handle) {
+	generator* g = generator_of(handle);
+	if (g) {
+		reach(g);
+	}
+}
+
+void mark_generators(bool* marked) {
+	if (!vm->generators_count) {
+		return;
+	}
+	for (size_t i = 0; i < vm->generators_count; i++) {
+		if (vm->generators[i] &&
+			vm->generators[i]->status == GENERATOR_RUNNING) {
+			reach(vm->generators[i]);
+		}
+	}
+	while (vm->pending_generators) {
+		generator* g = vm->pending_generators;
+		vm->pending_generators = g->next_pending;
+		// The frame of a running generator is on the call stack.
+		if (g->status != GENERATOR_RUNNING) {
+			for (size_t i = 0; i < g->frame_size; i++) {
+				if (is_variable(&g->frame[i])) {
+					mark_variable(marked, g->frame[i].val);
+				}
+			}
+		}
+		for (size_t i = 0; i < g->operands_count; i++) {
+			mark_data(marked, &g->operands[i]);
+		}
+		mark_data(marked, &g->value);
+	}
+	for (size_t i = 0; i < vm->generators_count; i++) {
+		generator* g = vm->generators[i];
+		if (!g) {
+			continue;
+		}
+		if (g->reached) {
+			g->reached = false;
+		}
+		else {
+			free_generator(g);
+			vm->generators[i] = 0;
+			if (i < vm->generators_hint) {
+				vm->generators_hint = i;
+			}
+		}
+	}
+}
+
+void free_generators(void) {
+	for (size_t i = 0; i < vm->generators_count; i++) {
+		if (vm->generators[i]) {
+			free_generator(vm->generators[i]);
+		}
+	}
+	if (vm->generators) {
+		safe_free(vm->generators);
+	}
+	vm->generators = 0;
+	vm->generators_count = 0;
+	vm->generators_capacity = 0;
+	vm->generators_hint = 0;
+	vm->running_generator = 0;
+	vm->pending_generators = 0;
+}
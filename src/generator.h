@@ -0,0 +1,53 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "data.h"
+#include "memory.h"
+#include <stdbool.h>
+
+// generator.h - Felix Guo
+// Generators produce the values of a function one at a time. Calling a
+//   function whose body yields binds its arguments and returns a generator
+//   instead of running the body. Advancing the generator puts its frame back
+//   on the call stack and runs the body up to the next yield, whose value is
+//   handed to the code that advanced it, or until it returns, which ends it.
+//   In between, the frame and whatever the body had on the operand stack are
+//   kept here, so a for loop over a generator needs memory for one value at
+//   a time instead of a list of all of them.
+
+// The state of a generator, kept in the [state] of its interpreter and
+//   referred to by the handle that is the value of a D_GENERATOR.
+typedef struct generator generator;
+
+// generator_create(line) suspends the function frame on top of the call stack
+//   as a new generator and returns to the caller with the generator on the
+//   operand stack. Implements OP_GEN.
+void generator_create(int line);
+
+// generator_yield(line) suspends the running generator and returns to the
+//   code that advanced it with the value on top of the operand stack.
+//   Implements OP_YIELD.
+void generator_yield(int line);
+
+// generator_advance(handle, line) runs the generator until it yields and keeps
+//   the value for generator_take(). Returns false once the generator has
+//   returned, or if it failed with a runtime error.
+bool generator_advance(data handle, int line);
+
+// generator_take(handle) returns the value the generator yielded last, the
+//   caller owns it.
+data generator_take(data handle);
+
+// generator_reached(handle) tells the garbage collector that the generator is
+//   in use, so its frame is marked by mark_generators().
+void generator_reached(data handle);
+
+// mark_generators(marked) marks the variables and values of every generator
+//   that was reached, including the generators they refer to, then frees the
+//   generators that weren't. Called by garbage_collect().
+void mark_generators(bool* marked);
+
+// free_generators() frees every generator of the interpreter.
+void free_generators(void);
+
+#endif
@@ -1,8 +1,10 @@
 #include "global.h"
+#include "state.h"
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 typedef struct malloc_node {
 	char* filename;
@@ -15,9 +17,10 @@ typedef struct malloc_node {
 
 static malloc_node* malloc_node_start = 0;
 static malloc_node* malloc_node_end = 0;
-static bool settings_data[SETTINGS_COUNT] = { false };
+// Interpreters on different threads allocate concurrently, the list of
+//   allocations is only touched while holding malloc_lock.
+static pthread_mutex_t malloc_lock = PTHREAD_MUTEX_INITIALIZER;
 bool is_big_endian = true;
-bool last_printed_newline = false;
 
 char* safe_strdup_impl(const char* s, char* allocated) {
 	strcpy(allocated, s);
@@ -34,14 +37,23 @@ void determine_endianness() {
 }
 
 void set_settings_flag(settings_flags flag) {
-	settings_data[flag] = true;
+	vm->settings_data[flag] = true;
 }
 
 bool get_settings_flag(settings_flags flag) {
-	return settings_data[flag];
+	return vm->settings_data[flag];
+}
+
+void set_settings_value(settings_values setting, int value) {
+	vm->settings_value_data[setting] = value;
+}
+
+int get_settings_value(settings_values setting) {
+	return vm->settings_value_data[setting];
 }
 
 static void attach_to_list(malloc_node* new_node) {
+	pthread_mutex_lock(&malloc_lock);
 	if (!malloc_node_end && !malloc_node_start) {
 		malloc_node_start = new_node;
 		malloc_node_end = new_node;
@@ -54,6 +66,7 @@ static void attach_to_list(malloc_node* new_node) {
 	new_node->next = malloc_node_start;
 
 	malloc_node_end = new_node;
+	pthread_mutex_unlock(&malloc_lock);
 }
 
 static void remove_from_list(malloc_node* node) {
@@ -112,6 +125,9 @@ void* safe_calloc_impl(size_t num, size_t size, char* filename, int line_num) {
 void* safe_realloc_impl(void* ptr, size_t size, char* filename, int line_num) {
 	malloc_node* core_ptr = ptr - sizeof(*core_ptr);
 
+	// The neighbours' links point into the block, so it can't move while
+	//   other threads change the list.
+	pthread_mutex_lock(&malloc_lock);
 	void* new_ptr = realloc(core_ptr, size + sizeof(*core_ptr));
 	if (!new_ptr) {
 		fprintf(stderr, "SafeRealloc: Couldn't reallocate memory! %s at"
@@ -132,6 +148,7 @@ void* safe_realloc_impl(void* ptr, size_t size, char* filename, int line_num) {
 
 	moved_node->ptr = new_ptr + sizeof(malloc_node);
 	moved_node->size = size;
+	pthread_mutex_unlock(&malloc_lock);
 	return moved_node->ptr;
 }
 
@@ -139,7 +156,9 @@ void safe_free_impl(void* ptr, char* filename, int line_num) {
 	UNUSED(filename);
 	UNUSED(line_num);
 	malloc_node* node_ptr = ptr - sizeof(malloc_node);
+	pthread_mutex_lock(&malloc_lock);
 	remove_from_list(node_ptr);
+	pthread_mutex_unlock(&malloc_lock);
 	free(node_ptr);
 	return;
 }
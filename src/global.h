@@ -17,6 +17,7 @@
 #endif
 
 #define INPUT_BUFFER_SIZE 1024
+#define OUTPUT_BUFFER_SIZE 65536
 #define WENDY_VM_HEADER "WendyVM Bytecode"
 
 // Data/Token Information
@@ -37,9 +38,21 @@
 #define INITIAL_CLOSURES_SIZE 128
 #define MEMREGSTACK_SIZE 10000
 
+// JIT Limits
+#define JIT_CODE_SIZE (16 * 1024 * 1024)
+#define JIT_DEFAULT_THRESHOLD 50
+
+// Inlining Limits, body size in AST nodes and growth as a percentage of the
+//   program's size.
+#define INLINE_DEFAULT_MAX_SIZE 16
+#define INLINE_DEFAULT_MAX_GROWTH 50
+
 // Compiler/VM Settings
 #define OPERATOR_OVERLOAD_PREFIX "#@"
 #define LOOP_COUNTER_PREFIX ":\")"
+// Appended to a loop's counter to name the variable that holds the generator
+//   it iterates.
+#define LOOP_GENERATOR_SUFFIX "g"
 
 #define DIVIDER "===================="
 
@@ -60,16 +73,32 @@ typedef enum {
 	SETTINGS_SANDBOXED,
 	SETTINGS_TRACE_VM,
     SETTINGS_DRY_RUN,
+	SETTINGS_JIT,
+	SETTINGS_JIT_REPORT,
+	SETTINGS_PROFILE,
+	SETTINGS_PROFILE_REPORT,
+	SETTINGS_STATS,
+	SETTINGS_STATS_JSON,
+	SETTINGS_NO_CACHE,
 	SETTINGS_COUNT } settings_flags;
 
+// Numeric settings, each with a default given in state.c
+typedef enum {
+	SETTINGS_JIT_THRESHOLD = 0,
+	SETTINGS_INLINE_MAX_SIZE,
+	SETTINGS_INLINE_MAX_GROWTH,
+	SETTINGS_VALUE_COUNT } settings_values;
+
 void set_settings_flag(settings_flags flag);
 bool get_settings_flag(settings_flags flag);
 
+void set_settings_value(settings_values setting, int value);
+int get_settings_value(settings_values setting);
+
 void determine_endianness(void);
 bool streq(const char* a, const char* b);
 
 extern bool is_big_endian;
-extern bool last_printed_newline;
 
 char* safe_strdup_impl(const char* s, char* allocated);
 
@@ -78,6 +107,13 @@ char* safe_strdup_impl(const char* s, char* allocated);
 #define UNUSED(var) (void)(var)
 #define forever for(;;)
 
+// Variables with a separate instance for every thread.
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 // Safe Malloc Implementation
 #ifndef RELEASE
 #define safe_malloc(size) safe_malloc_impl(size, __FILE__, __LINE__)
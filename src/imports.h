@@ -12,7 +12,6 @@ typedef struct import_node {
     struct import_node* next;
 } import_node;
 
-extern import_node* imported_libraries;
 
 void add_imported_library(char *name);
 void free_imported_libraries_ll(void);
@@ -0,0 +1,660 @@
+#define _GNU_SOURCE
+#include "jit.h"
+#include "vm.h"
+#include "codegen.h"
+#include "error.h"
+#include "global.h"
+#include "state.h"
+#include "operators.h"
+#include "data.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+// Upper bound on the machine code emitted for a single instruction.
+#define JIT_MAX_TEMPLATE_SIZE 512
+
+// A rel32 operand waiting for the code of a bytecode address to be emitted.
+typedef struct jit_fixup {
+	size_t at;
+	address target;
+} jit_fixup;
+
+void jit_init(uint8_t* program, size_t size) {
+	jit_free();
+	vm->jit_bytecode = program;
+	vm->jit_bytecode_size = size;
+	vm->jit_entry_table = safe_calloc(size, sizeof(uint8_t*));
+	vm->jit_function_index = safe_calloc(size, sizeof(unsigned int));
+}
+
+void jit_record_call(address start, char* name) {
+	if (start >= vm->jit_bytecode_size) {
+		return;
+	}
+	if (!vm->jit_function_index[start]) {
+		if (vm->jit_functions_count == vm->jit_functions_capacity) {
+			if (vm->jit_functions) {
+				vm->jit_functions_capacity *= 2;
+				vm->jit_functions = safe_realloc(vm->jit_functions,
+					vm->jit_functions_capacity * sizeof(jit_function));
+			}
+			else {
+				vm->jit_functions_capacity = 16;
+				vm->jit_functions = safe_malloc(
+					vm->jit_functions_capacity * sizeof(jit_function));
+			}
+		}
+		jit_function* fn = &vm->jit_functions[vm->jit_functions_count++];
+		fn->name = safe_strdup((!name || streq(name, "self")) ?
+			"annonymous" : name);
+		fn->start = start;
+		fn->calls = 0;
+		fn->state = JIT_INTERPRETED;
+		vm->jit_function_index[start] = vm->jit_functions_count;
+	}
+	jit_function* fn = &vm->jit_functions[vm->jit_function_index[start] - 1];
+	fn->calls++;
+	if (fn->state == JIT_INTERPRETED &&
+		fn->calls >= (unsigned int)get_settings_value(SETTINGS_JIT_THRESHOLD)) {
+		fn->state = JIT_HOT;
+		vm->jit_pending = true;
+	}
+}
+
+#ifdef JIT_SUPPORTED
+
+static void emit_byte(uint8_t b) {
+	vm->jit_code[vm->jit_code_used++] = b;
+}
+
+static void emit_bytes(int count, ...) {
+	va_list ap;
+	va_start(ap, count);
+	for (int i = 0; i < count; i++) {
+		emit_byte((uint8_t)va_arg(ap, int));
+	}
+	va_end(ap);
+}
+
+static void emit_u32(uint32_t v) {
+	memcpy(vm->jit_code + vm->jit_code_used, &v, sizeof(v));
+	vm->jit_code_used += sizeof(v);
+}
+
+static void emit_u64(uint64_t v) {
+	memcpy(vm->jit_code + vm->jit_code_used, &v, sizeof(v));
+	vm->jit_code_used += sizeof(v);
+}
+
+static void patch_rel32(size_t at, uint8_t* target) {
+	int32_t rel = (int32_t)(target - (vm->jit_code + at + sizeof(int32_t)));
+	memcpy(vm->jit_code + at, &rel, sizeof(rel));
+}
+
+// emit_rel32(target) emits a rel32 operand that refers to target.
+static void emit_rel32(uint8_t* target) {
+	size_t at = vm->jit_code_used;
+	vm->jit_code_used += sizeof(int32_t);
+	patch_rel32(at, target);
+}
+
+static void set_writable(bool writable) {
+	mprotect(vm->jit_code, JIT_CODE_SIZE, writable ?
+		PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+}
+
+// Displacement of a field of the interpreter's state from r12.
+#define VM_FIELD(field) ((uint32_t)offsetof(wendy_vm, field))
+
+// emit_vm_operand(rex, op, reg, field) emits op with the register operand reg
+//   and the memory operand [r12 + field].
+static void emit_vm_operand(uint8_t rex, uint8_t op, int reg, uint32_t field) {
+	emit_bytes(2, 0x41 | rex, op);
+	emit_bytes(2, 0x84 | (reg << 3), 0x24);
+	emit_u32(field);
+}
+
+// emit_forward_jcc(cc) emits a conditional jump whose target is filled in
+//   later by patch_here(), and returns the location of its operand.
+static size_t emit_forward_jcc(uint8_t cc) {
+	emit_bytes(2, 0x0F, cc);
+	size_t at = vm->jit_code_used;
+	vm->jit_code_used += sizeof(int32_t);
+	return at;
+}
+
+static size_t emit_forward_jmp(void) {
+	emit_byte(0xE9);
+	size_t at = vm->jit_code_used;
+	vm->jit_code_used += sizeof(int32_t);
+	return at;
+}
+
+static void patch_here(size_t at) {
+	patch_rel32(at, vm->jit_code + vm->jit_code_used);
+}
+
+// The trampoline saves the registers compiled code relies on and jumps to
+//   the entry point given as the first argument:
+//     rbx = &instruction_pointer, r12 = vm, r13 = jit_entry_table
+//   Compiled code leaves through the exit stub, which restores them. When
+//   the instruction pointer moves somewhere else, like into a call, compiled
+//   code continues through the dispatch stub, which stays in compiled code if
+//   the new instruction has been compiled and nothing waits to be compiled.
+static void emit_trampoline(void) {
+	emit_bytes(1, 0x53);                         // push rbx
+	emit_bytes(2, 0x41, 0x54);                   // push r12
+	emit_bytes(2, 0x41, 0x55);                   // push r13
+	emit_bytes(2, 0x48, 0xBB);                   // movabs rbx, imm64
+	emit_u64((uint64_t)(uintptr_t)get_instruction_pointer_ref());
+	emit_bytes(2, 0x49, 0xBC);                   // movabs r12, imm64
+	emit_u64((uint64_t)(uintptr_t)vm);
+	emit_bytes(2, 0x49, 0xBD);                   // movabs r13, imm64
+	emit_u64((uint64_t)(uintptr_t)vm->jit_entry_table);
+	emit_bytes(2, 0xFF, 0xE7);                   // jmp rdi
+
+	vm->jit_exit_stub = vm->jit_code + vm->jit_code_used;
+	emit_bytes(2, 0x41, 0x5D);                   // pop r13
+	emit_bytes(2, 0x41, 0x5C);                   // pop r12
+	emit_bytes(1, 0x5B);                         // pop rbx
+	emit_bytes(1, 0xC3);                         // ret
+
+	vm->jit_dispatch_stub = vm->jit_code + vm->jit_code_used;
+	emit_bytes(2, 0x8B, 0x03);                   // mov eax, [rbx]
+	emit_byte(0x3D);                             // cmp eax, imm32
+	emit_u32((uint32_t)vm->jit_bytecode_size);
+	emit_bytes(2, 0x0F, 0x83);                   // jae exit
+	emit_rel32(vm->jit_exit_stub);
+	emit_vm_operand(0, 0x80, 7, VM_FIELD(jit_pending)); // cmp byte [r12+], 0
+	emit_byte(0x00);
+	emit_bytes(2, 0x0F, 0x85);                   // jne exit
+	emit_rel32(vm->jit_exit_stub);
+	emit_bytes(5, 0x49, 0x8B, 0x44, 0xC5, 0x00); // mov rax, [r13+rax*8]
+	emit_bytes(3, 0x48, 0x85, 0xC0);             // test rax, rax
+	emit_bytes(2, 0x0F, 0x84);                   // jz exit
+	emit_rel32(vm->jit_exit_stub);
+	emit_bytes(2, 0xFF, 0xE0);                   // jmp rax
+}
+
+static bool ensure_code_region(void) {
+	if (vm->jit_code) {
+		return true;
+	}
+	void* region = mmap(0, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) {
+		return false;
+	}
+	vm->jit_code = region;
+	vm->jit_code_used = 0;
+	emit_trampoline();
+	set_writable(false);
+	return true;
+}
+
+// branch_target(a) returns the jump target of the instruction at a if it
+//   has one encoded as an operand, or 0 otherwise.
+static address branch_target(address a) {
+	opcode op = vm->jit_bytecode[a];
+	unsigned int operand = a + 1;
+	if (op == OP_JMP || op == OP_JIF || op == OP_LJMP || op == OP_APPEND ||
+		op == OP_LGEN) {
+		return get_address(vm->jit_bytecode + operand, &operand);
+	}
+	return 0;
+}
+
+// The function body being compiled.
+typedef struct jit_compiler {
+	address start;
+	address end;
+	// Whether an instruction starts at each address of the body.
+	bool* boundary;
+	// Offset of the compiled code of each instruction in the code region.
+	size_t* native;
+	jit_fixup* fixups;
+	size_t fixups_count;
+} jit_compiler;
+
+static bool in_body(jit_compiler* c, address a) {
+	return a >= c->start && a < c->end && c->boundary[a - c->start];
+}
+
+// emit_jump_to(c, target) continues execution at the bytecode address target.
+static void emit_jump_to(jit_compiler* c, address target) {
+	if (in_body(c, target)) {
+		emit_byte(0xE9);                         // jmp rel32
+		c->fixups[c->fixups_count++] = (jit_fixup){ vm->jit_code_used, target };
+		vm->jit_code_used += sizeof(int32_t);
+	}
+	else {
+		emit_bytes(2, 0xC7, 0x03);               // mov dword [rbx], imm32
+		emit_u32(target);
+		emit_byte(0xE9);                         // jmp dispatch
+		emit_rel32(vm->jit_dispatch_stub);
+	}
+}
+
+// emit_branch_to(c, cc, target) continues execution at target if the
+//   condition cc of a jcc rel32 holds.
+static void emit_branch_to(jit_compiler* c, uint8_t cc, address target) {
+	if (in_body(c, target)) {
+		emit_bytes(2, 0x0F, cc);                 // jcc rel32
+		c->fixups[c->fixups_count++] = (jit_fixup){ vm->jit_code_used, target };
+		vm->jit_code_used += sizeof(int32_t);
+	}
+	else {
+		// The opposite condition skips the jump.
+		size_t skip = emit_forward_jcc(cc ^ 1);
+		emit_jump_to(c, target);
+		patch_here(skip);
+	}
+}
+
+// emit_handler_call(c, a) emits a call to the handler of the instruction at a,
+//   which is how everything but the templates below is compiled.
+static void emit_handler_call(jit_compiler* c, address a) {
+	opcode op = vm->jit_bytecode[a];
+	address next = next_instruction(vm->jit_bytecode, a);
+	address target = branch_target(a);
+	emit_bytes(2, 0xC7, 0x03);                   // mov dword [rbx], imm32
+	emit_u32(a + 1);
+	emit_bytes(2, 0x48, 0xB8);                   // movabs rax, imm64
+	emit_u64((uint64_t)(uintptr_t)get_opcode_handler(op));
+	emit_bytes(2, 0xFF, 0xD0);                   // call rax
+	if (op != OP_MPTR) {
+		// Every other handler may raise an error.
+		emit_vm_operand(0, 0x80, 7, VM_FIELD(error_flag)); // cmp byte [r12+], 0
+		emit_byte(0x00);
+		emit_bytes(2, 0x0F, 0x85);               // jne exit
+		emit_rel32(vm->jit_exit_stub);
+	}
+	emit_bytes(2, 0x8B, 0x03);                   // mov eax, [rbx]
+	emit_byte(0x3D);                             // cmp eax, imm32
+	emit_u32(next);
+	if ((op == OP_JIF || op == OP_LJMP || op == OP_APPEND || op == OP_LGEN) &&
+		in_body(c, target)) {
+		// Fall through if the branch was not taken, otherwise jump
+		//   straight to the compiled target.
+		emit_bytes(2, 0x74, 0x10);               // je +16
+		emit_byte(0x3D);                         // cmp eax, imm32
+		emit_u32(target);
+		emit_branch_to(c, 0x84, target);         // je rel32
+		emit_byte(0xE9);                         // jmp dispatch
+		emit_rel32(vm->jit_dispatch_stub);
+	}
+	else {
+		// Anything else that moves the instruction pointer, like calls
+		//   and returns, continues through the dispatch stub.
+		emit_bytes(2, 0x0F, 0x85);               // jne dispatch
+		emit_rel32(vm->jit_dispatch_stub);
+	}
+}
+
+// Number operations with an inline template, and the quickened forms whose
+//   guard they share.
+static opcode inline_number_form(operator o) {
+	switch (o) {
+		case O_ADD: return OP_ADDNN;
+		case O_SUB: return OP_SUBNN;
+		case O_MUL: return OP_MULNN;
+		case O_LT: return OP_LTNN;
+		case O_GT: return OP_GTNN;
+		case O_LTE: return OP_LTENN;
+		case O_GTE: return OP_GTENN;
+		case O_EQ: return OP_EQNN;
+		case O_NEQ: return OP_NEQNN;
+		default: return OP_BIN;
+	}
+}
+
+// emit_number_guard(a, form, slow) emits the guard of op_addnn and friends
+//   for the binary site at a: the site has been quickened into form, no
+//   overload was bound since, and both operands are numbers. Jumps that fail
+//   the guard are stored in slow, and their count is returned. On success
+//   rcx points to the top cell of the argument stack, xmm0 holds the left
+//   operand and xmm1 the right one.
+static size_t emit_number_guard(address a, opcode form, size_t* slow) {
+	size_t count = 0;
+	uint8_t top = sizeof(data);
+	uint8_t below = 2 * sizeof(data);
+	uint8_t value = offsetof(data, value);
+	uint8_t o = vm->jit_bytecode[a + 1] & ~QUICKENED_REVERSED;
+	emit_bytes(2, 0x48, 0xB8);                   // movabs rax, imm64
+	emit_u64((uint64_t)(uintptr_t)(vm->jit_bytecode + a));
+	emit_bytes(3, 0x0F, 0xB7, 0x00);             // movzx eax, word [rax]
+	emit_byte(0x3D);                             // cmp eax, imm32
+	emit_u32(form | o << 8);
+	slow[count++] = emit_forward_jcc(0x85);      // jne slow
+	emit_vm_operand(0, 0x8B, 0, VM_FIELD(overload_epoch)); // mov eax, [r12+]
+	emit_vm_operand(0, 0x3B, 0, VM_FIELD(quickened_epoch)); // cmp eax, [r12+]
+	slow[count++] = emit_forward_jcc(0x85);      // jne slow
+	emit_vm_operand(0, 0x8B, 1, VM_FIELD(arg_pointer)); // mov ecx, [r12+]
+	emit_bytes(3, 0x8D, 0x41, 0x02);             // lea eax, [rcx+2]
+	emit_byte(0x3D);                             // cmp eax, imm32
+	emit_u32(MEMORY_SIZE);
+	slow[count++] = emit_forward_jcc(0x83);      // jae slow
+	emit_bytes(3, 0x48, 0x69, 0xC9);             // imul rcx, rcx, imm32
+	emit_u32(sizeof(data));
+	emit_vm_operand(0x08, 0x03, 1, VM_FIELD(memory)); // add rcx, [r12+]
+	emit_bytes(3, 0x81, 0x79, top);              // cmp dword [rcx+top], imm32
+	emit_u32(D_NUMBER);
+	slow[count++] = emit_forward_jcc(0x85);      // jne slow
+	emit_bytes(3, 0x81, 0x79, below);            // cmp dword [rcx+below], imm32
+	emit_u32(D_NUMBER);
+	slow[count++] = emit_forward_jcc(0x85);      // jne slow
+	emit_bytes(5, 0xF2, 0x0F, 0x10, 0x41, below + value); // movsd xmm0, [rcx+]
+	emit_bytes(5, 0xF2, 0x0F, 0x10, 0x49, top + value);   // movsd xmm1, [rcx+]
+	return count;
+}
+
+// emit_number_arithmetic(c, a, form) emits the template of a binary site at a
+//   that computes a number, like op_addnn does.
+static void emit_number_arithmetic(jit_compiler* c, address a, opcode form) {
+	size_t slow[8];
+	size_t slow_count = emit_number_guard(a, form, slow);
+	uint8_t top = sizeof(data);
+	uint8_t below = 2 * sizeof(data);
+	uint8_t value = offsetof(data, value);
+	uint8_t instruction = form == OP_ADDNN ? 0x58 : form == OP_SUBNN ? 0x5C : 0x59;
+	emit_bytes(4, 0xF2, 0x0F, instruction, 0xC1); // addsd/subsd/mulsd xmm0, xmm1
+	emit_bytes(5, 0xF2, 0x0F, 0x11, 0x41, below + value); // movsd [rcx+], xmm0
+	emit_bytes(3, 0xC7, 0x41, top);              // mov dword [rcx+top], imm32
+	emit_u32(D_EMPTY);
+	emit_vm_operand(0, 0xFF, 0, VM_FIELD(arg_pointer)); // inc dword [r12+]
+	size_t done = emit_forward_jmp();
+	for (size_t s = 0; s < slow_count; s++) {
+		patch_here(slow[s]);
+	}
+	emit_handler_call(c, a);
+	patch_here(done);
+}
+
+// emit_number_condition(c, a, form) emits the template of a number comparison
+//   at a whose result is only tested by the JIF after it. The comparison and
+//   the jump are done together, without creating the boolean. The JIF keeps
+//   its own code, which the slow path falls through to.
+static void emit_number_condition(jit_compiler* c, address a, opcode form) {
+	size_t slow[8];
+	size_t slow_count = emit_number_guard(a, form, slow);
+	uint8_t top = sizeof(data);
+	uint8_t below = 2 * sizeof(data);
+	address jif = next_instruction(vm->jit_bytecode, a);
+	address target = branch_target(jif);
+	// Unordered compares, where one side is NaN, clear seta and setae.
+	switch (form) {
+		case OP_LTNN:
+			emit_bytes(4, 0x66, 0x0F, 0x2E, 0xC8); // ucomisd xmm1, xmm0
+			emit_bytes(3, 0x0F, 0x97, 0xC0);     // seta al
+			break;
+		case OP_GTNN:
+			emit_bytes(4, 0x66, 0x0F, 0x2E, 0xC1); // ucomisd xmm0, xmm1
+			emit_bytes(3, 0x0F, 0x97, 0xC0);     // seta al
+			break;
+		case OP_LTENN:
+			emit_bytes(4, 0x66, 0x0F, 0x2E, 0xC8); // ucomisd xmm1, xmm0
+			emit_bytes(3, 0x0F, 0x93, 0xC0);     // setae al
+			break;
+		case OP_GTENN:
+			emit_bytes(4, 0x66, 0x0F, 0x2E, 0xC1); // ucomisd xmm0, xmm1
+			emit_bytes(3, 0x0F, 0x93, 0xC0);     // setae al
+			break;
+		case OP_EQNN:
+			emit_bytes(4, 0x66, 0x0F, 0x2E, 0xC1); // ucomisd xmm0, xmm1
+			emit_bytes(3, 0x0F, 0x94, 0xC0);     // sete al
+			emit_bytes(3, 0x0F, 0x9B, 0xC2);     // setnp dl
+			emit_bytes(2, 0x20, 0xD0);           // and al, dl
+			break;
+		default:
+			emit_bytes(4, 0x66, 0x0F, 0x2E, 0xC1); // ucomisd xmm0, xmm1
+			emit_bytes(3, 0x0F, 0x95, 0xC0);     // setne al
+			emit_bytes(3, 0x0F, 0x9A, 0xC2);     // setp dl
+			emit_bytes(2, 0x08, 0xD0);           // or al, dl
+			break;
+	}
+	// Pop both operands, the JIF would pop the boolean.
+	emit_bytes(3, 0xC7, 0x41, top);              // mov dword [rcx+top], imm32
+	emit_u32(D_EMPTY);
+	emit_bytes(3, 0xC7, 0x41, below);            // mov dword [rcx+below], imm32
+	emit_u32(D_EMPTY);
+	emit_vm_operand(0, 0x83, 0, VM_FIELD(arg_pointer)); // add dword [r12+], 2
+	emit_byte(0x02);
+	emit_bytes(2, 0x84, 0xC0);                   // test al, al
+	emit_branch_to(c, 0x84, target);             // jz target
+	emit_jump_to(c, next_instruction(vm->jit_bytecode, jif));
+	for (size_t s = 0; s < slow_count; s++) {
+		patch_here(slow[s]);
+	}
+	emit_handler_call(c, a);
+}
+
+// emit_push_constant(c, a, constant) emits the template of a PUSH at a of a
+//   constant without a string, which is push_arg() for the common case: the
+//   cell is empty, the operand stack has room and the free list isn't, so
+//   nothing needs to be destroyed or collected.
+static void emit_push_constant(jit_compiler* c, address a, data constant) {
+	size_t slow[8];
+	size_t slow_count = 0;
+	uint64_t bits;
+	memcpy(&bits, &constant.value, sizeof(bits));
+	emit_vm_operand(0, 0x8B, 1, VM_FIELD(arg_pointer)); // mov ecx, [r12+]
+	emit_bytes(2, 0x81, 0xF9);                   // cmp ecx, imm32
+	emit_u32(MEMORY_SIZE - ARGSTACK_SIZE + 1);
+	slow[slow_count++] = emit_forward_jcc(0x86); // jbe slow
+	emit_vm_operand(0x08, 0x8B, 2, VM_FIELD(free_memory)); // mov rdx, [r12+]
+	emit_bytes(3, 0x48, 0x85, 0xD2);             // test rdx, rdx
+	slow[slow_count++] = emit_forward_jcc(0x84); // jz slow
+	emit_bytes(5, 0x48, 0x83, 0x7A, offsetof(mem_block, size), 0x00); // cmp qword [rdx+], 0
+	slow[slow_count++] = emit_forward_jcc(0x84); // je slow
+	emit_bytes(3, 0x48, 0x69, 0xD1);             // imul rdx, rcx, imm32
+	emit_u32(sizeof(data));
+	emit_vm_operand(0x08, 0x03, 2, VM_FIELD(memory)); // add rdx, [r12+]
+	emit_bytes(2, 0x81, 0x3A);                   // cmp dword [rdx], imm32
+	emit_u32(D_EMPTY);
+	emit_bytes(2, 0x74, 0x0C);                   // je +12
+	emit_bytes(2, 0x81, 0x3A);                   // cmp dword [rdx], imm32
+	emit_u32(D_NUMBER);
+	slow[slow_count++] = emit_forward_jcc(0x85); // jne slow
+	emit_bytes(2, 0xC7, 0x02);                   // mov dword [rdx], imm32
+	emit_u32(constant.type);
+	emit_bytes(2, 0x48, 0xB8);                   // movabs rax, imm64
+	emit_u64(bits);
+	emit_bytes(4, 0x48, 0x89, 0x42, offsetof(data, value)); // mov [rdx+], rax
+	emit_vm_operand(0x08, 0x89, 0, VM_FIELD(last_pushed_identifier)); // mov [r12+], rax
+	emit_vm_operand(0, 0xFF, 1, VM_FIELD(arg_pointer)); // dec dword [r12+]
+	// The operand stack now holds MEMORY_SIZE - ecx cells.
+	emit_byte(0xB8);                             // mov eax, imm32
+	emit_u32(MEMORY_SIZE);
+	emit_bytes(2, 0x29, 0xC8);                   // sub eax, ecx
+	emit_vm_operand(0, 0x3B, 0, VM_FIELD(stats.peak_operand_stack)); // cmp eax, [r12+]
+	emit_bytes(2, 0x76, 0x08);                   // jbe +8
+	emit_vm_operand(0, 0x89, 0, VM_FIELD(stats.peak_operand_stack)); // mov [r12+], eax
+	size_t done = emit_forward_jmp();
+	for (size_t s = 0; s < slow_count; s++) {
+		patch_here(slow[s]);
+	}
+	emit_handler_call(c, a);
+	patch_here(done);
+}
+
+// constant_operand(a) returns the operand of the PUSH at a.
+static data constant_operand(address a) {
+	unsigned int operand = a + 1;
+	return get_data(vm->jit_bytecode + operand, &operand);
+}
+
+// compile_function(fn) compiles the body of fn, returning false if it could
+//   not be compiled.
+static bool compile_function(jit_function* fn) {
+	// Codegen lays each function out as: JMP <end> <body> <end>:
+	address start = fn->start;
+	if (start < 1 + sizeof(address) ||
+		vm->jit_bytecode[start - 1 - sizeof(address)] != OP_JMP) {
+		return false;
+	}
+	unsigned int operand = start - sizeof(address);
+	address end = get_address(vm->jit_bytecode + operand, &operand);
+	if (end <= start || end > vm->jit_bytecode_size) {
+		return false;
+	}
+	// Validate the body and find its instruction boundaries.
+	jit_compiler c = { start, end, 0, 0, 0, 0 };
+	c.boundary = safe_calloc(end - start, sizeof(bool));
+	size_t instructions = 0;
+	address a = start;
+	while (a < end) {
+		opcode op = vm->jit_bytecode[a];
+		if (op >= OPCODE_COUNT || op == OP_HALT || op == OP_RANGE) {
+			break;
+		}
+		c.boundary[a - start] = true;
+		instructions++;
+		a = next_instruction(vm->jit_bytecode, a);
+	}
+	if (a != end || !ensure_code_region() ||
+		vm->jit_code_used + (instructions + 1) * JIT_MAX_TEMPLATE_SIZE >
+			JIT_CODE_SIZE) {
+		safe_free(c.boundary);
+		return false;
+	}
+	c.native = safe_malloc((end - start) * sizeof(size_t));
+	c.fixups = safe_malloc(3 * instructions * sizeof(jit_fixup));
+
+	set_writable(true);
+	for (a = start; a < end; a = next_instruction(vm->jit_bytecode, a)) {
+		opcode op = vm->jit_bytecode[a];
+		address next = next_instruction(vm->jit_bytecode, a);
+		c.native[a - start] = vm->jit_code_used;
+		if (op == OP_JMP) {
+			// Unconditional jumps need no handler at all.
+			emit_jump_to(&c, branch_target(a));
+		}
+		else if (op == OP_SRC) {
+			operand = a + 1;
+			emit_vm_operand(0, 0xC7, 0, VM_FIELD(line)); // mov dword [r12+], imm32
+			emit_u32(get_address(vm->jit_bytecode + operand, &operand));
+		}
+		else if (op == OP_PUSH && is_numeric(constant_operand(a))) {
+			emit_push_constant(&c, a, constant_operand(a));
+		}
+		else if (op == OP_BIN || op == OP_RBIN || is_quickened_opcode(op)) {
+			// Quickening rewrites the site at runtime, so the template for
+			//   numbers checks which form the site has each time.
+			opcode form = inline_number_form(
+				vm->jit_bytecode[a + 1] & ~QUICKENED_REVERSED);
+			if (form == OP_ADDNN || form == OP_SUBNN || form == OP_MULNN) {
+				emit_number_arithmetic(&c, a, form);
+			}
+			else if (form != OP_BIN && next < end &&
+				vm->jit_bytecode[next] == OP_JIF) {
+				emit_number_condition(&c, a, form);
+			}
+			else {
+				emit_handler_call(&c, a);
+			}
+		}
+		else {
+			emit_handler_call(&c, a);
+		}
+	}
+	// Falling off the end of the body leaves it.
+	emit_jump_to(&c, end);
+	for (size_t f = 0; f < c.fixups_count; f++) {
+		patch_rel32(c.fixups[f].at,
+			vm->jit_code + c.native[c.fixups[f].target - start]);
+	}
+	set_writable(false);
+
+	for (a = start; a < end; a = next_instruction(vm->jit_bytecode, a)) {
+		vm->jit_entry_table[a] = vm->jit_code + c.native[a - start];
+	}
+	safe_free(c.fixups);
+	safe_free(c.native);
+	safe_free(c.boundary);
+	return true;
+}
+
+void jit_execute(uint8_t* entry) {
+	((void (*)(uint8_t*))vm->jit_code)(entry);
+}
+
+#else
+
+static bool compile_function(jit_function* fn) {
+	UNUSED(fn);
+	return false;
+}
+
+void jit_execute(uint8_t* entry) {
+	UNUSED(entry);
+}
+
+#endif
+
+void jit_compile_pending() {
+	if (!vm->jit_pending) {
+		return;
+	}
+	vm->jit_pending = false;
+	for (size_t f = 0; f < vm->jit_functions_count; f++) {
+		if (vm->jit_functions[f].state == JIT_HOT) {
+			vm->jit_functions[f].state = compile_function(&vm->jit_functions[f]) ?
+				JIT_COMPILED : JIT_REJECTED;
+		}
+	}
+}
+
+static int compare_calls(const void* a, const void* b) {
+	const jit_function* fa = a;
+	const jit_function* fb = b;
+	if (fa->calls != fb->calls) {
+		return fa->calls < fb->calls ? 1 : -1;
+	}
+	return fa->start < fb->start ? -1 : 1;
+}
+
+void jit_print_report(FILE* buffer) {
+	fprintf(buffer, "JIT Report (threshold %d)\n",
+		get_settings_value(SETTINGS_JIT_THRESHOLD));
+	fprintf(buffer, "%-12s %-12s %s\n", "calls", "status", "function");
+	qsort(vm->jit_functions, vm->jit_functions_count, sizeof(jit_function), compare_calls);
+	for (size_t f = 0; f < vm->jit_functions_count; f++) {
+		if (vm->jit_function_index) {
+			vm->jit_function_index[vm->jit_functions[f].start] = f + 1;
+		}
+		fprintf(buffer, "%-12u %-12s %s (0x%X)\n", vm->jit_functions[f].calls,
+			vm->jit_functions[f].state == JIT_COMPILED ? "compiled" : "interpreted",
+			vm->jit_functions[f].name, vm->jit_functions[f].start);
+	}
+}
+
+void jit_free() {
+#ifdef JIT_SUPPORTED
+	if (vm->jit_code) {
+		munmap(vm->jit_code, JIT_CODE_SIZE);
+	}
+#endif
+	vm->jit_code = 0;
+	vm->jit_code_used = 0;
+	vm->jit_exit_stub = 0;
+	vm->jit_dispatch_stub = 0;
+	for (size_t f = 0; f < vm->jit_functions_count; f++) {
+		safe_free(vm->jit_functions[f].name);
+	}
+	if (vm->jit_functions) safe_free(vm->jit_functions);
+	if (vm->jit_function_index) safe_free(vm->jit_function_index);
+	if (vm->jit_entry_table) safe_free(vm->jit_entry_table);
+	vm->jit_functions = 0;
+	vm->jit_functions_count = 0;
+	vm->jit_functions_capacity = 0;
+	vm->jit_function_index = 0;
+	vm->jit_entry_table = 0;
+	vm->jit_pending = false;
+}
@@ -0,0 +1,63 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "memory.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// jit.h - Felix Guo
+// Baseline template compiler for hot WendyScript functions. Every function
+//   entry is counted by the [vm]; once a function has been called
+//   --jit-threshold times its body is translated into x86-64 machine code.
+//   Jumps, line markers, pushes of number constants and number arithmetic
+//   get inline templates, and a number comparison feeding a JIF branches
+//   directly without creating the boolean. The templates share the guards of
+//   the quickened opcodes and call the opcode handler when those fail, like
+//   every other instruction does. Calls and returns into compiled code stay
+//   in compiled code; anything else goes back to the interpreter, so errors
+//   behave exactly as they do when interpreted.
+// On other platforms every function stays interpreted.
+
+// The compiler keeps its state in the interpreter's [state]:
+//   jit_entry_table maps each bytecode address to compiled code that resumes
+//   execution at that instruction, or 0 if the instruction is interpreted.
+//   jit_pending is set when a function crossed the threshold and is waiting
+//   to be compiled by jit_compile_pending().
+
+typedef enum jit_state {
+	JIT_INTERPRETED, JIT_HOT, JIT_COMPILED, JIT_REJECTED
+} jit_state;
+
+typedef struct jit_function {
+	char* name;
+	address start;
+	unsigned int calls;
+	jit_state state;
+} jit_function;
+
+// jit_init(bytecode, size) prepares the compiler for the given program.
+void jit_init(uint8_t* bytecode, size_t size);
+
+// jit_record_call(start, name) counts a call to the function whose body
+//   starts at start, and marks it for compilation once it becomes hot.
+void jit_record_call(address start, char* name);
+
+// jit_compile_pending() compiles functions that have become hot. It must be
+//   called from the interpreter loop, never from compiled code.
+void jit_compile_pending(void);
+
+// jit_execute(entry) runs compiled code until control leaves a compiled
+//   function, leaving the instruction pointer at the next instruction to
+//   interpret.
+void jit_execute(uint8_t* entry);
+
+// jit_print_report(buffer) prints the call counts and compilation status of
+//   every function that was called.
+void jit_print_report(FILE* buffer);
+
+// jit_free() releases the compiled code and all JIT bookkeeping.
+void jit_free(void);
+
+#endif
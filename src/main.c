@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "memory.h"
 #include "error.h"
 #include "execpath.h"
@@ -13,10 +14,20 @@
 #include "data.h"
 #include "dependencies.h"
 #include "imports.h"
+#include "jit.h"
+#include "profiler.h"
+#include "files.h"
+#include "stats.h"
+#include "state.h"
+#include "cache.h"
 #include <string.h>
 #include <stdio.h>
 
 #ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+
 char* readline(char* prompt) {
 	fputs(prompt, stdout);
 	char* cpy = safe_malloc(INPUT_BUFFER_SIZE);
@@ -32,6 +43,7 @@ void clear_console(void) {
 	system("cls");
 }
 #else
+#include <unistd.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
@@ -52,7 +64,9 @@ void invalid_usage(void) {
 	printf("Options:\n");
 	printf("    -h, --help        : shows this message.\n");
 	printf("    --nogc            : disables garbage-collection.\n");
-	printf("    --optimize        : enables optimization algorithm (this will destroy overloaded primitive operators).\n");
+	printf("    --optimize        : enables constant propagation, folding and dead code elimination.\n");
+	printf("    --inline-max-size=N   : largest function body, in AST nodes, that --optimize inlines, defaults to %d.\n", INLINE_DEFAULT_MAX_SIZE);
+	printf("    --inline-max-growth=N : percentage the program may grow by through inlining, defaults to %d.\n", INLINE_DEFAULT_MAX_GROWTH);
 	printf("    --trace-vm        : traces each VM instruction.\n");
     printf("    --dry-run         : compiles but does not write to a file or invoke the VM.\n");
 	printf("    -c, --compile     : compiles the given file but does not run.\n");
@@ -62,10 +76,29 @@ void invalid_usage(void) {
 	printf("    -d --disassemble  : prints out the disassembled bytecode.\n");
 	printf("    --dependencies    : prints out the module dependencies of the file.\n");
 	printf("    --sandbox         : runs the VM in sandboxed mode, ie. no file access and no native execution calls.\n");
+	printf("    --jit             : compiles hot functions to machine code (x86-64 Linux only).\n");
+	printf("    --jit-threshold=N : number of calls before a function is compiled, defaults to %d.\n", JIT_DEFAULT_THRESHOLD);
+	printf("    --jit-report      : enables the JIT and prints which functions were compiled on exit.\n");
+	printf("    --profile=path    : samples the running program and writes collapsed stacks for flamegraphs to path.\n");
+	printf("    --profile-report  : samples the running program and prints time spent per function and line on exit.\n");
+	printf("    --stats           : prints opcode, allocation and garbage collection counters on exit, turns off --jit.\n");
+	printf("    --stats-json=path : writes the --stats counters to path as JSON.\n");
+	printf("    --no-cache        : compiles source files even if $WENDY_CACHE or ~/.cache/wendy has their bytecode.\n");
 	printf("\nWendy will enter REPL mode if no parameters are supplied.\n");
 	safe_exit(1);
 }
 
+// Program output goes through this buffer. A person watching a terminal
+//   sees each line as it is printed, otherwise output is written in large
+//   blocks, and the buffer is flushed before reading input and on exit.
+static char output_buffer[OUTPUT_BUFFER_SIZE];
+
+// Output of --profile, if given.
+static char* profile_path = NULL;
+
+// Output of --stats-json, if given.
+static char* stats_path = NULL;
+
 // The first non-valid option is typically the file name / source string.
 // The other non-valid options are the arguments.
 // Returns true if user prompted for help.
@@ -103,6 +136,48 @@ bool process_options(char** options, int len, char** source) {
 		else if (streq("--sandbox", options[i])) {
 			set_settings_flag(SETTINGS_SANDBOXED);
 		}
+		else if (streq("--jit", options[i])) {
+			set_settings_flag(SETTINGS_JIT);
+		}
+		else if (streq("--jit-report", options[i])) {
+			set_settings_flag(SETTINGS_JIT);
+			set_settings_flag(SETTINGS_JIT_REPORT);
+		}
+		else if (strncmp("--profile=", options[i],
+				strlen("--profile=")) == 0) {
+			set_settings_flag(SETTINGS_PROFILE);
+			profile_path = options[i] + strlen("--profile=");
+		}
+		else if (streq("--profile-report", options[i])) {
+			set_settings_flag(SETTINGS_PROFILE);
+			set_settings_flag(SETTINGS_PROFILE_REPORT);
+		}
+		else if (streq("--no-cache", options[i])) {
+			set_settings_flag(SETTINGS_NO_CACHE);
+		}
+		else if (streq("--stats", options[i])) {
+			set_settings_flag(SETTINGS_STATS);
+		}
+		else if (strncmp("--stats-json=", options[i],
+				strlen("--stats-json=")) == 0) {
+			set_settings_flag(SETTINGS_STATS_JSON);
+			stats_path = options[i] + strlen("--stats-json=");
+		}
+		else if (strncmp("--jit-threshold=", options[i],
+				strlen("--jit-threshold=")) == 0) {
+			set_settings_value(SETTINGS_JIT_THRESHOLD,
+				atoi(options[i] + strlen("--jit-threshold=")));
+		}
+		else if (strncmp("--inline-max-size=", options[i],
+				strlen("--inline-max-size=")) == 0) {
+			set_settings_value(SETTINGS_INLINE_MAX_SIZE,
+				atoi(options[i] + strlen("--inline-max-size=")));
+		}
+		else if (strncmp("--inline-max-growth=", options[i],
+				strlen("--inline-max-growth=")) == 0) {
+			set_settings_value(SETTINGS_INLINE_MAX_GROWTH,
+				atoi(options[i] + strlen("--inline-max-growth=")));
+		}
 		else if (streq("-t", options[i]) ||
 				 streq("--token-list", options[i])) {
 			set_settings_flag(SETTINGS_TOKEN_LIST_PRINT);
@@ -129,24 +204,24 @@ bool process_options(char** options, int len, char** source) {
 			break;
 		}
 	}
-	program_arguments_count = len - i;
-	program_arguments = &options[i];
+	vm->program_arguments_count = len - i;
+	vm->program_arguments = &options[i];
 	return false;
 }
 
 void run(char* input_string) {
-	size_t alloc_size = 0;
+	arena front_end = { 0 };
 	token* tokens;
 	size_t tokens_count;
 	reset_error_flag();
-	tokens_count = scan_tokens(input_string, &tokens, &alloc_size);
+	tokens_count = scan_tokens(&front_end, input_string, &tokens);
 	if (get_settings_flag(SETTINGS_TOKEN_LIST_PRINT)) {
 		print_token_list(tokens, tokens_count);
 	}
 
-	statement_list* ast = generate_ast(tokens, tokens_count);
+	statement_list* ast = generate_ast(&front_end, tokens, tokens_count);
 	if (get_settings_flag(SETTINGS_OPTIMIZE)) {
-		ast = optimize_ast(ast);
+		ast = optimize_ast(&front_end, ast);
 	}
 	if (get_settings_flag(SETTINGS_ASTPRINT)) {
 		print_ast(ast);
@@ -158,12 +233,11 @@ void run(char* input_string) {
 			print_bytecode(bytecode, stdout);
 		}
 		if (!get_error_flag()) {
-			vm_run(bytecode, size);
+			vm_run(vm, bytecode, size);
 		}
 		safe_free(bytecode);
 	}
-	free_ast(ast);
-	free_token_list(tokens, tokens_count);
+	arena_free(&front_end);
 }
 
 bool bracket_check(char* source) {
@@ -211,12 +285,12 @@ int repl(void) {
 	// ENTER REPL MODE
 	set_settings_flag(SETTINGS_REPL);
 	push_frame("main", 0, 0);
-	bool has_run = false;
 	forever {
 		size_t source_size = 1;
 		source_to_run[0] = 0;
 		bool first = true;
 		// Perform bracket check to determine whether or not to execute:
+		fflush(stdout);
 		while (!bracket_check(source_to_run)) {
 			if (first) {
 				input_buffer = readline("> ");
@@ -237,23 +311,21 @@ int repl(void) {
 		}
 		add_history(source_to_run);
 		run(source_to_run);
-		has_run = true;
 		unwind_stack();
 	}
 
 cleanup:
-	free_imported_libraries_ll();
 	safe_free(source_to_run);
-	c_free_memory();
-	if (has_run) {
-		vm_cleanup_if_repl();
-	}
+	vm_destroy(vm);
 	check_leak();
 	return 0;
 }
 
 int main(int argc, char** argv) {
-	init_memory();
+	vm_enter(vm_create());
+	stats_start();
+	setvbuf(stdout, output_buffer, isatty(fileno(stdout)) ? _IOLBF : _IOFBF,
+		OUTPUT_BUFFER_SIZE);
 	determine_endianness();
 	char *option_result;
 	if (process_options(&argv[1], argc - 1, &option_result)) {
@@ -264,6 +336,9 @@ int main(int argc, char** argv) {
 		return repl();
 	}
 	set_settings_flag(SETTINGS_STRICT_ERROR);
+	if (get_settings_flag(SETTINGS_PROFILE)) {
+		profiler_start(profile_path);
+	}
 	// FILE READ MODE
 	long length = 0;
 	int file_name_length = strlen(option_result);
@@ -295,21 +370,34 @@ int main(int argc, char** argv) {
 		init_source(file, option_result, length, true);
 		// Text Source
 		char* buffer = get_source_buffer();
+		// Options that look at the front end always need it to run.
+		bool use_cache = !get_settings_flag(SETTINGS_NO_CACHE) &&
+			!get_settings_flag(SETTINGS_COMPILE) &&
+			!get_settings_flag(SETTINGS_TOKEN_LIST_PRINT) &&
+			!get_settings_flag(SETTINGS_ASTPRINT) &&
+			!get_settings_flag(SETTINGS_OUTPUT_DEPENDENCIES);
+		if (use_cache &&
+			(bytecode_stream = cache_load(buffer, strlen(buffer), &size))) {
+			goto loaded;
+		}
+		if (use_cache) {
+			cache_begin();
+		}
 		// Begin Processing the File
-		size_t alloc_size = 0;
+		arena front_end = { 0 };
 		token* tokens;
 		size_t tokens_count;
 
 		// Scanning and Tokenizing
-		tokens_count = scan_tokens(buffer, &tokens, &alloc_size);
+		tokens_count = scan_tokens(&front_end, buffer, &tokens);
 		if (get_settings_flag(SETTINGS_TOKEN_LIST_PRINT)) {
 			print_token_list(tokens, tokens_count);
 		}
 
 		// Build AST
-		statement_list* ast = generate_ast(tokens, tokens_count);
+		statement_list* ast = generate_ast(&front_end, tokens, tokens_count);
 		if (get_settings_flag(SETTINGS_OPTIMIZE)) {
-			ast = optimize_ast(ast);
+			ast = optimize_ast(&front_end, ast);
 		}
 		if (get_settings_flag(SETTINGS_ASTPRINT)) {
 			print_ast(ast);
@@ -318,16 +406,18 @@ int main(int argc, char** argv) {
 		if (get_settings_flag(SETTINGS_OUTPUT_DEPENDENCIES)) {
 			// Perform static analysis to output dependencies
 			print_dependencies(ast);
-			free_token_list(tokens, tokens_count);
-			free_ast(ast);
+			arena_free(&front_end);
 			goto wendy_exit;
 		}
 		else {
 			// Generate Bytecode
 			bytecode_stream = generate_code(ast, &size);
 		}
-		free_token_list(tokens, tokens_count);
-		free_ast(ast);
+		arena_free(&front_end);
+		if (use_cache) {
+			cache_store(buffer, strlen(buffer),
+				get_error_flag() ? 0 : bytecode_stream, size);
+		}
 	}
 	else {
 		// Compiled Source
@@ -351,8 +441,9 @@ int main(int argc, char** argv) {
 		}
 		safe_free(search_name);
 		bytecode_stream = safe_malloc(sizeof(uint8_t) * length);
-		fread(bytecode_stream, sizeof(uint8_t), length, file);
+		size = fread(bytecode_stream, sizeof(uint8_t), length, file);
 	}
+loaded:
 	fclose(file);
 	if (get_settings_flag(SETTINGS_DISASSEMBLE)) {
 		print_bytecode(bytecode_stream, stdout);
@@ -381,17 +472,30 @@ int main(int argc, char** argv) {
 	}
 	else {
 		push_frame("main", 0, 0);
-		vm_run(bytecode_stream, size);
-		if (!last_printed_newline) {
+		vm_run(vm, bytecode_stream, size);
+		if (!vm->last_printed_newline) {
 			printf("\n");
 		}
 	}
 	safe_free(bytecode_stream);
 
 wendy_exit:
-	free_imported_libraries_ll();
-	free_source();
-	c_free_memory();
+	if (get_settings_flag(SETTINGS_PROFILE)) {
+		profiler_stop();
+		if (get_settings_flag(SETTINGS_PROFILE_REPORT)) {
+			profiler_print_report(stderr);
+		}
+	}
+	if (get_settings_flag(SETTINGS_JIT_REPORT)) {
+		jit_print_report(stderr);
+	}
+	if (get_settings_flag(SETTINGS_STATS)) {
+		stats_print(stderr);
+	}
+	if (get_settings_flag(SETTINGS_STATS_JSON)) {
+		stats_write_json(stats_path);
+	}
+	vm_destroy(vm);
 	check_leak();
 	return 0;
 }
@@ -1,153 +1,326 @@
 #include "memory.h"
 #include "error.h"
 #include "global.h"
+#include "stats.h"
+#include "state.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 // Memory.c, provides functions for the interpreter to manipulate memory
 
-#define FUNCTION_START ">"
-#define AUTOFRAME_START "<"
-#define RA_START "#"
 #define CHAR(s) (*s)
 
-data* memory;
-mem_block* free_memory;
-stack_entry* call_stack;
-address* mem_reg_stack;
-stack_entry** closure_list;
-size_t* closure_list_sizes;
-
-address frame_pointer = 0;
-address stack_pointer = 0;
-address arg_pointer = 0;
-address closure_list_pointer = 0;
-
-size_t closure_list_size = 0;
-address mem_reg_pointer = 0;
-
-// Pointer to the end of the main() stack frame
-static address main_end_pointer = 0;
+const char* intern_name(const char* id) {
+	unsigned int hash = 2166136261u;
+	for (const char* c = id; *c; c++) {
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
+	}
+	interned_name** bucket = &vm->interned_names[hash % INTERNED_NAMES_BUCKETS];
+	for (interned_name* n = *bucket; n; n = n->next) {
+		if (strcmp(n->id, id) == 0) {
+			return n->id;
+		}
+	}
+	size_t length = strlen(id);
+	interned_name* n = safe_malloc(sizeof(interned_name) + length + 1);
+	memcpy(n->id, id, length + 1);
+	n->next = *bucket;
+	*bucket = n;
+	return n->id;
+}
 
 static inline bool is_at_main(void) {
-	return frame_pointer == 0;
+	return vm->frame_pointer == 0;
 }
 static inline bool is_identifier_entry(int index) {
-	return call_stack[index].id[0] != CHAR(FUNCTION_START) &&
-		   call_stack[index].id[0] != CHAR(AUTOFRAME_START) &&
-		   call_stack[index].id[0] != CHAR(RA_START);
+	return vm->call_stack[index].id[0] != CHAR(FUNCTION_START) &&
+		   vm->call_stack[index].id[0] != CHAR(AUTOFRAME_START) &&
+		   vm->call_stack[index].id[0] != CHAR(RA_START);
 }
 
 void write_memory(unsigned int location, data d, int line) {
 	if (location < MEMORY_SIZE) {
-		destroy_data(memory + location);
-		memory[location] = d;
+		destroy_data(vm->memory + location);
+		vm->memory[location] = d;
 	}
 	else {
 		error_runtime(line, MEMORY_REF_ERROR);
 	}
 }
 
-void mark_locations(bool* marked, address start, size_t block_size) {
-	for (size_t j = start; j < start + block_size; j++) {
-		marked[j] = true;
+// mark_block(marked, start, size) marks the size cells at start and queues
+//   them, so mark_data() marks what they refer to.
+static void mark_block(bool* marked, address start, size_t size) {
+	if (marked[start]) {
+		// The block was reached before.
+		return;
+	}
+	for (address a = start; a < start + size; a++) {
+		marked[a] = true;
+	}
+	if (vm->gc_worklist_count + 2 > vm->gc_worklist_capacity) {
+		if (vm->gc_worklist) {
+			vm->gc_worklist_capacity *= 2;
+			vm->gc_worklist = safe_realloc(vm->gc_worklist,
+				vm->gc_worklist_capacity * sizeof(address));
+		}
+		else {
+			vm->gc_worklist_capacity = 64;
+			vm->gc_worklist = safe_malloc(
+				vm->gc_worklist_capacity * sizeof(address));
+		}
+	}
+	vm->gc_worklist[vm->gc_worklist_count++] = start;
+	vm->gc_worklist[vm->gc_worklist_count++] = size;
+}
+
+// reach_closure(marked, closure) marks the variables captured by closure.
+static void reach_closure(bool* marked, address closure) {
+	if (closure == NO_CLOSURE || vm->closure_reached[closure]) {
+		return;
+	}
+	vm->closure_reached[closure] = true;
+	for (size_t i = 0; i < vm->closure_list_sizes[closure]; i++) {
+		mark_block(marked, vm->closure_list[closure][i].val, 1);
+	}
+}
+
+// reach(marked, d) marks the block d points to.
+static void reach(bool* marked, const data* d) {
+	// Check if it's a pointer type?
+	if (d->type == D_LIST || d->type == D_STRUCT) {
+		address a = d->value.number;
+		mark_block(marked, a, vm->memory[a].value.number +
+			(d->type == D_LIST ? 1 : 0));
+	}
+	else if (d->type == D_LIST_VIEW) {
+		// The list stays alive for as long as a view shares it.
+		address a = list_view_of(d)->list;
+		mark_block(marked, a, vm->memory[a].value.number + 1);
+	}
+	else if (d->type == D_FUNCTION) {
+		mark_block(marked, d->value.number, 3);
+	}
+	else if (d->type == D_CLOSURE) {
+		// The closure of a function is in the function's second cell.
+		reach_closure(marked, d->value.number);
+	}
+	else if (d->type == D_STRUCT_INSTANCE) {
+		address a = d->value.number;
+		// a points to D_STRUCT_INSTANCE_HEAD
+		address meta_loc = vm->memory[a].value.number;
+		// meta_loc points to D_STRUCT_METADATA, mark the metadata
+		size_t meta_size = vm->memory[meta_loc].value.number;
+		mark_block(marked, meta_loc, meta_size);
+		// count parameters
+		size_t params = 0;
+		for (address i = meta_loc; i < meta_loc + meta_size; i++) {
+			if (vm->memory[i].type == D_STRUCT_PARAM) {
+				params++;
+			}
+		}
+		// Mark parameters, +1 for T_STRUCT_INSTANCE_HEAD
+		mark_block(marked, a, params + 1);
+	}
+	else if (d->type == D_GENERATOR) {
+		generator_reached(*d);
 	}
 }
 
+void mark_data(bool* marked, const data* d) {
+	reach(marked, d);
+	// Lists can hold lists nested arbitrarily deep, so the blocks reached are
+	//   queued instead of marked recursively.
+	while (vm->gc_worklist_count) {
+		size_t size = vm->gc_worklist[--vm->gc_worklist_count];
+		address start = vm->gc_worklist[--vm->gc_worklist_count];
+		for (address a = start; a < start + size; a++) {
+			reach(marked, &vm->memory[a]);
+		}
+	}
+}
+
+void mark_variable(bool* marked, address a) {
+	// Mark it!
+	marked[a] = true;
+	mark_data(marked, &vm->memory[a]);
+}
+
+// free_unreached_closures() frees the closures garbage_collect() didn't reach
+//   and clears the marks of the others.
+static void free_unreached_closures(void) {
+	for (size_t i = 0; i < vm->closure_list_pointer; i++) {
+		if (!vm->closure_list[i]) {
+			continue;
+		}
+		if (vm->closure_reached[i]) {
+			vm->closure_reached[i] = false;
+		}
+		else {
+			safe_free(vm->closure_list[i]);
+			vm->closure_list[i] = 0;
+			vm->closures_count--;
+			if (i < vm->closures_hint) {
+				vm->closures_hint = i;
+			}
+		}
+	}
+}
+
+// free_blocks() empties the free list.
+static void free_blocks(void) {
+	mem_block* c = vm->free_memory;
+	while (c) {
+		mem_block* next = c->next;
+		safe_free(c);
+		c = next;
+	}
+	vm->free_memory = 0;
+}
+
 bool garbage_collect(size_t size) {
 	if (get_settings_flag(SETTINGS_NOGC)) {
 		return has_memory(size);
 	}
+	uint64_t started = stats_now_ns();
+	size_t free_before = stats_free_cells(0);
 	// Garbage! We'll implement the most basic mark and sweep algo.
 	bool *marked = safe_calloc(MEMORY_SIZE, sizeof(bool));
 	for (size_t i = 0; i < RESERVED_MEMORY; i++) {
 		// Don't delete the reserved ones!
 		marked[i] = true;
 	}
-	for (size_t i = 0; i < stack_pointer; i++) {
+	for (size_t i = 0; i < vm->stack_pointer; i++) {
 		if (is_identifier_entry(i)) {
-			address a = call_stack[i].val;
-			// Mark it!
-			marked[a] = true;
-			// Check if it's a pointer type?
-			if (memory[a].type == D_LIST || memory[a].type == D_STRUCT) {
-				a = memory[a].value.number;
-				mark_locations(marked, a, memory[a].value.number);
-			}
-			else if (memory[a].type == D_FUNCTION) {
-				a = memory[a].value.number;
-				mark_locations(marked, a, 3);
-			}
-			else if (memory[a].type == D_STRUCT_INSTANCE) {
-				a = memory[a].value.number;
-				// a points to D_STRUCT_INSTANCE_HEAD
-				address meta_loc = memory[a].value.number;
-				// meta_loc points to D_STRUCT_METADATA, mark the metadata
-				size_t meta_size = memory[meta_loc].value.number;
-				mark_locations(marked, meta_loc, meta_size);
-				// count parameters
-				size_t params = 0;
-				for (address i = meta_loc; i < meta_loc + meta_size; i++) {
-					if (memory[i].type == D_STRUCT_PARAM) {
-						params++;
-					}
-				}
-				// Mark parameters, +1 for T_STRUCT_INSTANCE_HEAD
-				mark_locations(marked, a, params + 1);
-			}
+			mark_variable(marked, vm->call_stack[i].val);
 		}
 	}
-
-	for (size_t i = 0; i < MEMORY_SIZE; i++) {
-		if (!marked[i]) {
-			here_u_go(i, 1);
+	// Values on the operand stack, like the arguments of a call or a list
+	//   that is being built, aren't in a variable yet.
+	for (address a = vm->arg_pointer + 1; a < MEMORY_SIZE; a++) {
+		mark_data(marked, &vm->memory[a]);
+	}
+	// Suspended generators keep the variables of their frame alive.
+	mark_generators(marked);
+	// Captured variables stay alive for as long as a reachable function can
+	//   call the closure.
+	free_unreached_closures();
+
+	// Every cell that isn't marked is free, so the free list is built again
+	//   from the runs of unmarked cells. A cell that was free already can't
+	//   end up in two blocks that way.
+	free_blocks();
+	mem_block** tail = &vm->free_memory;
+	// The operand stack at the top of memory is never part of the heap.
+	size_t heap_end = MEMORY_SIZE - ARGSTACK_SIZE;
+	size_t i = RESERVED_MEMORY;
+	while (i < heap_end) {
+		if (marked[i]) {
+			i++;
+			continue;
+		}
+		size_t start = i;
+		for (; i < heap_end && !marked[i]; i++) {
+			if (vm->memory[i].type == D_LIST_VIEW) {
+				// Let go of the list now, so unshare_list() doesn't find the
+				//   view once the list's cells are given to another list.
+				destroy_data(&vm->memory[i]);
+			}
 		}
+		mem_block* block = safe_malloc(sizeof(mem_block));
+		block->start = start;
+		block->size = i - start;
+		block->next = 0;
+		*tail = block;
+		tail = &block->next;
 	}
 	safe_free(marked);
+	uint64_t pause = stats_now_ns() - started;
+	vm->stats.collections++;
+	vm->stats.gc_pause_ns += pause;
+	if (pause > vm->stats.gc_max_pause_ns) {
+		vm->stats.gc_max_pause_ns = pause;
+	}
+	size_t free_after = stats_free_cells(0);
+	vm->stats.reclaimed_cells += free_after - free_before;
+	vm->stats.heap_cells = MEMORY_SIZE - ARGSTACK_SIZE - RESERVED_MEMORY - free_after;
 	return has_memory(size);
 }
 
-address create_closure(void) {
-	address location = closure_list_pointer;
+// is_captured(id, names, count) returns true if id is one of the names.
+static bool is_captured(const char* id, char** names, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		// Identifiers on the stack are truncated to MAX_IDENTIFIER_LEN.
+		if (strncmp(id, names[i], MAX_IDENTIFIER_LEN) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+address create_closure(char** names, size_t count) {
+	if (vm->stack_pointer == vm->main_end_pointer || (names && count == 0)) {
+		return NO_CLOSURE;
+	}
 	// Things to reserve.
-	size_t size = stack_pointer - main_end_pointer;
+	size_t size = names ? count : vm->stack_pointer - vm->main_end_pointer;
 
-	stack_entry* closure = safe_malloc(sizeof(stack_entry) * size);
+	closure_slot* closure = 0;
 	size_t actual_size = 0;
-	for (size_t i = main_end_pointer; i < stack_pointer; i++) {
-		if (is_identifier_entry(i)) {
-			strcpy(closure[actual_size].id, call_stack[i].id);
-			closure[actual_size].val = call_stack[i].val;
+	for (size_t i = vm->main_end_pointer; i < vm->stack_pointer; i++) {
+		if (is_identifier_entry(i) &&
+			(!names || is_captured(vm->call_stack[i].id, names, count))) {
+			if (!closure) {
+				closure = safe_malloc(sizeof(closure_slot) * size);
+			}
+			else if (actual_size == size) {
+				// A name can be bound more than once in nested frames.
+				size *= 2;
+				closure = safe_realloc(closure, sizeof(closure_slot) * size);
+			}
+			closure[actual_size].id = intern_name(vm->call_stack[i].id);
+			closure[actual_size].val = vm->call_stack[i].val;
 			actual_size++;
 		}
 	}
 	if (actual_size <= 0) {
-		safe_free(closure);
 		return NO_CLOSURE;
 	}
-	closure = safe_realloc(closure, actual_size * sizeof(stack_entry));
-	closure_list[closure_list_pointer] = closure;
-	closure_list_sizes[closure_list_pointer] = actual_size;
-	closure_list_pointer++;
-
-	if (closure_list_pointer == closure_list_size) {
-		// Resize for more storage
-		closure_list_size *= 2;
-		closure_list = safe_realloc(closure_list,
-			closure_list_size * sizeof(stack_entry*));
-		// Reset 0s
-		for (size_t i = closure_list_pointer; i < closure_list_size; i++) {
-			closure_list[i] = 0;
+	return add_closure(closure, actual_size);
+}
+
+address add_closure(closure_slot* closure, size_t size) {
+	// Take the index of a collected closure if there is one.
+	while (vm->closures_hint < vm->closure_list_pointer &&
+		vm->closure_list[vm->closures_hint]) {
+		vm->closures_hint++;
+	}
+	address location = vm->closures_hint;
+	if (location == vm->closure_list_pointer) {
+		if (vm->closure_list_pointer == vm->closure_list_size) {
+			// Resize for more storage
+			vm->closure_list_size *= 2;
+			vm->closure_list = safe_realloc(vm->closure_list,
+				vm->closure_list_size * sizeof(closure_slot*));
+			vm->closure_list_sizes = safe_realloc(vm->closure_list_sizes,
+				vm->closure_list_size * sizeof(size_t));
+			vm->closure_reached = safe_realloc(vm->closure_reached,
+				vm->closure_list_size * sizeof(bool));
 		}
-		closure_list_sizes = safe_realloc(closure_list_sizes,
-			closure_list_size * sizeof(size_t));
+		vm->closure_list_pointer++;
 	}
+	vm->closure_list[location] = closure;
+	vm->closure_list_sizes[location] = size;
+	vm->closure_reached[location] = false;
+	vm->closures_hint = location + 1;
+	vm->closures_count++;
 	return location;
 }
 
 bool has_memory(size_t size) {
-	mem_block* c = free_memory;
-	mem_block** p = &free_memory;
+	mem_block* c = vm->free_memory;
+	mem_block** p = &vm->free_memory;
 	while (c) {
 		if (c->size >= size) {
 			return true;
@@ -166,14 +339,19 @@ bool has_memory(size_t size) {
 
 address pls_give_memory(size_t size, int line) {
 	if (has_memory(size)) {
-		mem_block* c = free_memory;
+		mem_block* c = vm->free_memory;
 		while (c) {
 			if (c->size >= size) {
 				// Enough Room!
 				c->size -= size;
 				address start = c->start;
 				c->start += size;
-				//print_free_memory();
+				vm->stats.allocations++;
+				vm->stats.allocated_cells += size;
+				vm->stats.heap_cells += size;
+				if (vm->stats.heap_cells > vm->stats.peak_heap_cells) {
+					vm->stats.peak_heap_cells = vm->stats.heap_cells;
+				}
 				return start;
 			}
 			else {
@@ -198,7 +376,7 @@ void here_u_go(address a, size_t size) {
 	// We'll look to see if the returned memory can be appended to another
 	//   free block. If not, then we append to the front. Memory could be
 	//   in front of an existing or behind.
-	mem_block *c = free_memory;
+	mem_block *c = vm->free_memory;
 	address end = a + size;
 	while (c) {
 		if (a >= c->start && a + size <= c->start + c->size) {
@@ -225,16 +403,16 @@ void here_u_go(address a, size_t size) {
 	mem_block* new_m_block = safe_malloc(sizeof(mem_block));
 	new_m_block->start = a;
 	new_m_block->size = size;
-	new_m_block->next = free_memory;
+	new_m_block->next = vm->free_memory;
 
-	free_memory = new_m_block;
+	vm->free_memory = new_m_block;
 }
 
 
 void print_free_memory(void) {
 	printf("=============\n");
 	printf("Free Memory Blocks:\n");
-	mem_block* c = free_memory;
+	mem_block* c = vm->free_memory;
 	while(c) {
 		printf("Block from %d(0x%X) with size %zd.\n", c->start, c->start, c->size);
 		c = c->next;
@@ -244,24 +422,25 @@ void print_free_memory(void) {
 
 void init_memory(void) {
 	// Initialize Memory
-	memory = safe_calloc(MEMORY_SIZE, sizeof(data));
+	vm->memory = safe_calloc(MEMORY_SIZE, sizeof(data));
 
 	// Initialize MemReg
-	mem_reg_stack = safe_calloc(MEMREGSTACK_SIZE, sizeof(address));
+	vm->mem_reg_stack = safe_calloc(MEMREGSTACK_SIZE, sizeof(address));
 
 	// Initialize linked list of Free Memory
-	free_memory = safe_malloc(sizeof(mem_block));
-	free_memory->size = MEMORY_SIZE - ARGSTACK_SIZE - RESERVED_MEMORY;
-	free_memory->start = RESERVED_MEMORY;
-	free_memory->next = 0;
+	vm->free_memory = safe_malloc(sizeof(mem_block));
+	vm->free_memory->size = MEMORY_SIZE - ARGSTACK_SIZE - RESERVED_MEMORY;
+	vm->free_memory->start = RESERVED_MEMORY;
+	vm->free_memory->next = 0;
 
 	// Initialize Call Stack
-	call_stack = safe_calloc(STACK_SIZE, sizeof(stack_entry));
-	arg_pointer = MEMORY_SIZE - 1;
+	vm->call_stack = safe_calloc(STACK_SIZE, sizeof(stack_entry));
+	vm->arg_pointer = MEMORY_SIZE - 1;
 
-	closure_list = safe_calloc(INITIAL_CLOSURES_SIZE, sizeof(stack_entry*));
-	closure_list_sizes = safe_malloc(sizeof(size_t) * INITIAL_CLOSURES_SIZE);
-	closure_list_size = INITIAL_CLOSURES_SIZE;
+	vm->closure_list = safe_calloc(INITIAL_CLOSURES_SIZE, sizeof(closure_slot*));
+	vm->closure_list_sizes = safe_malloc(sizeof(size_t) * INITIAL_CLOSURES_SIZE);
+	vm->closure_reached = safe_calloc(INITIAL_CLOSURES_SIZE, sizeof(bool));
+	vm->closure_list_size = INITIAL_CLOSURES_SIZE;
 
 	// ADDRESS 0 REFERS TO NONE_data
 	write_memory(0, none_data(), -1);
@@ -270,43 +449,57 @@ void init_memory(void) {
 }
 
 void clear_arg_stack(void) {
-	arg_pointer = MEMORY_SIZE - 1;
+	vm->arg_pointer = MEMORY_SIZE - 1;
 }
 
 void c_free_memory(void) {
 	for (size_t i = 0; i < MEMORY_SIZE; i++) {
-		destroy_data(memory + i);
+		destroy_data(vm->memory + i);
 	}
-	safe_free(memory);
-	safe_free(call_stack);
-	safe_free(mem_reg_stack);
+	safe_free(vm->memory);
+	safe_free(vm->call_stack);
+	safe_free(vm->mem_reg_stack);
 
 	// Clear all the free_memory blocks.
-	mem_block* c = free_memory;
-	while (c) {
-		mem_block* next = c->next;
-		safe_free(c);
-		c = next;
+	free_blocks();
+	if (vm->gc_worklist) {
+		safe_free(vm->gc_worklist);
 	}
-	safe_free(closure_list_sizes);
-	int i = 0;
-	while (closure_list[i]) {
-		safe_free(closure_list[i]);
-		i++;
+	for (size_t i = 0; i < vm->closure_list_pointer; i++) {
+		if (vm->closure_list[i]) {
+			safe_free(vm->closure_list[i]);
+		}
+	}
+	safe_free(vm->closure_list);
+	safe_free(vm->closure_list_sizes);
+	safe_free(vm->closure_reached);
+	for (size_t b = 0; b < INTERNED_NAMES_BUCKETS; b++) {
+		interned_name* n = vm->interned_names[b];
+		while (n) {
+			interned_name* next = n->next;
+			safe_free(n);
+			n = next;
+		}
+		vm->interned_names[b] = 0;
 	}
-	safe_free(closure_list);
 }
 
 void check_memory(int line) {
+	if (vm->stack_pointer > vm->stats.peak_stack_pointer) {
+		vm->stats.peak_stack_pointer = vm->stack_pointer;
+	}
+	if (MEMORY_SIZE - 1 - vm->arg_pointer > vm->stats.peak_operand_stack) {
+		vm->stats.peak_operand_stack = MEMORY_SIZE - 1 - vm->arg_pointer;
+	}
 	// Check stack
-	if (stack_pointer >= STACK_SIZE) {
-		printf("Call stack at %d with limit %d!", stack_pointer, STACK_SIZE);
+	if (vm->stack_pointer >= STACK_SIZE) {
+		printf("Call stack at %d with limit %d!", vm->stack_pointer, STACK_SIZE);
 		error_runtime(line, MEMORY_STACK_OVERFLOW);
 	}
 	// Check memory, if the two ends overlap
-	if (arg_pointer <= MEMORY_SIZE - ARGSTACK_SIZE) {
+	if (vm->arg_pointer <= MEMORY_SIZE - ARGSTACK_SIZE) {
 		printf("Internal Stack out of memory! %d with limit %d.\n",
-				MEMORY_SIZE - arg_pointer, ARGSTACK_SIZE);
+				MEMORY_SIZE - vm->arg_pointer, ARGSTACK_SIZE);
 		error_runtime(line, MEMORY_STACK_OVERFLOW);
 	}
 	if (!has_memory(1)) {
@@ -323,67 +516,67 @@ void check_memory(int line) {
 
 void push_frame(char* name, address ret, int line) {
 	// store current frame pointer
-	stack_entry new_entry = { FUNCTION_START " ", frame_pointer, false };
+	stack_entry new_entry = { FUNCTION_START " ", vm->frame_pointer, false };
 	strcat(new_entry.id, name);
 	strcat(new_entry.id, "()");
 	// this new entry will be stored @ location stack_pointer, so we move the
 	//   frame pointer to this location
-	frame_pointer = stack_pointer;
+	vm->frame_pointer = vm->stack_pointer;
 	// add and increment stack_pointer
-	call_stack[stack_pointer++] = new_entry;
+	vm->call_stack[vm->stack_pointer++] = new_entry;
 	check_memory(line);
 	stack_entry ne2 = { RA_START "RET", ret, false };
-	call_stack[stack_pointer++] = ne2;
+	vm->call_stack[vm->stack_pointer++] = ne2;
 	check_memory(line);
 }
 
 void push_auto_frame(address ret, char* type, int line) {
 	// store current frame pointer
-	stack_entry new_entry = { AUTOFRAME_START "autoframe:", frame_pointer, false };
+	stack_entry new_entry = { AUTOFRAME_START "autoframe:", vm->frame_pointer, false };
 	strcat(new_entry.id, type);
 	strcat(new_entry.id, ">");
 
-	frame_pointer = stack_pointer;
-	call_stack[stack_pointer++] = new_entry;
+	vm->frame_pointer = vm->stack_pointer;
+	vm->call_stack[vm->stack_pointer++] = new_entry;
 
 	check_memory(line);
 
 	stack_entry ne2 = { RA_START "RET", ret, false };
-	call_stack[stack_pointer++] = ne2;
+	vm->call_stack[vm->stack_pointer++] = ne2;
 	check_memory(line);
 }
 
 bool pop_frame(bool is_ret, address* ret) {
 	if (is_at_main()) return true;
-	address trace = frame_pointer;
+	address trace = vm->frame_pointer;
 	if (is_ret) {
-		while (call_stack[trace].id[0] != CHAR(FUNCTION_START)) {
-			trace = call_stack[trace].val;
+		while (vm->call_stack[trace].id[0] != CHAR(FUNCTION_START)) {
+			trace = vm->call_stack[trace].val;
             pop_mem_reg();
 		}
-		*ret = call_stack[trace + 1].val;
+		*ret = vm->call_stack[trace + 1].val;
 	}
-	stack_pointer = trace;
-	frame_pointer = call_stack[trace].val;
-	return (is_ret || call_stack[trace].id[0] == CHAR(FUNCTION_START));
+	vm->stack_pointer = trace;
+	vm->frame_pointer = vm->call_stack[trace].val;
+	return (is_ret || vm->call_stack[trace].id[0] == CHAR(FUNCTION_START));
 }
 
 void write_state(FILE* fp) {
-	fprintf(fp, "FramePointer: %d\n", frame_pointer);
-	fprintf(fp, "StackTrace: %d\n", stack_pointer);
-	for (size_t i = 0; i < stack_pointer; i++) {
-		if (call_stack[i].id[0] == CHAR(FUNCTION_START)) {
-			fprintf(fp, ">%s %d\n", call_stack[i].id, call_stack[i].val);
+	fprintf(fp, "FramePointer: %d\n", vm->frame_pointer);
+	fprintf(fp, "StackTrace: %d\n", vm->stack_pointer);
+	for (size_t i = 0; i < vm->stack_pointer; i++) {
+		if (vm->call_stack[i].id[0] == CHAR(FUNCTION_START)) {
+			fprintf(fp, ">%s %d\n", vm->call_stack[i].id, vm->call_stack[i].val);
 		}
 		else {
-			fprintf(fp, "%s %d\n", call_stack[i].id, call_stack[i].val);
+			fprintf(fp, "%s %d\n", vm->call_stack[i].id, vm->call_stack[i].val);
 		}
 	}
 	fprintf(fp, "Memory: %d\n", MEMORY_SIZE);
 	for (size_t i = 0; i < MEMORY_SIZE; i++) {
-		if (memory[i].type != 0) {
-			fprintf(fp, "%zd %s ", i, data_string[memory[i].type]);
-			print_data_inline(&memory[i], fp);
+		if (vm->memory[i].type != 0) {
+			fprintf(fp, "%zd %s ", i, data_string[vm->memory[i].type]);
+			print_data_inline(&vm->memory[i], fp);
 			fprintf(fp, "\n");
 		}
 	}
@@ -392,35 +585,35 @@ void write_state(FILE* fp) {
 void print_call_stack(FILE* file, int maxlines) {
 	fprintf(file, "\n" DIVIDER "\n");
 	fprintf(file, "Dump: Stack Trace\n");
-	int start = stack_pointer - maxlines;
+	int start = vm->stack_pointer - maxlines;
 	if (start < 0 || maxlines < 0) start = 0;
-	for (size_t i = start; i < stack_pointer; i++) {
-		if (call_stack[i].id[0] != '$' && call_stack[i].id[0] != '~') {
-			if (frame_pointer == i) {
-				if (call_stack[i].id[0] == CHAR(FUNCTION_START)) {
+	for (size_t i = start; i < vm->stack_pointer; i++) {
+		if (vm->call_stack[i].id[0] != '$' && vm->call_stack[i].id[0] != '~') {
+			if (vm->frame_pointer == i) {
+				if (vm->call_stack[i].id[0] == CHAR(FUNCTION_START)) {
 					fprintf(file, "%5zd FP-> [" BLU "%s" RESET " -> 0x%04X", i,
-							call_stack[i].id, call_stack[i].val);
+							vm->call_stack[i].id, vm->call_stack[i].val);
 				}
 				else {
-					fprintf(file, "%5zd FP-> [%s -> 0x%04X", i, call_stack[i].id,
-							call_stack[i].val);
+					fprintf(file, "%5zd FP-> [%s -> 0x%04X", i, vm->call_stack[i].id,
+							vm->call_stack[i].val);
 				}
 				fprintf(file, "]\n");
 			}
 			else {
-				if (call_stack[i].id[0] == CHAR(FUNCTION_START)) {
+				if (vm->call_stack[i].id[0] == CHAR(FUNCTION_START)) {
 					fprintf(file, "%5zd      [" BLU "%s" RESET " -> 0x%04X: ", i,
-							call_stack[i].id, call_stack[i].val);
+							vm->call_stack[i].id, vm->call_stack[i].val);
 				}
-				else if (call_stack[i].is_closure) {
+				else if (vm->call_stack[i].is_closure) {
 					fprintf(file, "%5zd  C-> [%s -> 0x%04X: ",i,
-							call_stack[i].id, call_stack[i].val);
+							vm->call_stack[i].id, vm->call_stack[i].val);
 				}
 				else {
 					fprintf(file, "%5zd      [%s -> 0x%04X: ",i,
-							call_stack[i].id, call_stack[i].val);
+							vm->call_stack[i].id, vm->call_stack[i].val);
 				}
-				print_data_inline(&memory[call_stack[i].val], stdout);
+				print_data_inline(&vm->memory[vm->call_stack[i].val], file);
 				fprintf(file, "]\n");
 
 			}
@@ -430,23 +623,23 @@ void print_call_stack(FILE* file, int maxlines) {
 }
 
 void push_arg(data t, int line) {
-	write_memory(arg_pointer, t, line);
-	arg_pointer--;
+	write_memory(vm->arg_pointer, t, line);
+	vm->arg_pointer--;
 	check_memory(line);
 }
 
 data* top_arg(int line) {
-	if (arg_pointer != MEMORY_SIZE - 1) {
-		return &memory[arg_pointer + 1];
+	if (vm->arg_pointer != MEMORY_SIZE - 1) {
+		return &vm->memory[vm->arg_pointer + 1];
 	}
 	error_runtime(line, MEMORY_STACK_UNDERFLOW);
 	return 0;
 }
 
 data pop_arg(int line) {
-	if (arg_pointer != MEMORY_SIZE - 1) {
-		data ret = copy_data(memory[++arg_pointer]);
-		destroy_data(&memory[arg_pointer]);
+	if (vm->arg_pointer != MEMORY_SIZE - 1) {
+		data ret = copy_data(vm->memory[++vm->arg_pointer]);
+		destroy_data(&vm->memory[vm->arg_pointer]);
 		return ret;
 	}
 	error_runtime(line, MEMORY_STACK_UNDERFLOW);
@@ -472,6 +665,66 @@ address push_memory_wendy_list(data* a, int size, int line) {
 	return loc;
 }
 
+// copy_view(v, line) returns the address of a new list with copies of the
+//   elements of the view v.
+static address copy_view(const data* v, int line) {
+	int size = list_size(v);
+	data* elements = safe_malloc((size ? size : 1) * sizeof(data));
+	for (int i = 0; i < size; i++) {
+		elements[i] = copy_data(*list_element(v, i));
+	}
+	address list = push_memory_wendy_list(elements, size, line);
+	safe_free(elements);
+	return list;
+}
+
+data list_of_view(const data* view, int line) {
+	return make_data(D_LIST, data_value_num(copy_view(view, line)));
+}
+
+address own_list_view(data* view, int line) {
+	list_view* v = list_view_of(view);
+	if (!v->owner) {
+		address list = copy_view(view, line);
+		if (v->previous) v->previous->next = v->next;
+		else vm->list_views = v->next;
+		if (v->next) v->next->previous = v->previous;
+		v->previous = v->next = 0;
+		v->owner = true;
+		v->end = abs(v->end - v->start);
+		v->start = 0;
+		v->list = list;
+	}
+	return v->list;
+}
+
+void unshare_list(address list, int line) {
+	// Copying can collect garbage, which lets go of unreachable views, so the
+	//   views of the list are held until each has its copy.
+	size_t count = 0;
+	for (list_view* v = vm->list_views; v; v = v->next) {
+		if (v->list == list) count++;
+	}
+	data* views = safe_malloc((count ? count : 1) * sizeof(data));
+	size_t n = 0;
+	for (list_view* v = vm->list_views; v; v = v->next) {
+		if (v->list == list) {
+			views[n] = make_data(D_LIST_VIEW, data_value_num(0));
+			views[n].value.string = (char*)v;
+			v->references++;
+			n++;
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (list_view_of(&views[i])->references > 1) {
+			own_list_view(&views[i], line);
+		}
+		destroy_data(&views[i]);
+	}
+	safe_free(views);
+	vm->memory[list].type = D_LIST_HEADER;
+}
+
 address push_memory(data t, int line) {
 	address loc = pls_give_memory(1, line);
 	write_memory(loc, t, line);
@@ -479,12 +732,21 @@ address push_memory(data t, int line) {
 	return loc;
 }
 
-void copy_stack_entry(stack_entry se, int line) {
-	call_stack[stack_pointer] = se;
-	call_stack[stack_pointer].is_closure = true;
-	stack_pointer++;
+static bool is_overload_id(char* id) {
+	return strncmp(id, OPERATOR_OVERLOAD_PREFIX,
+		strlen(OPERATOR_OVERLOAD_PREFIX)) == 0;
+}
+
+void push_closure_slot(closure_slot slot, int line) {
+	stack_entry* entry = &vm->call_stack[vm->stack_pointer++];
+	strcpy(entry->id, slot.id);
+	entry->val = slot.val;
+	entry->is_closure = true;
+	if (is_overload_id(entry->id)) {
+		vm->overload_epoch++;
+	}
 	if (is_at_main()) {
-		main_end_pointer = stack_pointer;
+		vm->main_end_pointer = vm->stack_pointer;
 	}
 	check_memory(line);
 }
@@ -495,35 +757,38 @@ void push_stack_entry(char* id, address val, int line) {
 	new_entry.is_closure = false;
 	strncpy(new_entry.id, id, MAX_IDENTIFIER_LEN);
 	new_entry.id[MAX_IDENTIFIER_LEN] = 0; // null term
-	call_stack[stack_pointer++] = new_entry;
+	vm->call_stack[vm->stack_pointer++] = new_entry;
+	if (is_overload_id(id)) {
+		vm->overload_epoch++;
+	}
 	if (is_at_main()) {
 		// currently in main function
-		main_end_pointer = stack_pointer;
+		vm->main_end_pointer = vm->stack_pointer;
 	}
 	check_memory(line);
 }
 
 address get_fn_frame_ptr(void) {
-	address trace = frame_pointer;
-	while (call_stack[trace].id[0] != CHAR(FUNCTION_START)) {
-		trace = call_stack[trace].val;
+	address trace = vm->frame_pointer;
+	while (vm->call_stack[trace].id[0] != CHAR(FUNCTION_START)) {
+		trace = vm->call_stack[trace].val;
 	}
 	return trace;
 }
 
 bool id_exist(char* id, bool search_main) {
-	size_t start = frame_pointer;
+	size_t start = vm->frame_pointer;
 	if (search_main) {
 		start = get_fn_frame_ptr();
 	}
-	for (size_t i = start + 1; i < stack_pointer; i++) {
-		if (streq(id, call_stack[i].id)) {
+	for (size_t i = start + 1; i < vm->stack_pointer; i++) {
+		if (streq(id, vm->call_stack[i].id)) {
 			return true;
 		}
 	}
 	if (search_main) {
-		for (size_t i = 0; i < main_end_pointer; i++) {
-			if (streq(id, call_stack[i].id)) {
+		for (size_t i = 0; i < vm->main_end_pointer; i++) {
+			if (streq(id, vm->call_stack[i].id)) {
 				return true;
 			}
 		}
@@ -532,7 +797,7 @@ bool id_exist(char* id, bool search_main) {
 }
 
 address get_address_of_id(char* id, int line) {
-	return call_stack[get_stack_pos_of_id(id, line)].val;
+	return vm->call_stack[get_stack_pos_of_id(id, line)].val;
 }
 
 address get_stack_pos_of_id(char* id, int line) {
@@ -541,13 +806,13 @@ address get_stack_pos_of_id(char* id, int line) {
 		return 0;
 	}
 	address frame_ptr = get_fn_frame_ptr();
-	for (size_t i = stack_pointer - 1; i > frame_ptr; i--) {
-		if (streq(id, call_stack[i].id)) {
+	for (size_t i = vm->stack_pointer - 1; i > frame_ptr; i--) {
+		if (streq(id, vm->call_stack[i].id)) {
 			return i;
 		}
 	}
-	for (size_t i = 0; i < main_end_pointer; i++) {
-		if (streq(id, call_stack[i].id)) {
+	for (size_t i = 0; i < vm->main_end_pointer; i++) {
+		if (streq(id, vm->call_stack[i].id)) {
 			return i;
 		}
 	}
@@ -560,27 +825,27 @@ data* get_value_of_id(char* id, int line) {
 
 data* get_value_of_address(address a, int line) {
 	if (a < MEMORY_SIZE) {
-		return &memory[a];
+		return &vm->memory[a];
 	}
 	else {
 		error_runtime(line, MEMORY_REF_ERROR);
-		return &memory[0];
+		return &vm->memory[0];
 	}
 }
 
 void push_mem_reg(address memory_register, int line) {
-	if (mem_reg_pointer >= MEMREGSTACK_SIZE) {
+	if (vm->mem_reg_pointer >= MEMREGSTACK_SIZE) {
 		error_runtime(line, MEMORY_REGISTER_STACK_OVERFLOW);
 	}
-	mem_reg_stack[mem_reg_pointer++] = memory_register;
+	vm->mem_reg_stack[vm->mem_reg_pointer++] = memory_register;
 }
 
 address pop_mem_reg(void) {
-	if (mem_reg_pointer == 0) {
+	if (vm->mem_reg_pointer == 0) {
 		error_general(MEMORY_MEM_STACK_ERROR);
 		return 0;
 	}
-	return mem_reg_stack[--mem_reg_pointer];
+	return vm->mem_reg_stack[--vm->mem_reg_pointer];
 }
 
 void unwind_stack(void) {
@@ -589,3 +854,21 @@ void unwind_stack(void) {
 		pop_frame(true, &pointer);
 	}
 }
+
+void clear_globals(void) {
+	unwind_stack();
+	clear_arg_stack();
+	// Only the main frame's function entry and return address remain.
+	vm->stack_pointer = 2;
+	vm->main_end_pointer = 2;
+	vm->mem_reg_pointer = 0;
+	for (size_t i = 0; i < vm->closure_list_pointer; i++) {
+		if (vm->closure_list[i]) {
+			safe_free(vm->closure_list[i]);
+			vm->closure_list[i] = 0;
+		}
+	}
+	vm->closure_list_pointer = 0;
+	vm->closures_hint = 0;
+	vm->closures_count = 0;
+}
@@ -8,6 +8,12 @@
 // memory.h - Felix Guo
 // This module manages the memory model for WendyScript.
 
+// Prefixes of the special call stack entries: function frames, automatic
+//   frames created for blocks and saved return addresses.
+#define FUNCTION_START ">"
+#define AUTOFRAME_START "<"
+#define RA_START "#"
+
 // Sentinal value for when no closure needs to be created
 #define NO_CLOSURE (unsigned int)(-1)
 
@@ -19,6 +25,13 @@ typedef struct {
 	bool is_closure;
 } stack_entry;
 
+// A closure slot holds one captured variable. The name is interned by the
+//   memory module, so slots can be copied without copying the identifier.
+typedef struct {
+	const char* id;
+	address val;
+} closure_slot;
+
 typedef struct mem_block mem_block;
 struct mem_block {
 	size_t size;
@@ -26,22 +39,17 @@ struct mem_block {
 	mem_block* next;
 };
 
-extern data* memory;
-extern mem_block* free_memory;
-extern stack_entry* call_stack;
-extern address* mem_reg_stack;
+// Captured identifiers are interned so closure slots only hold a pointer.
+#define INTERNED_NAMES_BUCKETS 256
 
-// Includes a list of closures, used to store temporary stack frames.
-//   The size of the closure lists is also stored for easy iteration.
-extern stack_entry** closure_list;
-extern size_t* closure_list_sizes;
+typedef struct interned_name interned_name;
+struct interned_name {
+	interned_name* next;
+	char id[];
+};
 
-extern address frame_pointer;
-extern address stack_pointer;
-extern address closure_list_pointer;
-extern size_t closure_list_size;
-extern address mem_reg_pointer;
-extern address arg_pointer;
+// The memory, stacks and closures themselves are kept in the [state] of the
+//   interpreter.
 
 // init_memory() initializes the memory module
 void init_memory(void);
@@ -56,6 +64,13 @@ void check_memory(int line);
 //   free_memory. Returns true if some memory was collected and false otherwise.
 bool garbage_collect(size_t size);
 
+// mark_variable(marked, a) marks the variable at a and the data it refers to
+//   as in use during garbage_collect().
+void mark_variable(bool* marked, address a);
+
+// mark_data(marked, d) marks the data d refers to as in use.
+void mark_data(bool* marked, const data* d);
+
 // print_free_memory() prints out a list of the free memory blocks available
 //   in Wendy
 void print_free_memory(void);
@@ -95,6 +110,19 @@ address push_memory(data t, int line);
 //   it to the array a appending a list header data..
 address push_memory_wendy_list(data* a, int size, int line);
 
+// list_of_view(view, line) returns a new D_LIST with copies of the elements
+//   of the D_LIST_VIEW view.
+data list_of_view(const data* view, int line);
+
+// own_list_view(view, line) gives the D_LIST_VIEW view a copy of its elements
+//   that only it uses, unless it has one already, and returns the address of
+//   that list. Copies of the view see the change, like copies of a list do.
+address own_list_view(data* view, int line);
+
+// unshare_list(list, line) gives every view of the list at address list a copy
+//   of its elements, so the list can be changed without changing them.
+void unshare_list(address list, int line);
+
 // push_memory_array(a, size) finds a continuous block of size in memory and
 //   sets it to the array "a" directly.
 address push_memory_array(data* a, int size, int line);
@@ -106,9 +134,9 @@ data pop_memory(void);
 // stack frame (eg variable declaration).
 void push_stack_entry(char* id, address val, int line);
 
-// copy_stack_entry(se) copies the given stack entry into the top of the call
-//   stack, USE FOR CLOSURES
-void copy_stack_entry(stack_entry se, int line);
+// push_closure_slot(slot) binds the captured variable slot at the top of the
+//   call stack, USE FOR CLOSURES
+void push_closure_slot(closure_slot slot, int line);
 
 // id_exist(id, search_main) returns true if id exists in the current stackframe
 bool id_exist(char* id, bool search_main);
@@ -142,9 +170,17 @@ data* top_arg(int line);
 // clear_arg_stack() clears the operational stack
 void clear_arg_stack(void);
 
-// create_closure() creates a closure with the current stack frame and returns
-//   the index of the closure frame
-address create_closure(void);
+// create_closure(names, count) creates a closure holding the variables of the
+//   current stack frame whose names are among the count names, and returns the
+//   index of the closure frame. If names is NULL every variable is captured.
+address create_closure(char** names, size_t count);
+
+// add_closure(slots, size) adds a closure of the size slots, which it takes
+//   ownership of, and returns its index.
+address add_closure(closure_slot* slots, size_t size);
+
+// intern_name(id) returns the unique copy of id, creating it if necessary.
+const char* intern_name(const char* id);
 
 // write_state(fp) writes the current state for debugging to the file fp
 void write_state(FILE* fp);
@@ -159,4 +195,9 @@ address pop_mem_reg(void);
 //   * used after each run in REPL in case REPL leaves the stack in a non-
 //   stable state
 void unwind_stack(void);
+
+// clear_globals() pops every frame, variable and closure, leaving an empty
+//   main frame, so the interpreter can run something unrelated next. The
+//   memory they referred to is left for the garbage collector.
+void clear_globals(void);
 #endif
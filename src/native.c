@@ -5,14 +5,18 @@
 #include "codegen.h"
 #include "vm.h"
 #include "imports.h"
+#include "stats.h"
+#include "dtoa.h"
+#include "files.h"
+#include "simd.h"
+#include "parallel.h"
+#include "state.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
 #include <errno.h>
 
-char** program_arguments = 0;
-int program_arguments_count = 0;
 typedef struct native_function {
 	char* name;
 	int argc;
@@ -34,11 +38,54 @@ static data native_read(data* args, int line);
 static data native_readRaw(data* args, int line);
 static data native_readFile(data* args, int line);
 static data native_writeFile(data* args, int line);
+static data native_flush(data* args, int line);
+static data native_open(data* args, int line);
+static data native_close(data* args, int line);
+static data native_readLine(data* args, int line);
+static data native_lines(data* args, int line);
+static data native_write(data* args, int line);
+static data native_stringBuilderAppend(data* args, int line);
+static data native_stringBuilderAppendAll(data* args, int line);
+static data native_stringBuilderToString(data* args, int line);
+
+// String Functions
+static data native_stringSplit(data* args, int line);
+static data native_stringJoin(data* args, int line);
+static data native_stringFind(data* args, int line);
+static data native_stringReplace(data* args, int line);
+static data native_stringStartsWith(data* args, int line);
+static data native_stringEndsWith(data* args, int line);
+static data native_stringFormat(data* args, int line);
+
+// Array Functions
+static data native_arrayOf(data* args, int line);
+static data native_arrayZeros(data* args, int line);
+static data native_arrayToList(data* args, int line);
+static data native_arrayAdd(data* args, int line);
+static data native_arraySub(data* args, int line);
+static data native_arrayMul(data* args, int line);
+static data native_arrayDiv(data* args, int line);
+static data native_arraySum(data* args, int line);
+static data native_arrayMin(data* args, int line);
+static data native_arrayMax(data* args, int line);
+static data native_arrayDot(data* args, int line);
+static data native_arrayCumsum(data* args, int line);
+static data native_arraySimd(data* args, int line);
+
+// Parallel Functions
+static data native_parallelMap(data* args, int line);
+static data native_parallelSpawn(data* args, int line);
+static data native_parallelJoin(data* args, int line);
+static data native_channelOpen(data* args, int line);
+static data native_channelSend(data* args, int line);
+static data native_channelReceive(data* args, int line);
+static data native_channelClose(data* args, int line);
 
 // Math Functions
 static data native_pow(data* args, int line);
 static data native_ln(data* args, int line);
 static data native_log(data* args, int line);
+static data native_stats(data* args, int line);
 
 static native_function native_functions[] = {
 	{ "printCallStack", 1, native_printCallStack },
@@ -54,11 +101,48 @@ static native_function native_functions[] = {
 	{ "pow", 2, native_pow },
 	{ "ln", 1, native_ln },
 	{ "log", 1, native_log },
+	{ "stats", 0, native_stats },
 	{ "getProgramArgs", 0, native_getProgramArgs },
 	{ "io_read", 0, native_read },
 	{ "io_readRaw", 0, native_readRaw },
 	{ "io_readFile", 1, native_readFile },
-	{ "io_writeFile", 2, native_writeFile }
+	{ "io_writeFile", 2, native_writeFile },
+	{ "io_flush", 0, native_flush },
+	{ "io_open", 2, native_open },
+	{ "io_close", 1, native_close },
+	{ "io_readLine", 1, native_readLine },
+	{ "io_lines", 1, native_lines },
+	{ "io_write", 2, native_write },
+	{ "stringBuilderAppend", 2, native_stringBuilderAppend },
+	{ "stringBuilderAppendAll", 2, native_stringBuilderAppendAll },
+	{ "stringBuilderToString", 1, native_stringBuilderToString },
+	{ "string_split", 2, native_stringSplit },
+	{ "string_join", 2, native_stringJoin },
+	{ "string_find", 2, native_stringFind },
+	{ "string_replace", 3, native_stringReplace },
+	{ "string_startsWith", 2, native_stringStartsWith },
+	{ "string_endsWith", 2, native_stringEndsWith },
+	{ "string_format", 2, native_stringFormat },
+	{ "array_of", 1, native_arrayOf },
+	{ "array_zeros", 1, native_arrayZeros },
+	{ "array_toList", 1, native_arrayToList },
+	{ "array_add", 2, native_arrayAdd },
+	{ "array_sub", 2, native_arraySub },
+	{ "array_mul", 2, native_arrayMul },
+	{ "array_div", 2, native_arrayDiv },
+	{ "array_sum", 1, native_arraySum },
+	{ "array_min", 1, native_arrayMin },
+	{ "array_max", 1, native_arrayMax },
+	{ "array_dot", 2, native_arrayDot },
+	{ "array_cumsum", 1, native_arrayCumsum },
+	{ "array_simd", 0, native_arraySimd },
+	{ "parallel_map", 3, native_parallelMap },
+	{ "parallel_spawn", 2, native_parallelSpawn },
+	{ "parallel_join", 1, native_parallelJoin },
+	{ "parallel_channel", 1, native_channelOpen },
+	{ "parallel_send", 2, native_channelSend },
+	{ "parallel_receive", 1, native_channelReceive },
+	{ "parallel_close", 1, native_channelClose }
 };
 
 static double native_to_numeric(data* t, int line) {
@@ -79,14 +163,532 @@ static char* native_to_string(data* t, int line) {
 	return t->value.string;
 }
 
+// native_to_builder(t, line) returns the buffer member of the StringBuilder
+//   instance t, creating the buffer the first time it's used. The buffer lives
+//   in the instance, so it's appended to in place and collected with it.
+static data* native_to_builder(data* t, int line) {
+	if (t->type == D_STRUCT_INSTANCE) {
+		address instance = t->value.number;
+		address metadata = vm->memory[instance].value.number;
+		if (vm->memory[instance].type == D_STRUCT_INSTANCE_HEAD &&
+			vm->memory[metadata + 1].type == D_STRUCT_NAME &&
+			streq(vm->memory[metadata + 1].value.string, "StringBuilder")) {
+			data* buffer = &vm->memory[instance + 1];
+			if (buffer->type == D_NONE) {
+				destroy_data(buffer);
+				*buffer = string_buffer_data();
+			}
+			if (buffer->type == D_STRING_BUFFER) {
+				return buffer;
+			}
+		}
+	}
+	error_runtime(line, VM_NOT_A_STRING_BUILDER);
+	return 0;
+}
+
+// builder_append(buffer, value, line) appends the string or number value,
+//   formatted the same way it prints.
+static void builder_append(data* buffer, data* value, int line) {
+	if (value->type == D_STRING) {
+		string_buffer_append(buffer, value->value.string,
+			strlen(value->value.string));
+	}
+	else if (value->type == D_NUMBER) {
+		char number[NUMBER_BUFFER_SIZE];
+		string_buffer_append(buffer, number,
+			format_number(value->value.number, number));
+	}
+	else {
+		error_runtime(line, VM_INVALID_NATIVE_STRING_OR_NUMBER_TYPE_ERROR);
+	}
+}
+
+static data native_stringBuilderAppend(data* args, int line) {
+	data* buffer = native_to_builder(args, line);
+	if (buffer) {
+		builder_append(buffer, args + 1, line);
+	}
+	return noneret_data();
+}
+
+static data native_stringBuilderAppendAll(data* args, int line) {
+	data* buffer = native_to_builder(args, line);
+	if (!buffer) {
+		return noneret_data();
+	}
+	if (args[1].type != D_LIST) {
+		error_runtime(line, VM_INVALID_NATIVE_LIST_TYPE_ERROR);
+		return noneret_data();
+	}
+	address start = args[1].value.number;
+	int size = vm->memory[start].value.number;
+	for (int i = 0; i < size; i++) {
+		builder_append(buffer, &vm->memory[start + i + 1], line);
+	}
+	return noneret_data();
+}
+
+static data native_stringBuilderToString(data* args, int line) {
+	data* buffer = native_to_builder(args, line);
+	if (!buffer) {
+		return none_data();
+	}
+	string_buffer* b = string_buffer_of(buffer);
+	data result = make_data(D_STRING, data_value_size(b->length));
+	memcpy(result.value.string, b->chars, b->length);
+	return result;
+}
+
+// find_in(haystack, length, needle, needle_length) returns the first
+//   occurrence of needle within length chars of haystack, or NULL. memchr
+//   skips to each candidate first character.
+static const char* find_in(const char* haystack, size_t length,
+		const char* needle, size_t needle_length) {
+	if (needle_length == 0) {
+		return haystack;
+	}
+	const char* end = haystack + length;
+	while ((size_t)(end - haystack) >= needle_length) {
+		const char* c = memchr(haystack, needle[0],
+			end - haystack - needle_length + 1);
+		if (!c) {
+			return 0;
+		}
+		if (memcmp(c + 1, needle + 1, needle_length - 1) == 0) {
+			return c;
+		}
+		haystack = c + 1;
+	}
+	return 0;
+}
+
+// string_piece(t, number, line) returns the text of the string or number t,
+//   numbers are formatted into number. Sets an error for any other type.
+static const char* string_piece(data* t, char* number, size_t* length,
+		int line) {
+	if (t->type == D_STRING) {
+		*length = strlen(t->value.string);
+		return t->value.string;
+	}
+	else if (t->type == D_NUMBER) {
+		*length = format_number(t->value.number, number);
+		return number;
+	}
+	error_runtime(line, VM_INVALID_NATIVE_STRING_OR_NUMBER_TYPE_ERROR);
+	*length = 0;
+	return "";
+}
+
+static data make_string(const char* s, size_t length) {
+	data t = make_data(D_STRING, data_value_size(length));
+	memcpy(t.value.string, s, length);
+	return t;
+}
+
+static data native_stringSplit(data* args, int line) {
+	char* s = native_to_string(args, line);
+	char* separator = native_to_string(args + 1, line);
+	size_t length = strlen(s);
+	size_t separator_length = strlen(separator);
+	// An empty separator splits into characters. A trailing separator doesn't
+	//   produce an empty last piece, so lines split into lines.
+	size_t count = 0;
+	if (separator_length == 0) {
+		count = length;
+	}
+	else {
+		const char* c = s;
+		const char* end = s + length;
+		const char* next;
+		while ((next = find_in(c, end - c, separator, separator_length))) {
+			count++;
+			c = next + separator_length;
+		}
+		if (c != end) {
+			count++;
+		}
+	}
+	data* parts = safe_malloc((count ? count : 1) * sizeof(data));
+	const char* c = s;
+	for (size_t p = 0; p < count; p++) {
+		const char* next = separator_length
+			? find_in(c, s + length - c, separator, separator_length)
+			: c + 1;
+		if (!next) {
+			next = s + length;
+		}
+		parts[p] = make_string(c, next - c);
+		c = next + separator_length;
+	}
+	data list = make_data(D_LIST,
+		data_value_num(push_memory_wendy_list(parts, count, line)));
+	safe_free(parts);
+	return list;
+}
+
+static data native_stringJoin(data* args, int line) {
+	if (args[0].type != D_LIST) {
+		error_runtime(line, VM_INVALID_NATIVE_LIST_TYPE_ERROR);
+		return none_data();
+	}
+	address start = args[0].value.number;
+	int size = vm->memory[start].value.number;
+	char* separator = native_to_string(args + 1, line);
+	size_t separator_length = strlen(separator);
+	char number[NUMBER_BUFFER_SIZE];
+	// The result is allocated once with the exact total length.
+	size_t total = size > 0 ? (size - 1) * separator_length : 0;
+	for (int i = 0; i < size; i++) {
+		size_t length;
+		string_piece(&vm->memory[start + i + 1], number, &length, line);
+		total += length;
+	}
+	data result = make_data(D_STRING, data_value_size(total));
+	char* out = result.value.string;
+	for (int i = 0; i < size; i++) {
+		if (i != 0) {
+			memcpy(out, separator, separator_length);
+			out += separator_length;
+		}
+		size_t length;
+		const char* piece = string_piece(&vm->memory[start + i + 1], number,
+			&length, line);
+		memcpy(out, piece, length);
+		out += length;
+	}
+	return result;
+}
+
+static data native_stringFind(data* args, int line) {
+	char* s = native_to_string(args, line);
+	char* search = native_to_string(args + 1, line);
+	const char* found = find_in(s, strlen(s), search, strlen(search));
+	return make_data(D_NUMBER, data_value_num(found ? found - s : -1));
+}
+
+static data native_stringReplace(data* args, int line) {
+	char* s = native_to_string(args, line);
+	char* from = native_to_string(args + 1, line);
+	char* to = native_to_string(args + 2, line);
+	size_t length = strlen(s);
+	size_t from_length = strlen(from);
+	size_t to_length = strlen(to);
+	if (from_length == 0) {
+		return make_string(s, length);
+	}
+	size_t count = 0;
+	const char* c = s;
+	while ((c = find_in(c, s + length - c, from, from_length))) {
+		count++;
+		c += from_length;
+	}
+	data result = make_data(D_STRING,
+		data_value_size(length - count * from_length + count * to_length));
+	char* out = result.value.string;
+	c = s;
+	for (size_t n = 0; n < count; n++) {
+		const char* next = find_in(c, s + length - c, from, from_length);
+		memcpy(out, c, next - c);
+		out += next - c;
+		memcpy(out, to, to_length);
+		out += to_length;
+		c = next + from_length;
+	}
+	memcpy(out, c, s + length - c);
+	return result;
+}
+
+static data native_stringStartsWith(data* args, int line) {
+	char* s = native_to_string(args, line);
+	char* prefix = native_to_string(args + 1, line);
+	return strncmp(s, prefix, strlen(prefix)) == 0 ? true_data() : false_data();
+}
+
+static data native_stringEndsWith(data* args, int line) {
+	char* s = native_to_string(args, line);
+	char* suffix = native_to_string(args + 1, line);
+	size_t length = strlen(s);
+	size_t suffix_length = strlen(suffix);
+	return suffix_length <= length &&
+		memcmp(s + length - suffix_length, suffix, suffix_length) == 0
+		? true_data() : false_data();
+}
+
+static data native_stringFormat(data* args, int line) {
+	char* s = native_to_string(args, line);
+	if (args[1].type != D_LIST) {
+		error_runtime(line, VM_INVALID_NATIVE_LIST_TYPE_ERROR);
+		return none_data();
+	}
+	address start = args[1].value.number;
+	int size = vm->memory[start].value.number;
+	char number[NUMBER_BUFFER_SIZE];
+	// $n is replaced by the nth item of the list, counting from 1. $$ is a
+	//   literal $, anything else is copied as is.
+	data buffer = string_buffer_data();
+	const char* c = s;
+	const char* dollar;
+	while ((dollar = strchr(c, '$'))) {
+		string_buffer_append(&buffer, c, dollar - c);
+		c = dollar + 1;
+		if (*c == '$') {
+			string_buffer_append(&buffer, "$", 1);
+			c++;
+			continue;
+		}
+		size_t index = 0;
+		const char* digits = c;
+		while (*c >= '0' && *c <= '9' && index <= (size_t)size) {
+			index = index * 10 + (*c++ - '0');
+		}
+		if (c == digits || index == 0 || index > (size_t)size) {
+			string_buffer_append(&buffer, dollar, c - dollar);
+			continue;
+		}
+		size_t length;
+		const char* piece = string_piece(&vm->memory[start + index], number,
+			&length, line);
+		string_buffer_append(&buffer, piece, length);
+	}
+	string_buffer_append(&buffer, c, strlen(c));
+	data result = make_string(string_buffer_of(&buffer)->chars,
+		string_buffer_of(&buffer)->length);
+	destroy_data(&buffer);
+	return result;
+}
+
+// native_to_array(t, line) returns the block of the f64array t, or NULL after
+//   setting an error.
+static f64_array* native_to_array(data* t, int line) {
+	if (t->type != D_F64ARRAY) {
+		error_runtime(line, VM_INVALID_NATIVE_ARRAY_TYPE_ERROR);
+		return 0;
+	}
+	return f64_array_of(t);
+}
+
+// take_array(t, length, result) moves the argument t into result if it's an
+//   array of length values that nothing else refers to, like the result of
+//   a * b in a * b + c. Its block can then be written over and returned
+//   instead of allocating a new one. t is left empty so it isn't released
+//   afterwards.
+static bool take_array(data* t, size_t length, data* result) {
+	if (t->type != D_F64ARRAY || f64_array_of(t)->references != 1 ||
+		f64_array_of(t)->length != length) {
+		return false;
+	}
+	*result = *t;
+	t->type = D_EMPTY;
+	return true;
+}
+
+// array_result(a, b, length) returns an array of length values to store the
+//   result of an operation on the arguments a and b in.
+static data array_result(data* a, data* b, size_t length) {
+	data result;
+	if (take_array(a, length, &result) || (b && take_array(b, length, &result))) {
+		return result;
+	}
+	return f64_array_data(length);
+}
+
+// array_arithmetic(op, args, line) applies op element-wise to two arrays of
+//   the same length, or to an array and a number on either side.
+static data array_arithmetic(simd_op op, data* args, int line) {
+	data* a = args;
+	data* b = args + 1;
+	if (a->type == D_F64ARRAY && b->type == D_F64ARRAY) {
+		f64_array* x = f64_array_of(a);
+		f64_array* y = f64_array_of(b);
+		if (x->length != y->length) {
+			error_runtime(line, VM_ARRAY_LENGTH_MISMATCH, x->length, y->length);
+			return none_data();
+		}
+		data result = array_result(a, b, x->length);
+		simd_binary(op, f64_array_of(&result)->values, x->values, y->values,
+			x->length);
+		return result;
+	}
+	else if (a->type == D_F64ARRAY && b->type == D_NUMBER) {
+		f64_array* x = f64_array_of(a);
+		data result = array_result(a, 0, x->length);
+		simd_scalar(op, f64_array_of(&result)->values, x->values,
+			b->value.number, false, x->length);
+		return result;
+	}
+	else if (a->type == D_NUMBER && b->type == D_F64ARRAY) {
+		f64_array* y = f64_array_of(b);
+		data result = array_result(b, 0, y->length);
+		simd_scalar(op, f64_array_of(&result)->values, y->values,
+			a->value.number, true, y->length);
+		return result;
+	}
+	error_runtime(line, VM_INVALID_NATIVE_ARRAY_TYPE_ERROR);
+	return none_data();
+}
+
+static data native_arrayOf(data* args, int line) {
+	if (args[0].type == D_F64ARRAY) {
+		return copy_data(args[0]);
+	}
+	else if (args[0].type == D_RANGE) {
+		int start = range_start(args[0]);
+		int end = range_end(args[0]);
+		data result = f64_array_data(abs(end - start));
+		double* values = f64_array_of(&result)->values;
+		int n = 0;
+		for (int i = start; i != end; start < end ? i++ : i--) {
+			values[n++] = i;
+		}
+		return result;
+	}
+	else if (args[0].type != D_LIST) {
+		error_runtime(line, VM_INVALID_NATIVE_LIST_TYPE_ERROR);
+		return none_data();
+	}
+	address start = args[0].value.number;
+	int size = vm->memory[start].value.number;
+	data result = f64_array_data(size);
+	double* values = f64_array_of(&result)->values;
+	for (int i = 0; i < size; i++) {
+		values[i] = native_to_numeric(&vm->memory[start + i + 1], line);
+	}
+	return result;
+}
+
+static data native_arrayZeros(data* args, int line) {
+	double length = native_to_numeric(args, line);
+	if (length < 0) {
+		length = 0;
+	}
+	data result = f64_array_data(length);
+	memset(f64_array_of(&result)->values, 0, (size_t)length * sizeof(double));
+	return result;
+}
+
+static data native_arrayToList(data* args, int line) {
+	f64_array* a = native_to_array(args, line);
+	if (!a) {
+		return none_data();
+	}
+	data* items = safe_malloc((a->length ? a->length : 1) * sizeof(data));
+	for (size_t i = 0; i < a->length; i++) {
+		items[i] = make_data(D_NUMBER, data_value_num(a->values[i]));
+	}
+	data list = make_data(D_LIST,
+		data_value_num(push_memory_wendy_list(items, a->length, line)));
+	safe_free(items);
+	return list;
+}
+
+static data native_arrayAdd(data* args, int line) {
+	return array_arithmetic(SIMD_ADD, args, line);
+}
+
+static data native_arraySub(data* args, int line) {
+	return array_arithmetic(SIMD_SUB, args, line);
+}
+
+static data native_arrayMul(data* args, int line) {
+	return array_arithmetic(SIMD_MUL, args, line);
+}
+
+static data native_arrayDiv(data* args, int line) {
+	return array_arithmetic(SIMD_DIV, args, line);
+}
+
+static data native_arraySum(data* args, int line) {
+	f64_array* a = native_to_array(args, line);
+	if (!a) {
+		return none_data();
+	}
+	return make_data(D_NUMBER, data_value_num(simd_sum(a->values, a->length)));
+}
+
+static data native_arrayMin(data* args, int line) {
+	f64_array* a = native_to_array(args, line);
+	if (!a || a->length == 0) {
+		return none_data();
+	}
+	return make_data(D_NUMBER, data_value_num(simd_min(a->values, a->length)));
+}
+
+static data native_arrayMax(data* args, int line) {
+	f64_array* a = native_to_array(args, line);
+	if (!a || a->length == 0) {
+		return none_data();
+	}
+	return make_data(D_NUMBER, data_value_num(simd_max(a->values, a->length)));
+}
+
+static data native_arrayDot(data* args, int line) {
+	f64_array* a = native_to_array(args, line);
+	f64_array* b = native_to_array(args + 1, line);
+	if (!a || !b) {
+		return none_data();
+	}
+	if (a->length != b->length) {
+		error_runtime(line, VM_ARRAY_LENGTH_MISMATCH, a->length, b->length);
+		return none_data();
+	}
+	return make_data(D_NUMBER,
+		data_value_num(simd_dot(a->values, b->values, a->length)));
+}
+
+static data native_arrayCumsum(data* args, int line) {
+	f64_array* a = native_to_array(args, line);
+	if (!a) {
+		return none_data();
+	}
+	data result = array_result(args, 0, a->length);
+	simd_cumsum(f64_array_of(&result)->values, a->values, a->length);
+	return result;
+}
+
+static data native_arraySimd(data* args, int line) {
+	UNUSED(args);
+	UNUSED(line);
+	return make_data(D_STRING, data_value_str((char*)simd_level()));
+}
+
+static data native_parallelMap(data* args, int line) {
+	int workers = native_to_numeric(&args[2], line);
+	return parallel_map(args[0], args[1], workers, line);
+}
+
+static data native_parallelSpawn(data* args, int line) {
+	return parallel_spawn(args[0], args[1], line);
+}
+
+static data native_parallelJoin(data* args, int line) {
+	return parallel_join(args[0], line);
+}
+
+static data native_channelOpen(data* args, int line) {
+	return channel_open(native_to_numeric(&args[0], line), line);
+}
+
+static data native_channelSend(data* args, int line) {
+	return channel_send(args[0], args[1], line);
+}
+
+static data native_channelReceive(data* args, int line) {
+	return channel_receive(args[0], line);
+}
+
+static data native_channelClose(data* args, int line) {
+	return channel_close(args[0], line);
+}
+
 static data native_getProgramArgs(data* args, int line) {
 	UNUSED(args);
 	UNUSED(line);
-	data* array = safe_malloc(sizeof(data) * program_arguments_count);
+	data* array = safe_malloc(sizeof(data) * vm->program_arguments_count);
 	int size = 0;
-	for (int i = 0; i < program_arguments_count; i++) {
+	for (int i = 0; i < vm->program_arguments_count; i++) {
 		array[size++] = make_data(D_STRING,
-			data_value_str(program_arguments[i]));
+			data_value_str(vm->program_arguments[i]));
 	}
 	data final = make_data(D_LIST, data_value_num(push_memory_wendy_list(array, size, -1)));
 	safe_free(array);
@@ -100,6 +702,34 @@ static data native_garbageCollect(data* args, int line) {
 	return noneret_data();
 }
 
+static data native_stats(data* args, int line) {
+	UNUSED(args);
+	UNUSED(line);
+	uint64_t instructions = 0;
+	for (size_t op = 0; op < OPCODE_COUNT; op++) {
+		instructions += vm->stats.opcode_counts[op];
+	}
+	size_t blocks;
+	size_t free_cells = stats_free_cells(&blocks);
+	// Same order as the members of the Stats struct in system.w.
+	double values[] = {
+		stats_wall_ns(), instructions, vm->stats.allocations,
+		vm->stats.allocated_cells, vm->stats.collections, vm->stats.gc_pause_ns,
+		vm->stats.gc_max_pause_ns, vm->stats.reclaimed_cells,
+		vm->stats.peak_stack_pointer, vm->stats.peak_operand_stack,
+		vm->closures_count, blocks, free_cells, vm->stats.peak_heap_cells
+	};
+	size_t count = sizeof(values) / sizeof(values[0]);
+	data* array = safe_malloc(sizeof(data) * count);
+	for (size_t i = 0; i < count; i++) {
+		array[i] = make_data(D_NUMBER, data_value_num(values[i]));
+	}
+	data final = make_data(D_LIST,
+		data_value_num(push_memory_wendy_list(array, count, line)));
+	safe_free(array);
+	return final;
+}
+
 static data native_printFreeMemory(data* args, int line) {
 	UNUSED(args);
 	UNUSED(line);
@@ -110,7 +740,7 @@ static data native_printFreeMemory(data* args, int line) {
 static data native_getImportedLibraries(data* args, int line) {
 	UNUSED(args);
 	UNUSED(line);
-	import_node *node = imported_libraries;
+	import_node *node = vm->imported_libraries;
 	// Traverse once to find length
 	size_t length = 0;
 	while (node) {
@@ -118,7 +748,7 @@ static data native_getImportedLibraries(data* args, int line) {
 		node = node->next;
 	}
 	data* library_list = safe_malloc(length * sizeof(data));
-	node = imported_libraries;
+	node = vm->imported_libraries;
 	length = 0;
 	while (node) {
 		library_list[length++] =
@@ -134,6 +764,7 @@ static data native_getc(data* args, int line) {
 	UNUSED(args);
 	UNUSED(line);
 	char result[2];
+	fflush(stdout);
 	result[0] = getc(stdin);
 	result[1] = 0;
 	return make_data(D_STRING, data_value_str(result));
@@ -156,6 +787,8 @@ static data native_log(data* args, int line) {
 static data native_exec(data* args, int line) {
 	char* command = native_to_string(args, line);
 	if (!get_settings_flag(SETTINGS_SANDBOXED)) {
+		// The command writes to the same stdout as we do.
+		fflush(stdout);
 		return make_data(D_NUMBER, data_value_num(system(command)));
 	}
 	return noneret_data();
@@ -207,7 +840,7 @@ static data native_examineMemory(data* args, int line) {
 	double arg2_to = native_to_numeric(args + 1, line);
 	printf("Memory Contents: \n");
 	for (int i = arg1_from; i < arg2_to; i++) {
-		data t = memory[i];
+		data t = vm->memory[i];
 		printf("[0x%08X] [%s] ", i, data_string[t.type]);
 		if (is_numeric(t)) {
 			printf("[%f][%d][0x%X]", t.value.number, (int)t.value.number,
@@ -224,47 +857,53 @@ static data native_examineMemory(data* args, int line) {
 static data native_read(data* args, int line) {
 	UNUSED(args);
 	UNUSED(line);
-	// Scan one line from the input.
-	char buffer[INPUT_BUFFER_SIZE];
-	while(!fgets(buffer, INPUT_BUFFER_SIZE, stdin)) {};
-
-	char* end_ptr = buffer;
-	errno = 0;
-	double d = strtod(buffer, &end_ptr);
-	// null terminator or newline character
-	if (errno != 0 || (*end_ptr != 0 && *end_ptr != 10)) {
-		size_t len = strlen(buffer);
-		// remove last newline
-		buffer[len - 1] = 0;
-		return make_data(D_STRING, data_value_str(buffer));
+	// Scan one line from the input, none at the end of the input.
+	char* buffer = 0;
+	size_t capacity;
+	fflush(stdout);
+	data result;
+	if (read_line(stdin, &buffer, &capacity) < 0) {
+		result = none_data();
 	}
-	return make_data(D_NUMBER, data_value_num(d));
+	else {
+		char* end_ptr = buffer;
+		errno = 0;
+		double d = strtod(buffer, &end_ptr);
+		result = errno != 0 || *end_ptr != 0
+			? make_data(D_STRING, data_value_str(buffer))
+			: make_data(D_NUMBER, data_value_num(d));
+	}
+	safe_free(buffer);
+	return result;
+}
+
+static data native_flush(data* args, int line) {
+	UNUSED(args);
+	UNUSED(line);
+	fflush(stdout);
+	return noneret_data();
 }
 
 static data native_readRaw(data* args, int line) {
 	UNUSED(args);
 	UNUSED(line);
-	// Scan one line from the input.
-	char buffer[INPUT_BUFFER_SIZE];
-	while(!fgets(buffer, INPUT_BUFFER_SIZE, stdin)) {};
-	size_t len = strlen(buffer);
-	buffer[len - 1] = 0;
-	return make_data(D_STRING, data_value_str(buffer));
+	// Scan one line from the input, none at the end of the input.
+	char* buffer = 0;
+	size_t capacity;
+	fflush(stdout);
+	data result = read_line(stdin, &buffer, &capacity) < 0
+		? none_data() : make_data(D_STRING, data_value_str(buffer));
+	safe_free(buffer);
+	return result;
 }
 
 static data native_readFile(data* args, int line) {
 	if (!get_settings_flag(SETTINGS_SANDBOXED)) {
 		char* file = native_to_string(args, line);
-		FILE *f = fopen(file, "rb");
-		fseek(f, 0, SEEK_END);
-		long fsize = ftell(f);
-		fseek(f, 0, SEEK_SET);  //same as rewind(f);
+		size_t length;
 		data_value r;
-		r.string = safe_malloc(fsize + 1);
-		fread(r.string, fsize, 1, f);
-		fclose(f);
-		r.string[fsize] = 0;
-		return make_data(D_STRING, r);
+		r.string = file_read_all(file, &length);
+		return r.string ? make_data(D_STRING, r) : none_data();
 	}
 	return noneret_data();
 }
@@ -274,38 +913,156 @@ static data native_writeFile(data* args, int line) {
 		char* file = native_to_string(args, line);
 		char* content = native_to_string(args + 1, line);
 		FILE *f = fopen(file, "wb");
-		fwrite(content, 1, strlen(content), f);
+		if (f) {
+			fwrite(content, 1, strlen(content), f);
+			fclose(f);
+		}
 	}
 	return noneret_data();
 }
 
-void native_call(char* function_name, int expected_args, int line) {
+// native_to_handle(t, line) returns the file handle t, the handle member of a
+//   File.
+static int native_to_handle(data* t, int line) {
+	return (int)native_to_numeric(t, line);
+}
+
+static data native_open(data* args, int line) {
+	if (get_settings_flag(SETTINGS_SANDBOXED)) {
+		return none_data();
+	}
+	int handle = file_open(native_to_string(args, line),
+		native_to_string(args + 1, line));
+	return handle < 0 ? none_data() : make_data(D_NUMBER, data_value_num(handle));
+}
+
+static data native_close(data* args, int line) {
+	file_close(native_to_handle(args, line));
+	return noneret_data();
+}
+
+static data native_readLine(data* args, int line) {
+	size_t length;
+	const char* s = file_read_line(native_to_handle(args, line), &length);
+	return s ? make_string(s, length) : none_data();
+}
+
+static data native_lines(data* args, int line) {
+	return make_data(D_ITERATOR, data_value_num(native_to_handle(args, line)));
+}
+
+static data native_write(data* args, int line) {
+	char number[NUMBER_BUFFER_SIZE];
+	size_t length;
+	const char* s = string_piece(args + 1, number, &length, line);
+	if (!file_write(native_to_handle(args, line), s, length)) {
+		error_runtime(line, VM_FILE_NOT_WRITABLE);
+	}
+	return noneret_data();
+}
+
+static native_function* find_native(const char* name) {
 	int functions = sizeof(native_functions) / sizeof(native_functions[0]);
-	bool found = false;
 	for (int i = 0; i < functions; i++) {
-		if(streq(native_functions[i].name, function_name)) {
-			int argc = native_functions[i].argc;
-			if (expected_args != argc) {
-				error_runtime(line, VM_INVALID_NATIVE_NUMBER_OF_ARGS, function_name);
-			}
-			data* arg_list = safe_malloc(sizeof(data) * argc);
-			for (int j = 0; j < argc; j++) {
-				arg_list[j] = pop_arg(line);
-			}
-			data end_marker = pop_arg(line);
-			if (end_marker.type != D_END_OF_ARGUMENTS) {
-				error_runtime(line, VM_INVALID_NATIVE_NUMBER_OF_ARGS, function_name);
-			}
-			push_arg(native_functions[i].function(arg_list, line), line);
-			for (int i = 0; i < argc; i++) {
-				destroy_data(&arg_list[i]);
-			}
-			safe_free(arg_list);
-			found = true;
-			break;
+		if (streq(native_functions[i].name, name)) {
+			return &native_functions[i];
+		}
+	}
+	return 0;
+}
+
+static host_native* find_host_native(const char* name) {
+	for (size_t i = 0; i < vm->host_natives_count; i++) {
+		if (streq(vm->host_natives[i].name, name)) {
+			return &vm->host_natives[i];
+		}
+	}
+	return 0;
+}
+
+bool native_register(const char* name, int argc, host_function function,
+	void* userdata, void (*release)(void* userdata)) {
+	if (find_native(name)) {
+		return false;
+	}
+	host_native* existing = find_host_native(name);
+	if (existing) {
+		if (existing->release) {
+			existing->release(existing->userdata);
+		}
+		existing->argc = argc;
+		existing->function = function;
+		existing->userdata = userdata;
+		existing->release = release;
+		return true;
+	}
+	if (vm->host_natives_count == vm->host_natives_capacity) {
+		vm->host_natives_capacity = vm->host_natives_capacity
+			? vm->host_natives_capacity * 2 : 8;
+		vm->host_natives = vm->host_natives
+			? safe_realloc(vm->host_natives,
+				vm->host_natives_capacity * sizeof(host_native))
+			: safe_malloc(vm->host_natives_capacity * sizeof(host_native));
+	}
+	host_native* added = &vm->host_natives[vm->host_natives_count++];
+	added->name = safe_strdup(name);
+	added->argc = argc;
+	added->function = function;
+	added->userdata = userdata;
+	added->release = release;
+	return true;
+}
+
+void native_unregister_all(void) {
+	for (size_t i = 0; i < vm->host_natives_count; i++) {
+		host_native* native = &vm->host_natives[i];
+		if (native->release) {
+			native->release(native->userdata);
 		}
+		safe_free(native->name);
+	}
+	if (vm->host_natives) {
+		safe_free(vm->host_natives);
 	}
-	if (!found) {
+	vm->host_natives = 0;
+	vm->host_natives_count = 0;
+	vm->host_natives_capacity = 0;
+}
+
+void native_call(char* function_name, int expected_args, int line) {
+	native_function* builtin = find_native(function_name);
+	host_native* host = builtin ? 0 : find_host_native(function_name);
+	if (!builtin && !host) {
 		error_runtime(line, VM_INVALID_NATIVE_CALL, function_name);
+		return;
+	}
+	int argc = builtin ? builtin->argc : host->argc;
+	if (expected_args != argc) {
+		error_runtime(line, VM_INVALID_NATIVE_NUMBER_OF_ARGS, function_name);
+	}
+	// Natives take lists, so slices are given as lists of their own. They're
+	//   made while the arguments are still on the stack, where the collector
+	//   sees them.
+	for (int j = 0; j < argc && vm->arg_pointer + 1 + j < MEMORY_SIZE; j++) {
+		data* arg = &vm->memory[vm->arg_pointer + 1 + j];
+		if (arg->type == D_LIST_VIEW) {
+			data list = list_of_view(arg, line);
+			destroy_data(arg);
+			*arg = list;
+		}
+	}
+	data* arg_list = safe_malloc(sizeof(data) * argc);
+	for (int j = 0; j < argc; j++) {
+		arg_list[j] = pop_arg(line);
+	}
+	data end_marker = pop_arg(line);
+	if (end_marker.type != D_END_OF_ARGUMENTS) {
+		error_runtime(line, VM_INVALID_NATIVE_NUMBER_OF_ARGS, function_name);
+	}
+	push_arg(builtin ? builtin->function(arg_list, line)
+		: host->function(arg_list, argc, host->userdata, line), line);
+	for (int i = 0; i < argc; i++) {
+		destroy_data(&arg_list[i]);
 	}
+	safe_free(arg_list);
 }
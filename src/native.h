@@ -1,14 +1,37 @@
 #ifndef NATIVE_H
 #define NATIVE_H
 
+#include "data.h"
+
 // native.h - Felix Guo
 // Contains native implementations of some functions that can be called from
 //    WendyScript (this compiler specific)
-// Also keeps track of arguments!
+// The program's arguments are kept by the interpreter in [state].
+
+// A native provided by the program embedding the interpreter, see [wendy].
+//   It's called with the argc arguments, args[0] being the first, and the
+//   userdata it was registered with. release(userdata) is called when the
+//   native is replaced or the interpreter is destroyed, if it's not NULL.
+typedef data (*host_function)(data* args, int argc, void* userdata, int line);
 
-extern char** program_arguments;
-extern int program_arguments_count;
+typedef struct host_native {
+	char* name;
+	int argc;
+	host_function function;
+	void* userdata;
+	void (*release)(void* userdata);
+} host_native;
 
 void native_call(char* function_name, int expected_args, int line);
 
+// native_register(name, argc, function, userdata, release) lets the
+//   interpreter the thread works with call function as the native name,
+//   replacing a native registered before under that name. Returns false if
+//   name is a built-in native.
+bool native_register(const char* name, int argc, host_function function,
+	void* userdata, void (*release)(void* userdata));
+
+// native_unregister_all() forgets the registered natives.
+void native_unregister_all(void);
+
 #endif
@@ -5,243 +5,605 @@
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdint.h>
 
 // Implementation of Optimization Algorithms
 // Note: this file is particularly messy because the normal AST traversal
 //   algorithm doesn't apply here. The optimizer passes does not only read from
 //   the AST, but readily mutates it as well.
+//
+// The optimizer runs in rounds of two passes. The scan pass records, for every
+//   identifier name in the program, how often it is declared, assigned and
+//   used. The optimize pass then walks the program in execution order, keeping
+//   track of which names hold a known literal at that point (facts). Facts are
+//   substituted and folded, merged where branches join and killed at loops.
+//
+// Identifiers are resolved by name at runtime and closures share variables
+//   with the frame that created them, so facts are never kept for a name that
+//   is assigned inside any function. A function body starts with no facts
+//   except globals that are declared once at the top level with a literal and
+//   never assigned.
+//
+// Small functions bound once at the top level are inlined at direct call sites
+//   when every argument is a literal or a stable variable, so the body can be
+//   evaluated in the caller without changing what any name refers to.
 
-// Linked list node of identifiers within a statement block
-typedef struct id_node id_node;
-struct id_node {
-	char* id_name;
-	expr* value;
-	int modified_count;
-	int usage_count;
-	id_node* next;
+#define OPTIMIZE_ROUNDS 2
+#define SYMBOL_TABLE_INITIAL_CAPACITY 64
+
+// Symbol table entry, one per identifier name in the program.
+typedef struct symbol symbol;
+struct symbol {
+	char* name;
+	unsigned int hash;
+	// Whole program information, collected by the scan pass.
+	int declarations;
+	int local_declarations;
+	int assignments;
+	int usages;
+	bool assigned_in_function;
+	bool has_global_value;
+	data global_value;
+	expr* function;
+	// Flow information at the current point of the optimize pass.
+	bool known;
+	data value;
+	bool declared;
+	symbol* next;
 };
 
-// Statement scope block to simulate function calls and checking if identifiers exist.
+typedef struct symbol_table {
+	symbol** buckets;
+	size_t capacity;
+	size_t count;
+} symbol_table;
+
+// A fact saved so it can be restored later, when leaving a scope that
+//   shadowed it or when joining control flow.
+typedef struct saved_fact {
+	symbol* sym;
+	bool known;
+	data value;
+} saved_fact;
+
+// Statement scope block to simulate local variable frames. Keeps the outer
+//   facts of every name declared in the block.
 typedef struct statement_block statement_block;
 struct statement_block {
-	id_node* id_list;
+	saved_fact* shadowed;
+	size_t count;
+	size_t capacity;
 	statement_block* next;
 };
 
-static statement_block* curr_statement_block = 0;
+typedef struct fact_set {
+	saved_fact* facts;
+	size_t count;
+} fact_set;
+
+static THREAD_LOCAL symbol_table symbols = { 0, 0, 0 };
+static THREAD_LOCAL statement_block* curr_statement_block = 0;
+
+// Scan pass state.
+static THREAD_LOCAL int scan_function_depth = 0;
+static THREAD_LOCAL int scan_block_depth = 0;
+static THREAD_LOCAL bool has_raw_bytecode = false;
+static THREAD_LOCAL bool operators_overloaded = false;
+static THREAD_LOCAL bool local_overloads = false;
+static THREAD_LOCAL size_t program_size = 0;
+
+// Optimize pass state.
+static THREAD_LOCAL arena* nodes = 0; // owns the tree
+static THREAD_LOCAL int function_depth = 0;
+static THREAD_LOCAL bool propagation_enabled = false;
+static THREAD_LOCAL bool global_values_enabled = false;
+static THREAD_LOCAL bool remove_unused_enabled = false;
+static THREAD_LOCAL bool inline_enabled = false;
+static THREAD_LOCAL size_t inline_budget = 0;
+static THREAD_LOCAL int inline_depth = 0;
+
+// Limits recursion through mutually recursive functions being inlined into
+//   each other.
+#define MAX_INLINE_DEPTH 8
 
 // Forward Declarations
-static void free_id_nodes(id_node* node);
-static void free_statement_blocks(statement_block* block);
 static statement_list* optimize_statement_list(statement_list* list);
 static statement* optimize_statement(statement* state);
 static expr* optimize_expr(expr* expression);
-static expr_list* optimize_expr_list(expr_list* list);
-static statement_list* scan_statement_list_with_new_block(statement_list* list);
 static void scan_statement_list(statement_list* list);
 static void scan_statement(statement* state);
 static void scan_expr(expr* expression);
 static void scan_expr_list(expr_list* list);
+static void kill_assigned_statement(statement* state);
+static void kill_assigned_expr(expr* expression);
 
 static inline bool is_boolean(data t) {
 	return t.type == D_TRUE || t.type == D_FALSE;
 }
 
-static id_node* find_id_node(char* id, int line, int col) {
-	UNUSED(line);
-	UNUSED(col);
-	// Search in each block and each list. Returns null if not found for now.
-	// TODO: perform identifier checking here, but will need to add in
-	//   special cases like `this` for OOP
-	statement_block* b = curr_statement_block;
-	while (b) {
-		id_node* n = b->id_list;
-		while (n) {
-			if (streq(n->id_name, id)) {
-				return n;
+// is_constant(expression) returns true if expression is a literal whose value
+//   can be copied into other places in the program.
+static bool is_constant(expr* expression) {
+	if (!expression || expression->type != E_LITERAL) {
+		return false;
+	}
+	data_type t = expression->op.lit_expr.type;
+	return t == D_NUMBER || t == D_STRING || t == D_TRUE || t == D_FALSE ||
+		t == D_NONE;
+}
+
+static bool is_identifier(expr* expression) {
+	return expression && expression->type == E_LITERAL &&
+		expression->op.lit_expr.type == D_IDENTIFIER;
+}
+
+// Names bound implicitly by the VM, and operator overloads which are looked up
+//   implicitly, are never tracked.
+static bool is_reserved(char* id) {
+	return streq(id, "this") || streq(id, "self") || streq(id, "arguments") ||
+		streq(id, "time") || strncmp(id, OPERATOR_OVERLOAD_PREFIX,
+			strlen(OPERATOR_OVERLOAD_PREFIX)) == 0;
+}
+
+/* SYMBOL TABLE */
+static unsigned int hash_id(char* id) {
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+	for (; *id; id++) {
+		hash ^= (uint8_t)*id;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void init_symbols(void) {
+	symbols.capacity = SYMBOL_TABLE_INITIAL_CAPACITY;
+	symbols.count = 0;
+	symbols.buckets = safe_calloc(symbols.capacity, sizeof(symbol*));
+}
+
+static void free_symbols(void) {
+	for (size_t b = 0; b < symbols.capacity; b++) {
+		symbol* s = symbols.buckets[b];
+		while (s) {
+			symbol* next = s->next;
+			if (s->known) {
+				destroy_data(&s->value);
 			}
-			n = n->next;
+			if (s->has_global_value) {
+				destroy_data(&s->global_value);
+			}
+			safe_free(s->name);
+			safe_free(s);
+			s = next;
+		}
+	}
+	safe_free(symbols.buckets);
+	symbols.buckets = 0;
+	symbols.capacity = 0;
+	symbols.count = 0;
+}
+
+static symbol* find_symbol(char* id) {
+	unsigned int hash = hash_id(id);
+	symbol* s = symbols.buckets[hash & (symbols.capacity - 1)];
+	while (s) {
+		if (s->hash == hash && streq(s->name, id)) {
+			return s;
 		}
-		b = b->next;
+		s = s->next;
 	}
 	return 0;
 }
 
-static void remove_entry(char* id, int line, int col) {
-	UNUSED(line);
-	UNUSED(col);
-	// Basic LL Search and Remove
-	statement_block* b = curr_statement_block;
-	while (b) {
-		id_node** n = &b->id_list;
-		while (*n) {
-			if (streq((*n)->id_name, id)) {
-				id_node* next = (*n)->next;
-				safe_free(*n);
-				*n = next;
-				return;
-			}
-			n = &((*n)->next);
+static void grow_symbols(void) {
+	size_t new_capacity = symbols.capacity * 2;
+	symbol** new_buckets = safe_calloc(new_capacity, sizeof(symbol*));
+	for (size_t b = 0; b < symbols.capacity; b++) {
+		symbol* s = symbols.buckets[b];
+		while (s) {
+			symbol* next = s->next;
+			size_t index = s->hash & (new_capacity - 1);
+			s->next = new_buckets[index];
+			new_buckets[index] = s;
+			s = next;
 		}
-		b = b->next;
 	}
+	safe_free(symbols.buckets);
+	symbols.buckets = new_buckets;
+	symbols.capacity = new_capacity;
 }
 
-static void add_usage(char* id, int line, int col) {
-	id_node* r = find_id_node(id, line, col);
-	if (r) r->usage_count++;
+// intern_symbol(id) returns the entry for id, creating it if needed.
+static symbol* intern_symbol(char* id) {
+	symbol* s = find_symbol(id);
+	if (s) {
+		return s;
+	}
+	if (symbols.count * 4 >= symbols.capacity * 3) {
+		grow_symbols();
+	}
+	s = safe_calloc(1, sizeof(symbol));
+	s->name = safe_strdup(id);
+	s->hash = hash_id(id);
+	size_t index = s->hash & (symbols.capacity - 1);
+	s->next = symbols.buckets[index];
+	symbols.buckets[index] = s;
+	symbols.count++;
+	return s;
 }
 
-static void remove_usage(char* id, int line, int col) {
-	id_node* r = find_id_node(id, line, col);
-	if (r) r->usage_count--;
+/* FACTS */
+static bool is_propagatable(symbol* s) {
+	return propagation_enabled && !s->assigned_in_function &&
+		!is_reserved(s->name);
 }
 
-static int get_usage(char* id, int line, int col) {
-	id_node* r = find_id_node(id, line, col);
-	if (r) return r->usage_count;
-	else return 100;
+static bool has_usable_global_value(symbol* s) {
+	return global_values_enabled && is_propagatable(s) &&
+		s->has_global_value && s->declarations == 1 && s->assignments == 0;
 }
 
-static expr* get_value(char* id, int line, int col) {
-	id_node* r = find_id_node(id, line, col);
-	if (r) return r->value;
-	else return 0;
+// current_value(id) returns the known literal value of id at this point in the
+//   program, or 0 if it is unknown.
+static data* current_value(char* id) {
+	symbol* s = find_symbol(id);
+	if (!s) {
+		return 0;
+	}
+	if (s->known) {
+		return &s->value;
+	}
+	if (function_depth > 0 && has_usable_global_value(s)) {
+		return &s->global_value;
+	}
+	return 0;
 }
 
-static int get_modified(char* id, int line, int col) {
-	id_node* r = find_id_node(id, line, col);
-	if (r) return r->modified_count;
-	else return 100;
+static void forget(symbol* s) {
+	if (s->known) {
+		destroy_data(&s->value);
+		s->known = false;
+	}
 }
 
-static void add_modified(char* id, int line, int col) {
-	id_node* r = find_id_node(id, line, col);
-	if (r) r->modified_count++;
+// set_fact(s, value) records that s now holds value, or that its value is
+//   unknown if value is not a constant.
+static void set_fact(symbol* s, expr* value) {
+	forget(s);
+	if (is_constant(value) && is_propagatable(s)) {
+		s->known = true;
+		s->value = copy_data(value->op.lit_expr);
+	}
 }
 
-void optimize_safe_free_e(expr* expression, traversal_algorithm* algo) {
-	UNUSED(algo);
-	if (expression->type == E_LITERAL
-		&& expression->op.lit_expr.type == D_IDENTIFIER) {
-		remove_usage(expression->op.lit_expr.value.string,
-				expression->line, expression->col);
+static void forget_id(char* id) {
+	symbol* s = find_symbol(id);
+	if (s) {
+		forget(s);
 	}
-    ast_safe_free_e(expression, algo);
 }
-void optimize_safe_free_el(expr_list* ptr, traversal_algorithm* algo) {
-    UNUSED(algo);
-    ast_safe_free_el(ptr, algo);
+
+static void forget_all(void) {
+	for (size_t b = 0; b < symbols.capacity; b++) {
+		for (symbol* s = symbols.buckets[b]; s; s = s->next) {
+			forget(s);
+		}
+	}
 }
 
-void optimize_safe_free_s(statement* ptr, traversal_algorithm* algo) {
-    UNUSED(algo);
-    ast_safe_free_s(ptr, algo);
+static void make_new_block(void) {
+	statement_block* new_block = safe_calloc(1, sizeof(statement_block));
+	new_block->next = curr_statement_block;
+	curr_statement_block = new_block;
 }
 
-void optimize_safe_free_sl(statement_list* ptr, traversal_algorithm* algo) {
-    UNUSED(algo);
-    ast_safe_free_sl(ptr, algo);
+// delete_block() leaves the current block, restoring the facts of every name
+//   that it shadowed.
+static void delete_block(void) {
+	statement_block* block = curr_statement_block;
+	for (size_t n = block->count; n > 0; n--) {
+		saved_fact* saved = &block->shadowed[n - 1];
+		forget(saved->sym);
+		saved->sym->known = saved->known;
+		saved->sym->value = saved->value;
+	}
+	if (block->shadowed) {
+		safe_free(block->shadowed);
+	}
+	curr_statement_block = block->next;
+	safe_free(block);
 }
 
-traversal_algorithm optimize_safe_free_impl = {
-	optimize_safe_free_e,
-	optimize_safe_free_el,
-	optimize_safe_free_s,
-	optimize_safe_free_sl,
-	HANDLE_AFTER_CHILDREN, 0
-};
+// declare(id, value) binds a new variable id in the current block.
+static void declare(char* id, expr* value) {
+	if (!curr_statement_block) {
+		error_general(OPTIMIZER_NO_STATEMENT_BLOCK);
+		return;
+	}
+	statement_block* block = curr_statement_block;
+	symbol* s = intern_symbol(id);
+	bool already_shadowed = false;
+	for (size_t n = 0; n < block->count; n++) {
+		if (block->shadowed[n].sym == s) {
+			already_shadowed = true;
+			break;
+		}
+	}
+	if (!already_shadowed) {
+		if (block->count == block->capacity) {
+			block->capacity = block->capacity ? block->capacity * 2 : 8;
+			if (block->shadowed) {
+				block->shadowed = safe_realloc(block->shadowed,
+					block->capacity * sizeof(saved_fact));
+			}
+			else {
+				block->shadowed = safe_malloc(block->capacity * sizeof(saved_fact));
+			}
+		}
+		saved_fact* saved = &block->shadowed[block->count++];
+		saved->sym = s;
+		saved->known = s->known;
+		saved->value = s->value;
+		// Ownership of the value moved into the block.
+		s->known = false;
+	}
+	set_fact(s, value);
+}
 
-statement_list* optimize_ast(statement_list* ast) {
-	statement_list* result = scan_statement_list_with_new_block(ast);
-	free_statement_blocks(curr_statement_block);
-	return result;
+static fact_set save_facts(void) {
+	fact_set set = { 0, 0 };
+	size_t capacity = 0;
+	for (size_t b = 0; b < symbols.capacity; b++) {
+		for (symbol* s = symbols.buckets[b]; s; s = s->next) {
+			if (!s->known) continue;
+			if (set.count == capacity) {
+				capacity = capacity ? capacity * 2 : 8;
+				if (set.facts) {
+					set.facts = safe_realloc(set.facts,
+						capacity * sizeof(saved_fact));
+				}
+				else {
+					set.facts = safe_malloc(capacity * sizeof(saved_fact));
+				}
+			}
+			saved_fact* saved = &set.facts[set.count++];
+			saved->sym = s;
+			saved->known = true;
+			saved->value = copy_data(s->value);
+		}
+	}
+	return set;
 }
 
-static void free_statement_block(statement_block* block) {
-	if (!block) return;
-	free_id_nodes(curr_statement_block->id_list);
-	safe_free(block);
+static void restore_facts(fact_set set) {
+	forget_all();
+	for (size_t n = 0; n < set.count; n++) {
+		set.facts[n].sym->known = true;
+		set.facts[n].sym->value = copy_data(set.facts[n].value);
+	}
 }
 
-void free_statement_blocks(statement_block* block) {
-	if (!block) return;
-	free_statement_blocks(block->next);
-	free_statement_block(block);
+// merge_facts(other) keeps only the current facts that also hold in other,
+//   used where two branches of control flow join.
+static void merge_facts(fact_set other) {
+	for (size_t b = 0; b < symbols.capacity; b++) {
+		for (symbol* s = symbols.buckets[b]; s; s = s->next) {
+			if (!s->known) continue;
+			bool agrees = false;
+			for (size_t n = 0; n < other.count; n++) {
+				if (other.facts[n].sym == s) {
+					agrees = data_equal(&other.facts[n].value, &s->value);
+					break;
+				}
+			}
+			if (!agrees) {
+				forget(s);
+			}
+		}
+	}
 }
 
-static void free_id_nodes(id_node* node) {
-	if (!node) return;
-	free_id_nodes(node->next);
-	safe_free(node);
+static void free_facts(fact_set set) {
+	for (size_t n = 0; n < set.count; n++) {
+		destroy_data(&set.facts[n].value);
+	}
+	if (set.facts) {
+		safe_free(set.facts);
+	}
 }
 
-static void add_node(char* id, expr* value) {
-	if (!curr_statement_block) {
-		error_general(OPTIMIZER_NO_STATEMENT_BLOCK);
+// root_identifier(lvalue) returns the variable an lvalue like a.b[c] writes
+//   through, or 0 if there is none.
+static char* root_identifier(expr* lvalue) {
+	while (lvalue && lvalue->type == E_BINARY &&
+		(lvalue->op.bin_expr.operator == O_MEMBER ||
+		 lvalue->op.bin_expr.operator == O_SUBSCRIPT)) {
+		lvalue = lvalue->op.bin_expr.left;
 	}
-	id_node* new_node = safe_malloc(sizeof(id_node));
-	new_node->id_name = id;
-	new_node->value = value;
-	new_node->modified_count = 0;
-	new_node->usage_count = 0;
-	new_node->next = curr_statement_block->id_list;
-	curr_statement_block->id_list = new_node;
+	return is_identifier(lvalue) ? lvalue->op.lit_expr.value.string : 0;
 }
 
-static void make_new_block(void) {
-	statement_block* new_block = safe_malloc(sizeof(statement_block));
-	new_block->next = curr_statement_block;
-	new_block->id_list = 0;
-	curr_statement_block = new_block;
+statement_list* optimize_ast(arena* a, statement_list* ast) {
+	nodes = a;
+	bool repl = get_settings_flag(SETTINGS_REPL);
+	bool compile = get_settings_flag(SETTINGS_COMPILE);
+	for (int round = 0; round < OPTIMIZE_ROUNDS; round++) {
+		init_symbols();
+		has_raw_bytecode = false;
+		operators_overloaded = false;
+		local_overloads = false;
+		program_size = 0;
+		scan_statement_list(ast);
+
+		// The REPL optimizes each input on its own while earlier inputs keep
+		//   running, and compiled libraries are linked into unknown programs,
+		//   so only local facts are safe to use for them.
+		propagation_enabled = !repl && !has_raw_bytecode;
+		global_values_enabled = propagation_enabled && !compile;
+		remove_unused_enabled = !repl && !has_raw_bytecode;
+		inline_enabled = global_values_enabled && !local_overloads;
+		inline_budget = program_size *
+			get_settings_value(SETTINGS_INLINE_MAX_GROWTH) / 100;
+		function_depth = 0;
+		inline_depth = 0;
+
+		make_new_block();
+		ast = optimize_statement_list(ast);
+		delete_block();
+		free_symbols();
+	}
+	return ast;
 }
 
-static void delete_block(void) {
-	statement_block* next = curr_statement_block->next;
-	free_statement_block(curr_statement_block);
-	curr_statement_block = next;
+/* OPTIMIZE CODE */
+static bool is_return(statement* state) {
+	return state->type == S_OPERATION &&
+		state->op.operation_statement.operator == OP_RET;
+}
+
+static bool is_pure(expr* expression) {
+	if (expression->type == E_LITERAL) {
+		return expression->op.lit_expr.type != D_IDENTIFIER;
+	}
+	if (expression->type == E_FUNCTION) {
+		return true;
+	}
+	if (expression->type == E_LIST) {
+		for (expr_list* e = expression->op.list_expr.contents; e; e = e->next) {
+			if (!is_pure(e->elem)) return false;
+		}
+		return true;
+	}
+	return false;
 }
 
-static statement_list* scan_optimize_statement_list(statement_list* list) {
-	// We run two passes of optimization for some unknown reason. I added this
-	//   back in the day and I can't remember why :)
-	scan_statement_list(list);
-	list = optimize_statement_list(list);
-	list = optimize_statement_list(list);
-	return list;
+// is_unused_let(state) returns true if the let binds a name that the program
+//   never refers to, to a value that has no side effects.
+static bool is_unused_let(statement* state) {
+	if (!remove_unused_enabled) {
+		return false;
+	}
+	if (get_settings_flag(SETTINGS_COMPILE) && function_depth == 0 &&
+		!curr_statement_block->next) {
+		// Top level bindings of a library are its exports.
+		return false;
+	}
+	char* id = state->op.let_statement.lvalue;
+	symbol* s = find_symbol(id);
+	return s && !is_reserved(id) && s->usages == 0 && s->assignments == 0 &&
+		is_pure(state->op.let_statement.rvalue);
+}
+
+// wrap_in_block(state) puts a lone declaration in its own block, so it keeps
+//   its scope after the if statement around it is folded away.
+static statement* wrap_in_block(statement* state) {
+	if (!state || (state->type != S_LET && state->type != S_STRUCT)) {
+		return state;
+	}
+	statement_list* list = arena_alloc(nodes, sizeof(statement_list));
+	list->elem = state;
+	list->next = 0;
+	statement* block = arena_alloc(nodes, sizeof(statement));
+	block->type = S_BLOCK;
+	block->src_line = state->src_line;
+	block->op.block_statement = list;
+	return block;
+}
+
+static statement* optimize_if_statement(statement* state) {
+	state->op.if_statement.condition =
+		optimize_expr(state->op.if_statement.condition);
+	expr* condition = state->op.if_statement.condition;
+	statement* run_if_true = state->op.if_statement.statement_true;
+	statement* run_if_false = state->op.if_statement.statement_false;
+
+	if (condition->type == E_LITERAL && is_boolean(condition->op.lit_expr)) {
+		// Only one branch can ever run.
+		statement* taken = run_if_true;
+		if (condition->op.lit_expr.type == D_FALSE) {
+			taken = run_if_false;
+		}
+		make_new_block();
+		taken = optimize_statement(wrap_in_block(taken));
+		delete_block();
+		return taken;
+	}
+
+	fact_set before = save_facts();
+	make_new_block();
+	state->op.if_statement.statement_true = optimize_statement(run_if_true);
+	delete_block();
+	fact_set after_true = save_facts();
+
+	restore_facts(before);
+	make_new_block();
+	state->op.if_statement.statement_false = optimize_statement(run_if_false);
+	delete_block();
+	merge_facts(after_true);
+
+	free_facts(before);
+	free_facts(after_true);
+	return state;
 }
-static statement_list* scan_statement_list_with_new_block(statement_list* list) {
+
+static statement* optimize_loop_statement(statement* state) {
+	char* index_var = state->op.loop_statement.index_var;
+	// Anything assigned in the loop may hold a value from any iteration, both
+	//   inside the loop and after it.
+	kill_assigned_statement(state);
 	make_new_block();
-	list = scan_optimize_statement_list(list);
+	if (index_var) {
+		declare(index_var, 0);
+	}
+	state->op.loop_statement.condition =
+		optimize_expr(state->op.loop_statement.condition);
+	make_new_block();
+	state->op.loop_statement.statement_true =
+		optimize_statement(state->op.loop_statement.statement_true);
+	delete_block();
 	delete_block();
-	return list;
+	kill_assigned_statement(state);
+
+	expr* condition = state->op.loop_statement.condition;
+	if (!index_var && condition->type == E_LITERAL &&
+		condition->op.lit_expr.type == D_FALSE) {
+		// Never runs.
+		return 0;
+	}
+	return state;
 }
 
-/* OPTIMIZE CODE */
 static statement* optimize_statement(statement* state) {
 	if (!state) return 0;
 	if (state->type == S_LET) {
 		state->op.let_statement.rvalue =
-				optimize_expr(state->op.let_statement.rvalue);
-		if (get_usage(state->op.let_statement.lvalue,
-				state->src_line,
-				0) == 0 &&
-			state->op.let_statement.rvalue->type == E_LITERAL) {
-			remove_entry(state->op.let_statement.lvalue,
-				state->src_line,
-				0);
-			traverse_statement(state, &optimize_safe_free_impl);
-
+			optimize_expr(state->op.let_statement.rvalue);
+		if (is_unused_let(state)) {
 			return 0;
 		}
+		declare(state->op.let_statement.lvalue, state->op.let_statement.rvalue);
+		find_symbol(state->op.let_statement.lvalue)->declared = true;
 	}
 	else if (state->type == S_OPERATION) {
-
+		opcode op = state->op.operation_statement.operator;
+		if (op == OP_RET || op == OP_YIELD || op == OP_OUTL) {
+			state->op.operation_statement.operand =
+				optimize_expr(state->op.operation_statement.operand);
+		}
+		else {
+			// inc, dec and input write to their operand.
+			kill_assigned_statement(state);
+		}
 	}
 	else if (state->type == S_EXPR) {
 		state->op.expr_statement = optimize_expr(state->op.expr_statement);
 	}
 	else if (state->type == S_BLOCK) {
+		make_new_block();
+		state->op.block_statement =
+			optimize_statement_list(state->op.block_statement);
+		delete_block();
 		if (!state->op.block_statement) {
 			return 0;
 		}
@@ -249,184 +611,441 @@ static statement* optimize_statement(statement* state) {
 	else if (state->type == S_STRUCT) {
 		state->op.struct_statement.init_fn =
 			 optimize_expr(state->op.struct_statement.init_fn);
-		state->op.struct_statement.instance_members =
-			optimize_expr_list(state->op.struct_statement.instance_members);
-		state->op.struct_statement.static_members =
-			optimize_expr_list(state->op.struct_statement.static_members);
+		declare(state->op.struct_statement.name, 0);
 	}
 	else if (state->type == S_IF) {
-		state->op.if_statement.condition =
-			optimize_expr(state->op.if_statement.condition);
-		expr* condition = state->op.if_statement.condition;
-
-		state->op.if_statement.statement_true =
-			optimize_statement(state->op.if_statement.statement_true);
-		state->op.if_statement.statement_false =
-			optimize_statement(state->op.if_statement.statement_false);
-
-		statement* run_if_false = state->op.if_statement.statement_false;
-		statement* run_if_true = state->op.if_statement.statement_true;
-		if (condition->type == E_LITERAL && condition->op.lit_expr.type == D_TRUE) {
-			// Always going to be true!
-			traverse_statement(run_if_false, &optimize_safe_free_impl);
-			traverse_expr(condition, &optimize_safe_free_impl);
-			safe_free(state);
-			return run_if_true;
-		}
-		else if (condition->type == E_LITERAL && condition->op.lit_expr.type == D_FALSE) {
-			traverse_statement(run_if_true, &optimize_safe_free_impl);
-			traverse_expr(condition, &optimize_safe_free_impl);
-			safe_free(state);
-			return run_if_false;
-		}
+		return optimize_if_statement(state);
 	}
 	else if (state->type == S_LOOP) {
-		state->op.loop_statement.condition =
-			optimize_expr(state->op.loop_statement.condition);
-		state->op.loop_statement.statement_true =
-			optimize_statement(state->op.loop_statement.statement_true);
-		if (!state->op.loop_statement.statement_true) {
-			// Empty Body
-			traverse_expr(state->op.loop_statement.condition, &optimize_safe_free_impl);
-			return 0;
-		}
+		return optimize_loop_statement(state);
+	}
+	else if (state->type == S_BYTECODE) {
+		forget_all();
 	}
 	return state;
 }
 
 static statement_list* optimize_statement_list(statement_list* list) {
-	if (!list) return 0;
-	list->next = optimize_statement_list(list->next);
-	list->elem = optimize_statement(list->elem);
-	if (list->elem) {
-		return list;
+	statement_list* head = list;
+	statement_list** link = &head;
+	while (*link) {
+		statement_list* curr = *link;
+		curr->elem = optimize_statement(curr->elem);
+		if (!curr->elem) {
+			// No Statement
+			*link = curr->next;
+			continue;
+		}
+		if (is_return(curr->elem) && curr->next) {
+			// Unreachable
+			curr->next = 0;
+		}
+		link = &curr->next;
+	}
+	return head;
+}
+
+static bool fold_binary(expr* expression) {
+	expr* left = expression->op.bin_expr.left;
+	expr* right = expression->op.bin_expr.right;
+	enum operator op = expression->op.bin_expr.operator;
+	data possible_optimized;
+	if (left->type == E_LITERAL && left->op.lit_expr.type == D_NUMBER &&
+		right->type == E_LITERAL && right->op.lit_expr.type == D_NUMBER) {
+		// Peek Optimization is Available on Numbers
+		// Optimized Reuslt will be on OP
+		bool can_optimize = true;
+		double a = left->op.lit_expr.value.number;
+		double b = right->op.lit_expr.value.number;
+		switch (op) {
+			case O_MUL:
+				possible_optimized.value.number = a * b;
+				break;
+			case O_IDIV:
+				if (b != 0) {
+					possible_optimized.value.number = (int)(a / b);
+				}
+				else can_optimize = false;
+				break;
+			case O_DIV:
+				if (b != 0) {
+					possible_optimized.value.number = a / b;
+				}
+				else can_optimize = false;
+				break;
+			case O_REM:
+				if (b != 0 && a == floor(a) && b == floor(b)) {
+					possible_optimized.value.number = (long long)a % (long long)b;
+				}
+				else can_optimize = false;
+				break;
+			case O_SUB:
+				possible_optimized.value.number = a - b;
+				break;
+			case O_ADD:
+				possible_optimized.value.number = a + b;
+				break;
+			case O_LT:
+				possible_optimized = a < b ? true_data() : false_data();
+				break;
+			case O_GT:
+				possible_optimized = a > b ? true_data() : false_data();
+				break;
+			case O_LTE:
+				possible_optimized = a <= b ? true_data() : false_data();
+				break;
+			case O_GTE:
+				possible_optimized = a >= b ? true_data() : false_data();
+				break;
+			case O_EQ:
+				possible_optimized = a == b ? true_data() : false_data();
+				break;
+			case O_NEQ:
+				possible_optimized = a != b ? true_data() : false_data();
+				break;
+			default:
+				can_optimize = false;
+				break;
+		}
+		if (!can_optimize) {
+			return false;
+		}
+		if (!is_boolean(possible_optimized)) {
+			// Didn't get optimized to a boolean
+			possible_optimized.type = D_NUMBER;
+		}
+	}
+	else if (left->type == E_LITERAL && is_boolean(left->op.lit_expr) &&
+		right->type == E_LITERAL && is_boolean(right->op.lit_expr)) {
+		// Peek Optimization is Available on Booleans
+		bool a = left->op.lit_expr.type == D_TRUE;
+		bool b = right->op.lit_expr.type == D_TRUE;
+		switch (op) {
+			case O_AND:
+				possible_optimized = a && b ? true_data() : false_data();
+				break;
+			case O_OR:
+				possible_optimized = a || b ? true_data() : false_data();
+				break;
+			case O_EQ:
+				possible_optimized = a == b ? true_data() : false_data();
+				break;
+			case O_NEQ:
+				possible_optimized = a != b ? true_data() : false_data();
+				break;
+			default:
+				return false;
+		}
 	}
 	else {
-		// No Statement
-		statement_list* next = list->next;
-		safe_free(list);
-		return next;
+		return false;
+	}
+	expression->type = E_LITERAL;
+	expression->op.lit_expr = ast_literal(nodes, possible_optimized);
+	return true;
+}
+
+/* INLINING */
+static size_t count_nodes(expr* expression) {
+	if (!expression) return 0;
+	size_t count = 1;
+	switch (expression->type) {
+		case E_BINARY:
+			count += count_nodes(expression->op.bin_expr.left);
+			count += count_nodes(expression->op.bin_expr.right);
+			break;
+		case E_UNARY:
+			count += count_nodes(expression->op.una_expr.operand);
+			break;
+		case E_IF:
+			count += count_nodes(expression->op.if_expr.condition);
+			count += count_nodes(expression->op.if_expr.expr_true);
+			count += count_nodes(expression->op.if_expr.expr_false);
+			break;
+		case E_CALL:
+			count += count_nodes(expression->op.call_expr.function);
+			for (expr_list* a = expression->op.call_expr.arguments; a; a = a->next) {
+				count += count_nodes(a->elem);
+			}
+			break;
+		case E_LIST:
+			for (expr_list* e = expression->op.list_expr.contents; e; e = e->next) {
+				count += count_nodes(e->elem);
+			}
+			break;
+		default:
+			break;
+	}
+	return count;
+}
+
+static bool is_parameter(expr_list* parameters, char* id) {
+	for (expr_list* p = parameters; p; p = p->next) {
+		expr* name = p->elem->type == E_ASSIGN ?
+			p->elem->op.assign_expr.lvalue : p->elem;
+		if (is_identifier(name) && streq(name->op.lit_expr.value.string, id)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// is_inlinable_body(body, fn) returns true if body can be evaluated in any
+//   caller's frame: it binds nothing, assigns nothing, and every name other
+//   than a parameter refers to a global that is never shadowed.
+static bool is_inlinable_body(expr* body, expr* fn, char* fn_name) {
+	if (!body) return true;
+	switch (body->type) {
+		case E_LITERAL:
+			if (body->op.lit_expr.type == D_IDENTIFIER) {
+				char* id = body->op.lit_expr.value.string;
+				if (is_parameter(fn->op.func_expr.parameters, id)) {
+					return true;
+				}
+				symbol* s = find_symbol(id);
+				return !streq(id, fn_name) && !is_reserved(id) &&
+					s && s->local_declarations == 0;
+			}
+			return true;
+		case E_BINARY:
+			return is_inlinable_body(body->op.bin_expr.left, fn, fn_name) &&
+				(body->op.bin_expr.operator == O_MEMBER ||
+				 is_inlinable_body(body->op.bin_expr.right, fn, fn_name));
+		case E_UNARY:
+			return is_inlinable_body(body->op.una_expr.operand, fn, fn_name);
+		case E_IF:
+			return is_inlinable_body(body->op.if_expr.condition, fn, fn_name) &&
+				is_inlinable_body(body->op.if_expr.expr_true, fn, fn_name) &&
+				is_inlinable_body(body->op.if_expr.expr_false, fn, fn_name);
+		case E_CALL:
+			if (!is_inlinable_body(body->op.call_expr.function, fn, fn_name)) {
+				return false;
+			}
+			for (expr_list* a = body->op.call_expr.arguments; a; a = a->next) {
+				if (!is_inlinable_body(a->elem, fn, fn_name)) return false;
+			}
+			return true;
+		case E_LIST:
+			for (expr_list* e = body->op.list_expr.contents; e; e = e->next) {
+				if (!is_inlinable_body(e->elem, fn, fn_name)) return false;
+			}
+			return true;
+		default:
+			// Functions capture the frame they are created in, and
+			//   assignments (including named arguments) bind names.
+			return false;
+	}
+}
+
+// inline_target(id) returns the function bound to id if calls to it can be
+//   inlined, or 0 otherwise. A call that comes before the declaration has to
+//   stay a call, it fails at runtime.
+static expr* inline_target(char* id) {
+	symbol* s = find_symbol(id);
+	if (!inline_enabled || !s || !s->function || !s->declared ||
+		s->declarations != 1 || s->assignments != 0 ||
+		s->local_declarations != 0 || is_reserved(id)) {
+		return 0;
+	}
+	expr* fn = s->function;
+	statement* body = fn->op.func_expr.body;
+	if (fn->op.func_expr.is_native || !body || body->type != S_EXPR ||
+		count_nodes(body->op.expr_statement) >
+			(size_t)get_settings_value(SETTINGS_INLINE_MAX_SIZE)) {
+		return 0;
 	}
+	for (expr_list* p = fn->op.func_expr.parameters; p; p = p->next) {
+		if (p->elem->type == E_ASSIGN ?
+			!is_constant(p->elem->op.assign_expr.rvalue) :
+			!is_identifier(p->elem)) {
+			// Defaults that are not literals are evaluated in the callee.
+			return 0;
+		}
+	}
+	return is_inlinable_body(body->op.expr_statement, fn, id) ? fn : 0;
+}
+
+// is_stable_argument(arg) returns true if arg can be evaluated any number of
+//   times, at any point of the inlined body, with the same result.
+static bool is_stable_argument(expr* arg) {
+	if (is_constant(arg)) {
+		return true;
+	}
+	if (!is_identifier(arg)) {
+		return false;
+	}
+	symbol* s = find_symbol(arg->op.lit_expr.value.string);
+	return s && !s->assigned_in_function;
+}
+
+// bind_arguments(fn, arguments, bound) matches the call's arguments to the
+//   parameters of fn, filling bound with one expression per parameter in
+//   order. Returns false if the call cannot be inlined.
+static bool bind_arguments(expr* fn, expr_list* arguments, expr** bound,
+		size_t count) {
+	expr_list* parameters = fn->op.func_expr.parameters;
+	for (size_t n = 0; n < count; n++) {
+		bound[n] = 0;
+	}
+	size_t position = 0;
+	for (expr_list* a = arguments; a; a = a->next) {
+		expr* value = a->elem;
+		size_t index = position;
+		if (value->type == E_ASSIGN) {
+			// Named argument.
+			if (!is_identifier(value->op.assign_expr.lvalue)) return false;
+			char* id = value->op.assign_expr.lvalue->op.lit_expr.value.string;
+			index = 0;
+			expr_list* p = parameters;
+			for (; p; p = p->next, index++) {
+				expr* name = p->elem->type == E_ASSIGN ?
+					p->elem->op.assign_expr.lvalue : p->elem;
+				if (streq(name->op.lit_expr.value.string, id)) break;
+			}
+			if (!p) return false;
+			value = value->op.assign_expr.rvalue;
+		}
+		else {
+			position++;
+		}
+		if (index >= count || bound[index] || !is_stable_argument(value)) {
+			// Extra arguments end up in the callee's arguments list.
+			return false;
+		}
+		bound[index] = value;
+	}
+	size_t index = 0;
+	for (expr_list* p = parameters; p; p = p->next, index++) {
+		if (!bound[index]) {
+			if (p->elem->type != E_ASSIGN) return false;
+			bound[index] = p->elem->op.assign_expr.rvalue;
+		}
+	}
+	return true;
+}
+
+static expr* clone_expr(expr* expression, expr_list* parameters, expr** bound);
+
+static expr_list* clone_expr_list(expr_list* list, expr_list* parameters,
+		expr** bound) {
+	if (!list) return 0;
+	expr_list* copy = arena_alloc(nodes, sizeof(expr_list));
+	copy->elem = clone_expr(list->elem, parameters, bound);
+	copy->next = clone_expr_list(list->next, parameters, bound);
+	return copy;
+}
+
+// clone_expr(expression, parameters, bound) copies an inlinable body,
+//   replacing each parameter with a copy of its bound argument.
+static expr* clone_expr(expr* expression, expr_list* parameters, expr** bound) {
+	if (!expression) return 0;
+	if (is_identifier(expression)) {
+		size_t index = 0;
+		for (expr_list* p = parameters; p; p = p->next, index++) {
+			expr* name = p->elem->type == E_ASSIGN ?
+				p->elem->op.assign_expr.lvalue : p->elem;
+			if (streq(name->op.lit_expr.value.string,
+					expression->op.lit_expr.value.string)) {
+				return clone_expr(bound[index], 0, 0);
+			}
+		}
+	}
+	// Literals share their strings, which belong to the arena.
+	expr* copy = arena_alloc(nodes, sizeof(expr));
+	*copy = *expression;
+	switch (expression->type) {
+		case E_BINARY:
+			copy->op.bin_expr.left =
+				clone_expr(expression->op.bin_expr.left, parameters, bound);
+			if (expression->op.bin_expr.operator == O_MEMBER) {
+				copy->op.bin_expr.right = clone_expr(expression->op.bin_expr.right, 0, 0);
+			}
+			else {
+				copy->op.bin_expr.right =
+					clone_expr(expression->op.bin_expr.right, parameters, bound);
+			}
+			break;
+		case E_UNARY:
+			copy->op.una_expr.operand =
+				clone_expr(expression->op.una_expr.operand, parameters, bound);
+			break;
+		case E_IF:
+			copy->op.if_expr.condition =
+				clone_expr(expression->op.if_expr.condition, parameters, bound);
+			copy->op.if_expr.expr_true =
+				clone_expr(expression->op.if_expr.expr_true, parameters, bound);
+			copy->op.if_expr.expr_false =
+				clone_expr(expression->op.if_expr.expr_false, parameters, bound);
+			break;
+		case E_CALL:
+			copy->op.call_expr.function =
+				clone_expr(expression->op.call_expr.function, parameters, bound);
+			copy->op.call_expr.arguments =
+				clone_expr_list(expression->op.call_expr.arguments, parameters, bound);
+			break;
+		case E_LIST:
+			copy->op.list_expr.contents =
+				clone_expr_list(expression->op.list_expr.contents, parameters, bound);
+			break;
+		default:
+			break;
+	}
+	return copy;
+}
+
+// try_inline(call) returns the body of the called function with the call's
+//   arguments substituted, or 0 if the call has to stay a call.
+static expr* try_inline(expr* call) {
+	expr* callee = call->op.call_expr.function;
+	if (!is_identifier(callee) || inline_depth >= MAX_INLINE_DEPTH) {
+		return 0;
+	}
+	expr* fn = inline_target(callee->op.lit_expr.value.string);
+	if (!fn) {
+		return 0;
+	}
+	expr* body = fn->op.func_expr.body->op.expr_statement;
+	size_t growth = count_nodes(body);
+	if (growth > inline_budget) {
+		return 0;
+	}
+	size_t count = 0;
+	for (expr_list* p = fn->op.func_expr.parameters; p; p = p->next) {
+		count++;
+	}
+	expr** bound = safe_malloc((count + 1) * sizeof(expr*));
+	expr* result = 0;
+	if (bind_arguments(fn, call->op.call_expr.arguments, bound, count)) {
+		inline_budget -= growth;
+		result = clone_expr(body, fn->op.func_expr.parameters, bound);
+		result->line = call->line;
+		result->col = call->col;
+	}
+	safe_free(bound);
+	return result;
 }
 
 static expr* optimize_expr(expr* expression) {
 	if (!expression) return 0;
 	if (expression->type == E_LITERAL) {
 		if (expression->op.lit_expr.type == D_IDENTIFIER) {
-			// Is a static, then replace with value if literal
-			if (get_modified(expression->op.lit_expr.value.string,
-				expression->line, expression->col) == 0) {
-				expr* value = get_value(expression->op.lit_expr.value.string,
-					expression->line, expression->col);
-				if (value && value->type == E_LITERAL) {
-					remove_usage(expression->op.lit_expr.value.string,
-						expression->line, expression->col);
-                    destroy_data(&expression->op.lit_expr);
-					*expression = *value;
-				}
+			data* value = current_value(expression->op.lit_expr.value.string);
+			if (value) {
+				expression->op.lit_expr = ast_literal(nodes, copy_data(*value));
 			}
 		}
 	}
 	else if (expression->type == E_BINARY) {
 		expression->op.bin_expr.left =
 			optimize_expr(expression->op.bin_expr.left);
+		if (expression->op.bin_expr.operator == O_MEMBER) {
+			// The right hand side names a member, not a variable.
+			return expression;
+		}
 		expression->op.bin_expr.right =
 			optimize_expr(expression->op.bin_expr.right);
-
-		expr* left = expression->op.bin_expr.left;
-		expr* right = expression->op.bin_expr.right;
-		enum operator op = expression->op.bin_expr.operator;
-        data possible_optimized;
-		if (left->type == E_LITERAL && left->op.lit_expr.type == D_NUMBER &&
-			right->type == E_LITERAL && right->op.lit_expr.type == D_NUMBER) {
-			// Peek Optimization is Available on Numbers
-			// Optimized Reuslt will be on OP
-			bool can_optimize = true;
-			double a = left->op.lit_expr.value.number;
-			double b = right->op.lit_expr.value.number;
-			switch (op) {
-				case O_MUL:
-					possible_optimized.value.number = a * b;
-					break;
-				case O_IDIV:
-					if (b != 0) {
-						possible_optimized.value.number = (int)(a / b);
-					}
-					break;
-				case O_DIV:
-					if (b != 0) {
-						possible_optimized.value.number = a / b;
-					}
-					break;
-				case O_REM:
-					if (b != 0 && a == floor(a) && b == floor(b)) {
-						possible_optimized.value.number = (long long)a % (long long)b;
-					}
-					break;
-				case O_SUB:
-					possible_optimized.value.number = a - b;
-					break;
-				case O_ADD:
-					possible_optimized.value.number = a + b;
-					break;
-				case O_LT:
-					possible_optimized = a < b ? true_data() : false_data();
-					break;
-				case O_GT:
-					possible_optimized = a > b ? true_data() : false_data();
-					break;
-				case O_LTE:
-					possible_optimized = a <= b ? true_data() : false_data();
-					break;
-				case O_GTE:
-					possible_optimized = a >= b ? true_data() : false_data();
-					break;
-				case O_EQ:
-					possible_optimized = a == b ? true_data() : false_data();
-					break;
-				case O_NEQ:
-					possible_optimized = a != b ? true_data() : false_data();
-					break;
-				default:
-					can_optimize = false;
-					break;
-			}
-			if (can_optimize) {
-				if (!is_boolean(possible_optimized)) {
-					// Didn't get optimized to a boolean
-					possible_optimized.type = D_NUMBER;
-				}
-				expression->type = E_LITERAL;
-				expression->op.lit_expr = possible_optimized;
-				safe_free(left);
-				safe_free(right);
-				return expression;
-			}
-		}
-		else if (left->type == E_LITERAL && is_boolean(left->op.lit_expr) &&
-			right->type == E_LITERAL && is_boolean(right->op.lit_expr)) {
-			// Peek Optimization is Available on Booleans
-			bool can_optimize = true;
-			bool a = left->op.lit_expr.type == D_TRUE;
-			bool b = right->op.lit_expr.type == D_TRUE;
-			switch (op) {
-				case O_AND:
-					possible_optimized = a && b ? true_data() : false_data();
-					break;
-				case O_OR:
-					possible_optimized = a || b ? true_data() : false_data();
-					break;
-				default:
-					can_optimize = false;
-					break;
-			}
-			if (can_optimize) {
-				expression->type = E_LITERAL;
-				expression->op.lit_expr = possible_optimized;
-				safe_free(left);
-				safe_free(right);
-				return expression;
-			}
+		if (!operators_overloaded) {
+			fold_binary(expression);
 		}
 	}
 	else if (expression->type == E_UNARY) {
@@ -434,149 +1053,324 @@ static expr* optimize_expr(expr* expression) {
 			optimize_expr(expression->op.una_expr.operand);
 		enum operator op = expression->op.una_expr.operator;
 		expr* operand = expression->op.una_expr.operand;
+		if (operators_overloaded) {
+			return expression;
+		}
 		if (op == O_NEG && operand->type == E_LITERAL &&
 			operand->op.lit_expr.type == D_NUMBER) {
 			// Apply here
 			operand->op.lit_expr.value.number *= -1;
-			safe_free(expression);
 			return operand;
 		}
 		if (op == O_NOT && operand->type == E_LITERAL &&
-			(operand->op.lit_expr.type == D_TRUE ||
-			operand->op.lit_expr.type == D_FALSE)) {
+			is_boolean(operand->op.lit_expr)) {
 			// Apply here
+			bool was_true = operand->op.lit_expr.type == D_TRUE;
 			operand->op.lit_expr =
-				operand->op.lit_expr.type == D_TRUE ? false_data() : true_data();
-			safe_free(expression);
+				ast_literal(nodes, was_true ? false_data() : true_data());
 			return operand;
 		}
 	}
 	else if (expression->type == E_IF) {
 		expression->op.if_expr.condition =
 			optimize_expr(expression->op.if_expr.condition);
+		expr* condition = expression->op.if_expr.condition;
+		if (condition->type == E_LITERAL && is_boolean(condition->op.lit_expr)) {
+			expr* taken = expression->op.if_expr.expr_true;
+			if (condition->op.lit_expr.type == D_FALSE) {
+				taken = expression->op.if_expr.expr_false;
+			}
+			if (!taken) {
+				// A missing else evaluates to none.
+				expression->type = E_LITERAL;
+				expression->op.lit_expr = ast_literal(nodes, none_data());
+				return expression;
+			}
+			return optimize_expr(taken);
+		}
 		expression->op.if_expr.expr_true =
 			optimize_expr(expression->op.if_expr.expr_true);
+		kill_assigned_expr(expression->op.if_expr.expr_true);
 		expression->op.if_expr.expr_false =
 			optimize_expr(expression->op.if_expr.expr_false);
+		kill_assigned_expr(expression->op.if_expr.expr_false);
 	}
 	else if (expression->type == E_CALL) {
+		// Arguments are evaluated last to first, so nothing assigned within
+		//   them is known while optimizing them.
+		expr_list* args = expression->op.call_expr.arguments;
+		for (expr_list* a = args; a; a = a->next) {
+			kill_assigned_expr(a->elem);
+		}
+		for (expr_list* a = args; a; a = a->next) {
+			if (a->elem->type == E_ASSIGN) {
+				// Named argument.
+				a->elem->op.assign_expr.rvalue =
+					optimize_expr(a->elem->op.assign_expr.rvalue);
+			}
+			else {
+				a->elem = optimize_expr(a->elem);
+			}
+		}
+		for (expr_list* a = args; a; a = a->next) {
+			kill_assigned_expr(a->elem);
+		}
 		expression->op.call_expr.function =
 			optimize_expr(expression->op.call_expr.function);
-		expression->op.call_expr.arguments =
-			optimize_expr_list(expression->op.call_expr.arguments);
+		expr* inlined = try_inline(expression);
+		if (inlined) {
+			inline_depth++;
+			inlined = optimize_expr(inlined);
+			inline_depth--;
+			return inlined;
+		}
 	}
 	else if (expression->type == E_LIST) {
-		expression->op.list_expr.contents =
-			optimize_expr_list(expression->op.list_expr.contents);
+		for (expr_list* e = expression->op.list_expr.contents; e; e = e->next) {
+			e->elem = optimize_expr(e->elem);
+		}
 	}
 	else if (expression->type == E_FUNCTION) {
+		if (expression->op.func_expr.is_native) {
+			return expression;
+		}
+		// The body runs later, when almost nothing about the caller is known.
+		fact_set outside = save_facts();
+		forget_all();
+		function_depth++;
+		make_new_block();
+		for (expr_list* p = expression->op.func_expr.parameters; p; p = p->next) {
+			if (p->elem->type == E_ASSIGN) {
+				// Default Argument
+				p->elem->op.assign_expr.rvalue =
+					optimize_expr(p->elem->op.assign_expr.rvalue);
+				if (is_identifier(p->elem->op.assign_expr.lvalue)) {
+					declare(p->elem->op.assign_expr.lvalue->op.lit_expr.value.string, 0);
+				}
+			}
+			else if (is_identifier(p->elem)) {
+				declare(p->elem->op.lit_expr.value.string, 0);
+			}
+		}
 		expression->op.func_expr.body =
 			optimize_statement(expression->op.func_expr.body);
+		delete_block();
+		function_depth--;
+		restore_facts(outside);
+		free_facts(outside);
 	}
 	else if (expression->type == E_ASSIGN) {
-		if (expression->op.assign_expr.lvalue->type == E_LITERAL &&
-			expression->op.assign_expr.lvalue->op.lit_expr.type == D_IDENTIFIER) {
-				// Only optimize if not lists
-			if (get_usage(expression->op.assign_expr.lvalue->op.lit_expr.value.string,
-					expression->line, expression->col) == 0) {
-				traverse_expr(expression, &optimize_safe_free_impl);
-				return 0;
-			}
-			expression->op.assign_expr.rvalue =
-				optimize_expr(expression->op.assign_expr.rvalue);
+		expression->op.assign_expr.rvalue =
+			optimize_expr(expression->op.assign_expr.rvalue);
+		expr* lvalue = expression->op.assign_expr.lvalue;
+		if (is_identifier(lvalue) && expression->op.assign_expr.operator == O_ASSIGN) {
+			set_fact(intern_symbol(lvalue->op.lit_expr.value.string),
+				expression->op.assign_expr.rvalue);
+		}
+		else {
+			kill_assigned_expr(expression);
 		}
 	}
 	return expression;
 }
 
-static expr_list* optimize_expr_list(expr_list* list) {
-	if (!list) return 0;
-	list->next = optimize_expr_list(list->next);
-	list->elem = optimize_expr(list->elem);
-	if (list->elem) {
-		return list;
+/* KILLING FACTS */
+// kill_assigned_statement(state) forgets every variable state could write to.
+//   Function bodies are skipped since nothing they assign is ever tracked.
+static void kill_assigned_statement(statement* state) {
+	if (!state) return;
+	if (state->type == S_LET) {
+		kill_assigned_expr(state->op.let_statement.rvalue);
 	}
-	else {
-		// No Statement
-		expr_list* next = list->next;
-		safe_free(list);
-		return next;
+	else if (state->type == S_OPERATION) {
+		opcode op = state->op.operation_statement.operator;
+		if (op != OP_RET && op != OP_YIELD && op != OP_OUTL) {
+			char* id = root_identifier(state->op.operation_statement.operand);
+			if (id) forget_id(id);
+		}
+		kill_assigned_expr(state->op.operation_statement.operand);
+	}
+	else if (state->type == S_EXPR) {
+		kill_assigned_expr(state->op.expr_statement);
+	}
+	else if (state->type == S_BLOCK) {
+		for (statement_list* l = state->op.block_statement; l; l = l->next) {
+			kill_assigned_statement(l->elem);
+		}
+	}
+	else if (state->type == S_IF) {
+		kill_assigned_expr(state->op.if_statement.condition);
+		kill_assigned_statement(state->op.if_statement.statement_true);
+		kill_assigned_statement(state->op.if_statement.statement_false);
+	}
+	else if (state->type == S_LOOP) {
+		kill_assigned_expr(state->op.loop_statement.condition);
+		kill_assigned_statement(state->op.loop_statement.statement_true);
+	}
+	else if (state->type == S_BYTECODE) {
+		forget_all();
+	}
+}
+
+static void kill_assigned_expr(expr* expression) {
+	if (!expression) return;
+	if (expression->type == E_BINARY) {
+		kill_assigned_expr(expression->op.bin_expr.left);
+		kill_assigned_expr(expression->op.bin_expr.right);
+	}
+	else if (expression->type == E_UNARY) {
+		kill_assigned_expr(expression->op.una_expr.operand);
+	}
+	else if (expression->type == E_IF) {
+		kill_assigned_expr(expression->op.if_expr.condition);
+		kill_assigned_expr(expression->op.if_expr.expr_true);
+		kill_assigned_expr(expression->op.if_expr.expr_false);
+	}
+	else if (expression->type == E_CALL) {
+		kill_assigned_expr(expression->op.call_expr.function);
+		for (expr_list* a = expression->op.call_expr.arguments; a; a = a->next) {
+			if (a->elem->type == E_ASSIGN) {
+				kill_assigned_expr(a->elem->op.assign_expr.rvalue);
+			}
+			else {
+				kill_assigned_expr(a->elem);
+			}
+		}
+	}
+	else if (expression->type == E_LIST) {
+		for (expr_list* e = expression->op.list_expr.contents; e; e = e->next) {
+			kill_assigned_expr(e->elem);
+		}
+	}
+	else if (expression->type == E_ASSIGN) {
+		char* id = root_identifier(expression->op.assign_expr.lvalue);
+		if (id) forget_id(id);
+		kill_assigned_expr(expression->op.assign_expr.lvalue);
+		kill_assigned_expr(expression->op.assign_expr.rvalue);
 	}
 }
 
 /* BEGIN SCANNING CODE */
+static void add_declaration(char* id, bool top_level) {
+	symbol* s = intern_symbol(id);
+	s->declarations++;
+	if (!top_level) {
+		s->local_declarations++;
+	}
+}
+
+static bool scan_at_top_level(void) {
+	return scan_function_depth == 0 && scan_block_depth == 0;
+}
+
+static void add_assignment(expr* lvalue) {
+	char* id = root_identifier(lvalue);
+	if (!id) return;
+	symbol* s = intern_symbol(id);
+	s->assignments++;
+	if (scan_function_depth > 0) {
+		s->assigned_in_function = true;
+	}
+}
+
+static void scan_declaration_list(expr_list* list) {
+	for (; list; list = list->next) {
+		if (is_identifier(list->elem)) {
+			add_declaration(list->elem->op.lit_expr.value.string, false);
+		}
+	}
+}
+
 static void scan_statement(statement* state) {
 	if (!state) return;
 	if (state->type == S_LET) {
-		// Add Usage
-		add_node(state->op.let_statement.lvalue,
-			state->op.let_statement.rvalue);
-		scan_expr(state->op.let_statement.rvalue);
+		char* id = state->op.let_statement.lvalue;
+		expr* rvalue = state->op.let_statement.rvalue;
+		bool top_level = scan_at_top_level();
+		add_declaration(id, top_level);
+		symbol* s = intern_symbol(id);
+		if (top_level && is_constant(rvalue) && !s->has_global_value) {
+			s->has_global_value = true;
+			s->global_value = copy_data(rvalue->op.lit_expr);
+		}
+		if (top_level && rvalue && rvalue->type == E_FUNCTION) {
+			s->function = rvalue;
+		}
+		if (strncmp(id, OPERATOR_OVERLOAD_PREFIX,
+				strlen(OPERATOR_OVERLOAD_PREFIX)) == 0) {
+			if (strstr(id, "number") || strstr(id, "bool") || strstr(id, "any")) {
+				// Folding would skip the user's overload.
+				operators_overloaded = true;
+			}
+			if (!top_level) {
+				// Inlined code could see overloads its callee could not.
+				local_overloads = true;
+			}
+		}
+		scan_expr(rvalue);
 	}
 	else if (state->type == S_OPERATION) {
 		opcode op = state->op.operation_statement.operator;
-		if (op == OP_RET) {
-			scan_expr(state->op.operation_statement.operand);
-		}
-		else if (op == OP_OUTL) {
-			scan_expr(state->op.operation_statement.operand);
-		}
-		else {
-			add_modified(state->op.operation_statement.operand->op.lit_expr.value.string,
-				state->src_line, 0);
+		if (op != OP_RET && op != OP_YIELD && op != OP_OUTL) {
+			add_assignment(state->op.operation_statement.operand);
 		}
+		scan_expr(state->op.operation_statement.operand);
 	}
 	else if (state->type == S_EXPR) {
 		scan_expr(state->op.expr_statement);
 	}
 	else if (state->type == S_BLOCK) {
-		state->op.block_statement =
-			scan_optimize_statement_list(state->op.block_statement);
+		scan_block_depth++;
+		scan_statement_list(state->op.block_statement);
+		scan_block_depth--;
 	}
 	else if (state->type == S_STRUCT) {
+		add_declaration(state->op.struct_statement.name, scan_at_top_level());
+		scan_declaration_list(state->op.struct_statement.instance_members);
+		scan_declaration_list(state->op.struct_statement.static_members);
 		scan_expr(state->op.struct_statement.init_fn);
-		scan_expr_list(state->op.struct_statement.instance_members);
-		scan_expr_list(state->op.struct_statement.static_members);
 	}
 	else if (state->type == S_IF) {
 		scan_expr(state->op.if_statement.condition);
-		make_new_block();
+		scan_block_depth++;
 		scan_statement(state->op.if_statement.statement_true);
-		delete_block();
-		make_new_block();
 		scan_statement(state->op.if_statement.statement_false);
-		delete_block();
+		scan_block_depth--;
 	}
 	else if (state->type == S_LOOP) {
 		if (state->op.loop_statement.index_var) {
-			add_modified(state->op.loop_statement.index_var,
-				state->src_line, 0);
+			add_declaration(state->op.loop_statement.index_var, false);
 		}
+		scan_block_depth++;
 		scan_expr(state->op.loop_statement.condition);
-		make_new_block();
 		scan_statement(state->op.loop_statement.statement_true);
-		delete_block();
+		scan_block_depth--;
+	}
+	else if (state->type == S_BYTECODE) {
+		has_raw_bytecode = true;
 	}
 }
 
 static void scan_statement_list(statement_list* list) {
-	if (!list) return;
-	scan_statement(list->elem);
-	scan_statement_list(list->next);
+	for (; list; list = list->next) {
+		scan_statement(list->elem);
+	}
 }
 
 static void scan_expr(expr* expression) {
 	if (!expression) return;
+	program_size++;
 	if (expression->type == E_LITERAL) {
 		if (expression->op.lit_expr.type == D_IDENTIFIER) {
 			// Used!
-			add_usage(expression->op.lit_expr.value.string,
-				expression->line, expression->col);
+			intern_symbol(expression->op.lit_expr.value.string)->usages++;
 		}
 	}
 	else if (expression->type == E_BINARY) {
 		scan_expr(expression->op.bin_expr.left);
-		scan_expr(expression->op.bin_expr.right);
+		if (expression->op.bin_expr.operator != O_MEMBER) {
+			scan_expr(expression->op.bin_expr.right);
+		}
 	}
 	else if (expression->type == E_UNARY) {
 		scan_expr(expression->op.una_expr.operand);
@@ -588,34 +1382,46 @@ static void scan_expr(expr* expression) {
 	}
 	else if (expression->type == E_CALL) {
 		scan_expr(expression->op.call_expr.function);
-		scan_expr_list(expression->op.call_expr.arguments);
+		for (expr_list* a = expression->op.call_expr.arguments; a; a = a->next) {
+			if (a->elem->type == E_ASSIGN) {
+				// Named arguments bind parameters of the callee.
+				scan_expr(a->elem->op.assign_expr.rvalue);
+			}
+			else {
+				scan_expr(a->elem);
+			}
+		}
 	}
 	else if (expression->type == E_LIST) {
 		scan_expr_list(expression->op.list_expr.contents);
 	}
 	else if (expression->type == E_FUNCTION) {
-		make_new_block();
-		expr_list* curr = expression->op.func_expr.parameters;
-		while (curr) {
-			add_node(curr->elem->op.lit_expr.value.string, 0);
-			curr = curr->next;
+		scan_function_depth++;
+		for (expr_list* p = expression->op.func_expr.parameters; p; p = p->next) {
+			if (p->elem->type == E_ASSIGN) {
+				scan_expr(p->elem->op.assign_expr.rvalue);
+				if (is_identifier(p->elem->op.assign_expr.lvalue)) {
+					add_declaration(
+						p->elem->op.assign_expr.lvalue->op.lit_expr.value.string,
+						false);
+				}
+			}
+			else if (is_identifier(p->elem)) {
+				add_declaration(p->elem->op.lit_expr.value.string, false);
+			}
 		}
 		scan_statement(expression->op.func_expr.body);
-		delete_block();
+		scan_function_depth--;
 	}
 	else if (expression->type == E_ASSIGN) {
-		if (expression->op.assign_expr.lvalue->type == E_LITERAL &&
-			expression->op.assign_expr.lvalue->op.lit_expr.type == D_IDENTIFIER) {
-			add_modified(expression->op.assign_expr.lvalue->op.lit_expr.value.string,
-				expression->line, expression->col);
-		}
+		add_assignment(expression->op.assign_expr.lvalue);
 		scan_expr(expression->op.assign_expr.lvalue);
 		scan_expr(expression->op.assign_expr.rvalue);
 	}
 }
 
 static void scan_expr_list(expr_list* list) {
-	if (!list) return;
-	scan_expr(list->elem);
-	scan_expr_list(list->next);
+	for (; list; list = list->next) {
+		scan_expr(list->elem);
+	}
 }
@@ -7,6 +7,8 @@
 // Includes two different types of optimization algorithms, one to prune down
 //   AST and another to optimize bytecode instructions/
 
-statement_list* optimize_ast(statement_list* ast);
+// optimize_ast(a, ast) returns the optimized tree, nodes it adds are allocated
+//   in the arena a of the tree.
+statement_list* optimize_ast(arena* a, statement_list* ast);
 
 #endif
@@ -0,0 +1,1003 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+#include "state.h"
+#include "error.h"
+#include "vm.h"
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Implementation of the worker pool, tasks and channels.
+
+// Maps addresses of one interpreter to addresses of another, open addressing
+//   with keys stored + 1 so 0 marks an empty slot.
+typedef struct {
+	address* keys;
+	address* values;
+	size_t capacity;
+	size_t count;
+} address_map;
+
+// A value copied out of an interpreter while it travels through a channel.
+//   The parcel has cells and closures like an interpreter, with the value
+//   itself in cell 0, and owns the names of its closure slots.
+typedef struct parcel {
+	data* memory;
+	size_t size;
+	size_t capacity;
+	closure_slot** closure_list;
+	size_t* closure_list_sizes;
+	size_t closures;
+	size_t closures_capacity;
+} parcel;
+
+// The cells and closures a transfer reads from.
+typedef struct {
+	const data* memory;
+	closure_slot** closure_list;
+	size_t* closure_list_sizes;
+} heap;
+
+// A transfer copies data from an interpreter or parcel into the parcel to,
+//   or into the interpreter the thread works with if to is NULL. Copied
+//   blocks and closures are remembered, so values that share a list still
+//   share it after the copy, and cycles end.
+typedef struct {
+	heap from;
+	parcel* to;
+	address_map blocks;
+	address_map closures;
+	int line;
+	// Set if a value that can't leave its interpreter was copied as none.
+	bool failed;
+} transfer;
+
+typedef struct worker {
+	pthread_t thread;
+	wendy_vm* vm;
+	worker_pool* pool;
+	size_t index;
+	// The last job the worker has seen.
+	unsigned long job;
+	// The chunk of the list the worker maps, and the list of its results in
+	//   the worker's memory.
+	size_t start;
+	size_t end;
+	address results;
+	// The message of the error that stopped the job, NULL if there was none.
+	char* error;
+} worker;
+
+struct worker_pool {
+	worker** workers;
+	size_t count;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	// Incremented for every job, idle workers wait for it to change.
+	unsigned long job;
+	bool stopping;
+	// The current job. Workers below active take part, running of them have
+	//   not finished yet. The parent waits until all have, so the workers can
+	//   read its memory meanwhile.
+	size_t active;
+	size_t running;
+	wendy_vm* parent;
+	data function;
+	address list;
+	int line;
+};
+
+struct task {
+	pthread_t thread;
+	wendy_vm* vm;
+	// The function and its arguments, and after it returned its result, in
+	//   the task's memory.
+	address function;
+	address arguments;
+	address result;
+	char* error;
+	bool joined;
+};
+
+typedef struct channel {
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	// A ring of capacity parcels, count of them from head on are queued.
+	parcel** queue;
+	size_t capacity;
+	size_t head;
+	size_t count;
+	bool closed;
+	// The interpreter that opened the channel. Once it's destroyed the
+	//   channel is removed from the table, and freed when no thread uses it
+	//   anymore.
+	wendy_vm* owner;
+	size_t users;
+} channel;
+
+// Channels are shared by every interpreter in the process, so a handle
+//   means the same channel in all of them. Handles aren't reused.
+static pthread_mutex_t channels_lock = PTHREAD_MUTEX_INITIALIZER;
+static channel** channels = 0;
+static size_t channels_count = 0;
+static size_t channels_capacity = 0;
+
+static bool map_find(const address_map* map, address key, address* value) {
+	if (!map->capacity) {
+		return false;
+	}
+	size_t mask = map->capacity - 1;
+	for (size_t i = (key * 2654435761u) & mask; map->keys[i];
+		i = (i + 1) & mask) {
+		if (map->keys[i] == key + 1) {
+			*value = map->values[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+static void map_free(address_map* map) {
+	if (map->capacity) {
+		safe_free(map->keys);
+		safe_free(map->values);
+	}
+}
+
+static void map_add(address_map* map, address key, address value) {
+	if ((map->count + 1) * 2 > map->capacity) {
+		address_map grown = { 0, 0, map->capacity ? map->capacity * 2 : 64, 0 };
+		grown.keys = safe_calloc(grown.capacity, sizeof(address));
+		grown.values = safe_malloc(grown.capacity * sizeof(address));
+		for (size_t i = 0; i < map->capacity; i++) {
+			if (map->keys[i]) {
+				map_add(&grown, map->keys[i] - 1, map->values[i]);
+			}
+		}
+		map_free(map);
+		*map = grown;
+	}
+	size_t mask = map->capacity - 1;
+	size_t i = (key * 2654435761u) & mask;
+	while (map->keys[i]) {
+		i = (i + 1) & mask;
+	}
+	map->keys[i] = key + 1;
+	map->values[i] = value;
+	map->count++;
+}
+
+static heap heap_of(const wendy_vm* instance) {
+	heap h = { instance->memory, instance->closure_list,
+		instance->closure_list_sizes };
+	return h;
+}
+
+static heap heap_of_parcel(const parcel* p) {
+	heap h = { p->memory, p->closure_list, p->closure_list_sizes };
+	return h;
+}
+
+static void transfer_begin(transfer* t, heap from, parcel* to, int line) {
+	memset(t, 0, sizeof(transfer));
+	t->from = from;
+	t->to = to;
+	t->line = line;
+}
+
+static void transfer_end(transfer* t) {
+	map_free(&t->blocks);
+	map_free(&t->closures);
+}
+
+// pause_collection() stops garbage collection and returns whether it ran
+//   before. Copied blocks can't be reached from the stack until the whole
+//   value is copied.
+static bool pause_collection(void) {
+	bool paused = vm->settings_data[SETTINGS_NOGC];
+	vm->settings_data[SETTINGS_NOGC] = true;
+	return paused;
+}
+
+static void resume_collection(bool paused) {
+	vm->settings_data[SETTINGS_NOGC] = paused;
+}
+
+// give_cells(t, size) returns size new cells of the destination of t.
+static address give_cells(transfer* t, size_t size) {
+	parcel* p = t->to;
+	if (!p) {
+		return pls_give_memory(size, t->line);
+	}
+	if (p->size + size > p->capacity) {
+		size_t capacity = p->capacity;
+		while (p->size + size > p->capacity) {
+			p->capacity *= 2;
+		}
+		p->memory = safe_realloc(p->memory, p->capacity * sizeof(data));
+		memset(p->memory + capacity, 0, (p->capacity - capacity) * sizeof(data));
+	}
+	address a = p->size;
+	p->size += size;
+	return a;
+}
+
+static void put_cell(transfer* t, address a, data d) {
+	if (t->to) {
+		t->to->memory[a] = d;
+	}
+	else {
+		write_memory(a, d, t->line);
+	}
+}
+
+// put_closure(t, closure, size) adds a closure with the size slot names of
+//   closure of the source of t to its destination and returns its index.
+static address put_closure(transfer* t, address closure, size_t size) {
+	closure_slot* slots = safe_malloc(sizeof(closure_slot) * size);
+	for (size_t i = 0; i < size; i++) {
+		const char* id = t->from.closure_list[closure][i].id;
+		slots[i].id = t->to ? safe_strdup(id) : intern_name(id);
+		slots[i].val = 0;
+	}
+	parcel* p = t->to;
+	if (!p) {
+		return add_closure(slots, size);
+	}
+	if (p->closures == p->closures_capacity) {
+		p->closures_capacity = p->closures_capacity ? p->closures_capacity * 2
+			: 4;
+		p->closure_list = p->closure_list
+			? safe_realloc(p->closure_list,
+				p->closures_capacity * sizeof(closure_slot*))
+			: safe_malloc(p->closures_capacity * sizeof(closure_slot*));
+		p->closure_list_sizes = p->closure_list_sizes
+			? safe_realloc(p->closure_list_sizes,
+				p->closures_capacity * sizeof(size_t))
+			: safe_malloc(p->closures_capacity * sizeof(size_t));
+	}
+	p->closure_list[p->closures] = slots;
+	p->closure_list_sizes[p->closures] = size;
+	return p->closures++;
+}
+
+static data copy_value(transfer* t, const data* d);
+
+// copy_block(t, block, size) returns the copy of the size cells at block.
+static address copy_block(transfer* t, address block, size_t size) {
+	address copy;
+	if (map_find(&t->blocks, block, &copy)) {
+		return copy;
+	}
+	copy = give_cells(t, size);
+	map_add(&t->blocks, block, copy);
+	for (size_t i = 0; i < size; i++) {
+		put_cell(t, copy + i, copy_value(t, &t->from.memory[block + i]));
+	}
+	return copy;
+}
+
+// copy_closure(t, closure) returns the index of the copy of closure.
+static address copy_closure(transfer* t, address closure) {
+	address copy;
+	if (closure == NO_CLOSURE) {
+		return NO_CLOSURE;
+	}
+	if (map_find(&t->closures, closure, &copy)) {
+		return copy;
+	}
+	size_t size = t->from.closure_list_sizes[closure];
+	// The captured variables may hold functions with this closure.
+	copy = put_closure(t, closure, size);
+	map_add(&t->closures, closure, copy);
+	for (size_t i = 0; i < size; i++) {
+		address value = copy_block(t, t->from.closure_list[closure][i].val, 1);
+		closure_slot** list = t->to ? t->to->closure_list : vm->closure_list;
+		list[copy][i].val = value;
+	}
+	return copy;
+}
+
+static data copy_value(transfer* t, const data* d) {
+	const data* memory = t->from.memory;
+	address a = d->value.number;
+	switch (d->type) {
+		case D_LIST:
+			return make_data(D_LIST, data_value_num(
+				copy_block(t, a, memory[a].value.number + 1)));
+		case D_LIST_VIEW: {
+			// The elements of a view are copied as a list.
+			list_view* view = list_view_of(d);
+			int size = abs(view->end - view->start);
+			int step = view->start < view->end ? 1 : -1;
+			address copy = give_cells(t, size + 1);
+			put_cell(t, copy, list_header_data(size));
+			for (int i = 0; i < size; i++) {
+				put_cell(t, copy + 1 + i, copy_value(t,
+					&memory[view->list + 1 + view->start + step * i]));
+			}
+			return make_data(D_LIST, data_value_num(copy));
+		}
+		case D_SHARED_LIST_HEADER:
+			// Views stay with the interpreter that made them.
+			return list_header_data(d->value.number);
+		case D_STRUCT:
+		case D_STRUCT_INSTANCE_HEAD:
+			// Both point to the struct's metadata.
+			return make_data(d->type, data_value_num(
+				copy_block(t, a, memory[a].value.number)));
+		case D_STRUCT_INSTANCE: {
+			address meta = memory[a].value.number;
+			size_t params = 0;
+			for (address i = meta; i < meta + memory[meta].value.number; i++) {
+				if (memory[i].type == D_STRUCT_PARAM) {
+					params++;
+				}
+			}
+			return make_data(D_STRUCT_INSTANCE, data_value_num(
+				copy_block(t, a, params + 1)));
+		}
+		case D_FUNCTION:
+			return make_data(D_FUNCTION, data_value_num(copy_block(t, a, 3)));
+		case D_CLOSURE:
+			return make_data(D_CLOSURE, data_value_num(copy_closure(t, a)));
+		case D_F64ARRAY: {
+			// The reference count isn't safe to share between threads.
+			f64_array* array = f64_array_of(d);
+			data copy = f64_array_data(array->length);
+			memcpy(f64_array_of(&copy)->values, array->values,
+				array->length * sizeof(double));
+			return copy;
+		}
+		case D_ITERATOR:
+		case D_GENERATOR:
+			t->failed = true;
+			return none_data();
+		default:
+			return copy_data(*d);
+	}
+}
+
+static void free_parcel(parcel* p);
+
+// pack(d, line) returns a parcel holding a copy of the data d of the
+//   interpreter the thread works with, or NULL if it can't be copied.
+static parcel* pack(const data* d, int line) {
+	parcel* p = safe_calloc(1, sizeof(parcel));
+	p->capacity = 16;
+	p->memory = safe_calloc(p->capacity, sizeof(data));
+	p->size = 1;
+	transfer t;
+	transfer_begin(&t, heap_of(vm), p, line);
+	// Copying may move the parcel's cells.
+	data value = copy_value(&t, d);
+	p->memory[0] = value;
+	transfer_end(&t);
+	if (t.failed) {
+		free_parcel(p);
+		return 0;
+	}
+	return p;
+}
+
+// unpack(p, line) returns a copy of the value in the parcel p in the
+//   interpreter the thread works with.
+static data unpack(const parcel* p, int line) {
+	bool paused = pause_collection();
+	transfer t;
+	transfer_begin(&t, heap_of_parcel(p), 0, line);
+	data value = copy_value(&t, &p->memory[0]);
+	transfer_end(&t);
+	resume_collection(paused);
+	return value;
+}
+
+static void free_parcel(parcel* p) {
+	for (size_t i = 0; i < p->size; i++) {
+		destroy_data(&p->memory[i]);
+	}
+	safe_free(p->memory);
+	for (size_t i = 0; i < p->closures; i++) {
+		for (size_t j = 0; j < p->closure_list_sizes[i]; j++) {
+			safe_free((char*)p->closure_list[i][j].id);
+		}
+		safe_free(p->closure_list[i]);
+	}
+	if (p->closure_list) {
+		safe_free(p->closure_list);
+		safe_free(p->closure_list_sizes);
+	}
+	safe_free(p);
+}
+
+// is_global(entry) returns true if the entry of the main frame is a variable
+//   or an operator overload.
+static bool is_global(const stack_entry* entry) {
+	if (entry->id[0] == RA_START[0]) {
+		return strncmp(entry->id, OPERATOR_OVERLOAD_PREFIX,
+			strlen(OPERATOR_OVERLOAD_PREFIX)) == 0;
+	}
+	return entry->id[0] != FUNCTION_START[0] &&
+		entry->id[0] != AUTOFRAME_START[0];
+}
+
+// copy_program(t, parent) gives the interpreter the thread works with the
+//   program and globals of parent, which t transfers from.
+static void copy_program(transfer* t, const wendy_vm* parent) {
+	vm_copy_program(parent->bytecode, parent->bytecode_size);
+	// Functions find globals by name when they're called, so every variable
+	//   of the main frame is copied, after the entries of the frame itself.
+	for (address i = 2; i < parent->main_end_pointer; i++) {
+		const stack_entry* entry = &parent->call_stack[i];
+		if (is_global(entry)) {
+			push_stack_entry((char*)entry->id, copy_block(t, entry->val, 1),
+				t->line);
+		}
+	}
+}
+
+// keep(name, d, line) binds d in the main frame under a name programs can't
+//   use, so the collector keeps what it refers to, and returns its address.
+static address keep(char* name, data d, int line) {
+	address a = push_memory(d, line);
+	push_stack_entry(name, a, line);
+	return a;
+}
+
+// create_isolate() returns a new interpreter for another thread.
+static wendy_vm* create_isolate(void) {
+	wendy_vm* instance = vm_create();
+	// Isolates own their copy of the program, and errors must not end the
+	//   process from another thread.
+	instance->settings_data[SETTINGS_REPL] = true;
+	instance->settings_data[SETTINGS_NOGC] = vm->settings_data[SETTINGS_NOGC];
+	instance->settings_data[SETTINGS_SANDBOXED] =
+		vm->settings_data[SETTINGS_SANDBOXED];
+	wendy_vm* previous = vm_enter(instance);
+	push_frame("main", 0, 0);
+	vm_enter(previous);
+	return instance;
+}
+
+// run_job(w) maps the worker's chunk of the list on the interpreter of the
+//   worker, which the thread works with.
+static void run_job(worker* w) {
+	worker_pool* pool = w->pool;
+	wendy_vm* parent = pool->parent;
+	int line = pool->line;
+	clear_globals();
+	reset_error_flag();
+	bool paused = pause_collection();
+	transfer t;
+	transfer_begin(&t, heap_of(parent), 0, line);
+	copy_program(&t, parent);
+	size_t count = w->end - w->start;
+	address items = pls_give_memory(count + 1, line);
+	write_memory(items, list_header_data(count), line);
+	for (size_t i = 0; i < count; i++) {
+		write_memory(items + i + 1, copy_value(&t,
+			&parent->memory[pool->list + w->start + i + 1]), line);
+	}
+	data function = copy_value(&t, &pool->function);
+	transfer_end(&t);
+	w->results = pls_give_memory(count + 1, line);
+	write_memory(w->results, list_header_data(count), line);
+	for (size_t i = 0; i < count; i++) {
+		write_memory(w->results + i + 1, none_data(), line);
+	}
+	keep("parallel:function", copy_data(function), line);
+	keep("parallel:items", make_data(D_LIST, data_value_num(items)), line);
+	keep("parallel:results", make_data(D_LIST, data_value_num(w->results)),
+		line);
+	resume_collection(paused);
+
+	if (t.failed) {
+		w->error = safe_strdup(VM_PARALLEL_CANT_TRANSFER);
+	}
+	for (size_t i = 0; i < count && !w->error && !get_error_flag(); i++) {
+		data result;
+		if (vm_call(function, &vm->memory[items + i + 1], 1, &result)) {
+			write_memory(w->results + i + 1, result, line);
+		}
+	}
+	if (!w->error && get_error_flag()) {
+		w->error = safe_strdup(vm->error_message);
+	}
+	destroy_data(&function);
+}
+
+static void* worker_main(void* argument) {
+	worker* w = argument;
+	worker_pool* pool = w->pool;
+	vm_enter(w->vm);
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->stopping && pool->job == w->job) {
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		}
+		if (pool->stopping) {
+			break;
+		}
+		w->job = pool->job;
+		if (w->index < pool->active) {
+			pthread_mutex_unlock(&pool->lock);
+			run_job(w);
+			pthread_mutex_lock(&pool->lock);
+			if (--pool->running == 0) {
+				pthread_cond_signal(&pool->done);
+			}
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	vm_enter(0);
+	return 0;
+}
+
+// start_thread(thread, run, argument) starts a thread running run with
+//   SIGPROF blocked, so the profiler only ever interrupts the main thread.
+//   Its tables aren't shared safely between threads, and time spent in
+//   workers is sampled as the call that waits for them. Threads inherit the
+//   mask, blocking it first leaves no window for a sample.
+static bool start_thread(pthread_t* thread, void* (*run)(void*),
+	void* argument) {
+	sigset_t profiling;
+	sigset_t previous;
+	sigemptyset(&profiling);
+	sigaddset(&profiling, SIGPROF);
+	pthread_sigmask(SIG_BLOCK, &profiling, &previous);
+	bool started = pthread_create(thread, 0, run, argument) == 0;
+	pthread_sigmask(SIG_SETMASK, &previous, 0);
+	return started;
+}
+
+// create_worker(pool) returns a new idle worker of pool, or NULL if no
+//   thread could be started.
+static worker* create_worker(worker_pool* pool) {
+	worker* w = safe_calloc(1, sizeof(worker));
+	w->pool = pool;
+	w->index = pool->count;
+	w->job = pool->job;
+	w->vm = create_isolate();
+	if (!start_thread(&w->thread, worker_main, w)) {
+		vm_destroy(w->vm);
+		safe_free(w);
+		return 0;
+	}
+	return w;
+}
+
+// grow_pool(count) returns the pool of the interpreter with at least count
+//   workers if they could be started.
+static worker_pool* grow_pool(size_t count) {
+	worker_pool* pool = vm->workers;
+	if (!pool) {
+		pool = safe_calloc(1, sizeof(worker_pool));
+		pthread_mutex_init(&pool->lock, 0);
+		pthread_cond_init(&pool->wake, 0);
+		pthread_cond_init(&pool->done, 0);
+		pool->workers = safe_malloc(sizeof(worker*) * PARALLEL_MAX_WORKERS);
+		vm->workers = pool;
+	}
+	while (pool->count < count) {
+		worker* w = create_worker(pool);
+		if (!w) {
+			break;
+		}
+		pool->workers[pool->count++] = w;
+	}
+	return pool;
+}
+
+static size_t processor_count(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? count : 1;
+#else
+	return 1;
+#endif
+}
+
+data parallel_map(data function, data list, int workers, int line) {
+	if (function.type != D_FUNCTION && function.type != D_STRUCT) {
+		error_runtime(line, VM_FN_CALL_NOT_FN);
+		return none_data();
+	}
+	if (list.type == D_RANGE) {
+		int start = range_start(list);
+		int end = range_end(list);
+		size_t size = abs(end - start);
+		data* numbers = safe_malloc(sizeof(data) * (size ? size : 1));
+		size_t n = 0;
+		for (int i = start; i != end; start < end ? i++ : i--) {
+			numbers[n++] = make_data(D_NUMBER, data_value_num(i));
+		}
+		list = make_data(D_LIST, data_value_num(
+			push_memory_wendy_list(numbers, size, line)));
+		safe_free(numbers);
+	}
+	else if (list.type != D_LIST) {
+		error_runtime(line, VM_INVALID_NATIVE_LIST_TYPE_ERROR);
+		return none_data();
+	}
+	address block = list.value.number;
+	size_t length = vm->memory[block].value.number;
+	if (length == 0) {
+		return make_data(D_LIST, data_value_num(
+			push_memory_wendy_list(0, 0, line)));
+	}
+	size_t count = workers > 0 ? (size_t)workers : processor_count();
+	if (count > PARALLEL_MAX_WORKERS) {
+		count = PARALLEL_MAX_WORKERS;
+	}
+	if (count > length) {
+		count = length;
+	}
+	worker_pool* pool = grow_pool(count);
+	if (pool->count < count) {
+		count = pool->count;
+	}
+	if (count == 0) {
+		error_runtime(line, VM_PARALLEL_NO_THREADS);
+		return none_data();
+	}
+	size_t chunk = (length + count - 1) / count;
+	count = (length + chunk - 1) / chunk;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->parent = vm;
+	pool->function = function;
+	pool->list = block;
+	pool->line = line;
+	for (size_t i = 0; i < count; i++) {
+		pool->workers[i]->start = i * chunk;
+		pool->workers[i]->end = (i + 1) * chunk < length ? (i + 1) * chunk
+			: length;
+	}
+	pool->active = count;
+	pool->running = count;
+	pool->job++;
+	pthread_cond_broadcast(&pool->wake);
+	while (pool->running > 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < count; i++) {
+		worker* w = pool->workers[i];
+		if (w->error) {
+			if (!get_error_flag()) {
+				error_runtime(line, VM_PARALLEL_WORKER_FAILED, w->error);
+			}
+			safe_free(w->error);
+			w->error = 0;
+		}
+	}
+	if (get_error_flag()) {
+		return none_data();
+	}
+	bool paused = pause_collection();
+	bool failed = false;
+	address result = pls_give_memory(length + 1, line);
+	write_memory(result, list_header_data(length), line);
+	for (size_t i = 0; i < count; i++) {
+		worker* w = pool->workers[i];
+		transfer t;
+		transfer_begin(&t, heap_of(w->vm), 0, line);
+		for (size_t j = w->start; j < w->end; j++) {
+			write_memory(result + j + 1, copy_value(&t,
+				&w->vm->memory[w->results + j - w->start + 1]), line);
+		}
+		transfer_end(&t);
+		failed = failed || t.failed;
+	}
+	resume_collection(paused);
+	if (failed) {
+		error_runtime(line, VM_PARALLEL_CANT_TRANSFER);
+		return none_data();
+	}
+	return make_data(D_LIST, data_value_num(result));
+}
+
+static void* task_main(void* argument) {
+	task* k = argument;
+	vm_enter(k->vm);
+	data function = copy_data(vm->memory[k->function]);
+	address arguments = vm->memory[k->arguments].value.number;
+	int argc = vm->memory[arguments].value.number;
+	data result;
+	if (vm_call(function, &vm->memory[arguments + 1], argc, &result)) {
+		write_memory(k->result, result, vm->line);
+	}
+	else {
+		k->error = safe_strdup(vm->error_message);
+	}
+	destroy_data(&function);
+	vm_enter(0);
+	return 0;
+}
+
+static void free_task(task* k) {
+	vm_destroy(k->vm);
+	if (k->error) {
+		safe_free(k->error);
+	}
+	safe_free(k);
+}
+
+data parallel_spawn(data function, data arguments, int line) {
+	if (function.type != D_FUNCTION && function.type != D_STRUCT) {
+		error_runtime(line, VM_FN_CALL_NOT_FN);
+		return none_data();
+	}
+	if (arguments.type != D_LIST) {
+		error_runtime(line, VM_INVALID_NATIVE_LIST_TYPE_ERROR);
+		return none_data();
+	}
+	task* k = safe_calloc(1, sizeof(task));
+	k->vm = create_isolate();
+	wendy_vm* parent = vm_enter(k->vm);
+	bool paused = pause_collection();
+	transfer t;
+	transfer_begin(&t, heap_of(parent), 0, line);
+	copy_program(&t, parent);
+	k->function = keep("parallel:function", copy_value(&t, &function), line);
+	k->arguments = keep("parallel:arguments", copy_value(&t, &arguments),
+		line);
+	k->result = keep("parallel:result", none_data(), line);
+	transfer_end(&t);
+	resume_collection(paused);
+	vm_enter(parent);
+	if (t.failed) {
+		free_task(k);
+		error_runtime(line, VM_PARALLEL_CANT_TRANSFER);
+		return none_data();
+	}
+	if (!start_thread(&k->thread, task_main, k)) {
+		free_task(k);
+		error_runtime(line, VM_PARALLEL_NO_THREADS);
+		return none_data();
+	}
+	if (vm->tasks_count == vm->tasks_capacity) {
+		vm->tasks_capacity = vm->tasks_capacity ? vm->tasks_capacity * 2 : 8;
+		vm->tasks = vm->tasks
+			? safe_realloc(vm->tasks, vm->tasks_capacity * sizeof(task*))
+			: safe_malloc(vm->tasks_capacity * sizeof(task*));
+	}
+	vm->tasks[vm->tasks_count] = k;
+	return make_data(D_NUMBER, data_value_num(vm->tasks_count++));
+}
+
+data parallel_join(data handle, int line) {
+	double index = handle.value.number;
+	if (handle.type != D_NUMBER || index < 0 || index >= vm->tasks_count ||
+		!vm->tasks[(size_t)index]) {
+		error_runtime(line, VM_NOT_A_TASK);
+		return none_data();
+	}
+	task* k = vm->tasks[(size_t)index];
+	vm->tasks[(size_t)index] = 0;
+	pthread_join(k->thread, 0);
+	data result = none_data();
+	if (k->error) {
+		error_runtime(line, VM_TASK_FAILED, k->error);
+	}
+	else {
+		bool paused = pause_collection();
+		transfer t;
+		transfer_begin(&t, heap_of(k->vm), 0, line);
+		destroy_data(&result);
+		result = copy_value(&t, &k->vm->memory[k->result]);
+		transfer_end(&t);
+		resume_collection(paused);
+		if (t.failed) {
+			error_runtime(line, VM_PARALLEL_CANT_TRANSFER);
+		}
+	}
+	free_task(k);
+	return result;
+}
+
+static void free_channel(channel* c) {
+	for (size_t i = 0; i < c->count; i++) {
+		free_parcel(c->queue[(c->head + i) % c->capacity]);
+	}
+	safe_free(c->queue);
+	pthread_mutex_destroy(&c->lock);
+	pthread_cond_destroy(&c->not_empty);
+	pthread_cond_destroy(&c->not_full);
+	safe_free(c);
+}
+
+// acquire_channel(handle) returns the channel of handle, which must be
+//   released with release_channel, or NULL if there is none.
+static channel* acquire_channel(data handle) {
+	channel* c = 0;
+	double index = handle.value.number;
+	pthread_mutex_lock(&channels_lock);
+	if (handle.type == D_NUMBER && index >= 0 && index < channels_count) {
+		c = channels[(size_t)index];
+	}
+	if (c) {
+		c->users++;
+	}
+	pthread_mutex_unlock(&channels_lock);
+	return c;
+}
+
+static void release_channel(channel* c) {
+	pthread_mutex_lock(&channels_lock);
+	bool unused = --c->users == 0 && !c->owner;
+	pthread_mutex_unlock(&channels_lock);
+	if (unused) {
+		free_channel(c);
+	}
+}
+
+data channel_open(int capacity, int line) {
+	UNUSED(line);
+	channel* c = safe_calloc(1, sizeof(channel));
+	pthread_mutex_init(&c->lock, 0);
+	pthread_cond_init(&c->not_empty, 0);
+	pthread_cond_init(&c->not_full, 0);
+	c->capacity = capacity > 0 ? capacity : 1;
+	c->queue = safe_malloc(c->capacity * sizeof(parcel*));
+	c->owner = vm;
+	pthread_mutex_lock(&channels_lock);
+	if (channels_count == channels_capacity) {
+		channels_capacity = channels_capacity ? channels_capacity * 2 : 8;
+		channels = channels
+			? safe_realloc(channels, channels_capacity * sizeof(channel*))
+			: safe_malloc(channels_capacity * sizeof(channel*));
+	}
+	size_t handle = channels_count++;
+	channels[handle] = c;
+	pthread_mutex_unlock(&channels_lock);
+	return make_data(D_NUMBER, data_value_num(handle));
+}
+
+data channel_send(data handle, data value, int line) {
+	channel* c = acquire_channel(handle);
+	if (!c) {
+		error_runtime(line, VM_NOT_A_CHANNEL);
+		return none_data();
+	}
+	parcel* p = pack(&value, line);
+	if (!p) {
+		release_channel(c);
+		error_runtime(line, VM_PARALLEL_CANT_TRANSFER);
+		return none_data();
+	}
+	pthread_mutex_lock(&c->lock);
+	while (!c->closed && c->count == c->capacity) {
+		pthread_cond_wait(&c->not_full, &c->lock);
+	}
+	bool closed = c->closed;
+	if (!closed) {
+		c->queue[(c->head + c->count) % c->capacity] = p;
+		c->count++;
+		pthread_cond_signal(&c->not_empty);
+	}
+	pthread_mutex_unlock(&c->lock);
+	release_channel(c);
+	if (closed) {
+		free_parcel(p);
+		error_runtime(line, VM_CHANNEL_CLOSED);
+	}
+	return noneret_data();
+}
+
+data channel_receive(data handle, int line) {
+	channel* c = acquire_channel(handle);
+	if (!c) {
+		error_runtime(line, VM_NOT_A_CHANNEL);
+		return none_data();
+	}
+	parcel* p = 0;
+	pthread_mutex_lock(&c->lock);
+	while (!c->closed && c->count == 0) {
+		pthread_cond_wait(&c->not_empty, &c->lock);
+	}
+	if (c->count > 0) {
+		p = c->queue[c->head];
+		c->head = (c->head + 1) % c->capacity;
+		c->count--;
+		pthread_cond_signal(&c->not_full);
+	}
+	pthread_mutex_unlock(&c->lock);
+	release_channel(c);
+	if (!p) {
+		// Closed and drained.
+		return none_data();
+	}
+	data value = unpack(p, line);
+	free_parcel(p);
+	return value;
+}
+
+data channel_close(data handle, int line) {
+	channel* c = acquire_channel(handle);
+	if (!c) {
+		error_runtime(line, VM_NOT_A_CHANNEL);
+		return none_data();
+	}
+	pthread_mutex_lock(&c->lock);
+	c->closed = true;
+	pthread_cond_broadcast(&c->not_empty);
+	pthread_cond_broadcast(&c->not_full);
+	pthread_mutex_unlock(&c->lock);
+	release_channel(c);
+	return noneret_data();
+}
+
+// close_channels() closes the channels opened by the interpreter the thread
+//   works with and removes them from the table, which is freed once it's
+//   empty.
+static void close_channels(void) {
+	pthread_mutex_lock(&channels_lock);
+	bool empty = true;
+	for (size_t i = 0; i < channels_count; i++) {
+		channel* c = channels[i];
+		if (c && c->owner == vm) {
+			channels[i] = 0;
+			c->owner = 0;
+			pthread_mutex_lock(&c->lock);
+			c->closed = true;
+			pthread_cond_broadcast(&c->not_empty);
+			pthread_cond_broadcast(&c->not_full);
+			pthread_mutex_unlock(&c->lock);
+			if (c->users == 0) {
+				free_channel(c);
+			}
+		}
+		else if (c) {
+			empty = false;
+		}
+	}
+	if (empty && channels) {
+		safe_free(channels);
+		channels = 0;
+		channels_count = 0;
+		channels_capacity = 0;
+	}
+	pthread_mutex_unlock(&channels_lock);
+}
+
+void parallel_shutdown(void) {
+	close_channels();
+	// Tasks that were never joined are waited for.
+	for (size_t i = 0; i < vm->tasks_count; i++) {
+		if (vm->tasks[i]) {
+			pthread_join(vm->tasks[i]->thread, 0);
+			free_task(vm->tasks[i]);
+		}
+	}
+	if (vm->tasks) {
+		safe_free(vm->tasks);
+	}
+	vm->tasks = 0;
+	vm->tasks_count = 0;
+	vm->tasks_capacity = 0;
+	worker_pool* pool = vm->workers;
+	if (!pool) {
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	for (size_t i = 0; i < pool->count; i++) {
+		pthread_join(pool->workers[i]->thread, 0);
+		vm_destroy(pool->workers[i]->vm);
+		safe_free(pool->workers[i]);
+	}
+	safe_free(pool->workers);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->wake);
+	pthread_cond_destroy(&pool->done);
+	safe_free(pool);
+	vm->workers = 0;
+}
@@ -0,0 +1,72 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "data.h"
+#include "memory.h"
+#include <stdbool.h>
+
+// parallel.h - Felix Guo
+// Runs functions of the program on other threads, on a pool of workers or as
+//   long-running tasks that talk through channels. Each thread has an
+//   interpreter of its own, with a copy of the program's bytecode, so
+//   only the pool and channels are shared between threads. Values are deep
+//   copied from one interpreter to another, since lists, structs and
+//   functions are addresses into the memory of the interpreter that made
+//   them.
+
+// Most workers a pool keeps, a larger count passed to parallel.map is
+//   lowered to it.
+#define PARALLEL_MAX_WORKERS 64
+
+// The pool of an interpreter, kept in its [state] and created by the first
+//   parallel_map().
+typedef struct worker_pool worker_pool;
+
+// parallel_map(function, list, workers, line) calls function with each
+//   element of list, split into chunks for up to workers threads, and returns
+//   the results as a list in the order of the elements. With workers 0 one
+//   thread per processor is used. Variables of the main frame are copied to
+//   every worker, changes the function makes to them are lost.
+data parallel_map(data function, data list, int workers, int line);
+
+// A function running on a thread of its own, started by parallel_spawn. The
+//   interpreter that started it keeps it in its [state].
+typedef struct task task;
+
+// parallel_spawn(function, arguments, line) starts function with the
+//   elements of the list arguments on a new thread with an interpreter of its
+//   own, and returns the handle of the task. Like parallel_map, the task gets
+//   copies of the globals.
+data parallel_spawn(data function, data arguments, int line);
+
+// parallel_join(handle, line) waits for the task to end and returns a copy
+//   of what its function returned. Only the interpreter that started a task
+//   can join it, and only once.
+data parallel_join(data handle, int line);
+
+// Channels pass values between interpreters running at the same time. A
+//   channel queues up to capacity values, sending to a full channel waits
+//   until there is room and receiving from an empty one waits for a value,
+//   so a fast producer can't run ahead of its consumer. Handles are valid in
+//   every interpreter of the process. A channel is closed at the latest when
+//   the interpreter that opened it is destroyed.
+
+// channel_open(capacity, line) returns the handle of a new channel.
+data channel_open(int capacity, int line);
+
+// channel_send(handle, value, line) queues a copy of value.
+data channel_send(data handle, data value, int line);
+
+// channel_receive(handle, line) returns the oldest queued value, or none once
+//   the channel is closed and empty.
+data channel_receive(data handle, int line);
+
+// channel_close(handle, line) closes the channel, values queued before can
+//   still be received.
+data channel_close(data handle, int line);
+
+// parallel_shutdown() closes the channels of the interpreter the thread works
+//   with, waits for its tasks and stops its workers, then frees them.
+void parallel_shutdown(void);
+
+#endif
@@ -0,0 +1,302 @@
+#define _GNU_SOURCE
+#include "profiler.h"
+#include "memory.h"
+#include "vm.h"
+#include "global.h"
+#include "state.h"
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PROFILER_SUPPORTED
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+// Implementation of the sampling profiler. The signal handler can't allocate,
+//   so distinct stacks are kept in a fixed open addressing table whose keys
+//   live in a fixed arena. Samples that don't fit are counted as dropped.
+
+#define PROFILE_TABLE_SIZE 8192
+#define PROFILE_KEYS_SIZE (1 << 20)
+#define PROFILE_MAX_DEPTH 128
+#define PROFILE_MAX_KEY 4096
+
+typedef struct profile_stack {
+	uint32_t hash;
+	uint32_t key;
+	uint32_t length;
+	unsigned long samples;
+} profile_stack;
+
+static profile_stack stacks[PROFILE_TABLE_SIZE];
+static char keys[PROFILE_KEYS_SIZE];
+static size_t keys_used = 0;
+static size_t stacks_count = 0;
+static unsigned long total_samples = 0;
+static unsigned long dropped_samples = 0;
+static char* output_path = 0;
+static bool running = false;
+
+// append_frame_name(key, length, entry) appends the function name of the
+//   frame entry "> name:0xRA()" to key and returns the new length.
+static size_t append_frame_name(char* key, size_t length, stack_entry* entry) {
+	const char* id = entry->id + 1;
+	if (*id == ' ') id++;
+	for (size_t c = 0; c < MAX_IDENTIFIER_LEN && id[c] && id[c] != ':' &&
+			id[c] != '(' && length < PROFILE_MAX_KEY - 1; c++) {
+		key[length++] = id[c];
+	}
+	return length;
+}
+
+// append_number(key, length, n) appends the decimal n to key, snprintf isn't
+//   safe to call from a signal handler.
+static size_t append_number(char* key, size_t length, int n) {
+	char digits[16];
+	size_t count = 0;
+	if (n < 0) n = 0;
+	do {
+		digits[count++] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	while (count && length < PROFILE_MAX_KEY - 1) {
+		key[length++] = digits[--count];
+	}
+	return length;
+}
+
+// record_stack(key, length) counts one sample of the collapsed stack key.
+static void record_stack(const char* key, size_t length) {
+	uint32_t hash = 2166136261u;
+	for (size_t c = 0; c < length; c++) {
+		hash = (hash ^ (unsigned char)key[c]) * 16777619u;
+	}
+	size_t slot = hash & (PROFILE_TABLE_SIZE - 1);
+	while (stacks[slot].samples) {
+		profile_stack* s = &stacks[slot];
+		if (s->hash == hash && s->length == length &&
+			memcmp(keys + s->key, key, length) == 0) {
+			s->samples++;
+			return;
+		}
+		slot = (slot + 1) & (PROFILE_TABLE_SIZE - 1);
+	}
+	// Keep the table at most 3/4 full so probing stays short.
+	if (stacks_count * 4 >= PROFILE_TABLE_SIZE * 3 ||
+		keys_used + length > PROFILE_KEYS_SIZE) {
+		dropped_samples++;
+		return;
+	}
+	memcpy(keys + keys_used, key, length);
+	stacks[slot] = (profile_stack){ hash, keys_used, length, 1 };
+	keys_used += length;
+	stacks_count++;
+}
+
+// take_sample(signal) records the Wendy call stack that was interrupted.
+static void take_sample(int signal) {
+	UNUSED(signal);
+	if (vm->stack_pointer == 0) {
+		return;
+	}
+	total_samples++;
+	// Follow the saved frame pointers from the innermost frame to main.
+	address frames[PROFILE_MAX_DEPTH];
+	size_t depth = 0;
+	address fp = vm->frame_pointer;
+	while (depth < PROFILE_MAX_DEPTH) {
+		if (vm->call_stack[fp].id[0] == *FUNCTION_START) {
+			frames[depth++] = fp;
+		}
+		address saved = vm->call_stack[fp].val;
+		if (fp == 0 || saved >= fp) {
+			break;
+		}
+		fp = saved;
+	}
+	if (depth == 0) {
+		return;
+	}
+	char key[PROFILE_MAX_KEY];
+	size_t length = 0;
+	for (size_t d = depth; d-- > 0; ) {
+		length = append_frame_name(key, length, &vm->call_stack[frames[d]]);
+		if (d > 0 && length < PROFILE_MAX_KEY - 1) {
+			key[length++] = ';';
+		}
+	}
+	if (length < PROFILE_MAX_KEY - 1) {
+		key[length++] = ':';
+	}
+	length = append_number(key, length, get_current_line());
+	record_stack(key, length);
+}
+
+void profiler_start(char* path) {
+	output_path = path;
+#ifdef PROFILER_SUPPORTED
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = take_sample;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGPROF, &action, 0);
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = PROFILE_INTERVAL_US;
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_PROF, &timer, 0);
+	running = true;
+#else
+	fprintf(stderr, "Profiling is not supported on this platform.\n");
+#endif
+}
+
+void profiler_stop(void) {
+	if (!running) {
+		return;
+	}
+	running = false;
+#ifdef PROFILER_SUPPORTED
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, 0);
+	signal(SIGPROF, SIG_DFL);
+#endif
+	if (!output_path) {
+		return;
+	}
+	FILE* file = fopen(output_path, "w");
+	if (!file) {
+		fprintf(stderr, "Error opening profile file %s to write.\n",
+			output_path);
+		return;
+	}
+	for (size_t s = 0; s < PROFILE_TABLE_SIZE; s++) {
+		if (stacks[s].samples) {
+			fprintf(file, "%.*s %lu\n", (int)stacks[s].length,
+				keys + stacks[s].key, stacks[s].samples);
+		}
+	}
+	fclose(file);
+}
+
+typedef struct profile_entry {
+	char* name;
+	unsigned long self;
+	unsigned long total;
+	size_t last_stack;
+} profile_entry;
+
+typedef struct profile_entries {
+	profile_entry* entries;
+	size_t count;
+	size_t capacity;
+} profile_entries;
+
+// find_entry(list, name, length) returns the entry for name, adding it first
+//   if necessary.
+static profile_entry* find_entry(profile_entries* list, const char* name,
+		size_t length) {
+	for (size_t e = 0; e < list->count; e++) {
+		if (strlen(list->entries[e].name) == length &&
+			strncmp(list->entries[e].name, name, length) == 0) {
+			return &list->entries[e];
+		}
+	}
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 16;
+		list->entries = list->entries
+			? safe_realloc(list->entries,
+				list->capacity * sizeof(profile_entry))
+			: safe_malloc(list->capacity * sizeof(profile_entry));
+	}
+	profile_entry* e = &list->entries[list->count++];
+	e->name = safe_malloc(length + 1);
+	memcpy(e->name, name, length);
+	e->name[length] = 0;
+	e->self = 0;
+	e->total = 0;
+	e->last_stack = (size_t)-1;
+	return e;
+}
+
+static int compare_entries(const void* a, const void* b) {
+	const profile_entry* x = a;
+	const profile_entry* y = b;
+	unsigned long xs = x->total ? x->total : x->self;
+	unsigned long ys = y->total ? y->total : y->self;
+	if (xs != ys) return xs < ys ? 1 : -1;
+	return strcmp(x->name, y->name);
+}
+
+static void free_entries(profile_entries* list) {
+	for (size_t e = 0; e < list->count; e++) {
+		safe_free(list->entries[e].name);
+	}
+	if (list->entries) safe_free(list->entries);
+}
+
+void profiler_print_report(FILE* buffer) {
+	profile_entries functions = { 0, 0, 0 };
+	profile_entries lines = { 0, 0, 0 };
+	for (size_t s = 0; s < PROFILE_TABLE_SIZE; s++) {
+		if (!stacks[s].samples) {
+			continue;
+		}
+		const char* key = keys + stacks[s].key;
+		size_t length = stacks[s].length;
+		unsigned long samples = stacks[s].samples;
+		size_t start = 0;
+		for (size_t c = 0; c <= length; c++) {
+			if (c < length && key[c] != ';') {
+				continue;
+			}
+			size_t end = c;
+			bool is_leaf = c == length;
+			if (is_leaf) {
+				// The leaf is "function:line".
+				profile_entry* l = find_entry(&lines, key + start, end - start);
+				l->self += samples;
+				while (end > start && key[end - 1] != ':') end--;
+				if (end > start) end--;
+			}
+			profile_entry* f = find_entry(&functions, key + start,
+				end - start);
+			// Recursive functions count once towards the total of a sample.
+			if (f->last_stack != s) {
+				f->total += samples;
+				f->last_stack = s;
+			}
+			if (is_leaf) {
+				f->self += samples;
+			}
+			start = c + 1;
+		}
+	}
+	qsort(functions.entries, functions.count, sizeof(profile_entry),
+		compare_entries);
+	qsort(lines.entries, lines.count, sizeof(profile_entry), compare_entries);
+
+	fprintf(buffer, "Profile Report (%lu samples every %dus", total_samples,
+		PROFILE_INTERVAL_US);
+	if (dropped_samples) {
+		fprintf(buffer, ", %lu dropped", dropped_samples);
+	}
+	fprintf(buffer, ")\n");
+	fprintf(buffer, "%-12s %-12s %s\n", "self", "total", "function");
+	for (size_t e = 0; e < functions.count; e++) {
+		fprintf(buffer, "%-12lu %-12lu %s\n", functions.entries[e].self,
+			functions.entries[e].total, functions.entries[e].name);
+	}
+	fprintf(buffer, "%-12s %s\n", "self", "line");
+	for (size_t e = 0; e < lines.count; e++) {
+		fprintf(buffer, "%-12lu %s\n", lines.entries[e].self,
+			lines.entries[e].name);
+	}
+	free_entries(&functions);
+	free_entries(&lines);
+}
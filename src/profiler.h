@@ -0,0 +1,33 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// profiler.h - Felix Guo
+// Sampling profiler for WendyScript programs. While enabled a SIGPROF timer
+//   interrupts the [vm] every PROFILE_INTERVAL_US microseconds of CPU time
+//   and the handler records the Wendy call stack, read from the function
+//   frames of the call stack, together with the current source line.
+// Samples are written in the collapsed stack format understood by flamegraph
+//   tools, one "main;caller;function:line count" line per distinct stack.
+// Nothing is added to the interpreter loop, so there is no cost unless
+//   profiling was requested.
+// On platforms without setitimer, profiling is unavailable.
+
+// Sampling period in microseconds of CPU time.
+#define PROFILE_INTERVAL_US 1000
+
+// profiler_start(path) starts sampling, the collapsed stacks are written to
+//   path when the profiler stops. path may be NULL to only collect samples
+//   for the report.
+void profiler_start(char* path);
+
+// profiler_stop() stops sampling and writes the collapsed stacks.
+void profiler_stop(void);
+
+// profiler_print_report(buffer) prints self and total sample counts for each
+//   function and self sample counts for each line.
+void profiler_print_report(FILE* buffer);
+
+#endif
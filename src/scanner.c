@@ -2,23 +2,93 @@
 #include "error.h"
 #include "global.h"
 #include "execpath.h"
+#include "arena.h"
+#include "cache.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
 
-static size_t source_len;
-static size_t current; // is used to keep track of source current
-static size_t start;
-static char* source;
-static token* tokens;
-static size_t tokens_alloc_size;
-static size_t t_curr; // t_curr is used to keep track of addToken
-static size_t line;
-static size_t col;
+static THREAD_LOCAL size_t source_len;
+static THREAD_LOCAL size_t current; // is used to keep track of source current
+static THREAD_LOCAL size_t start;
+static THREAD_LOCAL const char* source;
+static THREAD_LOCAL arena* strings; // owns the tokens and their strings
+static THREAD_LOCAL token* tokens; // copied to the arena once they're counted
+static THREAD_LOCAL size_t tokens_alloc_size;
+static THREAD_LOCAL size_t t_curr; // t_curr is used to keep track of addToken
+static THREAD_LOCAL size_t line;
+static THREAD_LOCAL size_t col;
+static THREAD_LOCAL bool ignore_next = false;
+// The line of the outermost import while an imported file is scanned, or 0.
+//   Only the importing source is loaded to show errors, so the tokens and
+//   errors of imported files are reported at the import.
+static THREAD_LOCAL size_t import_line = 0;
+
+// Files imported by path are scanned once per call to scan_tokens, into the
+//   token list where they're first imported. Importing one again copies its
+//   tokens from there.
+typedef struct imported_file {
+	char* path;
+	size_t first_token;
+	size_t end_token;
+	bool scanning;
+	struct imported_file* next;
+} imported_file;
+
+static THREAD_LOCAL imported_file* imported_files;
 
 static bool scan_token(void);
+static void scan_source(const char* text, size_t length);
 static void add_token(token_type type);
 static void add_token_with_value(token_type type, token_data val);
+static void add_lexeme(token_type type, size_t from, size_t to, token_data val);
+
+// Keywords are found by a perfect hash of their first and last character and
+//   their length, with multipliers found by search like gperf does. Every
+//   keyword has a slot of its own, so an identifier is compared to at most
+//   one keyword.
+#define KEYWORD_TABLE_SIZE 32
+#define KEYWORD_HASH(text, length) (((unsigned char)(text)[0] * 6 + \
+	(unsigned char)(text)[(length) - 1] * 17 + (length) * 7) & \
+	(KEYWORD_TABLE_SIZE - 1))
+
+typedef struct {
+	const char* name;
+	size_t length;
+	token_type type;
+} keyword_entry;
+
+static const keyword_entry keywords[KEYWORD_TABLE_SIZE] = {
+	[0] = { "dec", 3, T_DEC },
+	[5] = { "none", 4, T_NONE },
+	[9] = { "true", 4, T_TRUE },
+	[10] = { "if", 2, T_IF },
+	[11] = { "for", 3, T_LOOP },
+	[13] = { "input", 5, T_INPUT },
+	[15] = { "else", 4, T_ELSE },
+	[16] = { "struct", 6, T_STRUCT },
+	[17] = { "let", 3, T_LET },
+	[18] = { "in", 2, T_IN },
+	[19] = { "native", 6, T_NATIVE },
+	[20] = { "import", 6, T_REQ },
+	[21] = { "ret", 3, T_RET },
+	[26] = { "or", 2, T_OR },
+	[27] = { "set", 3, T_SET },
+	[28] = { "false", 5, T_FALSE },
+	[29] = { "yield", 5, T_YIELD },
+	[30] = { "inc", 3, T_INC },
+	[31] = { "and", 3, T_AND },
+};
+
+// keyword(text, length) returns the type of the keyword text, or
+//   T_IDENTIFIER if it isn't one.
+static token_type keyword(const char* text, size_t length) {
+	const keyword_entry* entry = &keywords[KEYWORD_HASH(text, length)];
+	if (entry->length == length && !memcmp(entry->name, text, length)) {
+		return entry->type;
+	}
+	return T_IDENTIFIER;
+}
 
 static bool is_at_end(void) {
 	return current >= source_len;
@@ -62,8 +132,70 @@ static bool is_alpha_numeric(char c) {
 	return is_alpha(c) || is_digit(c);
 }
 
-// handle_import() imports the string contents of the given file, otherwise
-//   leaves it for code_gen
+// source_line() returns the line of the importing source the scanner is at.
+static size_t source_line(void) {
+	return import_line ? import_line : line;
+}
+
+// reserve_tokens(count) makes room for count more tokens.
+static void reserve_tokens(size_t count) {
+	if (t_curr + count > tokens_alloc_size) {
+		while (t_curr + count > tokens_alloc_size) {
+			tokens_alloc_size *= 2;
+		}
+		tokens = safe_realloc(tokens, tokens_alloc_size * sizeof(token));
+	}
+}
+
+// scan_file(path) scans the file at path into the token list and returns it,
+//   or 0 if it can't be read.
+static imported_file* scan_file(char* path) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		error_lexer(source_line(), col, SCAN_REQ_FILE_READ_ERR);
+		return 0;
+	}
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	// Tokens refer to the text until the tree is generated.
+	char* text = arena_alloc(strings, length > 0 ? length + 1 : 1);
+	size_t read = length > 0 ? fread(text, 1, length, f) : 0;
+	text[read] = '\0';
+	fclose(f);
+	cache_add_dependency(CACHE_FILE, path, text, read);
+
+	imported_file* file = arena_alloc(strings, sizeof(imported_file));
+	file->path = path;
+	file->first_token = t_curr;
+	file->scanning = true;
+	file->next = imported_files;
+	imported_files = file;
+
+	const char* saved_source = source;
+	size_t saved_source_len = source_len;
+	size_t saved_current = current;
+	size_t saved_line = line;
+	size_t saved_col = col;
+	bool saved_ignore_next = ignore_next;
+	size_t saved_import_line = import_line;
+	import_line = source_line();
+	scan_source(text, read);
+	import_line = saved_import_line;
+	source = saved_source;
+	source_len = saved_source_len;
+	current = saved_current;
+	line = saved_line;
+	col = saved_col;
+	ignore_next = saved_ignore_next;
+
+	file->end_token = t_curr;
+	file->scanning = false;
+	return file;
+}
+
+// handle_import() imports the tokens of the given file, otherwise leaves it
+//   for code_gen
 static void handle_import(void) {
 	add_token(T_REQ);
 	// we scan a string
@@ -72,39 +204,29 @@ static void handle_import(void) {
 	while(!scan_token()) {
 		start = current;
 	}
-	if (tokens[t_curr - 1].t_type == T_STRING) {
-		int str_loc = t_curr - 1;
-		char* path = tokens[str_loc].t_data.string;
-		long length = 0;
-
-		char* buffer;
-		FILE * f = fopen(path, "r");
-		if (f) {
-			fseek (f, 0, SEEK_END);
-			length = ftell (f);
-			fseek (f, 0, SEEK_SET);
-			// + 2 for null terminator and newline
-			buffer = safe_malloc(length + 2);
-			buffer[0] = '\n';
-			if (buffer) {
-				fread(buffer + 1, 1, length, f);
-				buffer[length] = '\0'; // fread doesn't add a null terminator!
-				int newlen = source_len + strlen(buffer);
-				source = safe_realloc(source, newlen + 1);
-				size_t o_source_len = source_len;
-				source_len = newlen;
-				// at this point, we inset the buffer into the source
-				// current should be the next item, we move it down buffer bytes
-				memmove(&source[current + strlen(buffer)],
-						&source[current], o_source_len - current + 1);
-				memcpy(&source[current], buffer, strlen(buffer));
-			}
-			safe_free(buffer);
-			fclose (f);
-		}
-		else {
-			error_lexer(line, col, SCAN_REQ_FILE_READ_ERR);
+	if (tokens[t_curr - 1].t_type != T_STRING) {
+		return;
+	}
+	char* path = token_text(tokens[t_curr - 1], strings);
+	imported_file* file = imported_files;
+	while (file && !streq(file->path, path)) {
+		file = file->next;
+	}
+	if (!file) {
+		scan_file(path);
+	}
+	else if (file->scanning) {
+		error_lexer(source_line(), col, SCAN_REQ_CIRCULAR, path);
+	}
+	else {
+		size_t count = file->end_token - file->first_token;
+		reserve_tokens(count);
+		memcpy(&tokens[t_curr], &tokens[file->first_token],
+			count * sizeof(token));
+		for (size_t i = t_curr; i < t_curr + count; i++) {
+			tokens[i].t_line = source_line();
 		}
+		t_curr += count;
 	}
 }
 
@@ -114,20 +236,14 @@ static void handle_obj_type(void) {
 		advance();
 	}
 	if (is_at_end()) {
-		error_lexer(line, col, SCAN_EXPECTED_TOKEN, ">");
+		error_lexer(source_line(), col, SCAN_EXPECTED_TOKEN, ">");
 		return;
 	}
 	// The closing >
 	advance();
 
-	// Trim the surrounding quotes.
-	int s_length = current - 2 - start;
-	char value[s_length + 1]; // + 1 for null terminator
-
-	memcpy(value, &source[start + 1], s_length);
-	value[s_length] = '\0';
-
-	add_token_with_value(T_OBJ_TYPE, make_data_str(value));
+	// Trim the surrounding brackets.
+	add_lexeme(T_OBJ_TYPE, start + 1, current - 1, make_data_str(0));
 }
 
 static void handle_string(char endChar) {
@@ -139,7 +255,7 @@ static void handle_string(char endChar) {
 
 	// Unterminated string.
 	if (is_at_end()) {
-		error_lexer(line, col, SCAN_UNTERMINATED_STRING);
+		error_lexer(source_line(), col, SCAN_UNTERMINATED_STRING);
 		return;
 	}
 
@@ -148,9 +264,13 @@ static void handle_string(char endChar) {
 
 	// Trim the surrounding quotes.
 	size_t s_length = current - 2 - start;
-	char value[s_length + 1]; // + 1 for null terminator
-	memcpy(value, &source[start + 1], s_length);
-	value[s_length] = '\0';
+	if (!memchr(&source[start + 1], '\\', s_length)) {
+		// The string is its lexeme.
+		add_lexeme(T_STRING, start + 1, current - 1, make_data_str(0));
+		return;
+	}
+	// Escapes only shorten the string, so they're replaced in place.
+	char* value = arena_strndup(strings, &source[start + 1], s_length);
 	size_t s = 0;
 	for (size_t i = 0; i < s_length; i++) {
 		if (value[i] == '\\' && i != s_length - 1) {
@@ -170,7 +290,7 @@ static void handle_string(char endChar) {
 		}
 	}
 	value[s] = 0;
-	add_token_with_value(T_STRING, make_data_str(value));
+	add_lexeme(T_STRING, start + 1, current - 1, make_data_str(value));
 }
 
 // identifier() processes the next identifier and also handles wendyScript
@@ -178,38 +298,13 @@ static void handle_string(char endChar) {
 static void identifier(void) {
 	while (is_alpha_numeric(peek())) advance();
 
-	char text[current - start + 1];
-	memcpy(text, &source[start], current - start);
-	text[current - start] = '\0';
-
-	if (streq(text, "and"))       { add_token(T_AND); }
-	else if (streq(text, "else")) { add_token(T_ELSE); }
-	else if (streq(text, "false")){ add_token(T_FALSE); }
-	else if (streq(text, "if"))   { add_token(T_IF); }
-	else if (streq(text, "or"))   { add_token(T_OR); }
-	else if (streq(text, "true")) { add_token(T_TRUE); }
-
-	else if (streq(text, "let"))  { add_token(T_LET); }
-	else if (streq(text, "set"))  { add_token(T_SET); }
-	else if (streq(text, "for"))  { add_token(T_LOOP); }
-	else if (streq(text, "none")) { add_token(T_NONE); }
-	else if (streq(text, "in"))   { add_token(T_IN); }
-
-	else if (streq(text, "ret"))  { add_token(T_RET); }
-	else if (streq(text, "import"))   {
+	token_type type = keyword(&source[start], current - start);
+	if (type == T_REQ) {
 		handle_import();
 	}
-	else if (streq(text, "native"))   {
-		add_token(T_NATIVE);
-	}
-	else if (streq(text, "inc"))  { add_token(T_INC); }
-	else if (streq(text, "dec"))  { add_token(T_DEC); }
-	else if (streq(text, "input"))    { add_token(T_INPUT); }
-	else if (streq(text, "struct")){
-		add_token(T_STRUCT);
-
+	else {
+		add_token(type);
 	}
-	else { add_token(T_IDENTIFIER); }
 }
 
 // handle_number() processes the next number
@@ -230,7 +325,6 @@ static void handle_number(void) {
 	add_token_with_value(T_NUMBER, make_data_num(num));
 }
 
-static bool ignore_next = false;
 static bool scan_token(void) {
 	char c = advance();
 	switch(c) {
@@ -373,62 +467,73 @@ static bool scan_token(void) {
 				identifier();
 			}
 			else {
-				error_lexer(line, col, SCAN_UNEXPECTED_CHARACTER, c);
+				error_lexer(source_line(), col, SCAN_UNEXPECTED_CHARACTER, c);
 			}
 			break;
 	}
 	return true;
 }
 
-int scan_tokens(char* source_, token** destination, size_t* alloc_size) {
-	source_len = strlen(source_);
-	source = safe_malloc(source_len + 1);
-	strcpy(source, source_);
-
-	tokens_alloc_size = source_len;
-	tokens = safe_malloc(tokens_alloc_size * sizeof(token));
-	t_curr = 0;
+// scan_source(text, length) adds the tokens of text to the token list.
+static void scan_source(const char* text, size_t length) {
+	source = text;
+	source_len = length;
 	current = 0;
 	line = 1;
 	col = 1;
+	ignore_next = false;
 	while (!is_at_end()) {
 		start = current;
 		scan_token();
 	}
-	*destination = tokens;
-	*alloc_size = tokens_alloc_size;
-	safe_free(source);
+}
+
+size_t scan_tokens(arena* a, const char* source_, token** destination) {
+	strings = a;
+	imported_files = 0;
+	import_line = 0;
+	size_t length = strlen(source_);
+	// Tokens average a few characters each, the estimate only saves copies.
+	tokens_alloc_size = length / 4 + 16;
+	tokens = safe_malloc(tokens_alloc_size * sizeof(token));
+	t_curr = 0;
+	scan_source(source_, length);
+	*destination = arena_alloc(strings, t_curr * sizeof(token));
+	memcpy(*destination, tokens, t_curr * sizeof(token));
+	safe_free(tokens);
+	source = 0;
+	imported_files = 0;
 	return t_curr;
 }
 
 static void add_token(token_type type) {
-	char val[current - start + 1];
-	memcpy(val, &source[start], current - start);
-	val[current - start] = '\0';
-	add_token_with_value(type, make_data_str(val));
+	add_lexeme(type, start, current, make_data_str(0));
 }
 
 static void add_token_with_value(token_type type, token_data val) {
+	add_lexeme(type, start, current, val);
+}
+
+// add_lexeme(type, from, to, val) adds a token whose lexeme is the source from
+//   from up to to.
+static void add_lexeme(token_type type, size_t from, size_t to, token_data val) {
+	reserve_tokens(1);
 	if (type == T_NONE) {
-        tokens[t_curr++] = none_token();
-        safe_free(val.string);
-    }
+		tokens[t_curr] = none_token();
+	}
 	else if (type == T_TRUE) {
-        tokens[t_curr++] = true_token();
-        safe_free(val.string);
-    }
+		tokens[t_curr] = true_token();
+	}
 	else if (type == T_FALSE) {
-        tokens[t_curr++] = false_token();
-        safe_free(val.string);
-    }
-	else {
-		token new_t = { type, line, col, val };
-		tokens[t_curr++] = new_t;
+		tokens[t_curr] = false_token();
 	}
-	if (t_curr == tokens_alloc_size) {
-		tokens_alloc_size += 200;
-		tokens = safe_realloc(tokens, tokens_alloc_size * sizeof(token));
+	else {
+		token new_t = { type, source_line(), col, 0, 0, val };
+		tokens[t_curr] = new_t;
 	}
+	tokens[t_curr].t_lexeme = &source[from];
+	tokens[t_curr].t_length = to - from;
+	t_curr++;
 }
 
 void print_token_list(token* tokens, size_t size) {
@@ -437,9 +542,14 @@ void print_token_list(token* tokens, size_t size) {
 			printf("[%zd][Line %d] - %s -> %f\n", i, tokens[i].t_line,
 				token_string[tokens[i].t_type], tokens[i].t_data.number);
 		}
-		else {
+		else if (tokens[i].t_data.string) {
 			printf("[%zd][Line %d] - %s -> %s\n", i, tokens[i].t_line,
 				token_string[tokens[i].t_type], tokens[i].t_data.string);
 		}
+		else {
+			printf("[%zd][Line %d] - %s -> %.*s\n", i, tokens[i].t_line,
+				token_string[tokens[i].t_type], tokens[i].t_length,
+				tokens[i].t_lexeme);
+		}
 	}
 }
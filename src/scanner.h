@@ -2,13 +2,19 @@
 #define SCANNER_H
 
 #include "token.h"
+#include "arena.h"
 
 // scanner.h - Felix Guo
 // This module tokenizes a string of text input and converts it to a list of
 //   tokens, which are passed into [AST] to create a syntax tree.
 
-// scan_tokens(source) creates a list of tokens from the source
-int scan_tokens(char* source_, token** destination, size_t* alloc_size);
+// scan_tokens(a, source, destination) creates a list of tokens from the source
+//   in the arena a and returns how many there are. Tokens refer to the
+//   source, which has to outlive them. Files imported by path are scanned on
+//   their own and their tokens are put in place of the import, each file is
+//   read and scanned once however often it's imported. Their tokens have the
+//   line of the import.
+size_t scan_tokens(arena* a, const char* source_, token** destination);
 
 // print_token_list() prints the list of tokens
 void print_token_list(token* tokens, size_t size);
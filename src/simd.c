@@ -0,0 +1,413 @@
+#include "simd.h"
+#include "global.h"
+#include <stdlib.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Implementation of the array kernels. Each instruction set gets the same
+//   set of kernels, the loops are written once as macros over the vector
+//   width and the load, store and arithmetic intrinsics. Elements that don't
+//   fill a whole vector at the end are handled one at a time.
+
+typedef struct simd_kernels {
+	const char* name;
+	void (*binary)(simd_op, double*, const double*, const double*, size_t);
+	void (*scalar)(simd_op, double*, const double*, double, bool, size_t);
+	double (*sum)(const double*, size_t);
+	double (*dot)(const double*, const double*, size_t);
+	double (*min)(const double*, size_t);
+	double (*max)(const double*, size_t);
+} simd_kernels;
+
+// out[i] = a[i] OPERATOR b[i], WIDTH elements at a time.
+#define VECTOR_BINARY(WIDTH, LOAD, STORE, INTRINSIC, OPERATOR) { \
+	size_t i = 0; \
+	for (; i + WIDTH <= n; i += WIDTH) { \
+		STORE(out + i, INTRINSIC(LOAD(a + i), LOAD(b + i))); \
+	} \
+	for (; i < n; i++) { \
+		out[i] = a[i] OPERATOR b[i]; \
+	} \
+}
+
+// out[i] = a[i] OPERATOR s, or s OPERATOR a[i] if swapped. vs holds s in
+//   every lane.
+#define VECTOR_SCALAR(WIDTH, LOAD, STORE, INTRINSIC, OPERATOR) { \
+	size_t i = 0; \
+	if (swapped) { \
+		for (; i + WIDTH <= n; i += WIDTH) { \
+			STORE(out + i, INTRINSIC(vs, LOAD(a + i))); \
+		} \
+		for (; i < n; i++) { \
+			out[i] = s OPERATOR a[i]; \
+		} \
+	} \
+	else { \
+		for (; i + WIDTH <= n; i += WIDTH) { \
+			STORE(out + i, INTRINSIC(LOAD(a + i), vs)); \
+		} \
+		for (; i < n; i++) { \
+			out[i] = a[i] OPERATOR s; \
+		} \
+	} \
+}
+
+// Folds a into the vector acc with INTRINSIC, then the lanes of acc and the
+//   remaining elements into result with SCALAR.
+#define VECTOR_REDUCE(TYPE, WIDTH, LOAD, STORE, INTRINSIC, SCALAR) { \
+	TYPE acc = LOAD(a); \
+	size_t i = WIDTH; \
+	for (; i + WIDTH <= n; i += WIDTH) { \
+		acc = INTRINSIC(acc, LOAD(a + i)); \
+	} \
+	double lanes[WIDTH]; \
+	STORE(lanes, acc); \
+	for (int l = 0; l < WIDTH; l++) { \
+		result = SCALAR(result, lanes[l]); \
+	} \
+	for (; i < n; i++) { \
+		result = SCALAR(result, a[i]); \
+	} \
+}
+
+static double scalar_min(double a, double b) {
+	return b < a ? b : a;
+}
+
+static double scalar_max(double a, double b) {
+	return b > a ? b : a;
+}
+
+static void plain_binary(simd_op op, double* out, const double* a,
+		const double* b, size_t n) {
+	switch (op) {
+		case SIMD_ADD:
+			for (size_t i = 0; i < n; i++) out[i] = a[i] + b[i];
+			break;
+		case SIMD_SUB:
+			for (size_t i = 0; i < n; i++) out[i] = a[i] - b[i];
+			break;
+		case SIMD_MUL:
+			for (size_t i = 0; i < n; i++) out[i] = a[i] * b[i];
+			break;
+		case SIMD_DIV:
+			for (size_t i = 0; i < n; i++) out[i] = a[i] / b[i];
+			break;
+	}
+}
+
+static void plain_scalar(simd_op op, double* out, const double* a, double s,
+		bool swapped, size_t n) {
+	switch (op) {
+		case SIMD_ADD:
+			for (size_t i = 0; i < n; i++) out[i] = a[i] + s;
+			break;
+		case SIMD_SUB:
+			for (size_t i = 0; i < n; i++) {
+				out[i] = swapped ? s - a[i] : a[i] - s;
+			}
+			break;
+		case SIMD_MUL:
+			for (size_t i = 0; i < n; i++) out[i] = a[i] * s;
+			break;
+		case SIMD_DIV:
+			for (size_t i = 0; i < n; i++) {
+				out[i] = swapped ? s / a[i] : a[i] / s;
+			}
+			break;
+	}
+}
+
+static double plain_sum(const double* a, size_t n) {
+	double result = 0;
+	for (size_t i = 0; i < n; i++) result += a[i];
+	return result;
+}
+
+static double plain_dot(const double* a, const double* b, size_t n) {
+	double result = 0;
+	for (size_t i = 0; i < n; i++) result += a[i] * b[i];
+	return result;
+}
+
+static double plain_min(const double* a, size_t n) {
+	double result = a[0];
+	for (size_t i = 1; i < n; i++) result = scalar_min(result, a[i]);
+	return result;
+}
+
+static double plain_max(const double* a, size_t n) {
+	double result = a[0];
+	for (size_t i = 1; i < n; i++) result = scalar_max(result, a[i]);
+	return result;
+}
+
+static const simd_kernels plain_kernels = {
+	"scalar", plain_binary, plain_scalar, plain_sum, plain_dot, plain_min,
+	plain_max
+};
+
+#ifdef SIMD_X86
+
+// SSE2 is part of x86-64, so these need no target attribute.
+
+static void sse2_binary(simd_op op, double* out, const double* a,
+		const double* b, size_t n) {
+	switch (op) {
+		case SIMD_ADD:
+			VECTOR_BINARY(2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, +);
+			break;
+		case SIMD_SUB:
+			VECTOR_BINARY(2, _mm_loadu_pd, _mm_storeu_pd, _mm_sub_pd, -);
+			break;
+		case SIMD_MUL:
+			VECTOR_BINARY(2, _mm_loadu_pd, _mm_storeu_pd, _mm_mul_pd, *);
+			break;
+		case SIMD_DIV:
+			VECTOR_BINARY(2, _mm_loadu_pd, _mm_storeu_pd, _mm_div_pd, /);
+			break;
+	}
+}
+
+static void sse2_scalar(simd_op op, double* out, const double* a, double s,
+		bool swapped, size_t n) {
+	__m128d vs = _mm_set1_pd(s);
+	switch (op) {
+		case SIMD_ADD:
+			VECTOR_SCALAR(2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, +);
+			break;
+		case SIMD_SUB:
+			VECTOR_SCALAR(2, _mm_loadu_pd, _mm_storeu_pd, _mm_sub_pd, -);
+			break;
+		case SIMD_MUL:
+			VECTOR_SCALAR(2, _mm_loadu_pd, _mm_storeu_pd, _mm_mul_pd, *);
+			break;
+		case SIMD_DIV:
+			VECTOR_SCALAR(2, _mm_loadu_pd, _mm_storeu_pd, _mm_div_pd, /);
+			break;
+	}
+}
+
+static double sse2_sum(const double* a, size_t n) {
+	// Two accumulators so consecutive additions don't wait on each other.
+	__m128d acc0 = _mm_setzero_pd();
+	__m128d acc1 = _mm_setzero_pd();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		acc0 = _mm_add_pd(acc0, _mm_loadu_pd(a + i));
+		acc1 = _mm_add_pd(acc1, _mm_loadu_pd(a + i + 2));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+	double result = lanes[0] + lanes[1];
+	for (; i < n; i++) result += a[i];
+	return result;
+}
+
+static double sse2_dot(const double* a, const double* b, size_t n) {
+	__m128d acc0 = _mm_setzero_pd();
+	__m128d acc1 = _mm_setzero_pd();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		acc0 = _mm_add_pd(acc0,
+			_mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+		acc1 = _mm_add_pd(acc1,
+			_mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+	double result = lanes[0] + lanes[1];
+	for (; i < n; i++) result += a[i] * b[i];
+	return result;
+}
+
+static double sse2_min(const double* a, size_t n) {
+	double result = a[0];
+	if (n >= 2) {
+		VECTOR_REDUCE(__m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_min_pd,
+			scalar_min);
+	}
+	return result;
+}
+
+static double sse2_max(const double* a, size_t n) {
+	double result = a[0];
+	if (n >= 2) {
+		VECTOR_REDUCE(__m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_max_pd,
+			scalar_max);
+	}
+	return result;
+}
+
+static const simd_kernels sse2_kernels = {
+	"sse2", sse2_binary, sse2_scalar, sse2_sum, sse2_dot, sse2_min, sse2_max
+};
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void avx2_binary(simd_op op, double* out, const double* a,
+		const double* b, size_t n) {
+	switch (op) {
+		case SIMD_ADD:
+			VECTOR_BINARY(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd, +);
+			break;
+		case SIMD_SUB:
+			VECTOR_BINARY(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_sub_pd, -);
+			break;
+		case SIMD_MUL:
+			VECTOR_BINARY(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_mul_pd, *);
+			break;
+		case SIMD_DIV:
+			VECTOR_BINARY(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_div_pd, /);
+			break;
+	}
+}
+
+AVX2 static void avx2_scalar(simd_op op, double* out, const double* a,
+		double s, bool swapped, size_t n) {
+	__m256d vs = _mm256_set1_pd(s);
+	switch (op) {
+		case SIMD_ADD:
+			VECTOR_SCALAR(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd, +);
+			break;
+		case SIMD_SUB:
+			VECTOR_SCALAR(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_sub_pd, -);
+			break;
+		case SIMD_MUL:
+			VECTOR_SCALAR(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_mul_pd, *);
+			break;
+		case SIMD_DIV:
+			VECTOR_SCALAR(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_div_pd, /);
+			break;
+	}
+}
+
+AVX2 static double avx2_sum(const double* a, size_t n) {
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(a + i));
+		acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(a + i + 4));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+	double result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for (; i < n; i++) result += a[i];
+	return result;
+}
+
+AVX2 static double avx2_dot(const double* a, const double* b, size_t n) {
+	// Multiply and add are kept separate rather than fused, so each product
+	//   is rounded the same way as in the other kernels.
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		acc0 = _mm256_add_pd(acc0,
+			_mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+		acc1 = _mm256_add_pd(acc1,
+			_mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+				_mm256_loadu_pd(b + i + 4)));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+	double result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for (; i < n; i++) result += a[i] * b[i];
+	return result;
+}
+
+AVX2 static double avx2_min(const double* a, size_t n) {
+	double result = a[0];
+	if (n >= 4) {
+		VECTOR_REDUCE(__m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd,
+			_mm256_min_pd, scalar_min);
+	}
+	else {
+		result = plain_min(a, n);
+	}
+	return result;
+}
+
+AVX2 static double avx2_max(const double* a, size_t n) {
+	double result = a[0];
+	if (n >= 4) {
+		VECTOR_REDUCE(__m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd,
+			_mm256_max_pd, scalar_max);
+	}
+	else {
+		result = plain_max(a, n);
+	}
+	return result;
+}
+
+static const simd_kernels avx2_kernels = {
+	"avx2", avx2_binary, avx2_scalar, avx2_sum, avx2_dot, avx2_min, avx2_max
+};
+
+#endif
+
+static const simd_kernels* kernels = 0;
+
+// select_kernels() picks the widest kernels the CPU supports, or the ones
+//   asked for by WENDY_SIMD.
+static const simd_kernels* select_kernels(void) {
+	if (kernels) {
+		return kernels;
+	}
+	const char* wanted = getenv("WENDY_SIMD");
+	kernels = &plain_kernels;
+#ifdef SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && (!wanted || streq(wanted, "avx2"))) {
+		kernels = &avx2_kernels;
+	}
+	else if (!wanted || !streq(wanted, "scalar")) {
+		kernels = &sse2_kernels;
+	}
+#else
+	UNUSED(wanted);
+#endif
+	return kernels;
+}
+
+const char* simd_level(void) {
+	return select_kernels()->name;
+}
+
+void simd_binary(simd_op op, double* out, const double* a, const double* b,
+		size_t n) {
+	select_kernels()->binary(op, out, a, b, n);
+}
+
+void simd_scalar(simd_op op, double* out, const double* a, double s,
+		bool swapped, size_t n) {
+	select_kernels()->scalar(op, out, a, s, swapped, n);
+}
+
+double simd_sum(const double* a, size_t n) {
+	return select_kernels()->sum(a, n);
+}
+
+double simd_dot(const double* a, const double* b, size_t n) {
+	return select_kernels()->dot(a, b, n);
+}
+
+double simd_min(const double* a, size_t n) {
+	return select_kernels()->min(a, n);
+}
+
+double simd_max(const double* a, size_t n) {
+	return select_kernels()->max(a, n);
+}
+
+void simd_cumsum(double* out, const double* a, size_t n) {
+	double total = 0;
+	for (size_t i = 0; i < n; i++) {
+		total += a[i];
+		out[i] = total;
+	}
+}
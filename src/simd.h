@@ -0,0 +1,48 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// simd.h - Felix Guo
+// Element-wise kernels over arrays of doubles, used by the f64array natives.
+//   On x86-64 the widest instruction set the CPU supports is picked the first
+//   time a kernel runs: AVX2 (4 doubles at a time), or SSE2 (2 at a time),
+//   which every x86-64 CPU has. Elsewhere plain loops are used.
+// The WENDY_SIMD environment variable can be set to "avx2", "sse2" or
+//   "scalar" to use a narrower kernel, e.g. to compare them.
+// Vector kernels add up sums and dot products in a different order than a
+//   plain loop does, so those may differ in the last bits.
+
+typedef enum {
+	SIMD_ADD,
+	SIMD_SUB,
+	SIMD_MUL,
+	SIMD_DIV
+} simd_op;
+
+// simd_level() returns the name of the kernels in use.
+const char* simd_level(void);
+
+// simd_binary(op, out, a, b, n) stores a[i] op b[i] into out[i]. out may be
+//   a or b.
+void simd_binary(simd_op op, double* out, const double* a, const double* b,
+	size_t n);
+
+// simd_scalar(op, out, a, s, swapped, n) stores a[i] op s into out[i], or
+//   s op a[i] if swapped. out may be a.
+void simd_scalar(simd_op op, double* out, const double* a, double s,
+	bool swapped, size_t n);
+
+double simd_sum(const double* a, size_t n);
+double simd_dot(const double* a, const double* b, size_t n);
+
+// simd_min(a, n) and simd_max(a, n) require n > 0.
+double simd_min(const double* a, size_t n);
+double simd_max(const double* a, size_t n);
+
+// simd_cumsum(out, a, n) stores the running total of a into out, which may
+//   be a. Each total depends on the one before, so this is a plain loop.
+void simd_cumsum(double* out, const double* a, size_t n);
+
+#endif
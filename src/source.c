@@ -1,85 +1,81 @@
 #include "source.h"
 #include "global.h"
+#include "state.h"
 #include <string.h>
 
-static char* buffer = 0;
-static char** source_lines = 0;
-static int max_lines;
-static char* source_name;
-static bool source_accurate = false;
 
 void init_source(FILE* file, char* name, long length, bool accurate) {
 	if (!file) return;
-	source_accurate = accurate;
-	source_name = safe_malloc(sizeof(char) * (strlen(name) + 1));
-	strcpy(source_name, name);
-	buffer = safe_malloc(sizeof(char) * (length + 1));
-	fread(buffer, sizeof(char), length, file);
-	buffer[length] = '\0';
+	vm->source_accurate = accurate;
+	vm->source_name = safe_malloc(sizeof(char) * (strlen(name) + 1));
+	strcpy(vm->source_name, name);
+	vm->source_buffer = safe_malloc(sizeof(char) * (length + 1));
+	fread(vm->source_buffer, sizeof(char), length, file);
+	vm->source_buffer[length] = '\0';
 
 	int lines = 1;
-	for (int i = 0; buffer[i]; i++) {
-		if (buffer[i] == '\n') {
+	for (int i = 0; vm->source_buffer[i]; i++) {
+		if (vm->source_buffer[i] == '\n') {
 			// Newline Encountered
 			lines++;
 		}
 	}
 
-	max_lines = lines;
-	source_lines = safe_malloc(sizeof(char*) * max_lines);
+	vm->source_max_lines = lines;
+	vm->source_lines = safe_malloc(sizeof(char*) * vm->source_max_lines);
 	int line = 0;
 	int line_size = 0;
-	char* line_start = buffer;
+	char* line_start = vm->source_buffer;
 	for (int i = 0;; i++) {
 		line_size++;
-		if (buffer[i] == '\n' || buffer[i] == 0) {
-			source_lines[line] = safe_malloc(sizeof(char) * line_size);
-			strncpy(source_lines[line], line_start, line_size);
-			source_lines[line][line_size - 1] = 0;
-			line_start = buffer + i + 1;
+		if (vm->source_buffer[i] == '\n' || vm->source_buffer[i] == 0) {
+			vm->source_lines[line] = safe_malloc(sizeof(char) * line_size);
+			strncpy(vm->source_lines[line], line_start, line_size);
+			vm->source_lines[line][line_size - 1] = 0;
+			line_start = vm->source_buffer + i + 1;
 			line++;
 			line_size = 0;
 		}
-		if (!buffer[i]) break;
+		if (!vm->source_buffer[i]) break;
 	}
 }
 
 bool is_source_accurate() {
-	return source_accurate;
+	return vm->source_accurate;
 }
 bool is_valid_line_num(int line) {
 	// line is 1 indexed
-	return line <= max_lines;
+	return line <= vm->source_max_lines;
 }
 
 bool has_source() {
-	return buffer;
+	return vm->source_buffer;
 }
 
 char* get_source_name() {
-	return source_name;
+	return vm->source_name;
 }
 
 char* get_source_line(int line) {
-	if (line >= max_lines) {
+	if (line >= vm->source_max_lines) {
 		return "";
 	}
-	return source_lines[line - 1];
+	return vm->source_lines[line - 1];
 }
 
 char* get_source_buffer() {
-	return buffer;
+	return vm->source_buffer;
 }
 
 void free_source() {
-	if (!buffer) return;
-	safe_free(buffer);
-	safe_free(source_name);
-	for (int i = 0; i < max_lines; i++) {
-		if (source_lines[i]) {
-			safe_free(source_lines[i]);
+	if (!vm->source_buffer) return;
+	safe_free(vm->source_buffer);
+	safe_free(vm->source_name);
+	for (int i = 0; i < vm->source_max_lines; i++) {
+		if (vm->source_lines[i]) {
+			safe_free(vm->source_lines[i]);
 		}
 	}
-	safe_free(source_lines);
+	safe_free(vm->source_lines);
 }
 
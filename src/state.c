@@ -0,0 +1,50 @@
+#include "state.h"
+#include "source.h"
+#include "native.h"
+#include <stdlib.h>
+
+// Implementation of interpreter instances.
+
+THREAD_LOCAL wendy_vm* vm = 0;
+
+wendy_vm* vm_create(void) {
+	wendy_vm* instance = safe_calloc(1, sizeof(wendy_vm));
+	instance->settings_value_data[SETTINGS_JIT_THRESHOLD] =
+		JIT_DEFAULT_THRESHOLD;
+	instance->settings_value_data[SETTINGS_INLINE_MAX_SIZE] =
+		INLINE_DEFAULT_MAX_SIZE;
+	instance->settings_value_data[SETTINGS_INLINE_MAX_GROWTH] =
+		INLINE_DEFAULT_MAX_GROWTH;
+	wendy_vm* previous = vm_enter(instance);
+	init_memory();
+	vm_enter(previous);
+	return instance;
+}
+
+void vm_destroy(wendy_vm* instance) {
+	wendy_vm* previous = vm_enter(instance);
+	parallel_shutdown();
+	free_generators();
+	files_close_all();
+	jit_free();
+	if (get_settings_flag(SETTINGS_REPL) && vm->bytecode) {
+		// The REPL owns the bytecode it has accumulated.
+		vm_cleanup_if_repl();
+	}
+	else {
+		vm_cleanup();
+	}
+	free_imported_libraries_ll();
+	free_source();
+	c_free_memory();
+	native_unregister_all();
+	free(vm->error_message);
+	vm_enter(previous == instance ? 0 : previous);
+	safe_free(instance);
+}
+
+wendy_vm* vm_enter(wendy_vm* instance) {
+	wendy_vm* previous = vm;
+	vm = instance;
+	return previous;
+}
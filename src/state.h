@@ -0,0 +1,178 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include "global.h"
+#include "memory.h"
+#include "vm.h"
+#include "jit.h"
+#include "files.h"
+#include "imports.h"
+#include "stats.h"
+#include "native.h"
+#include "parallel.h"
+#include "generator.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// state.h - Felix Guo
+// Everything an interpreter owns is kept in a wendy_vm rather than in
+//   globals, so several interpreters can live in one process, each on its own
+//   thread. A thread picks the interpreter it works with through vm_enter,
+//   after which every module reaches the interpreter's state through vm.
+// Scratch state of a single compilation, like the scanner's position, is
+//   kept separately by each thread instead.
+
+typedef struct wendy_vm {
+	// [memory]
+	data* memory;
+	mem_block* free_memory;
+	stack_entry* call_stack;
+	address* mem_reg_stack;
+	// Includes a list of closures, each holding the variables captured by a
+	//   function. The size of the closure lists is also stored for easy
+	//   iteration. Closures no function refers to anymore are collected,
+	//   leaving NULL, closures_hint is the lowest index that may be free and
+	//   closure_list_pointer is one past the highest used index.
+	closure_slot** closure_list;
+	size_t* closure_list_sizes;
+	// Closures the garbage collector reached.
+	bool* closure_reached;
+	address frame_pointer;
+	address stack_pointer;
+	address arg_pointer;
+	address closure_list_pointer;
+	size_t closure_list_size;
+	size_t closures_hint;
+	size_t closures_count;
+	address mem_reg_pointer;
+	// Blocks garbage_collect() marked but hasn't looked into yet, as pairs of
+	//   start and size.
+	address* gc_worklist;
+	size_t gc_worklist_count;
+	size_t gc_worklist_capacity;
+	// Incremented whenever an operator overload is bound, so that code which
+	//   assumed no overload exists can detect that the assumption may be
+	//   stale.
+	unsigned int overload_epoch;
+	// Pointer to the end of the main() stack frame.
+	address main_end_pointer;
+	interned_name* interned_names[INTERNED_NAMES_BUCKETS];
+
+	// [vm] registers and the program being run.
+	address memory_register;
+	address memory_register_A;
+	int line;
+	address ip;
+	uint8_t* bytecode;
+	size_t bytecode_size;
+	char* last_pushed_identifier;
+	bool jit_enabled;
+	bool count_opcodes;
+	// Quickening state: binary_feedback counts, per BIN/RBIN site, how many
+	//   times in a row the site saw operands that have a specialized form.
+	//   quickened_sites lists every rewritten site so they can all be
+	//   restored.
+	site_feedback* binary_feedback;
+	size_t binary_feedback_size;
+	address* quickened_sites;
+	size_t quickened_count;
+	size_t quickened_capacity;
+	unsigned int quickened_epoch;
+	// Whether a + overload applies to string += string and string += number,
+	//   as of append_epoch.
+	bool append_overloaded_string;
+	bool append_overloaded_number;
+	unsigned int append_epoch;
+	bool append_checked;
+	// The string op_append() grew last, with its length and the size of its
+	//   allocation, so appending to it again doesn't scan it. Cleared when the
+	//   string is destroyed.
+	char* append_string;
+	size_t append_length;
+	size_t append_capacity;
+
+	// [codegen] output buffer.
+	uint8_t* codegen_bytecode;
+	size_t codegen_capacity;
+	size_t codegen_size;
+	int global_loop_id;
+	// Whether the function being generated yields.
+	bool codegen_yields;
+
+	// [jit]
+	uint8_t** jit_entry_table;
+	bool jit_pending;
+	uint8_t* jit_bytecode;
+	size_t jit_bytecode_size;
+	// Maps the start address of each called function to its index + 1 in
+	//   jit_functions, 0 means the function was never called.
+	unsigned int* jit_function_index;
+	jit_function* jit_functions;
+	size_t jit_functions_count;
+	size_t jit_functions_capacity;
+	uint8_t* jit_code;
+	size_t jit_code_used;
+	uint8_t* jit_exit_stub;
+	uint8_t* jit_dispatch_stub;
+
+	// [files] table of open files.
+	open_file* files;
+	size_t files_count;
+	size_t files_capacity;
+
+	// [source] of the program, for error messages.
+	char* source_buffer;
+	char** source_lines;
+	int source_max_lines;
+	char* source_name;
+	bool source_accurate;
+
+	import_node* imported_libraries;
+	bool error_flag;
+	// The message of the last error, allocated by vasprintf.
+	char* error_message;
+	bool settings_data[SETTINGS_COUNT];
+	int settings_value_data[SETTINGS_VALUE_COUNT];
+	bool last_printed_newline;
+	char** program_arguments;
+	int program_arguments_count;
+	host_native* host_natives;
+	size_t host_natives_count;
+	size_t host_natives_capacity;
+	// [parallel] worker threads, started by the first parallel.map, and the
+	//   tasks started by parallel.spawn, NULL once joined.
+	worker_pool* workers;
+	task** tasks;
+	size_t tasks_count;
+	size_t tasks_capacity;
+	// [generator] states indexed by handle, NULL where the generator was
+	//   collected. generators_hint is the lowest handle that may be free.
+	generator** generators;
+	size_t generators_count;
+	size_t generators_capacity;
+	size_t generators_hint;
+	generator* running_generator;
+	// Generators the garbage collector reached but hasn't marked yet.
+	generator* pending_generators;
+	// [data] views that share the elements of a list, see unshare_list().
+	list_view* list_views;
+	wendy_stats stats;
+	uint64_t stats_start_ns;
+} wendy_vm;
+
+// The interpreter the running thread works with.
+extern THREAD_LOCAL wendy_vm* vm;
+
+// vm_create() returns a new interpreter with empty memory and default
+//   settings. It doesn't change the interpreter the thread works with.
+wendy_vm* vm_create(void);
+
+// vm_destroy(instance) closes the files and frees all memory owned by the
+//   interpreter instance.
+void vm_destroy(wendy_vm* instance);
+
+// vm_enter(instance) makes the running thread work with instance and returns
+//   the interpreter it worked with before, which may be NULL.
+wendy_vm* vm_enter(wendy_vm* instance);
+
+#endif
@@ -0,0 +1,140 @@
+#define _POSIX_C_SOURCE 199309L
+#include "stats.h"
+#include "global.h"
+#include "state.h"
+#include <time.h>
+
+// Implementation of the runtime counters.
+
+void stats_start(void) {
+	vm->stats_start_ns = stats_now_ns();
+}
+
+uint64_t stats_now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+uint64_t stats_ticks(void) {
+#if defined(__x86_64__) && defined(__GNUC__)
+	return __builtin_ia32_rdtsc();
+#else
+	return stats_now_ns();
+#endif
+}
+
+uint64_t stats_wall_ns(void) {
+	return stats_now_ns() - vm->stats_start_ns;
+}
+
+size_t stats_free_cells(size_t* blocks) {
+	size_t cells = 0;
+	size_t count = 0;
+	for (mem_block* c = vm->free_memory; c; c = c->next) {
+		cells += c->size;
+		count++;
+	}
+	if (blocks) {
+		*blocks = count;
+	}
+	return cells;
+}
+
+static uint64_t total_instructions(void) {
+	uint64_t total = 0;
+	for (size_t op = 0; op < OPCODE_COUNT; op++) {
+		total += vm->stats.opcode_counts[op];
+	}
+	return total;
+}
+
+void stats_print(FILE* buffer) {
+	size_t blocks;
+	size_t free_cells = stats_free_cells(&blocks);
+	fprintf(buffer, "Runtime Statistics\n");
+	fprintf(buffer, "%-20s %.3f ms\n", "wall time",
+		stats_wall_ns() / 1000000.0);
+	fprintf(buffer, "%-20s %llu\n", "instructions",
+		(unsigned long long)total_instructions());
+	fprintf(buffer, "%-20s %llu (%llu cells)\n", "allocations",
+		(unsigned long long)vm->stats.allocations,
+		(unsigned long long)vm->stats.allocated_cells);
+	fprintf(buffer, "%-20s %llu cells\n", "peak heap",
+		(unsigned long long)vm->stats.peak_heap_cells);
+	fprintf(buffer, "%-20s %llu (%.3f ms total, %.3f ms max, %llu cells "
+		"reclaimed)\n", "collections",
+		(unsigned long long)vm->stats.collections,
+		vm->stats.gc_pause_ns / 1000000.0, vm->stats.gc_max_pause_ns / 1000000.0,
+		(unsigned long long)vm->stats.reclaimed_cells);
+	fprintf(buffer, "%-20s %u / %d\n", "peak call stack",
+		vm->stats.peak_stack_pointer, STACK_SIZE);
+	fprintf(buffer, "%-20s %u / %d\n", "peak operand stack",
+		vm->stats.peak_operand_stack, ARGSTACK_SIZE);
+	fprintf(buffer, "%-20s %zu\n", "closures", vm->closures_count);
+	fprintf(buffer, "%-20s %zu blocks (%zu cells)\n", "free list", blocks,
+		free_cells);
+	if (get_settings_flag(SETTINGS_JIT)) {
+		// Compiled code can't count instructions, see run_bytecode().
+		fprintf(buffer, "%-20s disabled while counting instructions\n", "jit");
+	}
+	fprintf(buffer, "%-12s %-12s %-14s %s\n", "opcode", "count", "ticks",
+		"ticks/op");
+	for (size_t op = 0; op < OPCODE_COUNT; op++) {
+		if (!vm->stats.opcode_counts[op]) {
+			continue;
+		}
+		fprintf(buffer, "%-12s %-12llu %-14llu %.1f\n", opcode_string[op],
+			(unsigned long long)vm->stats.opcode_counts[op],
+			(unsigned long long)vm->stats.opcode_ticks[op],
+			(double)vm->stats.opcode_ticks[op] / vm->stats.opcode_counts[op]);
+	}
+}
+
+void stats_write_json(char* path) {
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "Error opening stats file %s to write.\n", path);
+		return;
+	}
+	size_t blocks;
+	size_t free_cells = stats_free_cells(&blocks);
+	fprintf(file, "{\n");
+	fprintf(file, "  \"wall_ns\": %llu,\n",
+		(unsigned long long)stats_wall_ns());
+	fprintf(file, "  \"instructions\": %llu,\n",
+		(unsigned long long)total_instructions());
+	fprintf(file, "  \"allocations\": %llu,\n",
+		(unsigned long long)vm->stats.allocations);
+	fprintf(file, "  \"allocated_cells\": %llu,\n",
+		(unsigned long long)vm->stats.allocated_cells);
+	fprintf(file, "  \"peak_heap_cells\": %llu,\n",
+		(unsigned long long)vm->stats.peak_heap_cells);
+	fprintf(file, "  \"gc\": { \"collections\": %llu, \"pause_ns\": %llu, "
+		"\"max_pause_ns\": %llu, \"reclaimed_cells\": %llu },\n",
+		(unsigned long long)vm->stats.collections,
+		(unsigned long long)vm->stats.gc_pause_ns,
+		(unsigned long long)vm->stats.gc_max_pause_ns,
+		(unsigned long long)vm->stats.reclaimed_cells);
+	fprintf(file, "  \"peak_stack_pointer\": %u,\n", vm->stats.peak_stack_pointer);
+	fprintf(file, "  \"peak_operand_stack\": %u,\n", vm->stats.peak_operand_stack);
+	fprintf(file, "  \"closures\": %zu,\n", vm->closures_count);
+	fprintf(file, "  \"free_list_blocks\": %zu,\n", blocks);
+	fprintf(file, "  \"free_cells\": %zu,\n", free_cells);
+	fprintf(file, "  \"jit_disabled\": %s,\n",
+		get_settings_flag(SETTINGS_JIT) ? "true" : "false");
+	fprintf(file, "  \"opcodes\": {");
+	bool first = true;
+	for (size_t op = 0; op < OPCODE_COUNT; op++) {
+		if (!vm->stats.opcode_counts[op]) {
+			continue;
+		}
+		fprintf(file, "%s\n    \"%s\": { \"count\": %llu, \"ticks\": %llu }",
+			first ? "" : ",", opcode_string[op],
+			(unsigned long long)vm->stats.opcode_counts[op],
+			(unsigned long long)vm->stats.opcode_ticks[op]);
+		first = false;
+	}
+	fprintf(file, "%s}\n}\n", first ? "" : "\n  ");
+	fclose(file);
+}
@@ -0,0 +1,57 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "codegen.h"
+#include "memory.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// stats.h - Felix Guo
+// Runtime counters for tuning the memory sizes and finding hot opcodes.
+//   Allocation, garbage collection and peak usage counters are always kept
+//   since they are cheap. Counting and timing every executed opcode costs a
+//   branch per instruction, so the [vm] only does it with --stats or
+//   --stats-json.
+
+typedef struct wendy_stats {
+	uint64_t opcode_counts[OPCODE_COUNT];
+	// Time spent in each opcode, in stats_ticks() units.
+	uint64_t opcode_ticks[OPCODE_COUNT];
+	uint64_t allocations;
+	uint64_t allocated_cells;
+	uint64_t collections;
+	uint64_t gc_pause_ns;
+	uint64_t gc_max_pause_ns;
+	uint64_t reclaimed_cells;
+	// Cells in use on the heap, recomputed after every collection.
+	uint64_t heap_cells;
+	uint64_t peak_heap_cells;
+	address peak_stack_pointer;
+	address peak_operand_stack;
+} wendy_stats;
+
+// stats_start() records the time the program started running.
+void stats_start(void);
+
+// stats_ticks() returns a fast timestamp, the CPU cycle counter on x86-64 and
+//   nanoseconds elsewhere.
+uint64_t stats_ticks(void);
+
+// stats_now_ns() returns a monotonic timestamp in nanoseconds.
+uint64_t stats_now_ns(void);
+
+// stats_wall_ns() returns the nanoseconds since stats_start().
+uint64_t stats_wall_ns(void);
+
+// stats_free_cells(blocks) returns the number of free memory cells and stores
+//   the length of the free list in blocks if it's not NULL.
+size_t stats_free_cells(size_t* blocks);
+
+// stats_print(buffer) prints all counters in a readable table.
+void stats_print(FILE* buffer);
+
+// stats_write_json(path) writes all counters to path as a JSON object.
+void stats_write_json(char* path);
+
+#endif
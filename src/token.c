@@ -1,6 +1,8 @@
 #include "token.h"
 #include "global.h"
 #include "memory.h"
+#include "dtoa.h"
+#include "state.h"
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
@@ -10,8 +12,8 @@ const char* token_string[] = {
 	FOREACH_TOKEN(STRING)
 };
 
-static int line;
-static int col;
+static THREAD_LOCAL int line;
+static THREAD_LOCAL int col;
 
 void set_make_token_param(int l, int c) {
 	line = l;
@@ -47,10 +49,17 @@ token empty_token() {
 }
 
 token make_token(token_type t, token_data d) {
-	token token_ = { t, 0, 0, d };
+	token token_ = { t, 0, 0, 0, 0, d };
 	return token_;
 }
 
+char* token_text(token t, arena* a) {
+	if (t.t_type != T_NUMBER && t.t_data.string) {
+		return t.t_data.string;
+	}
+	return arena_strndup(a, t.t_lexeme, t.t_length);
+}
+
 token_data make_data_num(double i) {
 	token_data d;
 	d.number = i;
@@ -58,41 +67,32 @@ token_data make_data_num(double i) {
 }
 
 token_data make_data_str(char* s) {
-	size_t len = strlen(s);
 	token_data d;
-	d.string = safe_malloc(len + 1);
-	strcpy(d.string, s);
+	d.string = s;
 	return d;
 }
 
 void print_token(const token* t) {
 	print_token_inline(t, stdout);
 	printf("\n");
-	last_printed_newline = true;
+	vm->last_printed_newline = true;
 	fflush(stdout);
 }
 
 unsigned int print_token_inline(const token* t, FILE* buf) {
 	unsigned int p = 0;
 	if (t->t_type == T_NUMBER) {
-		size_t len = snprintf(0, 0, "%f", t->t_data.number);
-		char* buffer = safe_malloc(len + 1);
-		snprintf(buffer, len + 1, "%f", t->t_data.number);
-		len--;
-		while (buffer[len] == '0') {
-			buffer[len--] = 0;
-		}
-		if (buffer[len] == '.') {
-			buffer[len--] = 0;
-		}
-
-		p += fprintf(buf, "%s", buffer);
-		safe_free(buffer);
+		char buffer[NUMBER_BUFFER_SIZE];
+		p += fprintf(buf, "%.*s", (int)format_number(t->t_data.number, buffer),
+			buffer);
 	}
-	else {
+	else if (t->t_data.string) {
 		p += fprintf(buf, "%s", t->t_data.string);
 	}
-	last_printed_newline = false;
+	else {
+		p += fprintf(buf, "%.*s", t->t_length, t->t_lexeme);
+	}
+	vm->last_printed_newline = false;
 	fflush(buf);
 	return p;
 }
@@ -132,16 +132,3 @@ int precedence(token op) {
 			return 0;
 	}
 }
-
-inline void destroy_token(token l) {
-	if (l.t_type != T_NUMBER) {
-        safe_free(l.t_data.string);
-    }
-}
-
-void free_token_list(token* l, size_t s) {
-	for (size_t i = 0; i < s; i++) {
-        destroy_token(l[i]);
-	}
-	safe_free(l);
-}
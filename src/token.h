@@ -2,6 +2,7 @@
 #define TOKEN_H
 
 #include "global.h"
+#include "arena.h"
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -65,6 +66,7 @@
 	OP(T_LOOP) \
 	OP(T_DEFFN) \
 	OP(T_RET) \
+	OP(T_YIELD) \
 	OP(T_INPUT) \
 	OP(T_INC) \
 	OP(T_DEC) \
@@ -86,20 +88,30 @@ typedef union {
 	char* string;
 } token_data;
 
+// Tokens refer to their characters in the source instead of copying them.
+//   t_data holds the value of numbers, and the text of tokens whose value
+//   isn't their lexeme, like strings with escapes, and is 0 otherwise.
 typedef struct {
 	token_type t_type;
 	int t_line;
 	int t_col;
+	int t_length;
+	const char* t_lexeme; // not null terminated
 	token_data t_data;
 } token;
 
 // make_token(t, d) returns a new token
 token make_token(token_type t, token_data d);
 
+// token_text(t, a) returns the text of the token, copied to the arena a unless
+//   the token has a string of its own
+char* token_text(token t, arena* a);
+
 // make_data_int(i) makes a data union with the integer provided
 token_data make_data_num(double i);
 
-// makeDataStr(s) makes a data union with the string provided
+// make_data_str(s) makes a data union that refers to the string provided, the
+//   string isn't copied and has to outlive the token
 token_data make_data_str(char* s);
 
 // none_token() returns a none token
@@ -128,10 +140,4 @@ int precedence(token op);
 //   the scanner
 void set_make_token_param(int l, int c);
 
-// destroys_token(t) frees all memory associated with the token
-void destroy_token(token t);
-
-// free_token_list(l) frees the token list and associated strings
-void free_token_list(token* l, size_t s);
-
 #endif
@@ -7,34 +7,52 @@
 #include "global.h"
 #include "native.h"
 #include "imports.h"
+#include "jit.h"
+#include "stats.h"
+#include "files.h"
+#include "dtoa.h"
+#include "state.h"
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <limits.h>
 #include <stdarg.h>
 
-static address memory_register = 0;
-static address memory_register_A = 0;
-static int line;
-static address i = 0;
-static uint8_t* bytecode = 0;
-static size_t bytecode_size = 0;
-static char* last_pushed_identifier;
-
 // Forward Declarations
 static data eval_binop(operator op, data a, data b);
 static data eval_uniop(operator op, data a);
+static void record_binary_site(address site, operator op, data a, data b,
+		bool reversed);
 static data type_of(data a);
 static data size_of(data a);
 static data value_of(data a);
 static data char_of(data a);
 
 address get_instruction_pointer() {
-	return i;
+	return vm->ip;
+}
+
+int get_current_line() {
+	return vm->line;
+}
+
+void vm_cleanup() {
+	if (vm->binary_feedback) {
+		safe_free(vm->binary_feedback);
+		vm->binary_feedback = 0;
+	}
+	if (vm->quickened_sites) {
+		safe_free(vm->quickened_sites);
+		vm->quickened_sites = 0;
+	}
+	vm->binary_feedback_size = 0;
+	vm->quickened_count = 0;
+	vm->quickened_capacity = 0;
 }
 
 void vm_cleanup_if_repl() {
-	safe_free(bytecode);
+	vm_cleanup();
+	safe_free(vm->bytecode);
 }
 
 #define num_args(...) (sizeof((char*[]){__VA_ARGS__})/sizeof(char*))
@@ -102,657 +120,1153 @@ static char* get_print_overload_name(data a) {
 	return fn_name;
 }
 
-void vm_run(uint8_t* new_bytecode, size_t size) {
-	if (get_settings_flag(SETTINGS_DRY_RUN)) {
+// Each opcode is implemented by its own handler below. On entry to a
+//   handler, vm->ip points to the first byte after the opcode. The interpreter
+//   loop dispatches to them with a switch, and the [jit] module calls them
+//   directly from compiled code.
+static void op_call(void);
+
+static void op_push(void) {
+	data t = get_data(vm->bytecode + vm->ip, &vm->ip);
+	data d;
+	if (t.type == D_IDENTIFIER) {
+		if (streq(t.value.string, "time")) {
+			d = time_data();
+		}
+		else {
+			d = copy_data(*get_value_of_id(t.value.string, vm->line));
+		}
+	}
+	else {
+		d = copy_data(t);
+	}
+	vm->last_pushed_identifier = t.value.string;
+	push_arg(d, vm->line);
+}
+
+static void op_src(void) {
+	void* ad = &vm->bytecode[vm->ip];
+	vm->line = get_address(ad, &vm->ip);
+}
+
+static void op_pop(void) {
+	data r = pop_arg(vm->line);
+	destroy_data(&r);
+}
+
+static void op_bin(void) {
+	operator op = vm->bytecode[vm->ip++];
+	data b = pop_arg(vm->line);
+	data a = pop_arg(vm->line);
+	data any_d = any_data();
+	char* a_and_b = get_binary_overload_name(op, a, b);
+	char* any_a = get_binary_overload_name(op, any_d, b);
+	char* any_b = get_binary_overload_name(op, a, any_d);
+	destroy_data(&any_d);
+	char* fn_name = first_that(_id_exist, a_and_b, any_a, any_b);
+	if (fn_name) {
+		push_arg(make_data(D_END_OF_ARGUMENTS, data_value_num(0)),
+			vm->line);
+		push_arg(b, vm->line);
+		push_arg(a, vm->line);
+		push_arg(copy_data(*get_value_of_id(fn_name, vm->line)), vm->line);
+		safe_free(a_and_b);
+		safe_free(any_a);
+		safe_free(any_b);
+		op_call();
 		return;
 	}
-	// Verify Header
-	address start_at;
-	size_t saved_size = bytecode_size;
-	if (!get_settings_flag(SETTINGS_REPL)) {
-		bytecode = new_bytecode;
-		start_at = verify_header(bytecode);
+	else {
+		record_binary_site(vm->ip - 2, op, a, b, false);
+		push_arg(eval_binop(op, a, b), vm->line);
+		destroy_data(&a);
+		destroy_data(&b);
+	}
+	safe_free(a_and_b);
+	safe_free(any_a);
+	safe_free(any_b);
+}
+
+static void op_rbin(void) {
+	operator op = vm->bytecode[vm->ip++];
+	data a = pop_arg(vm->line);
+	data b = pop_arg(vm->line);
+	data any_d = any_data();
+	char* a_and_b = get_binary_overload_name(op, a, b);
+	char* any_a = get_binary_overload_name(op, any_d, b);
+	char* any_b = get_binary_overload_name(op, a, any_d);
+	destroy_data(&any_d);
+	char* fn_name = first_that(_id_exist, a_and_b, any_a, any_b);
+	if (fn_name) {
+		push_arg(make_data(D_END_OF_ARGUMENTS, data_value_num(0)),
+			vm->line);
+		push_arg(a, vm->line);
+		push_arg(b, vm->line);
+		push_arg(copy_data(*get_value_of_id(fn_name, vm->line)), vm->line);
+		safe_free(a_and_b);
+		safe_free(any_a);
+		safe_free(any_b);
+		op_call();
+		return;
 	}
 	else {
-		// REPL Bytecode has no headers!
-		// Resize Bytecode Block, Offset New Addresses, Push to End
-		bytecode_size += size;
-		if (bytecode) {
-			// This gets rid of the OP_HALT from the previous chain of BC
-			bytecode_size--;
-			bytecode = safe_realloc(bytecode, bytecode_size * sizeof(uint8_t));
+		record_binary_site(vm->ip - 2, op, a, b, true);
+		push_arg(eval_binop(op, a, b), vm->line);
+		destroy_data(&a);
+		destroy_data(&b);
+	}
+	safe_free(a_and_b);
+	safe_free(any_a);
+	safe_free(any_b);
+}
+
+// Quickening: once a BIN or RBIN site has seen operands with a specialized
+//   form QUICKEN_THRESHOLD times in a row, and no overload applied to them, the
+//   instruction is rewritten in place into one of the typed opcodes below.
+//   Those work directly on the top of the argument stack. If the operand types
+//   change, or an overload has been bound since, the site is restored to its
+//   generic form and handled by op_bin/op_rbin. Sites that keep missing are
+//   left generic after QUICKEN_MAX_MISSES restorations.
+#define QUICKEN_THRESHOLD 2
+#define QUICKEN_MAX_MISSES 4
+
+static opcode quickened_form(operator op, data a, data b) {
+	if (a.type == D_NUMBER && b.type == D_NUMBER) {
+		switch (op) {
+			case O_ADD: return OP_ADDNN;
+			case O_SUB: return OP_SUBNN;
+			case O_MUL: return OP_MULNN;
+			case O_DIV: return OP_DIVNN;
+			case O_LT: return OP_LTNN;
+			case O_GT: return OP_GTNN;
+			case O_LTE: return OP_LTENN;
+			case O_GTE: return OP_GTENN;
+			case O_EQ: return OP_EQNN;
+			case O_NEQ: return OP_NEQNN;
+			default: break;
+		}
+	}
+	else if (a.type == D_STRING && b.type == D_STRING && op == O_ADD) {
+		return OP_CATSS;
+	}
+	return OP_BIN;
+}
+
+static void deoptimize_site(address site) {
+	uint8_t o = vm->bytecode[site + 1];
+	vm->bytecode[site] = (o & QUICKENED_REVERSED) ? OP_RBIN : OP_BIN;
+	vm->bytecode[site + 1] = o & ~QUICKENED_REVERSED;
+	vm->binary_feedback[site].hits = 0;
+}
+
+// deoptimize_all() restores every quickened site. Used when an overload is
+//   bound, since any of them may now resolve to it.
+static void deoptimize_all(void) {
+	for (size_t n = 0; n < vm->quickened_count; n++) {
+		if (is_quickened_opcode(vm->bytecode[vm->quickened_sites[n]])) {
+			deoptimize_site(vm->quickened_sites[n]);
+		}
+	}
+	vm->quickened_count = 0;
+	vm->quickened_epoch = vm->overload_epoch;
+}
+
+// record_binary_site(site, op, a, b, reversed) records the operand types seen
+//   by the generic BIN (or RBIN if reversed) at site, quickening it if they
+//   have been the same specializable kind long enough.
+static void record_binary_site(address site, operator op, data a, data b,
+		bool reversed) {
+	if (site >= vm->binary_feedback_size) {
+		return;
+	}
+	site_feedback* feedback = &vm->binary_feedback[site];
+	opcode form = quickened_form(op, a, b);
+	if (form == OP_BIN || feedback->misses >= QUICKEN_MAX_MISSES) {
+		feedback->hits = 0;
+		return;
+	}
+	if (++feedback->hits < QUICKEN_THRESHOLD) {
+		return;
+	}
+	if (vm->overload_epoch != vm->quickened_epoch) {
+		deoptimize_all();
+	}
+	if (vm->quickened_count == vm->quickened_capacity) {
+		vm->quickened_capacity = vm->quickened_capacity ? vm->quickened_capacity * 2 : 16;
+		if (vm->quickened_sites) {
+			vm->quickened_sites = safe_realloc(vm->quickened_sites,
+				vm->quickened_capacity * sizeof(address));
 		}
 		else {
-			bytecode = safe_malloc(bytecode_size * sizeof(uint8_t));
+			vm->quickened_sites = safe_malloc(vm->quickened_capacity * sizeof(address));
+		}
+	}
+	vm->quickened_sites[vm->quickened_count++] = site;
+	vm->bytecode[site] = form;
+	vm->bytecode[site + 1] = op | (reversed ? QUICKENED_REVERSED : 0);
+}
+
+// quickened_operands(type, lhs, rhs) checks the guard of the quickened
+//   instruction whose operator byte is at vm->ip. On success it stores the
+//   left and right operands, which are the top two cells of the argument
+//   stack, and returns true. Otherwise the site is deoptimized, the generic handler is
+//   run in its place, and false is returned.
+static bool quickened_operands(data_type type, data** lhs, data** rhs) {
+	address site = vm->ip - 1;
+	uint8_t o = vm->bytecode[vm->ip];
+	if (vm->overload_epoch == vm->quickened_epoch && vm->arg_pointer + 2 < MEMORY_SIZE) {
+		data* top = &vm->memory[vm->arg_pointer + 1];
+		data* below = top + 1;
+		if (top->type == type && below->type == type) {
+			bool reversed = o & QUICKENED_REVERSED;
+			*lhs = reversed ? top : below;
+			*rhs = reversed ? below : top;
+			vm->ip++;
+			return true;
+		}
+	}
+	if (vm->overload_epoch != vm->quickened_epoch) {
+		deoptimize_all();
+	}
+	else {
+		vm->binary_feedback[site].misses++;
+		deoptimize_site(site);
+	}
+	if (vm->bytecode[site] == OP_RBIN) {
+		op_rbin();
+	}
+	else {
+		op_bin();
+	}
+	return false;
+}
+
+// pop_quickened_result(result) pops the right hand cell and replaces the
+//   remaining operand with result. Only valid when both operands are numbers.
+static void pop_quickened_result(data result) {
+	vm->arg_pointer++;
+	vm->memory[vm->arg_pointer].type = D_EMPTY;
+	vm->memory[vm->arg_pointer + 1] = result;
+}
+
+#define QUICKENED_NUMBER_OP(name, expression) \
+	static void name(void) { \
+		data* lhs; \
+		data* rhs; \
+		if (quickened_operands(D_NUMBER, &lhs, &rhs)) { \
+			double l = lhs->value.number; \
+			double r = rhs->value.number; \
+			pop_quickened_result(expression); \
+		} \
+	}
+
+#define num_result(n) make_data(D_NUMBER, data_value_num(n))
+#define bool_result(b) ((b) ? true_data() : false_data())
+
+QUICKENED_NUMBER_OP(op_addnn, num_result(l + r))
+QUICKENED_NUMBER_OP(op_subnn, num_result(l - r))
+QUICKENED_NUMBER_OP(op_mulnn, num_result(l * r))
+QUICKENED_NUMBER_OP(op_ltnn, bool_result(l < r))
+QUICKENED_NUMBER_OP(op_gtnn, bool_result(l > r))
+QUICKENED_NUMBER_OP(op_ltenn, bool_result(l <= r))
+QUICKENED_NUMBER_OP(op_gtenn, bool_result(l >= r))
+QUICKENED_NUMBER_OP(op_eqnn, bool_result(l == r))
+QUICKENED_NUMBER_OP(op_neqnn, bool_result(l != r))
+
+static void op_divnn(void) {
+	data* lhs;
+	data* rhs;
+	if (quickened_operands(D_NUMBER, &lhs, &rhs)) {
+		if (rhs->value.number == 0) {
+			error_runtime(vm->line, VM_MATH_DISASTER);
+			return;
 		}
-		if (saved_size != 0) {
-			start_at = saved_size - 1;
+		pop_quickened_result(num_result(lhs->value.number / rhs->value.number));
+	}
+}
+
+static void op_catss(void) {
+	data* lhs;
+	data* rhs;
+	if (quickened_operands(D_STRING, &lhs, &rhs)) {
+		size_t l = strlen(lhs->value.string);
+		size_t r = strlen(rhs->value.string);
+		data_value result;
+		result.string = safe_malloc((l + r + 1) * sizeof(char));
+		memcpy(result.string, lhs->value.string, l);
+		memcpy(result.string + l, rhs->value.string, r + 1);
+		vm->arg_pointer++;
+		destroy_data(&vm->memory[vm->arg_pointer]);
+		destroy_data(&vm->memory[vm->arg_pointer + 1]);
+		vm->memory[vm->arg_pointer + 1] = make_data(D_STRING, result);
+	}
+}
+
+#undef num_result
+#undef bool_result
+#undef QUICKENED_NUMBER_OP
+
+static void op_una(void) {
+	operator op = vm->bytecode[vm->ip++];
+	data a = pop_arg(vm->line);
+	char* fn_name = get_unary_overload_name(op, a);
+	if (id_exist(fn_name, true)) {
+		push_arg(make_data(D_END_OF_ARGUMENTS, data_value_num(0)),
+			vm->line);
+		push_arg(a, vm->line);
+		push_arg(copy_data(*get_value_of_id(fn_name, vm->line)), vm->line);
+		safe_free(fn_name);
+		op_call();
+		return;
+	}
+	else {
+		push_arg(eval_uniop(op, a), vm->line);
+		destroy_data(&a);
+	}
+	safe_free(fn_name);
+}
+
+static void op_native(void) {
+	void* ag = &vm->bytecode[vm->ip];
+	address args = get_address(ag, &vm->ip);
+	char* name = get_string(vm->bytecode + vm->ip, &vm->ip);
+	native_call(name, args, vm->line);
+}
+
+static void op_bind(void) {
+	char *id = get_string(vm->bytecode + vm->ip, &vm->ip);
+	if (id_exist(id, false)) {
+		error_runtime(vm->line, VM_VAR_DECLARED_ALREADY, id);
+	}
+	else {
+		push_stack_entry(id, vm->memory_register, vm->line);
+	}
+}
+
+static void op_where(void) {
+	char* id = get_string(vm->bytecode + vm->ip, &vm->ip);
+	vm->memory_register = get_address_of_id(id, vm->line);
+	vm->memory_register_A = vm->memory_register;
+}
+
+static void op_import(void) {
+	char* name = get_string(vm->bytecode + vm->ip, &vm->ip);
+	address a = get_address(vm->bytecode + vm->ip, &vm->ip);
+	if (has_already_imported_library(name)) {
+		vm->ip = a;
+	}
+	else {
+		add_imported_library(name);
+	}
+}
+
+static void op_argcln(void) {
+	// TODO: This instruction can be modified to support
+	//   variable arguments.
+	data* extra_args = safe_malloc(ARGSTACK_SIZE *
+								   sizeof(extra_args));
+	size_t count = 0;
+	while (top_arg(vm->line)->type != D_END_OF_ARGUMENTS) {
+		if (top_arg(vm->line)->type == D_NAMED_ARGUMENT_NAME) {
+			data identifier = pop_arg(vm->line);
+			address loc =
+				get_address_of_id(identifier.value.string, vm->line);
+			write_memory(loc, pop_arg(vm->line), vm->line);
+			destroy_data(&identifier);
 		}
 		else {
-			start_at = 0;
+			data r = pop_arg(vm->line);
+			extra_args[count++] = r;
 		}
-		offset_addresses(new_bytecode, size, start_at);
-		for (size_t i = 0; i < size; i++) {
-			bytecode[start_at + i] = new_bytecode[i];
+	}
+	// Assign "arguments" variable with rest of the arguments.
+	address ladr = push_memory_wendy_list(extra_args, count, vm->line);
+	address adr = push_memory(make_data(D_LIST, data_value_num(ladr)), vm->line);
+	push_stack_entry("arguments", adr, vm->line);
+	safe_free(extra_args);
+	// Pop End of Arguments
+	pop_arg(vm->line);
+}
+
+static void op_ret(void) {
+	pop_frame(true, &vm->ip);
+	vm->memory_register = pop_mem_reg();
+}
+
+static void op_ljmp(void) {
+	// L_JMP Address LoopIndexString
+	address end_of_loop = get_address(vm->bytecode + vm->ip, &vm->ip);
+	char* loop_index_string = get_string(vm->bytecode + vm->ip, &vm->ip);
+	data* loop_index_data = get_value_of_id(loop_index_string, vm->line);
+	int index = loop_index_data->value.number;
+	data condition = *top_arg(vm->line);
+	bool jump = false;
+	if (condition.type == D_TRUE) {
+		// Do Nothing
+	}
+	else if (is_list(&condition)) {
+		if (index >= list_size(&condition)) jump = true;
+	}
+	else if (condition.type == D_RANGE) {
+		int end = range_end(condition);
+		int start = range_start(condition);
+		if (start < end) {
+			if (start + index >= end) jump = true;
+		}
+		else {
+			if (start - index <= end) jump = true;
 		}
 	}
-	for (i = start_at;;) {
-		reset_error_flag();
-		opcode op = bytecode[i];
-		if (get_settings_flag(SETTINGS_TRACE_VM)) {
-			// This branch could slow down the VM but the CPU should branch
-			// predict after one or two iterations.
-			printf(BLU "<+%04X>: " RESET "%s\n", i, opcode_string[op]);
+	else if (condition.type == D_STRING) {
+		int size = strlen(condition.value.string);
+		if (index >= size) jump = true;
+	}
+	else if (condition.type == D_ITERATOR) {
+		// Iterators move to the next item here, LBIND only reads it.
+		if (!file_advance(condition.value.number)) jump = true;
+	}
+	else if (condition.type == D_GENERATOR) {
+		if (index == 0) {
+			// Later iterations resume this generator instead of evaluating
+			//   the condition again, see LGEN.
+			char name[MAX_IDENTIFIER_LEN + 1];
+			snprintf(name, sizeof(name), "%s" LOOP_GENERATOR_SUFFIX,
+				loop_index_string);
+			push_stack_entry(name, push_memory(condition, vm->line), vm->line);
 		}
-		i += 1;
-		switch (op) {
-			case OP_PUSH: {
-				data t = get_data(bytecode + i, &i);
-				data d;
-				if (t.type == D_IDENTIFIER) {
-					if (streq(t.value.string, "time")) {
-						d = time_data();
-					}
-					else {
-						d = copy_data(*get_value_of_id(t.value.string, line));
-					}
-				}
-				else {
-					d = copy_data(t);
-				}
-				last_pushed_identifier = t.value.string;
-				push_arg(d, line);
-				break;
-			}
-			case OP_SRC: {
-				void* ad = &bytecode[i];
-				line = get_address(ad, &i);
-				break;
-			}
-			case OP_POP: {
-				data r = pop_arg(line);
-				destroy_data(&r);
-				break;
-			}
-			case OP_BIN: {
-				operator op = bytecode[i++];
-				data b = pop_arg(line);
-				data a = pop_arg(line);
-				data any_d = any_data();
-				char* a_and_b = get_binary_overload_name(op, a, b);
-				char* any_a = get_binary_overload_name(op, any_d, b);
-				char* any_b = get_binary_overload_name(op, a, any_d);
-				destroy_data(&any_d);
-				char* fn_name = first_that(_id_exist, a_and_b, any_a, any_b);
-				if (fn_name) {
-					push_arg(make_data(D_END_OF_ARGUMENTS, data_value_num(0)),
-						line);
-					push_arg(b, line);
-					push_arg(a, line);
-					push_arg(copy_data(*get_value_of_id(fn_name, line)), line);
-					safe_free(a_and_b);
-					safe_free(any_a);
-					safe_free(any_b);
-					goto wendy_vm_call;
-				}
-				else {
-					push_arg(eval_binop(op, a, b), line);
-					destroy_data(&a);
-					destroy_data(&b);
-				}
-				safe_free(a_and_b);
-				safe_free(any_a);
-				safe_free(any_b);
-				break;
-			}
-			case OP_RBIN: {
-				operator op = bytecode[i++];
-				data a = pop_arg(line);
-				data b = pop_arg(line);
-				data any_d = any_data();
-				char* a_and_b = get_binary_overload_name(op, a, b);
-				char* any_a = get_binary_overload_name(op, any_d, b);
-				char* any_b = get_binary_overload_name(op, a, any_d);
-				destroy_data(&any_d);
-				char* fn_name = first_that(_id_exist, a_and_b, any_a, any_b);
-				if (fn_name) {
-					push_arg(make_data(D_END_OF_ARGUMENTS, data_value_num(0)),
-						line);
-					push_arg(a, line);
-					push_arg(b, line);
-					push_arg(copy_data(*get_value_of_id(fn_name, line)), line);
-					safe_free(a_and_b);
-					safe_free(any_a);
-					safe_free(any_b);
-					goto wendy_vm_call;
-				}
-				else {
-					push_arg(eval_binop(op, a, b), line);
-					destroy_data(&a);
-					destroy_data(&b);
-				}
-				safe_free(a_and_b);
-				safe_free(any_a);
-				safe_free(any_b);
-				break;
-			}
-			case OP_UNA: {
-				operator op = bytecode[i++];
-				data a = pop_arg(line);
-				char* fn_name = get_unary_overload_name(op, a);
-				if (id_exist(fn_name, true)) {
-					push_arg(make_data(D_END_OF_ARGUMENTS, data_value_num(0)),
-						line);
-					push_arg(a, line);
-					push_arg(copy_data(*get_value_of_id(fn_name, line)), line);
-					safe_free(fn_name);
-					goto wendy_vm_call;
-				}
-				else {
-					push_arg(eval_uniop(op, a), line);
-					destroy_data(&a);
-				}
-				safe_free(fn_name);
-				break;
-			}
-			case OP_NATIVE: {
-				void* ag = &bytecode[i];
-				address args = get_address(ag, &i);
-				char* name = get_string(bytecode + i, &i);
-				native_call(name, args, line);
-				break;
-			}
-			case OP_BIND: {
-				char *id = get_string(bytecode + i, &i);
-				if (id_exist(id, false)) {
-					error_runtime(line, VM_VAR_DECLARED_ALREADY, id);
-				}
-				else {
-					push_stack_entry(id, memory_register, line);
-				}
-				break;
-			}
-			case OP_WHERE: {
-				char* id = get_string(bytecode + i, &i);
-				memory_register = get_address_of_id(id, line);
-				memory_register_A = memory_register;
-				break;
-			}
-			case OP_IMPORT: {
-				char* name = get_string(bytecode + i, &i);
-				address a = get_address(bytecode + i, &i);
-				if (has_already_imported_library(name)) {
-					i = a;
-				}
-				else {
-					add_imported_library(name);
-				}
-				break;
-			}
-			case OP_ARGCLN: {
-				// TODO: This instruction can be modified to support
-				//   variable arguments.
-				data* extra_args = safe_malloc(ARGSTACK_SIZE *
-											   sizeof(extra_args));
-				size_t count = 0;
-				while (top_arg(line)->type != D_END_OF_ARGUMENTS) {
-					if (top_arg(line)->type == D_NAMED_ARGUMENT_NAME) {
-						data identifier = pop_arg(line);
-						address loc =
-							get_address_of_id(identifier.value.string, line);
-						write_memory(loc, pop_arg(line), line);
-						destroy_data(&identifier);
-					}
-					else {
-						data r = pop_arg(line);
-						extra_args[count++] = r;
-					}
-				}
-				// Assign "arguments" variable with rest of the arguments.
-				address ladr = push_memory_wendy_list(extra_args, count, line);
-				address adr = push_memory(make_data(D_LIST, data_value_num(ladr)), line);
-				push_stack_entry("arguments", adr, line);
-				safe_free(extra_args);
-				// Pop End of Arguments
-				pop_arg(line);
-				break;
-			}
-			case OP_RET: {
-				pop_frame(true, &i);
-				memory_register = pop_mem_reg();
-				break;
-			}
-			case OP_LJMP: {
-				// L_JMP Address LoopIndexString
-				address end_of_loop = get_address(bytecode + i, &i);
-				char* loop_index_string = get_string(bytecode + i, &i);
-				data* loop_index_data = get_value_of_id(loop_index_string, line);
-				int index = loop_index_data->value.number;
-				data condition = *top_arg(line);
-				bool jump = false;
-				if (condition.type == D_TRUE) {
-					// Do Nothing
-				}
-				else if (condition.type == D_LIST) {
-					address lst = condition.value.number;
-					int lst_size = memory[lst].value.number;
-					if (index >= lst_size) jump = true;
-				}
-				else if (condition.type == D_RANGE) {
-					int end = range_end(condition);
-					int start = range_start(condition);
-					if (start < end) {
-						if (start + index >= end) jump = true;
-					}
-					else {
-						if (start - index <= end) jump = true;
-					}
-				}
-				else if (condition.type == D_STRING) {
-					int size = strlen(condition.value.string);
-					if (index >= size) jump = true;
-				}
-				else {
-					jump = true;
-				}
-				if (jump)  {
-					// Pop Condition too!
-					data res = pop_arg(line);
-					destroy_data(&res);
-					i = end_of_loop;
-				}
-				break;
-			}
-			case OP_LBIND: {
-				char* user_index = get_string(bytecode + i, &i);
-				char* loop_index_string = get_string(bytecode + i, &i);
-				data* loop_index_data = get_value_of_id(loop_index_string, line);
-				int index = loop_index_data->value.number;
-				data condition = pop_arg(line);
-				data res;
-				if (condition.type == D_LIST) {
-					address lst = condition.value.number;
-					res = copy_data(memory[lst + 1 + index]);
-				}
-				else if (condition.type == D_RANGE) {
-					int end = range_end(condition);
-					int start = range_start(condition);
-					if (start < end) {
-						res = make_data(D_NUMBER, data_value_num(start + index));
-					}
-					else {
-						res = make_data(D_NUMBER, data_value_num(start - index));
-					}
-				}
-				else if (condition.type == D_STRING) {
-					data r = make_data(D_STRING, data_value_str(" "));
-					r.value.string[0] = condition.value.string[index];
-					r.value.string[1] = 0;
-					res = r;
-				}
-				else {
-					res = copy_data(*loop_index_data);
-				}
-				address mem_to_mod = get_address_of_id(user_index, line);
-				write_memory(mem_to_mod, res, -1);
-				destroy_data(&condition);
-				break;
-			}
-			case OP_INC: {
-				if (memory[memory_register].type != D_NUMBER) {
-					error_runtime(line, VM_TYPE_ERROR, "INC");
-					continue;
-				}
-				memory[memory_register].value.number++;
-				break;
-			}
-			case OP_DEC: {
-				if (memory[memory_register].type != D_NUMBER) {
-					error_runtime(line, VM_TYPE_ERROR, "DEC");
-					continue;
-				}
-				memory[memory_register].value.number--;
-				break;
-			}
-			case OP_ASSERT: {
-				data_type matching = bytecode[i++];
-				char* c = get_string(bytecode + i, &i);
-				if (memory[memory_register].type != matching) {
-					error_runtime(line, c);
-				}
-				break;
-			}
-			case OP_FRM: {
-				push_auto_frame(i, "automatic", line);
-				push_mem_reg(memory_register, line);
-				break;
-			}
-			case OP_MPTR: {
-				memory_register = (address)memory[memory_register].value.number;
-				break;
-			}
-			case OP_END: {
-				pop_frame(false, &i);
-				memory_register = pop_mem_reg();
-				break;
-			}
-			case OP_REQ: {
-				memory_register = pls_give_memory(bytecode[i++], line);
-				break;
-			}
-			case OP_RBW: {
-				// REQUEST BIND AND WRITE
-				char* bind_name = get_string(bytecode + i, &i);
-				memory_register = pls_give_memory(1, line);
-				if (id_exist(bind_name, false)) {
-					address a = get_stack_pos_of_id(bind_name, line);
-					if (!call_stack[a].is_closure) {
-						error_runtime(line, VM_VAR_DECLARED_ALREADY, bind_name);
-					}
-				}
-				push_stack_entry(bind_name, memory_register, line);
-				if (top_arg(line)->type == D_END_OF_ARGUMENTS ||
-					top_arg(line)->type == D_NAMED_ARGUMENT_NAME)
-					break;
-				data value = pop_arg(line);
-				if (value.type == D_FUNCTION) {
-					// Modify Name to be the base_name
-					address fn_adr = value.value.number;
-					memory[fn_adr + 2].value.string =
-						safe_realloc(memory[fn_adr + 2].value.string,
-							strlen(bind_name) + 1);
-					strcpy(memory[fn_adr + 2].value.string, bind_name);
-				}
-				write_memory(memory_register, value, line);
-				break;
-			}
-			case OP_MKPTR: {
-				push_arg(make_data((data_type) bytecode[i++],
-					data_value_num(memory_register)), line);
-				break;
-			}
-			case OP_NTHPTR: {
-				// Should be a list at the memory register.
-				data lst = memory[memory_register];
-				if (lst.type != D_LIST) {
-					error_runtime(line, VM_NOT_A_LIST);
-				}
-				address lst_start = lst.value.number;
-				data in = pop_arg(line);
-				if (in.type != D_NUMBER) {
-					error_runtime(line, VM_INVALID_LVALUE_LIST_SUBSCRIPT);
-				}
-				int lst_size = memory[lst_start].value.number;
-				int index = in.value.number;
-				if (index >= lst_size) {
-					error_runtime(line, VM_LIST_REF_OUT_RANGE);
+		// Generators run to their next value here, LBIND only takes it.
+		if (!generator_advance(condition, vm->line)) jump = true;
+	}
+	else {
+		jump = true;
+	}
+	if (jump)  {
+		// Pop Condition too!
+		data res = pop_arg(vm->line);
+		destroy_data(&res);
+		vm->ip = end_of_loop;
+	}
+}
+
+static void op_lbind(void) {
+	char* user_index = get_string(vm->bytecode + vm->ip, &vm->ip);
+	char* loop_index_string = get_string(vm->bytecode + vm->ip, &vm->ip);
+	data* loop_index_data = get_value_of_id(loop_index_string, vm->line);
+	int index = loop_index_data->value.number;
+	data condition = pop_arg(vm->line);
+	data res;
+	if (is_list(&condition)) {
+		res = copy_data(*list_element(&condition, index));
+	}
+	else if (condition.type == D_RANGE) {
+		int end = range_end(condition);
+		int start = range_start(condition);
+		if (start < end) {
+			res = make_data(D_NUMBER, data_value_num(start + index));
+		}
+		else {
+			res = make_data(D_NUMBER, data_value_num(start - index));
+		}
+	}
+	else if (condition.type == D_STRING) {
+		data r = make_data(D_STRING, data_value_str(" "));
+		r.value.string[0] = condition.value.string[index];
+		r.value.string[1] = 0;
+		res = r;
+	}
+	else if (condition.type == D_ITERATOR) {
+		size_t length;
+		const char* current = file_current_line(condition.value.number, &length);
+		res = make_data(D_STRING, data_value_size(length));
+		memcpy(res.value.string, current, length);
+	}
+	else if (condition.type == D_GENERATOR) {
+		res = generator_take(condition);
+	}
+	else {
+		res = copy_data(*loop_index_data);
+	}
+	address mem_to_mod = get_address_of_id(user_index, vm->line);
+	write_memory(mem_to_mod, res, -1);
+	destroy_data(&condition);
+}
+
+static void op_lgen(void) {
+	// L_GEN Address GeneratorName
+	address condition_end = get_address(vm->bytecode + vm->ip, &vm->ip);
+	char* name = get_string(vm->bytecode + vm->ip, &vm->ip);
+	// LJMP binds the generator last in the loop's frame.
+	stack_entry* last = &vm->call_stack[vm->stack_pointer - 1];
+	if (streq(last->id, name)) {
+		push_arg(copy_data(vm->memory[last->val]), vm->line);
+		vm->ip = condition_end;
+	}
+}
+
+static void op_gen(void) {
+	generator_create(vm->line);
+}
+
+static void op_yield(void) {
+	generator_yield(vm->line);
+}
+
+static void op_inc(void) {
+	if (vm->memory[vm->memory_register].type != D_NUMBER) {
+		error_runtime(vm->line, VM_TYPE_ERROR, "INC");
+		return;
+	}
+	vm->memory[vm->memory_register].value.number++;
+}
+
+static void op_dec(void) {
+	if (vm->memory[vm->memory_register].type != D_NUMBER) {
+		error_runtime(vm->line, VM_TYPE_ERROR, "DEC");
+		return;
+	}
+	vm->memory[vm->memory_register].value.number--;
+}
+
+static void op_assert(void) {
+	data_type matching = vm->bytecode[vm->ip++];
+	char* c = get_string(vm->bytecode + vm->ip, &vm->ip);
+	if (vm->memory[vm->memory_register].type != matching) {
+		error_runtime(vm->line, c);
+	}
+}
+
+static void op_frm(void) {
+	push_auto_frame(vm->ip, "automatic", vm->line);
+	push_mem_reg(vm->memory_register, vm->line);
+}
+
+static void op_mptr(void) {
+	vm->memory_register = (address)vm->memory[vm->memory_register].value.number;
+}
+
+static void op_end(void) {
+	pop_frame(false, &vm->ip);
+	vm->memory_register = pop_mem_reg();
+}
+
+static void op_req(void) {
+	vm->memory_register = pls_give_memory(vm->bytecode[vm->ip++], vm->line);
+}
+
+static void op_rbw(void) {
+	// REQUEST BIND AND WRITE
+	char* bind_name = get_string(vm->bytecode + vm->ip, &vm->ip);
+	vm->memory_register = pls_give_memory(1, vm->line);
+	if (id_exist(bind_name, false)) {
+		address a = get_stack_pos_of_id(bind_name, vm->line);
+		if (!vm->call_stack[a].is_closure) {
+			error_runtime(vm->line, VM_VAR_DECLARED_ALREADY, bind_name);
+		}
+	}
+	push_stack_entry(bind_name, vm->memory_register, vm->line);
+	if (top_arg(vm->line)->type == D_END_OF_ARGUMENTS ||
+		top_arg(vm->line)->type == D_NAMED_ARGUMENT_NAME)
+		return;
+	data value = pop_arg(vm->line);
+	if (value.type == D_FUNCTION) {
+		// Modify Name to be the base_name
+		address fn_adr = value.value.number;
+		vm->memory[fn_adr + 2].value.string =
+			safe_realloc(vm->memory[fn_adr + 2].value.string,
+				strlen(bind_name) + 1);
+		strcpy(vm->memory[fn_adr + 2].value.string, bind_name);
+	}
+	write_memory(vm->memory_register, value, vm->line);
+}
+
+static void op_mkptr(void) {
+	push_arg(make_data((data_type) vm->bytecode[vm->ip++],
+		data_value_num(vm->memory_register)), vm->line);
+}
+
+static void op_nthptr(void) {
+	// Should be a list at the memory register.
+	data lst = vm->memory[vm->memory_register];
+	if (!is_list(&lst)) {
+		error_runtime(vm->line, VM_NOT_A_LIST);
+		return;
+	}
+	address lst_start;
+	if (lst.type == D_LIST_VIEW) {
+		// The element is about to change, so the view gets elements of its
+		//   own, which copies of the view share.
+		lst_start = own_list_view(&vm->memory[vm->memory_register], vm->line);
+	}
+	else {
+		lst_start = lst.value.number;
+	}
+	if (vm->memory[lst_start].type == D_SHARED_LIST_HEADER) {
+		// Views of the list keep the elements as they were.
+		unshare_list(lst_start, vm->line);
+	}
+	data in = pop_arg(vm->line);
+	if (in.type != D_NUMBER) {
+		error_runtime(vm->line, VM_INVALID_LVALUE_LIST_SUBSCRIPT);
+	}
+	int lst_size = vm->memory[lst_start].value.number;
+	int index = in.value.number;
+	if (index >= lst_size) {
+		error_runtime(vm->line, VM_LIST_REF_OUT_RANGE);
+	}
+	vm->memory_register = lst_start + index + 1;
+	destroy_data(&in);
+}
+
+static void op_closur(void) {
+	// The operand lists the names the function uses but doesn't bind itself.
+	size_t count = vm->bytecode[vm->ip++];
+	address cloc;
+	if (count == CLOSURE_CAPTURE_ALL) {
+		cloc = create_closure(0, 0);
+	}
+	else {
+		char* names[CLOSURE_CAPTURE_ALL];
+		for (size_t n = 0; n < count; n++) {
+			names[n] = get_string(vm->bytecode + vm->ip, &vm->ip);
+		}
+		cloc = create_closure(names, count);
+	}
+	push_arg(make_data(D_CLOSURE, data_value_num(cloc)), vm->line);
+}
+
+static void op_memptr(void) {
+	// Member Pointer
+	// Structs can only modify Static members, instances modify instance
+	//   members.
+	// Either will be allowed to look through static parameters.
+	data t = vm->memory[vm->memory_register];
+	char* member = get_string(vm->bytecode + vm->ip, &vm->ip);
+	if (t.type != D_STRUCT && t.type != D_STRUCT_INSTANCE) {
+		if (t.type == D_NONERET) {
+			error_runtime(vm->line, VM_NOT_A_STRUCT_MAYBE_FORGOT_RET_THIS);
+		} else {
+			error_runtime(vm->line, VM_NOT_A_STRUCT);
+		}
+		return;
+	}
+	address metadata = (int)(t.value.number);
+	if (t.type == D_STRUCT_INSTANCE) {
+		// metadata actually points to the STRUCT_INSTANCE_HEAD
+		//   right now.
+		metadata = (address)(vm->memory[metadata].value.number);
+	}
+	data_type struct_type = t.type;
+	address struct_header = t.value.number;
+	bool found = false;
+	while(!found) {
+		int params_passed = 0;
+		int size = (int)(vm->memory[metadata].value.number);
+		for (int i = 0; i < size; i++) {
+			data mdata = vm->memory[metadata + i];
+			if (mdata.type == D_STRUCT_SHARED &&
+				streq(mdata.value.string, member)) {
+				// Found the static member we were looking for.
+				vm->memory_register = metadata + i + 1;
+				found = true;
+				if (vm->memory[vm->memory_register].type == D_FUNCTION) {
+					vm->memory[vm->memory_register].type = D_STRUCT_FUNCTION;
 				}
-				memory_register = lst_start + index + 1;
-				destroy_data(&in);
-				break;
-			}
-			case OP_CLOSUR: {
-				push_arg(make_data(D_CLOSURE, data_value_num(create_closure())), line);
 				break;
 			}
-			case OP_MEMPTR: {
-				// Member Pointer
-				// Structs can only modify Static members, instances modify instance
-				//   members.
-				// Either will be allowed to look through static parameters.
-				data t = memory[memory_register];
-				char* member = get_string(bytecode + i, &i);
-				if (t.type != D_STRUCT && t.type != D_STRUCT_INSTANCE) {
-					if (t.type == D_NONERET) {
-						error_runtime(line, VM_NOT_A_STRUCT_MAYBE_FORGOT_RET_THIS);
-					} else {
-						error_runtime(line, VM_NOT_A_STRUCT);
+			else if (mdata.type == D_STRUCT_PARAM) {
+				if (struct_type == D_STRUCT_INSTANCE &&
+					streq(mdata.value.string, member)) {
+					// Found the instance member we were looking for.
+					// Address of the STRUCT_INSTANCE_HEADER offset by
+					//   params_passed + 1;
+					address loc = struct_header + params_passed + 1;
+					vm->memory_register = loc;
+					found = true;
+					if (vm->memory[vm->memory_register].type == D_FUNCTION) {
+						vm->memory[vm->memory_register].type = D_STRUCT_FUNCTION;
 					}
 					break;
 				}
-				address metadata = (int)(t.value.number);
-				if (t.type == D_STRUCT_INSTANCE) {
-					// metadata actually points to the STRUCT_INSTANCE_HEAD
-					//   right now.
-					metadata = (address)(memory[metadata].value.number);
-				}
-				data_type struct_type = t.type;
-				address struct_header = t.value.number;
-				bool found = false;
-				while(!found) {
-					int params_passed = 0;
-					int size = (int)(memory[metadata].value.number);
-					for (int i = 0; i < size; i++) {
-						data mdata = memory[metadata + i];
-						if (mdata.type == D_STRUCT_SHARED &&
-							streq(mdata.value.string, member)) {
-							// Found the static member we were looking for.
-							memory_register = metadata + i + 1;
-							found = true;
-							if (memory[memory_register].type == D_FUNCTION) {
-								memory[memory_register].type = D_STRUCT_FUNCTION;
-							}
-							break;
-						}
-						else if (mdata.type == D_STRUCT_PARAM) {
-							if (struct_type == D_STRUCT_INSTANCE &&
-								streq(mdata.value.string, member)) {
-								// Found the instance member we were looking for.
-								// Address of the STRUCT_INSTANCE_HEADER offset by
-								//   params_passed + 1;
-								address loc = struct_header + params_passed + 1;
-								memory_register = loc;
-								found = true;
-								if (memory[memory_register].type == D_FUNCTION) {
-									memory[memory_register].type = D_STRUCT_FUNCTION;
-								}
-								break;
-							}
-							params_passed++;
-						}
-					}
-					if (found) break;
-					error_runtime(line, VM_MEMBER_NOT_EXIST, member);
-				}
-				break;
-			}
-			case OP_JMP: {
-				address addr = get_address(bytecode + i, &i);
-				i = addr;
-				break;
-			}
-			case OP_JIF: {
-				// Jump IF False Instruction
-				data top = pop_arg(line);
-				address addr = get_address(bytecode + i, &i);
-				if (top.type != D_TRUE && top.type != D_FALSE) {
-					error_runtime(line, VM_COND_EVAL_NOT_BOOL);
-				}
-				if (top.type == D_FALSE) {
-					i = addr;
-				}
-				destroy_data(&top);
-				break;
+				params_passed++;
 			}
-			case OP_CALL:
-			wendy_vm_call: {
-				data top = pop_arg(line);
-				int loc = top.value.number;
-				data boundName = memory[loc + 2];
-				char* function_disp = safe_malloc(128 * sizeof(char));
-				function_disp[0] = 0;
-				if (boundName.value.string && streq(boundName.value.string, "self")) {
-					sprintf(function_disp, "annonymous:0x%X", i);
-				}
-				else {
-					sprintf(function_disp, "%s:0x%X", boundName.value.string, i);
-				}
-				push_frame(function_disp, i, line);
-				safe_free(function_disp);
-				push_mem_reg(memory_register, line);
-				if (top.type == D_STRUCT) {
-					address j = top.value.number;
-					top = memory[j + 3];
-					top.type = D_STRUCT_FUNCTION;
-					// grab the size of the metadata chain also check if there's an
-					//   overloaded init.
-					int m_size = memory[j].value.number;
-					int params = 0;
-					for (int i = 0; i < m_size; i++) {
-						if (memory[j + i].type == D_STRUCT_PARAM) {
-							params++;
-						}
-					}
+		}
+		if (found) break;
+		error_runtime(vm->line, VM_MEMBER_NOT_EXIST, member);
+	}
+}
 
-					int si_size = 0;
-					data* struct_instance =
-						safe_malloc(MAX_STRUCT_META_LEN * sizeof(data));
+static void op_jmp(void) {
+	address addr = get_address(vm->bytecode + vm->ip, &vm->ip);
+	vm->ip = addr;
+}
 
-					si_size = params + 1; // + 1 for the header
-					struct_instance[0] = make_data(D_STRUCT_INSTANCE_HEAD,
-							data_value_num(j));
-					int offset = params;
-					for (int i = 0; i < params; i++) {
-						struct_instance[offset - i] = none_data();
-					}
-					// Struct instance is done.
-					address a = push_memory_array(struct_instance, si_size, line);
-					safe_free(struct_instance);
-					memory_register_A = a;
-				}
+static void op_jif(void) {
+	// Jump IF False Instruction
+	data top = pop_arg(vm->line);
+	address addr = get_address(vm->bytecode + vm->ip, &vm->ip);
+	if (top.type != D_TRUE && top.type != D_FALSE) {
+		error_runtime(vm->line, VM_COND_EVAL_NOT_BOOL);
+	}
+	if (top.type == D_FALSE) {
+		vm->ip = addr;
+	}
+	destroy_data(&top);
+}
 
-				if (top.type != D_FUNCTION && top.type != D_STRUCT_FUNCTION) {
-					error_runtime(line, VM_FN_CALL_NOT_FN);
-				}
-				if (top.type == D_STRUCT_FUNCTION) {
-					data_type t;
-					if (memory[memory_register_A].type == D_STRUCT_INSTANCE_HEAD) {
-						t = D_STRUCT_INSTANCE;
-					}
-					else {
-						t = D_STRUCT;
-					}
-					push_stack_entry("this", push_memory(make_data(
-						t, data_value_num(memory_register_A)), line), line);
-				}
-				// Top might have changed, reload
-				loc = top.value.number;
-				address addr = memory[loc].value.number;
-				i = addr;
-				// push closure variables
-				address cloc = memory[loc + 1].value.number;
-				if (cloc != NO_CLOSURE) {
-					size_t size = closure_list_sizes[cloc];
-					for (size_t i = 0; i < size; i++) {
-						copy_stack_entry(closure_list[cloc][i], line);
-					}
-				}
-				address adr = push_memory(top, line);
-				if (strcmp(boundName.value.string, "self") != 0) {
-					push_stack_entry("self", adr, line);
-				}
-				push_stack_entry(boundName.value.string, adr, line);
-				break;
-			}
-			case OP_READ: {
-				push_arg(copy_data(memory[memory_register]), line);
-				break;
+static void op_call(void) {
+	// The function stays on the operand stack until its closure is bound, a
+	//   collection meanwhile would free the closure of a function nothing
+	//   else refers to.
+	data* called = top_arg(vm->line);
+	if (!called) {
+		return;
+	}
+	data top = *called;
+	int loc = top.value.number;
+	data boundName = vm->memory[loc + 2];
+	char* function_disp = safe_malloc(128 * sizeof(char));
+	function_disp[0] = 0;
+	if (boundName.value.string && streq(boundName.value.string, "self")) {
+		sprintf(function_disp, "annonymous:0x%X", vm->ip);
+	}
+	else {
+		sprintf(function_disp, "%s:0x%X", boundName.value.string, vm->ip);
+	}
+	push_frame(function_disp, vm->ip, vm->line);
+	safe_free(function_disp);
+	push_mem_reg(vm->memory_register, vm->line);
+	if (top.type == D_STRUCT) {
+		address j = top.value.number;
+		top = vm->memory[j + 3];
+		top.type = D_STRUCT_FUNCTION;
+		// grab the size of the metadata chain also check if there's an
+		//   overloaded init.
+		int m_size = vm->memory[j].value.number;
+		int params = 0;
+		for (int i = 0; i < m_size; i++) {
+			if (vm->memory[j + i].type == D_STRUCT_PARAM) {
+				params++;
 			}
-			case OP_WRITE: {
-				size_t size = bytecode[i++];
-				if (top_arg(line)->type == D_END_OF_ARGUMENTS ||
-					top_arg(line)->type == D_NAMED_ARGUMENT_NAME)
-					break;
+		}
 
-				for (address j = memory_register + size - 1;
-						j >= memory_register; j--) {
-					write_memory(j, pop_arg(line), line);
-					if (memory[j].type == D_FUNCTION) {
-						// Write Name to Function
-						char* bind_name = last_pushed_identifier;
-						address fn_adr = memory[j].value.number;
-						data_value* fn_name_data = &memory[fn_adr + 2].value;
-						fn_name_data->string = safe_realloc(
-							fn_name_data->string, strlen(bind_name) + 1);
-						strcpy(fn_name_data->string, bind_name);
-					}
-				}
-				break;
-			}
-			case OP_OUT: {
-				data t = pop_arg(line);
-				if (t.type != D_NONERET) {
-					char* fn_name = get_print_overload_name(t);
-					if (id_exist(fn_name, true)) {
-						push_arg(make_data(D_END_OF_ARGUMENTS, data_value_num(0)),
-							line);
-						push_arg(t, line);
-						push_arg(copy_data(*get_value_of_id(fn_name, line)), line);
-						safe_free(fn_name);
-						destroy_data(&t);
-						/* This i-- allows the overloaded function to return
-						 * a string / object and have that be the printed
-						 * output, i.e. it will call function and execute
-						 * the OP_OUT again */
-						i--;
-						goto wendy_vm_call;
-					}
-					safe_free(fn_name);
-					print_data(&t);
-				}
-				destroy_data(&t);
-				break;
-			}
-			case OP_OUTL: {
-				data t = pop_arg(line);
-				if (t.type != D_NONERET) {
-					char* fn_name = get_print_overload_name(t);
-					if (id_exist(fn_name, true)) {
-						push_arg(make_data(D_END_OF_ARGUMENTS, data_value_num(0)),
-							line);
-						push_arg(t, line);
-						push_arg(copy_data(*get_value_of_id(fn_name, line)), line);
-						safe_free(fn_name);
-						destroy_data(&t);
-						/* This i-- allows the overloaded function to return
-						 * a string / object and have that be the printed
-						 * output, i.e. it will call function and execute
-						 * the OP_OUT again */
-						i--;
-						goto wendy_vm_call;
-					}
-					safe_free(fn_name);
-					print_data_inline(&t, stdout);
-				}
-				destroy_data(&t);
-				break;
+		int si_size = 0;
+		data* struct_instance =
+			safe_malloc(MAX_STRUCT_META_LEN * sizeof(data));
+
+		si_size = params + 1; // + 1 for the header
+		struct_instance[0] = make_data(D_STRUCT_INSTANCE_HEAD,
+				data_value_num(j));
+		int offset = params;
+		for (int i = 0; i < params; i++) {
+			struct_instance[offset - i] = none_data();
+		}
+		// Struct instance is done.
+		address a = push_memory_array(struct_instance, si_size, vm->line);
+		safe_free(struct_instance);
+		vm->memory_register_A = a;
+	}
+
+	if (top.type != D_FUNCTION && top.type != D_STRUCT_FUNCTION) {
+		error_runtime(vm->line, VM_FN_CALL_NOT_FN);
+	}
+	if (top.type == D_STRUCT_FUNCTION) {
+		data_type t;
+		if (vm->memory[vm->memory_register_A].type == D_STRUCT_INSTANCE_HEAD) {
+			t = D_STRUCT_INSTANCE;
+		}
+		else {
+			t = D_STRUCT;
+		}
+		push_stack_entry("this", push_memory(make_data(
+			t, data_value_num(vm->memory_register_A)), vm->line), vm->line);
+	}
+	// Top might have changed, reload
+	loc = top.value.number;
+	address addr = vm->memory[loc].value.number;
+	vm->ip = addr;
+	if (vm->jit_enabled) {
+		jit_record_call(addr, boundName.value.string);
+	}
+	// push closure variables
+	address cloc = vm->memory[loc + 1].value.number;
+	if (cloc != NO_CLOSURE) {
+		size_t size = vm->closure_list_sizes[cloc];
+		for (size_t i = 0; i < size; i++) {
+			push_closure_slot(vm->closure_list[cloc][i], vm->line);
+		}
+	}
+	address adr = push_memory(top, vm->line);
+	if (strcmp(boundName.value.string, "self") != 0) {
+		push_stack_entry("self", adr, vm->line);
+	}
+	push_stack_entry(boundName.value.string, adr, vm->line);
+	data function = pop_arg(vm->line);
+	destroy_data(&function);
+}
+
+static bool has_add_overload(data a, data b) {
+	data any_d = any_data();
+	char* a_and_b = get_binary_overload_name(O_ADD, a, b);
+	char* any_a = get_binary_overload_name(O_ADD, any_d, b);
+	char* any_b = get_binary_overload_name(O_ADD, a, any_d);
+	destroy_data(&any_d);
+	bool found = first_that(_id_exist, a_and_b, any_a, any_b) != 0;
+	safe_free(a_and_b);
+	safe_free(any_a);
+	safe_free(any_b);
+	return found;
+}
+
+// op_append() implements lvalue += value for strings. Strings are never
+//   shared between cells, so the string at $MR can grow in place instead of
+//   being read, concatenated into a new string and written back. Its size
+//   doubles when it runs out, and the length and size of the string appended
+//   to last are kept, so a loop of appends to one string takes linear time.
+//   Otherwise the READ RBIN WRITE sequence that follows does the assignment.
+static void op_append(void) {
+	address done = get_address(vm->bytecode + vm->ip, &vm->ip);
+	data* target = &vm->memory[vm->memory_register];
+	data* value = top_arg(vm->line);
+	if (target->type != D_STRING ||
+		(value->type != D_STRING && value->type != D_NUMBER)) {
+		return;
+	}
+	if (!vm->append_checked || vm->append_epoch != vm->overload_epoch) {
+		data number = make_data(D_NUMBER, data_value_num(0));
+		vm->append_overloaded_string = has_add_overload(*target, *target);
+		vm->append_overloaded_number = has_add_overload(*target, number);
+		vm->append_epoch = vm->overload_epoch;
+		vm->append_checked = true;
+	}
+	if (value->type == D_STRING ?
+		vm->append_overloaded_string : vm->append_overloaded_number) {
+		return;
+	}
+	char number[NUMBER_BUFFER_SIZE];
+	char* suffix = value->value.string;
+	size_t suffix_len;
+	if (value->type == D_NUMBER) {
+		suffix_len = format_number(value->value.number, number);
+		suffix = number;
+	}
+	else {
+		suffix_len = strlen(suffix);
+	}
+	size_t length;
+	size_t capacity;
+	if (target->value.string == vm->append_string) {
+		length = vm->append_length;
+		capacity = vm->append_capacity;
+	}
+	else {
+		length = strlen(target->value.string);
+		capacity = length + 1;
+	}
+	if (length + suffix_len >= capacity) {
+		capacity = capacity < 16 ? 16 : capacity;
+		while (capacity <= length + suffix_len) {
+			capacity *= 2;
+		}
+		target->value.string = safe_realloc(target->value.string, capacity);
+	}
+	memcpy(target->value.string + length, suffix, suffix_len);
+	target->value.string[length + suffix_len] = 0;
+	vm->append_string = target->value.string;
+	vm->append_length = length + suffix_len;
+	vm->append_capacity = capacity;
+	data v = pop_arg(vm->line);
+	destroy_data(&v);
+	vm->ip = done;
+}
+
+static void op_read(void) {
+	push_arg(copy_data(vm->memory[vm->memory_register]), vm->line);
+}
+
+static void op_write(void) {
+	size_t size = vm->bytecode[vm->ip++];
+	if (top_arg(vm->line)->type == D_END_OF_ARGUMENTS ||
+		top_arg(vm->line)->type == D_NAMED_ARGUMENT_NAME)
+		return;
+
+	for (address j = vm->memory_register + size - 1;
+			j >= vm->memory_register; j--) {
+		write_memory(j, pop_arg(vm->line), vm->line);
+		if (vm->memory[j].type == D_FUNCTION) {
+			// Write Name to Function
+			char* bind_name = vm->last_pushed_identifier;
+			address fn_adr = vm->memory[j].value.number;
+			data_value* fn_name_data = &vm->memory[fn_adr + 2].value;
+			fn_name_data->string = safe_realloc(
+				fn_name_data->string, strlen(bind_name) + 1);
+			strcpy(fn_name_data->string, bind_name);
+		}
+	}
+}
+
+// print_top(newline) implements OP_OUT and OP_OUTL
+static void print_top(bool newline) {
+	data t = pop_arg(vm->line);
+	if (t.type != D_NONERET) {
+		char* fn_name = get_print_overload_name(t);
+		if (id_exist(fn_name, true)) {
+			push_arg(make_data(D_END_OF_ARGUMENTS, data_value_num(0)),
+				vm->line);
+			push_arg(t, vm->line);
+			push_arg(copy_data(*get_value_of_id(fn_name, vm->line)), vm->line);
+			safe_free(fn_name);
+			destroy_data(&t);
+			/* This i-- allows the overloaded function to return
+			 * a string / object and have that be the printed
+			 * output, i.e. it will call function and execute
+			 * the OP_OUT again */
+			vm->ip--;
+			op_call();
+			return;
+		}
+		safe_free(fn_name);
+		if (newline) {
+			print_data(&t);
+		}
+		else {
+			print_data_inline(&t, stdout);
+		}
+	}
+	destroy_data(&t);
+}
+
+static void op_out(void) {
+	print_top(true);
+}
+
+static void op_outl(void) {
+	print_top(false);
+}
+
+// DEPRECATED
+static void op_in(void) {
+	// Scan one line from the input, after showing any pending prompt.
+	char* buffer = 0;
+	size_t capacity;
+	fflush(stdout);
+	if (read_line(stdin, &buffer, &capacity) < 0) {
+		safe_free(buffer);
+		write_memory(vm->memory_register, none_data(), vm->line);
+		return;
+	}
+
+	char* end_ptr = buffer;
+	errno = 0;
+	double d = strtod(buffer, &end_ptr);
+	if (errno != 0 || *end_ptr != 0) {
+		write_memory(vm->memory_register, make_data(D_STRING, data_value_str(buffer)), vm->line);
+	}
+	else {
+		// conversion successful
+		write_memory(vm->memory_register, make_data(D_NUMBER, data_value_num(d)), vm->line);
+	}
+	safe_free(buffer);
+}
+
+static void op_halt(void) {
+	// The interpreter loop checks for OP_HALT before dispatching.
+}
+
+static void op_invalid(void) {
+	error_runtime(vm->line, VM_INVALID_OPCODE, vm->bytecode[vm->ip - 1], vm->ip - 1);
+}
+
+static const vm_handler opcode_handlers[] = {
+	[OP_PUSH] = op_push, [OP_POP] = op_pop, [OP_BIN] = op_bin,
+	[OP_UNA] = op_una, [OP_CALL] = op_call, [OP_RET] = op_ret,
+	[OP_BIND] = op_bind, [OP_REQ] = op_req, [OP_WHERE] = op_where,
+	[OP_OUT] = op_out, [OP_OUTL] = op_outl, [OP_IN] = op_in,
+	[OP_MKPTR] = op_mkptr, [OP_RANGE] = op_invalid, [OP_READ] = op_read,
+	[OP_WRITE] = op_write, [OP_JMP] = op_jmp, [OP_JIF] = op_jif,
+	[OP_FRM] = op_frm, [OP_END] = op_end, [OP_LJMP] = op_ljmp,
+	[OP_LBIND] = op_lbind, [OP_INC] = op_inc, [OP_DEC] = op_dec,
+	[OP_NTHPTR] = op_nthptr, [OP_MEMPTR] = op_memptr,
+	[OP_ASSERT] = op_assert, [OP_MPTR] = op_mptr, [OP_CLOSUR] = op_closur,
+	[OP_RBIN] = op_rbin, [OP_RBW] = op_rbw, [OP_HALT] = op_halt,
+	[OP_SRC] = op_src, [OP_NATIVE] = op_native, [OP_IMPORT] = op_import,
+	[OP_ARGCLN] = op_argcln, [OP_ADDNN] = op_addnn, [OP_SUBNN] = op_subnn,
+	[OP_MULNN] = op_mulnn, [OP_DIVNN] = op_divnn, [OP_LTNN] = op_ltnn,
+	[OP_GTNN] = op_gtnn, [OP_LTENN] = op_ltenn, [OP_GTENN] = op_gtenn,
+	[OP_EQNN] = op_eqnn, [OP_NEQNN] = op_neqnn, [OP_CATSS] = op_catss,
+	[OP_APPEND] = op_append, [OP_GEN] = op_gen, [OP_YIELD] = op_yield,
+	[OP_LGEN] = op_lgen
+};
+
+// op_binary_site() runs whichever form a BIN or RBIN site currently has.
+//   Quickening rewrites these sites at runtime, so compiled code must not bind
+//   to the form that was present when it was compiled.
+static void op_binary_site(void) {
+	opcode_handlers[vm->bytecode[vm->ip - 1]]();
+}
+
+vm_handler get_opcode_handler(opcode op) {
+	if (op >= OPCODE_COUNT) {
+		return op_invalid;
+	}
+	if (op == OP_BIN || op == OP_RBIN || is_quickened_opcode(op)) {
+		return op_binary_site;
+	}
+	return opcode_handlers[op];
+}
+
+address* get_instruction_pointer_ref() {
+	return &vm->ip;
+}
+
+// grow_feedback() makes the quickening feedback cover the whole bytecode,
+//   which grows in the REPL.
+static void grow_feedback(void) {
+	if (vm->bytecode_size > vm->binary_feedback_size) {
+		if (vm->binary_feedback) {
+			vm->binary_feedback = safe_realloc(vm->binary_feedback,
+				vm->bytecode_size * sizeof(site_feedback));
+		}
+		else {
+			vm->binary_feedback = safe_malloc(vm->bytecode_size * sizeof(site_feedback));
+		}
+		memset(vm->binary_feedback + vm->binary_feedback_size, 0,
+			(vm->bytecode_size - vm->binary_feedback_size) * sizeof(site_feedback));
+		vm->binary_feedback_size = vm->bytecode_size;
+	}
+}
+
+// load_bytecode(new_bytecode, size) makes new_bytecode the program of the
+//   interpreter, or appends it to the program in the REPL, and returns the
+//   address to start running it from.
+static address load_bytecode(uint8_t* new_bytecode, size_t size) {
+	// Verify Header
+	address start_at;
+	size_t saved_size = vm->bytecode_size;
+	if (!get_settings_flag(SETTINGS_REPL)) {
+		vm->bytecode = new_bytecode;
+		vm->bytecode_size = size;
+		start_at = verify_header(vm->bytecode);
+	}
+	else {
+		// REPL Bytecode has no headers!
+		// Resize Bytecode Block, Offset New Addresses, Push to End. Each chain
+		//   of BC keeps its OP_HALT, so an embedded program can run it again.
+		vm->bytecode_size += size;
+		if (vm->bytecode) {
+			vm->bytecode = safe_realloc(vm->bytecode, vm->bytecode_size * sizeof(uint8_t));
+		}
+		else {
+			vm->bytecode = safe_malloc(vm->bytecode_size * sizeof(uint8_t));
+		}
+		start_at = saved_size;
+		offset_addresses(new_bytecode, size, start_at);
+		for (size_t i = 0; i < size; i++) {
+			vm->bytecode[start_at + i] = new_bytecode[i];
+		}
+	}
+	grow_feedback();
+	return start_at;
+}
+
+void vm_copy_program(const uint8_t* bytecode, size_t size) {
+	if (vm->bytecode && vm->bytecode_size == size) {
+		return;
+	}
+	if (vm->bytecode) {
+		safe_free(vm->bytecode);
+	}
+	vm->bytecode = safe_malloc(size * sizeof(uint8_t));
+	memcpy(vm->bytecode, bytecode, size);
+	vm->bytecode_size = size;
+	grow_feedback();
+}
+
+// execute(start) runs the program from start until it halts or fails.
+static void execute(address start) {
+	for (vm->ip = start;;) {
+		reset_error_flag();
+		if (vm->jit_enabled) {
+			if (vm->jit_pending) {
+				jit_compile_pending();
 			}
-			// DEPRECATED
-			case OP_IN: {
-				// Scan one line from the input.
-				char buffer[INPUT_BUFFER_SIZE];
-				while(!fgets(buffer, INPUT_BUFFER_SIZE, stdin)) {};
-
-				char* end_ptr = buffer;
-				errno = 0;
-				double d = strtod(buffer, &end_ptr);
-				// null terminator or newline character
-				if (errno != 0 || (*end_ptr != 0 && *end_ptr != 10)) {
-					size_t len = strlen(buffer);
-					// remove last newline
-					buffer[len - 1] = 0;
-					write_memory(memory_register, make_data(D_STRING, data_value_str(buffer)), line);
-				}
-				else {
-					// conversion successful
-					write_memory(memory_register, make_data(D_NUMBER, data_value_num(d)), line);
+			if (vm->jit_entry_table[vm->ip]) {
+				jit_execute(vm->jit_entry_table[vm->ip]);
+				if (get_error_flag()) {
+					clear_arg_stack();
+					break;
 				}
-				break;
+				continue;
 			}
+		}
+		opcode op = vm->bytecode[vm->ip];
+		if (get_settings_flag(SETTINGS_TRACE_VM)) {
+			// This branch could slow down the VM but the CPU should branch
+			// predict after one or two iterations.
+			printf(BLU "<+%04X>: " RESET "%s\n", vm->ip, opcode_string[op]);
+		}
+		vm->ip += 1;
+		uint64_t started = 0;
+		if (vm->count_opcodes) {
+			started = stats_ticks();
+		}
+		switch (op) {
+			case OP_PUSH: op_push(); break;
+			case OP_SRC: op_src(); break;
+			case OP_POP: op_pop(); break;
+			case OP_BIN: op_bin(); break;
+			case OP_RBIN: op_rbin(); break;
+			case OP_UNA: op_una(); break;
+			case OP_NATIVE: op_native(); break;
+			case OP_BIND: op_bind(); break;
+			case OP_WHERE: op_where(); break;
+			case OP_IMPORT: op_import(); break;
+			case OP_ARGCLN: op_argcln(); break;
+			case OP_RET: op_ret(); break;
+			case OP_LJMP: op_ljmp(); break;
+			case OP_LBIND: op_lbind(); break;
+			case OP_INC: op_inc(); break;
+			case OP_DEC: op_dec(); break;
+			case OP_ASSERT: op_assert(); break;
+			case OP_FRM: op_frm(); break;
+			case OP_MPTR: op_mptr(); break;
+			case OP_END: op_end(); break;
+			case OP_REQ: op_req(); break;
+			case OP_RBW: op_rbw(); break;
+			case OP_MKPTR: op_mkptr(); break;
+			case OP_NTHPTR: op_nthptr(); break;
+			case OP_CLOSUR: op_closur(); break;
+			case OP_MEMPTR: op_memptr(); break;
+			case OP_JMP: op_jmp(); break;
+			case OP_JIF: op_jif(); break;
+			case OP_CALL: op_call(); break;
+			case OP_READ: op_read(); break;
+			case OP_WRITE: op_write(); break;
+			case OP_OUT: op_out(); break;
+			case OP_OUTL: op_outl(); break;
+			case OP_IN: op_in(); break;
+			case OP_ADDNN: op_addnn(); break;
+			case OP_SUBNN: op_subnn(); break;
+			case OP_MULNN: op_mulnn(); break;
+			case OP_DIVNN: op_divnn(); break;
+			case OP_LTNN: op_ltnn(); break;
+			case OP_GTNN: op_gtnn(); break;
+			case OP_LTENN: op_ltenn(); break;
+			case OP_GTENN: op_gtenn(); break;
+			case OP_EQNN: op_eqnn(); break;
+			case OP_NEQNN: op_neqnn(); break;
+			case OP_CATSS: op_catss(); break;
+			case OP_APPEND: op_append(); break;
+			case OP_GEN: op_gen(); break;
+			case OP_YIELD: op_yield(); break;
+			case OP_LGEN: op_lgen(); break;
 			case OP_HALT:
 				return;
 			default:
-				error_runtime(line, VM_INVALID_OPCODE, bytecode[i], i);
+				op_invalid();
+		}
+		if (vm->count_opcodes && op < OPCODE_COUNT) {
+			vm->stats.opcode_counts[op]++;
+			vm->stats.opcode_ticks[op] += stats_ticks() - started;
 		}
 		if (get_error_flag()) {
 			clear_arg_stack();
@@ -761,35 +1275,150 @@ void vm_run(uint8_t* new_bytecode, size_t size) {
 	}
 }
 
+// run_bytecode(new_bytecode, size) runs the bytecode on the interpreter the
+//   thread works with.
+static void run_bytecode(uint8_t* new_bytecode, size_t size) {
+	if (get_settings_flag(SETTINGS_DRY_RUN)) {
+		return;
+	}
+	address start_at = load_bytecode(new_bytecode, size);
+	// The JIT needs stable bytecode, which the REPL does not provide, and
+	//   compiled code bypasses instruction tracing and counting.
+	vm->count_opcodes = get_settings_flag(SETTINGS_STATS) ||
+		get_settings_flag(SETTINGS_STATS_JSON);
+	vm->jit_enabled = get_settings_flag(SETTINGS_JIT) &&
+		!get_settings_flag(SETTINGS_REPL) &&
+		!get_settings_flag(SETTINGS_TRACE_VM) && !vm->count_opcodes;
+	if (vm->jit_enabled) {
+		jit_init(vm->bytecode, vm->bytecode_size);
+	}
+	execute(start_at);
+}
+
+void vm_run(wendy_vm* instance, uint8_t* new_bytecode, size_t size) {
+	wendy_vm* previous = vm_enter(instance);
+	run_bytecode(new_bytecode, size);
+	vm_enter(previous);
+}
+
+address vm_load(uint8_t* new_bytecode, size_t size) {
+	return load_bytecode(new_bytecode, size);
+}
+
+void vm_execute(address start) {
+	execute(start);
+}
+
+bool vm_call(data function, data* args, int argc, data* result) {
+	address saved_ip = vm->ip;
+	int saved_line = vm->line;
+	address saved_frame_pointer = vm->frame_pointer;
+	address saved_stack_pointer = vm->stack_pointer;
+	address saved_mem_reg_pointer = vm->mem_reg_pointer;
+	address saved_memory_register = vm->memory_register;
+	// Arguments are pushed like a call expression pushes them, the first one
+	//   last so it's on top.
+	push_arg(make_data(D_END_OF_ARGUMENTS, data_value_num(0)), vm->line);
+	for (int i = argc - 1; i >= 0; i--) {
+		push_arg(copy_data(args[i]), vm->line);
+	}
+	push_arg(copy_data(function), vm->line);
+	// The function returns to the OP_HALT that ends the program, which stops
+	//   execute() with the result on top of the argument stack.
+	vm->ip = vm->bytecode_size - 1;
+	op_call();
+	if (!get_error_flag()) {
+		execute(vm->ip);
+	}
+	bool ok = !get_error_flag();
+	if (ok) {
+		*result = pop_arg(vm->line);
+	}
+	else {
+		vm->frame_pointer = saved_frame_pointer;
+		vm->stack_pointer = saved_stack_pointer;
+		vm->mem_reg_pointer = saved_mem_reg_pointer;
+	}
+	vm->ip = saved_ip;
+	vm->line = saved_line;
+	vm->memory_register = saved_memory_register;
+	return ok;
+}
+
+// f64_array_subscript(a, b) returns the number at index b of the f64array a,
+//   or a new array of the elements in the range b.
+static data f64_array_subscript(data a, data b) {
+	f64_array* array = f64_array_of(&a);
+	int length = array->length;
+	if (b.type == D_NUMBER) {
+		double index = floor(b.value.number);
+		if (index < 0 || index >= length) {
+			error_runtime(vm->line, VM_LIST_REF_OUT_RANGE);
+			return none_data();
+		}
+		return make_data(D_NUMBER, data_value_num(array->values[(int)index]));
+	}
+	else if (b.type == D_RANGE) {
+		int start = range_start(b);
+		int end = range_end(b);
+		if (start < 0 || end < 0 || start > length || end > length) {
+			error_runtime(vm->line, VM_LIST_REF_OUT_RANGE);
+			return none_data();
+		}
+		data result = f64_array_data(abs(end - start));
+		double* values = f64_array_of(&result)->values;
+		int n = 0;
+		for (int i = start; i != end; start < end ? i++ : i--) {
+			values[n++] = array->values[i];
+		}
+		return result;
+	}
+	error_runtime(vm->line, VM_INVALID_LIST_SUBSCRIPT);
+	return none_data();
+}
+
+// copy_of_list(l) returns a copy of the list or view l, a view that shares
+//   the elements of l until either is changed.
+static data copy_of_list(const data* l) {
+	if (l->type == D_LIST_VIEW) {
+		list_view* v = list_view_of(l);
+		return list_view_data(v->list, v->start, v->end);
+	}
+	return list_view_data(l->value.number, 0, list_size(l));
+}
+
 static data eval_binop(operator op, data a, data b) {
 	if (op == O_SUBSCRIPT) {
 		// Array Reference, or String
-		// A must be a list/string/range, b must be a number.
-		if (a.type != D_LIST && a.type != D_STRING && a.type != D_RANGE) {
-			error_runtime(line, VM_TYPE_ERROR, operator_string[op]);
+		// A must be a list/string/range/f64array, b must be a number.
+		if (a.type == D_F64ARRAY) {
+			return f64_array_subscript(a, b);
+		}
+		if (!is_list(&a) && a.type != D_STRING && a.type != D_RANGE) {
+			error_runtime(vm->line, VM_TYPE_ERROR, operator_string[op]);
 			return none_data();
 		}
 
-		int list_size;
+		int size;
 		if (a.type == D_STRING) {
-			list_size = strlen(a.value.string);
+			size = strlen(a.value.string);
 		}
 		else if (a.type == D_RANGE) {
-			list_size = abs(range_end(a) - range_start(a));
+			size = abs(range_end(a) - range_start(a));
 		}
 		else {
-			list_size = memory[(int)a.value.number].value.number;
+			size = list_size(&a);
 		}
 
 		if (b.type != D_NUMBER && b.type != D_RANGE) {
-			error_runtime(line, VM_INVALID_LIST_SUBSCRIPT);
+			error_runtime(vm->line, VM_INVALID_LIST_SUBSCRIPT);
 			return none_data();
 		}
-		if ((b.type == D_NUMBER && (int)(b.value.number) >= list_size) ||
+		if ((b.type == D_NUMBER && (int)(b.value.number) >= size) ||
 			(b.type == D_RANGE &&
-			((range_start(b) > list_size || range_end(b) > list_size ||
+			((range_start(b) > size || range_end(b) > size ||
 			 range_start(b) < 0 || range_end(b) < 0)))) {
-			error_runtime(line, VM_LIST_REF_OUT_RANGE);
+			error_runtime(vm->line, VM_LIST_REF_OUT_RANGE);
 			return none_data();
 		}
 
@@ -810,17 +1439,11 @@ static data eval_binop(operator op, data a, data b) {
 					return make_data(D_NUMBER, data_value_num(start - index));
 				}
 			}
-			// Add 1 to offset because of the header.
-			int offset = floor(b.value.number) + 1;
-			address list_address = a.value.number;
-			data* c = get_value_of_address(list_address + offset, line);
-			return copy_data(*c);
+			return copy_data(*list_element(&a, floor(b.value.number)));
 		}
 		else {
 			int start = range_start(b);
 			int end = range_end(b);
-			int subarray_size = start - end;
-			if (subarray_size < 0) subarray_size *= -1;
 
 			if (a.type == D_STRING) {
 				data c = make_data(D_STRING, data_value_size(abs(start - end)));
@@ -845,17 +1468,15 @@ static data eval_binop(operator op, data a, data b) {
 				return range_data(a_start + b_start, a_start + b_end);
 			}
 
-			address array_start = (int)(a.value.number);
-			data* new_a = safe_malloc(subarray_size * sizeof(data));
-			int n = 0;
-			for (int i = start; i != end;
-				start < end ? i++ : i--) {
-				new_a[n++] = copy_data(memory[array_start + i + 1]);
+			// Slices share the elements of the list instead of copying them.
+			if (a.type == D_LIST_VIEW) {
+				// A slice of a view is a view of the same list.
+				list_view* v = list_view_of(&a);
+				int step = v->start < v->end ? 1 : -1;
+				return list_view_data(v->list, v->start + step * start,
+					v->start + step * end);
 			}
-			address new_aa = push_memory_wendy_list(new_a, subarray_size, line);
-			safe_free(new_a);
-			data c = make_data(D_LIST, data_value_num(new_aa));
-			return c;
+			return list_view_data(a.value.number, start, end);
 		}
 	}
 	if (op == O_MEMBER) {
@@ -864,29 +1485,29 @@ static data eval_binop(operator op, data a, data b) {
 		// Regular Member, Must be either struct or a struct instance.
 		//   Check for Regular Member before checking for built-in ones
 		if (b.type != D_MEMBER_IDENTIFIER) {
-			error_runtime(line, VM_MEMBER_NOT_IDEN);
+			error_runtime(vm->line, VM_MEMBER_NOT_IDEN);
 			return false_data();
 		}
 		if (a.type == D_STRUCT || a.type == D_STRUCT_INSTANCE) {
 			// Either will be allowed to look through static parameters.
 			address metadata = (int)(a.value.number);
-			memory_register_A = metadata;
+			vm->memory_register_A = metadata;
 			if (a.type == D_STRUCT_INSTANCE) {
 				// metadata actually points to the STRUCT_INSTANE_HEADER
 				//   right now.
-				metadata = (address)(memory[metadata].value.number);
+				metadata = (address)(vm->memory[metadata].value.number);
 			}
 			data_type struct_type = a.type;
 			address struct_header = a.value.number;
 
 			int params_passed = 0;
-			int size = (int)(memory[metadata].value.number);
+			int size = (int)(vm->memory[metadata].value.number);
 			for (int i = 0; i < size; i++) {
-				data mdata = memory[metadata + i];
+				data mdata = vm->memory[metadata + i];
 				if (mdata.type == D_STRUCT_SHARED &&
 					streq(mdata.value.string, b.value.string)) {
 					// Found the static member we were looking for
-					data result = copy_data(memory[metadata + i + 1]);
+					data result = copy_data(vm->memory[metadata + i + 1]);
 					if (result.type == D_FUNCTION) {
 						result.type = D_STRUCT_FUNCTION;
 					}
@@ -899,7 +1520,7 @@ static data eval_binop(operator op, data a, data b) {
 						// Address of the STRUCT_INSTANCE_HEADER offset by
 						//   params_passed + 1;
 						address loc = struct_header + params_passed + 1;
-						data result = copy_data(memory[loc]);
+						data result = copy_data(vm->memory[loc]);
 						if (result.type == D_FUNCTION) {
 							result.type = D_STRUCT_FUNCTION;
 						}
@@ -922,15 +1543,15 @@ static data eval_binop(operator op, data a, data b) {
 			return char_of(a);
 		}
 		else if (a.type == D_NONERET) {
-			error_runtime(line, VM_NOT_A_STRUCT_MAYBE_FORGOT_RET_THIS);
+			error_runtime(vm->line, VM_NOT_A_STRUCT_MAYBE_FORGOT_RET_THIS);
 			return none_data();
 		}
 		else if (!(a.type == D_STRUCT || a.type == D_STRUCT_INSTANCE)) {
-			error_runtime(line, VM_NOT_A_STRUCT);
+			error_runtime(vm->line, VM_NOT_A_STRUCT);
 			return none_data();
 		}
 		else {
-			error_runtime(line, VM_MEMBER_NOT_EXIST, b.value.string);
+			error_runtime(vm->line, VM_MEMBER_NOT_EXIST, b.value.string);
 			return false_data();
 		}
 	}
@@ -970,7 +1591,7 @@ static data eval_binop(operator op, data a, data b) {
 			case O_REM:
 				// check for division by zero error
 				if (b.value.number == 0) {
-					error_runtime(line, VM_MATH_DISASTER);
+					error_runtime(vm->line, VM_MATH_DISASTER);
 				}
 				else {
 					if (op == O_REM) {
@@ -980,7 +1601,7 @@ static data eval_binop(operator op, data a, data b) {
 
 						// check integer
 						if (a_n != floor(a_n) || b_n != floor(b_n)) {
-							error_runtime(line, VM_TYPE_ERROR, "/");
+							error_runtime(vm->line, VM_TYPE_ERROR, "/");
 							return none_data();
 						}
 						else {
@@ -1001,7 +1622,7 @@ static data eval_binop(operator op, data a, data b) {
 				}
 				break;
 			default:
-				error_runtime(line, VM_NUM_NUM_INVALID_OPERATOR,
+				error_runtime(vm->line, VM_NUM_NUM_INVALID_OPERATOR,
 					operator_string[op]);
 				break;
 		}
@@ -1024,13 +1645,16 @@ static data eval_binop(operator op, data a, data b) {
 			(streq(a.value.string, b.value.string)) ?
 			false_data() : true_data();
 	}
+	else if((a.type == D_F64ARRAY && b.type == D_F64ARRAY) &&
+			(op == O_EQ || op == O_NEQ)) {
+		return (op == O_EQ) ^ data_equal(&a, &b) ?
+			false_data() : true_data();
+	}
 
-	if (a.type == D_LIST || b.type == D_LIST) {
-		if (a.type == D_LIST && b.type == D_LIST) {
-			address start_a = a.value.number;
-			address start_b = b.value.number;
-			int size_a = memory[start_a].value.number;
-			int size_b = memory[start_b].value.number;
+	if (is_list(&a) || is_list(&b)) {
+		if (is_list(&a) && is_list(&b)) {
+			int size_a = list_size(&a);
+			int size_b = list_size(&b);
 
 			switch (op) {
 				case O_EQ: {
@@ -1038,8 +1662,8 @@ static data eval_binop(operator op, data a, data b) {
 						return false_data();
 					}
 					for (int i = 0; i < size_a; i++) {
-						if (!data_equal(&memory[start_a + i + 1],
-										&memory[start_b + i + 1])) {
+						if (!data_equal(list_element(&a, i),
+										list_element(&b, i))) {
 							return false_data();
 						}
 					}
@@ -1050,70 +1674,75 @@ static data eval_binop(operator op, data a, data b) {
 						return true_data();
 					}
 					for (int i = 0; i < size_a; i++) {
-						if (data_equal(&memory[start_a + i + 1],
-										&memory[start_b + i + 1])) {
+						if (data_equal(list_element(&a, i),
+										list_element(&b, i))) {
 							return false_data();
 						}
 					}
 					return true_data();
 				}
 				case O_ADD: {
+					// Adding an empty list copies the other one, which
+					//   doesn't need its elements copied yet.
+					if (size_a == 0) {
+						return copy_of_list(&b);
+					}
+					else if (size_b == 0) {
+						return copy_of_list(&a);
+					}
 					int new_size = size_a + size_b;
 					data* new_list = safe_malloc(new_size * sizeof(data));
 					int n = 0;
 					for (int i = 0; i < size_a; i++) {
-						new_list[n++] = copy_data(memory[start_a + i + 1]);
+						new_list[n++] = copy_data(*list_element(&a, i));
 					}
 					for (int i = 0; i < size_b; i++) {
-						new_list[n++] = copy_data(memory[start_b + i + 1]);
+						new_list[n++] = copy_data(*list_element(&b, i));
 					}
-					address new_adr = push_memory_wendy_list(new_list, new_size, line);
+					address new_adr = push_memory_wendy_list(new_list, new_size, vm->line);
 					safe_free(new_list);
 					return make_data(D_LIST, data_value_num(new_adr));
 				}
-				default: error_runtime(line, VM_LIST_LIST_INVALID_OPERATOR,
+				default: error_runtime(vm->line, VM_LIST_LIST_INVALID_OPERATOR,
 					operator_string[op]); break;
 			}
 		} // End A==List && B==List
-		else if (a.type == D_LIST) {
+		else if (is_list(&a)) {
 			if (op == O_ADD) {
 				// list + element
-				address start_a = a.value.number;
-				int size_a = memory[start_a].value.number;
+				int size_a = list_size(&a);
 
 				data* new_list = safe_malloc((size_a + 1) * sizeof(data));
 				int n = 0;
 				for (int i = 0; i < size_a; i++) {
-					new_list[n++] = copy_data(memory[start_a + i + 1]);
+					new_list[n++] = copy_data(*list_element(&a, i));
 				}
 				new_list[n++] = copy_data(b);
-				address new_adr = push_memory_wendy_list(new_list, size_a + 1, line);
+				address new_adr = push_memory_wendy_list(new_list, size_a + 1, vm->line);
 				safe_free(new_list);
 				return make_data(D_LIST, data_value_num(new_adr));
 			}
 			else if (op == O_MUL && b.type == D_NUMBER) {
 				// list * number
-				address start_a = a.value.number;
-				int size_a = memory[start_a].value.number;
+				int size_a = list_size(&a);
 				// Size expansion
 				int new_size = size_a * (int)b.value.number;
 				data* new_list = safe_malloc(new_size * sizeof(data));
 				// Copy all Elements n times
 				int n = 0;
 				for (int i = 0; i < new_size; i++) {
-					new_list[n++] = copy_data(memory[(start_a + (i % size_a)) + 1]);
+					new_list[n++] = copy_data(*list_element(&a, i % size_a));
 				}
-				address new_adr = push_memory_wendy_list(new_list, new_size, line);
+				address new_adr = push_memory_wendy_list(new_list, new_size, vm->line);
 				safe_free(new_list);
 				return make_data(D_LIST, data_value_num(new_adr));
 			}
 			else {
-				error_runtime(line, VM_INVALID_APPEND);
+				error_runtime(vm->line, VM_INVALID_APPEND);
 			}
 		}
-		else if (b.type == D_LIST) {
-			address start_b = b.value.number;
-			int size_b = memory[start_b].value.number;
+		else if (is_list(&b)) {
+			int size_b = list_size(&b);
 
 			if (op == O_ADD) {
 				// element + list
@@ -1121,105 +1750,87 @@ static data eval_binop(operator op, data a, data b) {
 				int n = 0;
 				new_list[n++] = copy_data(a);
 				for (int i = 0; i < size_b; i++) {
-					new_list[n++] = copy_data(memory[start_b + i + 1]);
+					new_list[n++] = copy_data(*list_element(&b, i));
 				}
-				address new_adr = push_memory_wendy_list(new_list, size_b + 1, line);
+				address new_adr = push_memory_wendy_list(new_list, size_b + 1, vm->line);
 				safe_free(new_list);
 				return make_data(D_LIST, data_value_num(new_adr));
 			}
 			else if (op == O_MUL && a.type == D_NUMBER) {
 				// number * list
-				address start_b = b.value.number;
-				int size_b = memory[start_b].value.number;
 				// Size expansion
 				int new_size = size_b * (int)a.value.number;
 				data* new_list = safe_malloc(new_size * sizeof(data));
 				// Copy all Elements n times
 				int n = 0;
 				for (int i = 0; i < new_size; i++) {
-					new_list[n++] = copy_data(memory[(start_b + (i % size_b)) + 1]);
+					new_list[n++] = copy_data(*list_element(&b, i % size_b));
 				}
-				address new_adr = push_memory_wendy_list(new_list, new_size, line);
+				address new_adr = push_memory_wendy_list(new_list, new_size, vm->line);
 				safe_free(new_list);
 				return make_data(D_LIST, data_value_num(new_adr));
 			}
 			else if (op == O_IN) {
 				// element in list
 				for (int i = 0; i < size_b; i++) {
-//                  print_token(&a);
-					//print_token(&memory[start_b + i + 1]);
-					if (data_equal(&a, &memory[start_b + i + 1])) {
+					if (data_equal(&a, list_element(&b, i))) {
 						return true_data();
 					}
 				}
 				return false_data();
 			}
-			else { error_runtime(line, VM_INVALID_APPEND); }
+			else { error_runtime(vm->line, VM_INVALID_APPEND); }
 		}
 	}
 	else if((a.type == D_STRING && b.type == D_STRING) ||
 			(a.type == D_STRING && b.type == D_NUMBER) ||
 			(a.type == D_NUMBER && b.type == D_STRING)) {
 		if (op == O_ADD) {
-			// string concatenation
-			size_t total_len = 0;
+			// string concatenation, numbers are formatted as they print
+			char number[NUMBER_BUFFER_SIZE];
+			char* left = a.value.string;
+			char* right = b.value.string;
+			size_t left_len, right_len;
 			if (a.type == D_NUMBER) {
-				total_len += snprintf(NULL, 0, "%g", a.value.number);
+				left_len = format_number(a.value.number, number);
+				left = number;
 			}
 			else {
-				total_len += strlen(a.value.string);
+				left_len = strlen(left);
 			}
 			if (b.type == D_NUMBER) {
-				total_len += snprintf(NULL, 0, "%g", a.value.number);
+				right_len = format_number(b.value.number, number);
+				right = number;
 			}
 			else {
-				total_len += strlen(b.value.string);
-			}
-
-			data result = make_data(D_STRING, data_value_size(total_len));
-			size_t length = 0;
-			if (a.type == D_NUMBER) {
-				length += sprintf(result.value.string + length, "%g", a.value.number);
-			}
-			else {
-				length += sprintf(result.value.string + length, "%s", a.value.string);
-			}
-			if (b.type == D_NUMBER) {
-				length += sprintf(result.value.string + length, "%g", b.value.number);
-			}
-			else {
-				length += sprintf(result.value.string + length, "%s", b.value.string);
+				right_len = strlen(right);
 			}
+			data result = make_data(D_STRING,
+				data_value_size(left_len + right_len));
+			memcpy(result.value.string, left, left_len);
+			memcpy(result.value.string + left_len, right, right_len);
+			result.value.string[left_len + right_len] = 0;
 			return result;
 		}
 		else if (op == O_MUL && (a.type == D_NUMBER || b.type == D_NUMBER)) {
 			// String Duplication (String and Number)
-			int times = 0;
-			char* string;
-			int size;
-			char* result;
-			if (a.type == D_NUMBER) {
-				times = (int) a.value.number;
-				size = times * strlen(b.value.string) + 1;
-				string = b.value.string;
-			}
-			else {
-				times = (int) b.value.number;
-				size = times * strlen(a.value.string) + 1;
-				string = a.value.string;
-			}
-			result = safe_malloc(size * sizeof(char));
-			result[0] = 0;
-			for (int i = 0; i < times; i++) {
-				// Copy it over n times
-				strcat(result, string);
+			int times = (int)(a.type == D_NUMBER ? a.value.number : b.value.number);
+			char* string = a.type == D_NUMBER ? b.value.string : a.value.string;
+			size_t length = strlen(string);
+			size_t size = times > 0 ? times * length : 0;
+			data t = make_data(D_STRING, data_value_size(size));
+			if (size) {
+				// Copy the string once, then keep doubling what's been copied.
+				memcpy(t.value.string, string, length);
+				for (size_t done = length; done < size; done *= 2) {
+					memcpy(t.value.string + done, t.value.string,
+						done < size - done ? done : size - done);
+				}
 			}
-			data t = make_data(D_STRING, data_value_str(result));
-			safe_free(result);
 			return t;
 		}
 		else {
-			error_runtime(line,
+			error_runtime(vm->line,
 				(a.type == D_STRING && b.type == D_STRING) ?
 				VM_STRING_STRING_INVALID_OPERATOR : VM_STRING_NUM_INVALID_OPERATOR,
 				operator_string[op]);
@@ -1236,12 +1847,12 @@ static data eval_binop(operator op, data a, data b) {
 				return (a.type == D_FALSE && b.type == D_FALSE) ?
 					false_data() : true_data();
 			default:
-				error_runtime(line, VM_TYPE_ERROR, operator_string[op]);
+				error_runtime(vm->line, VM_TYPE_ERROR, operator_string[op]);
 				break;
 		}
 	}
 	else {
-		error_runtime(line, VM_TYPE_ERROR, operator_string[op]);
+		error_runtime(vm->line, VM_TYPE_ERROR, operator_string[op]);
 	}
 	return none_data();
 }
@@ -1271,9 +1882,11 @@ static data size_of(data a) {
 	if (a.type == D_STRING) {
 		size = strlen(a.value.string);
 	}
-	else if (a.type == D_LIST) {
-		address h = a.value.number;
-		size = memory[h].value.number;
+	else if (a.type == D_F64ARRAY) {
+		size = f64_array_of(&a)->length;
+	}
+	else if (is_list(&a)) {
+		size = list_size(&a);
 	}
 	return make_data(D_NUMBER, data_value_num(size));
 }
@@ -1293,9 +1906,16 @@ static data type_of(data a) {
 			return make_data(D_OBJ_TYPE, data_value_str("none"));
 		case D_NONERET:
 			return make_data(D_OBJ_TYPE, data_value_str("noneret"));
+		case D_ITERATOR:
+			return make_data(D_OBJ_TYPE, data_value_str("iterator"));
+		case D_GENERATOR:
+			return make_data(D_OBJ_TYPE, data_value_str("generator"));
+		case D_F64ARRAY:
+			return make_data(D_OBJ_TYPE, data_value_str("f64array"));
 		case D_RANGE:
 			return make_data(D_OBJ_TYPE, data_value_str("range"));
 		case D_LIST:
+		case D_LIST_VIEW:
 			return make_data(D_OBJ_TYPE, data_value_str("list"));
 		case D_STRUCT:
 			return make_data(D_OBJ_TYPE, data_value_str("struct"));
@@ -1304,9 +1924,9 @@ static data type_of(data a) {
 		case D_ANY:
 			return make_data(D_OBJ_TYPE, data_value_str("any"));
 		case D_STRUCT_INSTANCE: {
-			data instance_loc = memory[(int)(a.value.number)];
+			data instance_loc = vm->memory[(int)(a.value.number)];
 			return make_data(D_OBJ_TYPE, data_value_str(
-				memory[(int)instance_loc.value.number + 1].value.string));
+				vm->memory[(int)instance_loc.value.number + 1].value.string));
 		}
 		default:
 			return make_data(D_OBJ_TYPE, data_value_str("unknown"));
@@ -1317,33 +1937,23 @@ static data eval_uniop(operator op, data a) {
 	if (op == O_COPY) {
 		// Create copy of object a, only applies to lists or
 		// struct or struct instances
-		if (a.type == D_LIST) {
-			// We make a copy of the list as pointed to A.
-			data list_header = memory[(int)a.value.number];
-			int list_size = list_header.value.number;
-			data* new_a = safe_malloc((list_size) * sizeof(data));
-			int n = 0;
-			address array_start = a.value.number;
-			for (int i = 0; i < list_size; i++) {
-				new_a[n++] = copy_data(memory[array_start + i + 1]);
-			}
-			address new_l_loc = push_memory_wendy_list(new_a, list_size, line);
-			safe_free(new_a);
-			return make_data(D_LIST, data_value_num(new_l_loc));
+		if (is_list(&a)) {
+			// The copy shares the elements until either list is changed.
+			return copy_of_list(&a);
 		}
 		else if (a.type == D_STRUCT || a.type == D_STRUCT_INSTANCE) {
 			// We make a copy of the STRUCT
 			address copy_start = a.value.number;
 			address metadata = (int)(a.value.number);
 			if (a.type == D_STRUCT_INSTANCE) {
-				metadata = memory[metadata].value.number;
+				metadata = vm->memory[metadata].value.number;
 			}
-			int size = memory[metadata].value.number + 1;
+			int size = vm->memory[metadata].value.number + 1;
 			if (a.type == D_STRUCT_INSTANCE) {
 				// find size of instance by counting instance members
 				int actual_size = 0;
 				for (int i = 0; i < size; i++) {
-					if (memory[metadata + i + 1].type == D_STRUCT_PARAM) {
+					if (vm->memory[metadata + i + 1].type == D_STRUCT_PARAM) {
 						actual_size++;
 					}
 				}
@@ -1352,9 +1962,9 @@ static data eval_uniop(operator op, data a) {
 			size++; // for the header itself
 			data* copy = safe_malloc(size * sizeof(data));
 			for (int i = 0; i < size; i++) {
-				copy[i] = copy_data(memory[copy_start + i]);
+				copy[i] = copy_data(vm->memory[copy_start + i]);
 			}
-			address addr = push_memory_array(copy, size, line);
+			address addr = push_memory_array(copy, size, vm->line);
 			safe_free(copy);
 			return a.type == D_STRUCT ? make_data(D_STRUCT, data_value_num(addr))
 				: make_data(D_STRUCT_INSTANCE, data_value_num(addr));
@@ -1366,7 +1976,7 @@ static data eval_uniop(operator op, data a) {
 	}
 	else if (op == O_NEG) {
 		if (a.type != D_NUMBER) {
-			error_runtime(line, VM_INVALID_NEGATE);
+			error_runtime(vm->line, VM_INVALID_NEGATE);
 			return none_data();
 		}
 		data res = make_data(D_NUMBER, data_value_num(-1 * a.value.number));
@@ -1374,7 +1984,7 @@ static data eval_uniop(operator op, data a) {
 	}
 	else if (op == O_NOT) {
 		if (a.type != D_TRUE && a.type != D_FALSE) {
-			error_runtime(line, VM_INVALID_NEGATE);
+			error_runtime(vm->line, VM_INVALID_NEGATE);
 			return none_data();
 		}
 		return a.type == D_TRUE ? false_data() : true_data();
@@ -1386,5 +1996,5 @@ static data eval_uniop(operator op, data a) {
 }
 
 void print_current_bytecode() {
-	print_bytecode(bytecode, stdout);
+	print_bytecode(vm->bytecode, stdout);
 }
@@ -4,19 +4,66 @@
 #include "data.h"
 #include "memory.h"
 #include "operators.h"
+#include "codegen.h"
 #include <stdint.h>
 
 // vm.h - Felix Guo
 // Executes a stream of bytecode based on instructions in [codegen] by
 //   interfacing with [memory]
 
-// vm_run(bytecode) runs the given bytecode.
-void vm_run(uint8_t* bytecode, size_t size);
+struct wendy_vm;
+
+// Counts, per BIN/RBIN site, how many times in a row the site saw operands
+//   that have a specialized form, see quickening in vm.c.
+typedef struct {
+	uint8_t hits;
+	uint8_t misses;
+} site_feedback;
+
+// vm_run(instance, bytecode, size) runs the given bytecode on the
+//   interpreter instance.
+void vm_run(struct wendy_vm* instance, uint8_t* bytecode, size_t size);
 void vm_cleanup_if_repl(void);
 
+// vm_load(bytecode, size) adds bytecode to the program of the interpreter the
+//   thread works with, like vm_run() does, and returns the address to run it
+//   from with vm_execute(start).
+address vm_load(uint8_t* bytecode, size_t size);
+void vm_execute(address start);
+
+// vm_copy_program(bytecode, size) makes a copy of the bytecode of another
+//   interpreter the program of the interpreter the thread works with, so
+//   functions of the other interpreter can be called with vm_call(). Nothing
+//   is copied if the program already has that size. Requires SETTINGS_REPL,
+//   so the copy is freed with the interpreter.
+void vm_copy_program(const uint8_t* bytecode, size_t size);
+
+// vm_call(function, args, argc, result) calls the function or struct
+//   function with copies of the argc args and stores the value it returns in
+//   result. Returns false, leaving result untouched, if the call failed with
+//   a runtime error. Natives can use it to call back into the program.
+bool vm_call(data function, data* args, int argc, data* result);
+
+// vm_cleanup() releases the runtime type feedback kept for the bytecode.
+void vm_cleanup(void);
+
 // get_instruction_pointer() returns the current instruction pointer.
 address get_instruction_pointer(void);
 
+// get_current_line() returns the source line of the executing instruction.
+int get_current_line(void);
+
+// get_instruction_pointer_ref() returns the location of the instruction
+//   pointer, so compiled code can read and write it directly.
+address* get_instruction_pointer_ref(void);
+
+// vm_handler is the signature of the per-opcode implementations. A handler
+//   expects the instruction pointer to be just past the opcode byte.
+typedef void (*vm_handler)(void);
+
+// get_opcode_handler(op) returns the handler that implements op.
+vm_handler get_opcode_handler(opcode op);
+
 // print_current_bytecode() prints the current executing bytecode
 void print_current_bytecode(void);
 #endif
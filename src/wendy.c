@@ -0,0 +1,336 @@
+#define _GNU_SOURCE
+#include "wendy.h"
+#include "state.h"
+#include "scanner.h"
+#include "ast.h"
+#include "codegen.h"
+#include "error.h"
+#include "native.h"
+#include <stdio.h>
+#include <string.h>
+
+// Implementation of the embedding interface. Every entry point enters the
+//   given interpreter for its duration, so hosts can use several interpreters
+//   on one thread.
+
+struct wendy_program {
+	wendy_vm* owner;
+	// Where the program's bytecode starts in the owner's bytecode.
+	address start;
+};
+
+// A host native as registered with wendy_register_native().
+typedef struct native_binding {
+	char* name;
+	wendy_native function;
+	void* userdata;
+} native_binding;
+
+wendy_value wendy_none(void) {
+	wendy_value v = { WENDY_NONE, false, 0, 0, 0, 0 };
+	return v;
+}
+
+wendy_value wendy_bool(bool b) {
+	wendy_value v = wendy_none();
+	v.type = WENDY_BOOL;
+	v.boolean = b;
+	return v;
+}
+
+wendy_value wendy_number(double n) {
+	wendy_value v = wendy_none();
+	v.type = WENDY_NUMBER;
+	v.number = n;
+	return v;
+}
+
+wendy_value wendy_string(const char* s) {
+	wendy_value v = wendy_none();
+	v.type = WENDY_STRING;
+	v.string = safe_strdup(s);
+	return v;
+}
+
+wendy_value wendy_list(size_t length) {
+	wendy_value v = wendy_none();
+	v.type = WENDY_LIST;
+	v.length = length;
+	v.items = safe_malloc(sizeof(wendy_value) * (length ? length : 1));
+	for (size_t i = 0; i < length; i++) {
+		v.items[i] = wendy_none();
+	}
+	return v;
+}
+
+void wendy_value_free(wendy_value* value) {
+	if (value->string) {
+		safe_free(value->string);
+	}
+	if (value->items) {
+		for (size_t i = 0; i < value->length; i++) {
+			wendy_value_free(&value->items[i]);
+		}
+		safe_free(value->items);
+	}
+	*value = wendy_none();
+}
+
+// to_data(value, result) stores value as data of the interpreter the thread
+//   works with in result, returns false if it can't be.
+static bool to_data(const wendy_value* value, data* result) {
+	switch (value->type) {
+		case WENDY_NONE:
+			*result = none_data();
+			return true;
+		case WENDY_BOOL:
+			*result = value->boolean ? true_data() : false_data();
+			return true;
+		case WENDY_NUMBER:
+			*result = make_data(D_NUMBER, data_value_num(value->number));
+			return true;
+		case WENDY_STRING:
+			*result = make_data(D_STRING,
+				data_value_str(value->string ? value->string : ""));
+			return true;
+		case WENDY_LIST: {
+			data* items = safe_malloc(sizeof(data) *
+				(value->length ? value->length : 1));
+			for (size_t i = 0; i < value->length; i++) {
+				if (!to_data(&value->items[i], &items[i])) {
+					for (size_t j = 0; j < i; j++) {
+						destroy_data(&items[j]);
+					}
+					safe_free(items);
+					return false;
+				}
+			}
+			address list = push_memory_wendy_list(items, value->length,
+				vm->line);
+			safe_free(items);
+			*result = make_data(D_LIST, data_value_num(list));
+			return true;
+		}
+		default:
+			return false;
+	}
+}
+
+// from_data(d) returns the data d of the interpreter the thread works with as
+//   a value the host owns.
+static wendy_value from_data(const data* d) {
+	switch (d->type) {
+		case D_NONE:
+		case D_NONERET:
+			return wendy_none();
+		case D_TRUE:
+		case D_FALSE:
+			return wendy_bool(d->type == D_TRUE);
+		case D_NUMBER:
+			return wendy_number(d->value.number);
+		case D_STRING:
+			return wendy_string(d->value.string);
+		case D_LIST:
+		case D_LIST_VIEW: {
+			size_t length = list_size(d);
+			wendy_value v = wendy_list(length);
+			for (size_t i = 0; i < length; i++) {
+				v.items[i] = from_data(list_element(d, i));
+			}
+			return v;
+		}
+		default: {
+			char* printed = 0;
+			size_t size = 0;
+			FILE* stream = open_memstream(&printed, &size);
+			print_data_inline(d, stream);
+			fclose(stream);
+			wendy_value v = wendy_string(printed);
+			v.type = WENDY_OTHER;
+			// Cannot be safe, because open_memstream uses malloc!
+			free(printed);
+			return v;
+		}
+	}
+}
+
+wendy_vm* wendy_open(void) {
+	determine_endianness();
+	wendy_vm* instance = vm_create();
+	wendy_vm* previous = vm_enter(instance);
+	set_settings_flag(SETTINGS_REPL);
+	push_frame("main", 0, 0);
+	vm_enter(previous);
+	return instance;
+}
+
+void wendy_close(wendy_vm* instance) {
+	vm_destroy(instance);
+}
+
+wendy_status wendy_compile(wendy_vm* instance, const char* source,
+	wendy_program** program) {
+	wendy_vm* previous = vm_enter(instance);
+	wendy_status status = WENDY_COMPILE_ERROR;
+	*program = 0;
+	reset_error_flag();
+	arena front_end = { 0 };
+	token* tokens;
+	size_t tokens_count = scan_tokens(&front_end, source, &tokens);
+	statement_list* ast = generate_ast(&front_end, tokens, tokens_count);
+	if (!ast_error_flag() && !get_error_flag()) {
+		size_t size;
+		uint8_t* bytecode = generate_code(ast, &size);
+		if (!get_error_flag()) {
+			*program = safe_malloc(sizeof(wendy_program));
+			(*program)->owner = instance;
+			(*program)->start = vm_load(bytecode, size);
+			status = WENDY_OK;
+		}
+		safe_free(bytecode);
+	}
+	arena_free(&front_end);
+	vm_enter(previous);
+	return status;
+}
+
+wendy_status wendy_run(wendy_vm* instance, const wendy_program* program) {
+	if (program->owner != instance) {
+		return WENDY_INVALID_ARGUMENT;
+	}
+	wendy_vm* previous = vm_enter(instance);
+	// An error stops the program wherever it is, the registers are restored
+	//   like vm_call() restores them so later runs and calls start clean.
+	address saved_mem_reg_pointer = vm->mem_reg_pointer;
+	address saved_memory_register = vm->memory_register;
+	vm_execute(program->start);
+	wendy_status status = WENDY_OK;
+	if (get_error_flag()) {
+		unwind_stack();
+		clear_arg_stack();
+		vm->mem_reg_pointer = saved_mem_reg_pointer;
+		vm->memory_register = saved_memory_register;
+		status = WENDY_RUNTIME_ERROR;
+	}
+	vm_enter(previous);
+	return status;
+}
+
+void wendy_program_free(wendy_program* program) {
+	safe_free(program);
+}
+
+wendy_status wendy_call(wendy_vm* instance, const char* function,
+	const wendy_value* args, int argc, wendy_value* result) {
+	wendy_vm* previous = vm_enter(instance);
+	wendy_status status = WENDY_OK;
+	reset_error_flag();
+	data* value = id_exist((char*)function, true)
+		? get_value_of_id((char*)function, vm->line) : 0;
+	if (!value) {
+		set_error_message(MEMORY_ID_NOT_FOUND, (char*)function);
+		status = WENDY_NOT_FOUND;
+	}
+	else if (value->type != D_FUNCTION && value->type != D_STRUCT) {
+		status = WENDY_INVALID_ARGUMENT;
+	}
+	if (status != WENDY_OK) {
+		vm_enter(previous);
+		return status;
+	}
+	data callee = copy_data(*value);
+	data* arg_list = safe_malloc(sizeof(data) * (argc > 0 ? argc : 1));
+	int converted = 0;
+	while (converted < argc &&
+		to_data(&args[converted], &arg_list[converted])) {
+		converted++;
+	}
+	data returned;
+	if (converted < argc) {
+		status = WENDY_INVALID_ARGUMENT;
+	}
+	else if (!vm_call(callee, arg_list, argc, &returned)) {
+		status = WENDY_RUNTIME_ERROR;
+	}
+	else {
+		if (result) {
+			*result = from_data(&returned);
+		}
+		destroy_data(&returned);
+	}
+	for (int i = 0; i < converted; i++) {
+		destroy_data(&arg_list[i]);
+	}
+	safe_free(arg_list);
+	destroy_data(&callee);
+	vm_enter(previous);
+	return status;
+}
+
+wendy_status wendy_get(wendy_vm* instance, const char* name,
+	wendy_value* result) {
+	wendy_vm* previous = vm_enter(instance);
+	wendy_status status = WENDY_NOT_FOUND;
+	if (id_exist((char*)name, true)) {
+		*result = from_data(get_value_of_id((char*)name, vm->line));
+		status = WENDY_OK;
+	}
+	else {
+		set_error_message(MEMORY_ID_NOT_FOUND, (char*)name);
+	}
+	vm_enter(previous);
+	return status;
+}
+
+static data call_native(data* args, int argc, void* userdata, int line) {
+	native_binding* binding = userdata;
+	wendy_value* values = safe_malloc(sizeof(wendy_value) *
+		(argc > 0 ? argc : 1));
+	for (int i = 0; i < argc; i++) {
+		values[i] = from_data(&args[i]);
+	}
+	wendy_value returned = wendy_none();
+	wendy_status status = binding->function(vm, values, argc, &returned,
+		binding->userdata);
+	for (int i = 0; i < argc; i++) {
+		wendy_value_free(&values[i]);
+	}
+	safe_free(values);
+	data result;
+	if (status != WENDY_OK) {
+		error_runtime(line, VM_HOST_NATIVE_FAILED, binding->name);
+		result = none_data();
+	}
+	else if (!to_data(&returned, &result)) {
+		error_runtime(line, VM_HOST_NATIVE_INVALID_RESULT, binding->name);
+		result = none_data();
+	}
+	wendy_value_free(&returned);
+	return result;
+}
+
+static void release_binding(void* userdata) {
+	native_binding* binding = userdata;
+	safe_free(binding->name);
+	safe_free(binding);
+}
+
+wendy_status wendy_register_native(wendy_vm* instance, const char* name,
+	int argc, wendy_native function, void* userdata) {
+	wendy_vm* previous = vm_enter(instance);
+	native_binding* binding = safe_malloc(sizeof(native_binding));
+	binding->name = safe_strdup(name);
+	binding->function = function;
+	binding->userdata = userdata;
+	wendy_status status = WENDY_OK;
+	if (!native_register(name, argc, call_native, binding, release_binding)) {
+		release_binding(binding);
+		status = WENDY_INVALID_ARGUMENT;
+	}
+	vm_enter(previous);
+	return status;
+}
+
+const char* wendy_error(wendy_vm* instance) {
+	return instance->error_message;
+}
@@ -0,0 +1,126 @@
+#ifndef WENDY_H
+#define WENDY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// wendy.h - Felix Guo
+// The C interface of libwendy, for programs that embed the interpreter
+//   instead of starting a wendy process for every script they run.
+//
+// A wendy_vm works like a REPL session: every program compiled for it is
+//   added to its bytecode, and all programs share its global variables, so a
+//   script can be run once to define functions that the host then calls
+//   many times with wendy_call().
+//
+// Errors never end the process (except running out of memory), they are
+//   printed to stderr and reported through the returned wendy_status, with
+//   wendy_error() returning the message.
+//
+// A wendy_vm must only be used by one thread at a time, different threads
+//   can use different interpreters at the same time.
+
+#if defined(__GNUC__)
+#define WENDY_API __attribute__((visibility("default")))
+#else
+#define WENDY_API
+#endif
+
+typedef struct wendy_vm wendy_vm;
+typedef struct wendy_program wendy_program;
+
+typedef enum {
+	WENDY_OK = 0,
+	WENDY_COMPILE_ERROR,
+	WENDY_RUNTIME_ERROR,
+	// The function or variable doesn't exist.
+	WENDY_NOT_FOUND,
+	// The value can't be passed to or from the interpreter, or a native has
+	//   the name of a built-in one.
+	WENDY_INVALID_ARGUMENT
+} wendy_status;
+
+typedef enum {
+	WENDY_NONE = 0,
+	WENDY_BOOL,
+	WENDY_NUMBER,
+	WENDY_STRING,
+	WENDY_LIST,
+	// Any other value, e.g. a function or struct. Its string is the value as
+	//   print would show it, it can't be passed back to the interpreter.
+	WENDY_OTHER
+} wendy_type;
+
+// A value passed between the host and the interpreter. Only the fields of
+//   its type are used.
+typedef struct wendy_value {
+	wendy_type type;
+	bool boolean;
+	double number;
+	char* string;
+	struct wendy_value* items;
+	size_t length;
+} wendy_value;
+
+// A native implemented by the host. It's called with the argc arguments,
+//   which are only valid during the call, and stores the value to return in
+//   result, which the interpreter frees. Returning anything but WENDY_OK
+//   stops the program with a runtime error.
+typedef wendy_status (*wendy_native)(wendy_vm* vm, const wendy_value* args,
+	int argc, wendy_value* result, void* userdata);
+
+// wendy_open() returns a new interpreter.
+WENDY_API wendy_vm* wendy_open(void);
+
+// wendy_close(vm) frees the interpreter, its programs can't be run anymore.
+WENDY_API void wendy_close(wendy_vm* vm);
+
+// wendy_compile(vm, source, program) compiles the source code for vm and
+//   stores a program that can be run any number of times in program. Like
+//   in the REPL, a global can only be declared once, so running a program
+//   that declares globals again fails with WENDY_RUNTIME_ERROR.
+WENDY_API wendy_status wendy_compile(wendy_vm* vm, const char* source,
+	wendy_program** program);
+
+// wendy_run(vm, program) runs a program compiled for vm.
+WENDY_API wendy_status wendy_run(wendy_vm* vm, const wendy_program* program);
+
+// wendy_program_free(program) frees the program.
+WENDY_API void wendy_program_free(wendy_program* program);
+
+// wendy_call(vm, function, args, argc, result) calls the global function or
+//   struct named function with argc arguments. If result isn't NULL the
+//   value it returned is stored there and must be freed with
+//   wendy_value_free().
+WENDY_API wendy_status wendy_call(wendy_vm* vm, const char* function,
+	const wendy_value* args, int argc, wendy_value* result);
+
+// wendy_get(vm, name, result) stores the value of the global variable name
+//   in result, which must be freed with wendy_value_free().
+WENDY_API wendy_status wendy_get(wendy_vm* vm, const char* name,
+	wendy_value* result);
+
+// wendy_register_native(vm, name, argc, function, userdata) lets programs
+//   on vm declare function with `let f => (a, b) native name;`.
+WENDY_API wendy_status wendy_register_native(wendy_vm* vm, const char* name,
+	int argc, wendy_native function, void* userdata);
+
+// wendy_error(vm) returns the message of the last error on vm, or NULL. It's
+//   set when a function returns WENDY_COMPILE_ERROR, WENDY_RUNTIME_ERROR or
+//   WENDY_NOT_FOUND.
+WENDY_API const char* wendy_error(wendy_vm* vm);
+
+// Values made by these functions, and values returned by the interpreter,
+//   own their memory and are freed with wendy_value_free(). Arguments given
+//   to wendy_call() are only read. wendy_string(s) copies s, and
+//   wendy_list(length) returns a list of length none values to be replaced,
+//   the list frees its items.
+WENDY_API wendy_value wendy_none(void);
+WENDY_API wendy_value wendy_bool(bool b);
+WENDY_API wendy_value wendy_number(double n);
+WENDY_API wendy_value wendy_string(const char* s);
+WENDY_API wendy_value wendy_list(size_t length);
+
+WENDY_API void wendy_value_free(wendy_value* value);
+
+#endif
@@ -0,0 +1,159 @@
+#include "wendy.h"
+#include <stdio.h>
+
+// Runs WendyScript through libwendy, see wendy.h. Built by `make libwendy`
+//   and run by io-test.sh.
+
+static const char* status_names[] = {
+	"OK", "COMPILE_ERROR", "RUNTIME_ERROR", "NOT_FOUND", "INVALID_ARGUMENT"
+};
+
+static void print_value(const wendy_value* value) {
+	switch (value->type) {
+		case WENDY_NONE: printf("none"); break;
+		case WENDY_BOOL: printf(value->boolean ? "true" : "false"); break;
+		case WENDY_NUMBER: printf("%g", value->number); break;
+		case WENDY_STRING: printf("\"%s\"", value->string); break;
+		case WENDY_LIST:
+			printf("[");
+			for (size_t i = 0; i < value->length; i++) {
+				printf(i ? ", " : "");
+				print_value(&value->items[i]);
+			}
+			printf("]");
+			break;
+		case WENDY_OTHER: printf("other %s", value->string); break;
+	}
+}
+
+static void report(const char* what, wendy_status status) {
+	printf("%s: %s\n", what, status_names[status]);
+}
+
+static void call(wendy_vm* vm, const char* function, wendy_value* args,
+	int argc) {
+	wendy_value result;
+	wendy_status status = wendy_call(vm, function, args, argc, &result);
+	report(function, status);
+	if (status == WENDY_OK) {
+		printf("  -> ");
+		print_value(&result);
+		printf("\n");
+		wendy_value_free(&result);
+	}
+	else if (status == WENDY_RUNTIME_ERROR || status == WENDY_NOT_FOUND) {
+		printf("  error: %s\n", wendy_error(vm));
+	}
+}
+
+static wendy_status host_scale(wendy_vm* vm, const wendy_value* args, int argc,
+	wendy_value* result, void* userdata) {
+	(void)vm;
+	(void)argc;
+	if (args[0].type != WENDY_NUMBER) {
+		return WENDY_INVALID_ARGUMENT;
+	}
+	*result = wendy_number(args[0].number * *(double*)userdata);
+	return WENDY_OK;
+}
+
+static wendy_status host_pair(wendy_vm* vm, const wendy_value* args, int argc,
+	wendy_value* result, void* userdata) {
+	(void)vm;
+	(void)argc;
+	(void)userdata;
+	*result = wendy_list(2);
+	result->items[0] = wendy_string(args[0].string);
+	result->items[1] = wendy_bool(true);
+	return WENDY_OK;
+}
+
+int main(void) {
+	wendy_vm* vm = wendy_open();
+	double factor = 2.5;
+	report("register scale", wendy_register_native(vm, "host_scale", 1,
+		host_scale, &factor));
+	report("register pair", wendy_register_native(vm, "host_pair", 1,
+		host_pair, 0));
+	report("register builtin", wendy_register_native(vm, "io_read", 0,
+		host_scale, 0));
+
+	wendy_program* setup;
+	report("compile setup", wendy_compile(vm,
+		"let scale => (x) native host_scale;\n"
+		"let pair => (x) native host_pair;\n"
+		"let greet => (name) \"Hello, \" + name + \"!\";\n"
+		"let total = 0;\n"
+		"let add => (xs) { for x in xs total += scale(x); ret total; };\n"
+		"let fail => () missing + 1;\n"
+		"let bad => () scale(\"x\");\n"
+		"struct Point => (x, y);\n", &setup));
+	report("run setup", wendy_run(vm, setup));
+	wendy_program_free(setup);
+
+	wendy_value name = wendy_string("host");
+	call(vm, "greet", &name, 1);
+	wendy_value_free(&name);
+
+	wendy_value numbers = wendy_list(3);
+	for (size_t i = 0; i < numbers.length; i++) {
+		numbers.items[i] = wendy_number(i + 1);
+	}
+	call(vm, "add", &numbers, 1);
+	call(vm, "add", &numbers, 1);
+	wendy_value_free(&numbers);
+
+	wendy_value key = wendy_string("key");
+	call(vm, "pair", &key, 1);
+	wendy_value_free(&key);
+
+	wendy_value coordinates[] = { wendy_number(3), wendy_number(4) };
+	call(vm, "Point", coordinates, 2);
+
+	call(vm, "missing", 0, 0);
+	call(vm, "total", 0, 0);
+	call(vm, "fail", 0, 0);
+	call(vm, "bad", 0, 0);
+	call(vm, "greet", 0, 0);
+
+	// A program that fails deep in recursion doesn't break later calls.
+	wendy_program* overflow;
+	report("compile overflow", wendy_compile(vm,
+		"let rec => (n) rec(n + 1);\nrec(0);", &overflow));
+	report("run overflow", wendy_run(vm, overflow));
+	wendy_program_free(overflow);
+	name = wendy_string("again");
+	call(vm, "greet", &name, 1);
+	wendy_value_free(&name);
+
+	// A program without declarations can be run any number of times, one that
+	//   declares a global fails the second time, as it's declared already.
+	wendy_program* declare;
+	report("compile declare", wendy_compile(vm, "let job = 1;", &declare));
+	report("run declare", wendy_run(vm, declare));
+	report("run declare", wendy_run(vm, declare));
+	printf("  error: %s\n", wendy_error(vm));
+	wendy_program_free(declare);
+
+	wendy_program* reset;
+	report("compile reset", wendy_compile(vm, "total = total - 1;", &reset));
+	for (int i = 0; i < 3; i++) {
+		report("run reset", wendy_run(vm, reset));
+	}
+	wendy_program_free(reset);
+	wendy_value total;
+	report("get total", wendy_get(vm, "total", &total));
+	printf("  -> ");
+	print_value(&total);
+	printf("\n");
+	wendy_value_free(&total);
+
+	wendy_program* broken;
+	report("compile broken", wendy_compile(vm, "let = ;", &broken));
+
+	wendy_vm* other = wendy_open();
+	report("get total on other vm", wendy_get(other, "total", &total));
+	wendy_close(other);
+	wendy_close(vm);
+	return 0;
+}
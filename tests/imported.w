@@ -0,0 +1,3 @@
+// Imported by import_file.in, once per import.
+count += 1;
+"imported " + count;